@@ -0,0 +1,304 @@
+#include "batch.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "heap.h"
+#include "jvm.h"
+#include "output.h"
+#include "read_class.h"
+#include "scheduler.h"
+#include "thread_pool.h"
+
+const char BATCH_COMMENT = '#';
+const double NANOSECONDS_PER_SECOND = 1e9;
+
+/** A program to run, and how long its runs took */
+typedef struct {
+    /** The main class, as given in the job list */
+    char *main_class;
+    class_file_t *class;
+    size_t repeat;
+    /** The number of runs that have finished */
+    size_t finished;
+    /** The number of runs that were cut off for using too much fuel */
+    size_t cut_off;
+    /** The total, fastest and slowest run times, in seconds */
+    double total_time;
+    double min_time;
+    double max_time;
+} batch_job_t;
+
+/** One run of a job, on a worker thread or as a green thread */
+typedef struct {
+    batch_job_t *job;
+    heap_t *heap;
+    /** Collects the run's output, since runs of the same job run concurrently */
+    output_t *output;
+    double start;
+    /** How long the run took, in seconds */
+    double time;
+    /** Whether the run finished, rather than being cut off */
+    bool finished;
+} batch_run_t;
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / NANOSECONDS_PER_SECOND;
+}
+
+static void record_run(batch_job_t *job, double time) {
+    job->total_time += time;
+    if (job->finished == 0 || time < job->min_time) {
+        job->min_time = time;
+    }
+    if (job->finished == 0 || time > job->max_time) {
+        job->max_time = time;
+    }
+    job->finished++;
+}
+
+/** Runs a run on a worker thread */
+static void run_task(void *argument) {
+    batch_run_t *run = argument;
+    run->start = now();
+    // Each run gets a fresh heap, just like a separate process would
+    run->heap = heap_init();
+    execute_main(run->job->class, run->heap, run->output);
+    heap_free(run->heap);
+    run->time = now() - run->start;
+    run->finished = true;
+}
+
+static void green_run_done(void *argument, const green_thread_t *thread,
+                           bool finished) {
+    (void) thread;
+    batch_run_t *run = argument;
+    run->time = now() - run->start;
+    run->finished = finished;
+    heap_free(run->heap);
+}
+
+/**
+ * Runs every run as a green thread on the calling thread.
+ */
+static void run_green_threads(batch_run_t *runs, size_t run_count,
+                              const batch_options_t *options) {
+    scheduler_t *scheduler = scheduler_init(options->quantum, options->fuel_limit);
+    for (size_t i = 0; i < run_count; i++) {
+        batch_run_t *run = &runs[i];
+        method_t *main_method =
+            find_method(MAIN_METHOD, MAIN_DESCRIPTOR, run->job->class);
+        assert(main_method != NULL && "Missing main() method");
+        run->heap = heap_init();
+        run->start = now();
+        scheduler_spawn(scheduler, green_thread_init(main_method, run->heap, run->output),
+                        green_run_done, run);
+    }
+    scheduler_run(scheduler);
+    scheduler_free(scheduler);
+}
+
+/**
+ * Lists every run of every job, in job order.
+ */
+static batch_run_t *list_runs(batch_job_t *jobs, size_t job_count, size_t *run_count) {
+    size_t count = 0;
+    for (size_t i = 0; i < job_count; i++) {
+        count += jobs[i].repeat;
+    }
+    batch_run_t *runs = malloc(sizeof(batch_run_t[count]));
+    assert(runs != NULL && "Failed to allocate runs");
+    batch_run_t *run = runs;
+    for (size_t i = 0; i < job_count; i++) {
+        for (size_t repeat = 0; repeat < jobs[i].repeat; repeat++, run++) {
+            *run = (batch_run_t){.job = &jobs[i], .output = output_init_buffer()};
+        }
+    }
+    *run_count = count;
+    return runs;
+}
+
+/**
+ * Reads the job list.
+ *
+ * @return the jobs, or NULL if the list can't be read
+ */
+/**
+ * Parses what follows the main class on a job line: either nothing, or a positive
+ * repeat count. Surrounding whitespace is ignored.
+ *
+ * @return whether the rest of the line was well-formed
+ */
+static bool parse_repeat(const char *text, size_t *repeat) {
+    while (isspace((unsigned char) *text)) {
+        text++;
+    }
+    // The repeat count defaults to 1
+    if (*text == '\0') {
+        *repeat = 1;
+        return true;
+    }
+    // strtoull() would accept a minus sign
+    if (!isdigit((unsigned char) *text)) {
+        return false;
+    }
+    char *end;
+    errno = 0;
+    unsigned long long count = strtoull(text, &end, 10);
+    while (isspace((unsigned char) *end)) {
+        end++;
+    }
+    *repeat = count;
+    return *end == '\0' && errno == 0 && count > 0 && count <= SIZE_MAX;
+}
+
+static batch_job_t *read_jobs(const char *jobs_path, size_t *job_count) {
+    FILE *jobs_file = fopen(jobs_path, "r");
+    if (jobs_file == NULL) {
+        return NULL;
+    }
+
+    batch_job_t *jobs = NULL;
+    size_t count = 0;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    bool valid = true;
+    while (getline(&line, &line_capacity, jobs_file) >= 0) {
+        char *main_class = line;
+        while (isspace((unsigned char) *main_class)) {
+            main_class++;
+        }
+        if (*main_class == '\0' || *main_class == BATCH_COMMENT) {
+            continue;
+        }
+        char *end = main_class;
+        while (*end != '\0' && !isspace((unsigned char) *end)) {
+            end++;
+        }
+        size_t repeat;
+        if (!parse_repeat(end, &repeat)) {
+            valid = false;
+            break;
+        }
+        *end = '\0';
+
+        jobs = realloc(jobs, sizeof(batch_job_t[count + 1]));
+        assert(jobs != NULL && "Failed to allocate jobs");
+        jobs[count++] = (batch_job_t){.main_class = strdup(main_class), .repeat = repeat};
+    }
+    free(line);
+    fclose(jobs_file);
+
+    if (!valid) {
+        for (size_t i = 0; i < count; i++) {
+            free(jobs[i].main_class);
+        }
+        free(jobs);
+        return NULL;
+    }
+    *job_count = count;
+    return jobs;
+}
+
+bool batch_run(class_loader_t *loader, const char *jobs_path,
+               const batch_options_t *options) {
+    size_t threads = options->threads;
+    size_t job_count;
+    batch_job_t *jobs = read_jobs(jobs_path, &job_count);
+    if (jobs == NULL) {
+        fprintf(stderr, "Failed to read job list %s\n", jobs_path);
+        return false;
+    }
+
+    bool found = true;
+    for (size_t i = 0; i < job_count; i++) {
+        jobs[i].class = class_loader_load_main(loader, jobs[i].main_class);
+        if (jobs[i].class == NULL) {
+            fprintf(stderr, "Main class not found: %s\n", jobs[i].main_class);
+            found = false;
+        }
+    }
+
+    if (found) {
+        /* Load, prepare and resolve everything up front, so that the workers share
+         * the classes without ever modifying them */
+        class_loader_preload(loader, threads);
+        class_loader_link(loader);
+
+        // Every run is a task of its own, so even a single job uses every thread
+        size_t run_count;
+        batch_run_t *runs = list_runs(jobs, job_count, &run_count);
+        thread_pool_t *pool = NULL;
+        double start = now();
+        if (options->green_threads) {
+            run_green_threads(runs, run_count, options);
+        }
+        else {
+            pool = thread_pool_init(threads);
+            for (size_t i = 0; i < run_count; i++) {
+                thread_pool_submit(pool, run_task, &runs[i]);
+            }
+            thread_pool_wait(pool);
+        }
+        double elapsed = now() - start;
+
+        // Each job's output is its runs' output, in order
+        size_t finished = 0;
+        size_t cut_off = 0;
+        for (size_t i = 0; i < run_count; i++) {
+            size_t length;
+            const char *contents = output_contents(runs[i].output, &length);
+            fwrite(contents, 1, length, stdout);
+            output_free(runs[i].output);
+            if (runs[i].finished) {
+                record_run(runs[i].job, runs[i].time);
+                finished++;
+            }
+            else {
+                runs[i].job->cut_off++;
+                cut_off++;
+            }
+        }
+        free(runs);
+        fflush(stdout);
+
+        fprintf(stderr, "%-4s %-32s %8s %12s %12s %12s %12s\n", "job", "class", "runs",
+                "total ms", "mean us", "min us", "max us");
+        for (size_t i = 0; i < job_count; i++) {
+            const batch_job_t *job = &jobs[i];
+            fprintf(stderr, "%-4zu %-32s %8zu %12.3f %12.3f %12.3f %12.3f\n", i,
+                    job->main_class, job->finished, job->total_time * 1e3,
+                    job->finished > 0 ? job->total_time / job->finished * 1e6 : 0.0,
+                    job->min_time * 1e6, job->max_time * 1e6);
+            if (job->cut_off > 0) {
+                fprintf(stderr, "     %zu runs cut off after using %" PRIu64 " fuel\n",
+                        job->cut_off, options->fuel_limit);
+            }
+        }
+        if (pool != NULL) {
+            fprintf(stderr, "%zu jobs, %zu runs on %zu threads", job_count, finished,
+                    thread_pool_threads(pool));
+            thread_pool_free(pool);
+        }
+        else {
+            fprintf(stderr, "%zu jobs, %zu runs on green threads", job_count, finished);
+        }
+        fprintf(stderr, " in %.3f ms (%.1f runs/s)\n", elapsed * 1e3,
+                elapsed > 0 ? finished / elapsed : 0.0);
+        found = cut_off == 0;
+    }
+
+    for (size_t i = 0; i < job_count; i++) {
+        free(jobs[i].main_class);
+    }
+    free(jobs);
+    return found;
+}
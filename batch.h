@@ -0,0 +1,52 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "class_loader.h"
+
+/** How to run a batch */
+typedef struct {
+    /** The number of worker threads, or 0 for one per online CPU */
+    size_t threads;
+    /** Whether to run every run as a green thread instead of on worker threads */
+    bool green_threads;
+    /** The fuel each green thread may use per turn, or 0 for the default */
+    uint64_t quantum;
+    /** The fuel each green thread may use before it is cut off, or 0 for no limit */
+    uint64_t fuel_limit;
+} batch_options_t;
+
+/**
+ * Runs a batch of programs concurrently in one process.
+ *
+ * The job list has one job per line: a main class (a class file path or a class
+ * name on the classpath) optionally followed by how many times to run it, e.g.
+ *
+ *     tests/Primes.class 100
+ *     pkg/Main
+ *
+ * Blank lines and lines starting with '#' are ignored. A repeat count that isn't a
+ * positive integer makes the whole job list invalid.
+ *
+ * Every job's classes are loaded, prepared and linked up front, so the workers
+ * only ever read the shared classes. Every run of every job is then a task for a
+ * pool of worker threads, so the runs of one job spread across the threads too.
+ * Each run has its own heap, stack frames and output buffer. Alternatively, every
+ * run can be a green thread, all multiplexed on the calling thread (see
+ * scheduler.h). Once every run has finished, the runs' output is written to stdout
+ * in job order, and a report of each job's latency and the batch's throughput is
+ * written to stderr.
+ *
+ * @param loader the class loader to load the jobs' classes with
+ * @param jobs_path the path of the job list
+ * @param options how to run the jobs
+ * @return whether the job list could be read, every job's class was found, and no
+ *   run was cut off
+ */
+bool batch_run(class_loader_t *loader, const char *jobs_path,
+               const batch_options_t *options);
+
+#endif /* BATCH_H */
@@ -0,0 +1,20 @@
+// Counts the ways to make TARGET pence from British coins (see
+// https://projecteuler.net/problem=31), modulo MODULUS, by dynamic programming.
+public class CoinSums {
+    static final int TARGET = 1000000;
+    // Less than 2^30, so that adding two ways never overflows an int
+    static final int MODULUS = 1000000007;
+
+    public static void main(String[] args) {
+        int[] coins = { 1, 2, 5, 10, 20, 50, 100, 200 };
+        int[] ways = new int[TARGET + 1];
+        ways[0] = 1;
+        for (int c = 0; c < coins.length; c++) {
+            for (int amount = coins[c]; amount <= TARGET; amount++) {
+                ways[amount] = (ways[amount] + ways[amount - coins[c]]) % MODULUS;
+            }
+        }
+        System.out.println(ways[200]);
+        System.out.println(ways[TARGET]);
+    }
+}
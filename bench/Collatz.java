@@ -0,0 +1,24 @@
+// Finds the start below N with the longest Collatz sequence.
+// Starts below 113383 never exceed an int; larger N would overflow.
+public class Collatz {
+    static final int N = 100000;
+
+    public static void main(String[] args) {
+        int longest = 0;
+        int longestStart = 0;
+        for (int start = 1; start < N; start++) {
+            int n = start;
+            int length = 1;
+            while (n != 1) {
+                n = n % 2 == 0 ? n / 2 : 3 * n + 1;
+                length++;
+            }
+            if (length > longest) {
+                longest = length;
+                longestStart = start;
+            }
+        }
+        System.out.println(longestStart);
+        System.out.println(longest);
+    }
+}
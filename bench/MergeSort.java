@@ -0,0 +1,75 @@
+// Sorts N pseudo-random ints with a top-down merge sort.
+public class MergeSort {
+    static final int N = 1000000;
+    // A small linear congruential generator, which never overflows an int
+    static final int MULTIPLIER = 75;
+    static final int INCREMENT = 74;
+    static final int MODULUS = 65537;
+
+    public static void main(String[] args) {
+        int[] x = new int[N];
+        int seed = 1;
+        for (int i = 0; i < N; i++) {
+            seed = (seed * MULTIPLIER + INCREMENT) % MODULUS;
+            x[i] = seed;
+        }
+        mergeSort(x, N);
+
+        int unsorted = 0;
+        for (int i = 1; i < N; i++) {
+            if (x[i - 1] > x[i]) {
+                unsorted++;
+            }
+        }
+        System.out.println(unsorted);
+        System.out.println(x[0]);
+        System.out.println(x[N / 2]);
+        System.out.println(x[N - 1]);
+    }
+
+    public static void merge(int[] x, int[] l, int[] r) {
+        int i = 0;
+        int j = 0;
+        int k = 0;
+        while (i < l.length && j < r.length) {
+            if (l[i] <= r[j]) {
+                x[k] = l[i];
+                i++;
+            } else {
+                x[k] = r[j];
+                j++;
+            }
+            k++;
+        }
+        while (i < l.length) {
+            x[k] = l[i];
+            k++;
+            i++;
+        }
+        while (j < r.length) {
+            x[k] = r[j];
+            k++;
+            j++;
+        }
+    }
+
+    public static void mergeSort(int[] x, int n) {
+        if (n < 2) {
+            return;
+        }
+        int m = n / 2;
+        int[] l = new int[m];
+        int[] r = new int[n - m];
+
+        for (int i = 0; i < m; i++) {
+            l[i] = x[i];
+        }
+        for (int i = m; i < n; i++) {
+            r[i - m] = x[i];
+        }
+        mergeSort(l, m);
+        mergeSort(r, n - m);
+
+        merge(x, l, r);
+    }
+}
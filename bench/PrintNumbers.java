@@ -0,0 +1,12 @@
+// Prints N numbers, to measure the cost of System.out.println(int).
+public class PrintNumbers {
+    static final int N = 1000000;
+
+    public static void main(String[] args) {
+        int value = -N / 2 * 4099;
+        for (int i = 0; i < N; i++) {
+            System.out.println(value);
+            value += 4099;
+        }
+    }
+}
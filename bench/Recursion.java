@@ -0,0 +1,24 @@
+// Deep and wide recursion: sums 1..DEPTH recursively REPEAT times, then computes
+// the FIB-th Fibonacci number the exponential way.
+public class Recursion {
+    static final int DEPTH = 5000;
+    static final int REPEAT = 500;
+    static final int FIB = 27;
+
+    public static void main(String[] args) {
+        int total = 0;
+        for (int i = 0; i < REPEAT; i++) {
+            total += sum(DEPTH);
+        }
+        System.out.println(total);
+        System.out.println(fib(FIB));
+    }
+
+    public static int sum(int n) {
+        return n == 0 ? 0 : n + sum(n - 1);
+    }
+
+    public static int fib(int n) {
+        return n < 2 ? n : fib(n - 2) + fib(n - 1);
+    }
+}
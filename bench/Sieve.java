@@ -0,0 +1,28 @@
+// Counts the primes below N with the sieve of Eratosthenes.
+// Scale N up (e.g. to 100000000) for a longer run; the sieve uses 4N bytes.
+public class Sieve {
+    static final int N = 10000000;
+
+    public static void main(String[] args) {
+        // composite[i] is 0 if i is prime and 1 if not; 0 and 1 are never examined
+        int[] composite = new int[N];
+        for (int i = 2; i * i < N; i++) {
+            if (composite[i] == 0) {
+                for (int j = i * i; j < N; j += i) {
+                    composite[j] = 1;
+                }
+            }
+        }
+
+        int count = 0;
+        int largest = 0;
+        for (int i = 2; i < N; i++) {
+            if (composite[i] == 0) {
+                count++;
+                largest = i;
+            }
+        }
+        System.out.println(count);
+        System.out.println(largest);
+    }
+}
@@ -0,0 +1,351 @@
+/**
+ * Measures the cost of dispatching individual opcodes, without javac or class files.
+ *
+ * Each kernel is a loop whose body exercises a few opcodes, assembled into a
+ * synthetic method in memory. The method is run many times through each dispatch
+ * design (`execute()`, which recurses for calls, and `green_thread_run()`, which
+ * pushes frames), after a few untimed warm-up runs. Runs are timed with the CPU's
+ * cycle counter, and the report gives the median, minimum and standard deviation of
+ * the time per dispatched opcode.
+ *
+ * The loop itself (iinc, iload, iload, if_icmplt) is the "loop" kernel, so the cost
+ * of a body's opcodes can be told apart from the cost of the loop around them.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "../jvm.h"
+#include "../read_class.h"
+#include "../symbols.h"
+#include "../verify.h"
+
+#define DEFAULT_ITERATIONS 1000000
+#define DEFAULT_RUNS 15
+#define DEFAULT_WARMUP 3
+/** How long to compare the cycle counter against the monotonic clock */
+#define CALIBRATION_NANOSECONDS 100000000
+
+/** The Integer constant holding the number of loop iterations */
+#define ITERATIONS_CONSTANT 1
+/** The Methodref constant that invokestatic kernels call */
+#define CALLEE_METHODREF 2
+#define CONSTANT_POOL_COUNT 3
+#define MAX_CODE_LENGTH 64
+
+/** The bytes of a code fragment, and how many there are */
+#define CODE(...) (const u1[]){__VA_ARGS__}, sizeof((const u1[]){__VA_ARGS__})
+
+/**
+ * A loop to measure. The kernel's method is laid out as:
+ *     ldc #ITERATIONS_CONSTANT; istore_0    (local 0 is the iteration count)
+ *     <setup>
+ *     iconst_0; istore_1                    (local 1 is the loop counter)
+ *   loop:
+ *     <body>
+ *     iinc 1 1; iload_1; iload_0; if_icmplt loop
+ *     return
+ * Locals 2 and 3 are free for the body to use.
+ */
+typedef struct {
+    const char *name;
+    const u1 *setup;
+    size_t setup_length;
+    /** The number of instructions in `setup` */
+    size_t setup_instructions;
+    const u1 *body;
+    size_t body_length;
+    /** The number of instructions `body` dispatches, including in methods it calls */
+    size_t body_instructions;
+} kernel_t;
+
+static const kernel_t KERNELS[] = {
+    {"loop", NULL, 0, 0, NULL, 0, 0},
+    {"iload/iadd/istore", NULL, 0, 0,
+     CODE(i_iload_2, i_iload_1, i_iadd, i_istore_2, i_iload_3, i_iload_2, i_iadd,
+          i_istore_3),
+     8},
+    {"iconst/bipush", NULL, 0, 0,
+     CODE(i_iconst_5, i_bipush, 100, i_iadd, i_sipush, 0x10, 0x00, i_iadd, i_istore_2),
+     6},
+    {"isub", NULL, 0, 0, CODE(i_iload_1, i_iconst_3, i_isub, i_istore_2), 4},
+    {"imul", NULL, 0, 0, CODE(i_iload_1, i_iconst_3, i_imul, i_istore_2), 4},
+    {"idiv", NULL, 0, 0, CODE(i_iload_1, i_iconst_3, i_idiv, i_istore_2), 4},
+    {"irem", NULL, 0, 0, CODE(i_iload_1, i_iconst_3, i_irem, i_istore_2), 4},
+    {"ishl/ishr/iushr", NULL, 0, 0,
+     CODE(i_iload_1, i_iconst_3, i_ishl, i_iconst_1, i_ishr, i_iconst_2, i_iushr,
+          i_istore_2),
+     8},
+    {"iand/ior/ixor", NULL, 0, 0,
+     CODE(i_iload_1, i_iconst_3, i_iand, i_iload_1, i_ior, i_iload_1, i_ixor,
+          i_istore_2),
+     8},
+    {"dup/ineg", NULL, 0, 0, CODE(i_iload_1, i_dup, i_ineg, i_iadd, i_istore_2), 5},
+    {"iaload/iastore", CODE(i_iload_0, i_newarray, 10, i_astore_3), 3,
+     CODE(i_aload_3, i_iload_1, i_iload_1, i_iastore, i_aload_3, i_iload_1, i_iaload,
+          i_istore_2),
+     8},
+    {"arraylength", CODE(i_iconst_1, i_newarray, 10, i_astore_3), 3,
+     CODE(i_aload_3, i_arraylength, i_istore_2), 3},
+    // The counter is never negative, so this runs iload_1, ifge, goto (to the next
+    // instruction) and skips the iconst_0, istore_2
+    {"ifge/goto", NULL, 0, 0,
+     CODE(i_iload_1, i_ifge, 0x00, 0x05, i_iconst_0, i_istore_2, i_goto, 0x00, 0x03),
+     3},
+    // iload_1; invokestatic identity; istore_2, where identity is iload_0; ireturn
+    {"invokestatic", NULL, 0, 0,
+     CODE(i_iload_1, i_invokestatic, 0x00, CALLEE_METHODREF, i_istore_2), 5},
+};
+
+/** identity(I)I, the method the invokestatic kernel calls */
+static const u1 CALLEE_CODE[] = {i_iload_0, i_ireturn};
+
+/** A method assembled from a kernel, with a class to hold it */
+typedef struct {
+    class_file_t class;
+    /** The kernel's method, then the callee, then the terminating method */
+    method_t methods[3];
+    u1 code[MAX_CODE_LENGTH];
+    u1 tags[CONSTANT_POOL_COUNT];
+    u4 values[CONSTANT_POOL_COUNT];
+    method_t *resolved_methods[CONSTANT_POOL_COUNT];
+    /** The number of instructions a run of the method dispatches */
+    uint64_t instructions;
+} program_t;
+
+/** The dispatch designs to compare */
+typedef enum { DISPATCH_EXECUTE, DISPATCH_GREEN_THREAD, DISPATCH_COUNT } dispatch_t;
+
+static const char *const DISPATCH_NAMES[DISPATCH_COUNT] = {
+    [DISPATCH_EXECUTE] = "execute",
+    [DISPATCH_GREEN_THREAD] = "green",
+};
+
+static inline uint64_t read_cycle_counter(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+static uint64_t monotonic_nanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/** @return how many cycle counter ticks there are per nanosecond */
+static double calibrate_cycle_counter(void) {
+    uint64_t start_nanoseconds = monotonic_nanoseconds();
+    uint64_t start_ticks = read_cycle_counter();
+    uint64_t nanoseconds;
+    do {
+        nanoseconds = monotonic_nanoseconds() - start_nanoseconds;
+    } while (nanoseconds < CALIBRATION_NANOSECONDS);
+    return (double) (read_cycle_counter() - start_ticks) / nanoseconds;
+}
+
+static void init_method(method_t *method, program_t *program, const char *name,
+                        const char *descriptor, const char *parameter_types,
+                        char return_type) {
+    method->name = symbol_intern(name, strlen(name));
+    method->descriptor = symbol_intern(descriptor, strlen(descriptor));
+    method->parameter_count = strlen(parameter_types);
+    method->parameter_types = symbol_intern(parameter_types, strlen(parameter_types));
+    method->return_type = return_type;
+    method->class = &program->class;
+}
+
+/** Appends bytes to a method's code */
+static void emit(method_t *method, const u1 *bytes, size_t length) {
+    assert(method->code.code_length + length <= MAX_CODE_LENGTH && "Kernel too long");
+    if (length == 0) {
+        return;
+    }
+    memcpy(method->code.code + method->code.code_length, bytes, length);
+    method->code.code_length += length;
+}
+
+/**
+ * Assembles a kernel into a method, and verifies it as if it had been loaded from a
+ * class file.
+ */
+static void assemble(program_t *program, const kernel_t *kernel, int32_t iterations) {
+    memset(program, 0, sizeof(*program));
+    class_file_t *class = &program->class;
+    class->name = symbol_intern(kernel->name, strlen(kernel->name));
+    class->constant_pool = (constant_pool_t){
+        .count = CONSTANT_POOL_COUNT, .tags = program->tags, .values = program->values};
+    program->tags[ITERATIONS_CONSTANT] = CONSTANT_Integer;
+    program->values[ITERATIONS_CONSTANT] = (u4) iterations;
+    // The call site is resolved up front, so no class loader is needed
+    program->tags[CALLEE_METHODREF] = CONSTANT_Methodref;
+    program->resolved_methods[CALLEE_METHODREF] = &program->methods[1];
+    class->resolved_methods = program->resolved_methods;
+    class->methods = program->methods;
+
+    method_t *method = &program->methods[0];
+    init_method(method, program, MAIN_METHOD, MAIN_DESCRIPTOR, "[", 'V');
+    method->code = (code_t){.max_stack = 4, .max_locals = 4, .code = program->code};
+    emit(method, CODE(i_ldc, ITERATIONS_CONSTANT, i_istore_0));
+    emit(method, kernel->setup, kernel->setup_length);
+    emit(method, CODE(i_iconst_0, i_istore_1));
+    size_t loop = method->code.code_length;
+    emit(method, kernel->body, kernel->body_length);
+    emit(method, CODE(i_iinc, 1, 1, i_iload_1, i_iload_0));
+    int16_t offset = (int16_t) (loop - method->code.code_length);
+    emit(method, CODE(i_if_icmplt, (u1) ((u2) offset >> 8), (u1) offset, i_return));
+    program->instructions = 2 + kernel->setup_instructions + 2 +
+                            (uint64_t) iterations * (kernel->body_instructions + 4) +
+                            1;
+
+    method_t *callee = &program->methods[1];
+    init_method(callee, program, "identity", "(I)I", "I", 'I');
+    callee->code = (code_t){.max_stack = 1,
+                            .max_locals = 1,
+                            .code_length = sizeof(CALLEE_CODE),
+                            .code = (u1 *) CALLEE_CODE};
+
+    for (int i = 0; i < 2; i++) {
+        bool verified = verify_method(&program->methods[i], &class->constant_pool);
+        assert(verified && "Kernel failed verification");
+        atomic_init(&program->methods[i].prepared, true);
+    }
+}
+
+/** Runs a program once, returning how many cycle counter ticks it took */
+static uint64_t run(program_t *program, dispatch_t dispatch, output_t *output) {
+    method_t *method = &program->methods[0];
+    heap_t *heap = heap_init();
+    uint64_t start, end;
+    if (dispatch == DISPATCH_EXECUTE) {
+        int32_t *locals = calloc(method->code.max_locals, sizeof(int32_t));
+        assert(locals != NULL && "Failed to allocate locals");
+        start = read_cycle_counter();
+        execute(method, locals, &program->class, heap, output);
+        end = read_cycle_counter();
+        free(locals);
+    }
+    else {
+        green_thread_t *thread = green_thread_init(method, heap, output);
+        uint64_t fuel = UINT64_MAX;
+        start = read_cycle_counter();
+        bool finished = green_thread_run(thread, &fuel);
+        end = read_cycle_counter();
+        assert(finished && "Kernel ran out of fuel");
+        green_thread_free(thread);
+    }
+    heap_free(heap);
+    return end - start;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static bool kernel_selected(const kernel_t *kernel, int count, char *names[]) {
+    if (count == 0) {
+        return true;
+    }
+    for (int i = 0; i < count; i++) {
+        if (strcmp(kernel->name, names[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char *argv[]) {
+    int32_t iterations = DEFAULT_ITERATIONS;
+    int runs = DEFAULT_RUNS;
+    int warmup = DEFAULT_WARMUP;
+    int arg = 1;
+    for (; arg + 1 < argc && strncmp(argv[arg], "--", 2) == 0; arg += 2) {
+        if (strcmp(argv[arg], "--iterations") == 0) {
+            iterations = atoi(argv[arg + 1]);
+        }
+        else if (strcmp(argv[arg], "--runs") == 0) {
+            runs = atoi(argv[arg + 1]);
+        }
+        else if (strcmp(argv[arg], "--warmup") == 0) {
+            warmup = atoi(argv[arg + 1]);
+        }
+        else {
+            break;
+        }
+    }
+    if ((arg < argc && strncmp(argv[arg], "--", 2) == 0) || iterations < 1 ||
+        runs < 1 || warmup < 0) {
+        fprintf(stderr,
+                "USAGE: %s [--iterations N] [--runs N] [--warmup N] [kernel ...]\n",
+                argv[0]);
+        return 1;
+    }
+
+    double ticks_per_nanosecond = calibrate_cycle_counter();
+    printf("%.3f cycle counter ticks per ns; %d runs of %" PRId32
+           " iterations after %d warm-up runs\n",
+           ticks_per_nanosecond, runs, iterations, warmup);
+    printf("%-18s %-8s %12s %10s %10s %10s %10s\n", "kernel", "dispatch", "opcodes/run",
+           "median ns", "min ns", "stddev ns", "ticks");
+
+    output_t *output = output_init_buffer();
+    program_t *program = malloc(sizeof(*program));
+    double *samples = malloc(runs * sizeof(*samples));
+    assert(program != NULL && samples != NULL && "Failed to allocate benchmark");
+    size_t kernel_count = sizeof(KERNELS) / sizeof(KERNELS[0]);
+    for (size_t i = 0; i < kernel_count; i++) {
+        const kernel_t *kernel = &KERNELS[i];
+        if (!kernel_selected(kernel, argc - arg, &argv[arg])) {
+            continue;
+        }
+        assemble(program, kernel, iterations);
+        for (dispatch_t dispatch = 0; dispatch < DISPATCH_COUNT; dispatch++) {
+            for (int j = 0; j < warmup; j++) {
+                run(program, dispatch, output);
+            }
+            // Per opcode, in cycle counter ticks
+            double sum = 0;
+            for (int j = 0; j < runs; j++) {
+                samples[j] = (double) run(program, dispatch, output) /
+                             program->instructions;
+                sum += samples[j];
+            }
+            double mean = sum / runs;
+            double squares = 0;
+            for (int j = 0; j < runs; j++) {
+                squares += (samples[j] - mean) * (samples[j] - mean);
+            }
+            qsort(samples, runs, sizeof(*samples), compare_doubles);
+            double median = runs % 2 == 1
+                                ? samples[runs / 2]
+                                : (samples[runs / 2 - 1] + samples[runs / 2]) / 2;
+
+            printf("%-18s %-8s %12" PRIu64 " %10.3f %10.3f %10.3f %10.3f\n",
+                   kernel->name, DISPATCH_NAMES[dispatch], program->instructions,
+                   median / ticks_per_nanosecond, samples[0] / ticks_per_nanosecond,
+                   sqrt(squares / runs) / ticks_per_nanosecond, median);
+        }
+    }
+
+    free(samples);
+    free(program);
+    output_free(output);
+    symbols_free();
+    return 0;
+}
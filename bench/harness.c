@@ -0,0 +1,321 @@
+/**
+ * Runs benchmark programs on several JVM implementations and compares them.
+ *
+ * Each program is run a few times untimed to warm up the file cache, then timed over
+ * a number of runs. The report has the median, 90th and 99th percentile, min and max
+ * wall time, and the peak RSS, of every implementation on every program. If a build
+ * that counts instructions is given (see COUNT_INSTRUCTIONS in jvm.h), it is run once
+ * per program to find how many instructions the program executes, and the report
+ * also has each implementation's instructions per second at its median time.
+ *
+ * Every run's stdout is hashed, so that an implementation that prints something
+ * different from the first implementation is reported as wrong rather than fast.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_JVMS 8
+#define DEFAULT_RUNS 10
+#define DEFAULT_WARMUP 1
+
+const char USAGE[] =
+    "USAGE: %s [--runs N] [--warmup N] [--count <counting jvm>] [--json <file>]\n"
+    "    --jvm <name>=<path> [--jvm <name>=<path> ...] <class file> ...\n";
+const char INSTRUCTIONS_FORMAT[] = "Executed %" SCNu64 " instructions";
+
+typedef struct {
+    const char *name;
+    const char *path;
+} jvm_t;
+
+/** The outcome of one run of a program */
+typedef struct {
+    /** Whether the program exited with status 0 */
+    bool ok;
+    double seconds;
+    /** The peak resident set size, in KiB */
+    long max_rss;
+    /** A hash of everything the program printed to stdout */
+    uint64_t output_hash;
+} run_t;
+
+/** The summary of one implementation's runs of one program */
+typedef struct {
+    bool ok;
+    /** Whether the output matched the first implementation's */
+    bool matches;
+    double median, p90, p99, min, max;
+    long max_rss;
+    uint64_t output_hash;
+} result_t;
+
+/** FNV-1a, which is plenty to tell whether two outputs differ */
+static uint64_t hash_bytes(uint64_t hash, const char *bytes, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t) bytes[i]) * 0x100000001b3;
+    }
+    return hash;
+}
+
+/**
+ * Runs `path <class file>`, with one of its streams read through a pipe and the other
+ * discarded.
+ *
+ * @param read_stderr whether to read stderr (into `text`) rather than hash stdout
+ * @param text where to store what was read from stderr, NUL-terminated
+ */
+static run_t run(const char *path, const char *class_file, bool read_stderr,
+                 char *text, size_t text_size) {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) {
+        perror("pipe");
+        exit(1);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(pipe_fds[1], read_stderr ? STDERR_FILENO : STDOUT_FILENO);
+        dup2(null_fd, read_stderr ? STDOUT_FILENO : STDERR_FILENO);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        close(null_fd);
+        execl(path, path, class_file, (char *) NULL);
+        _exit(127);
+    }
+
+    close(pipe_fds[1]);
+    run_t result = {.output_hash = 0xcbf29ce484222325};
+    size_t text_length = 0;
+    char buffer[64 * 1024];
+    ssize_t received;
+    while ((received = read(pipe_fds[0], buffer, sizeof(buffer))) != 0) {
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (read_stderr) {
+            size_t copied = (size_t) received;
+            if (copied > text_size - 1 - text_length) {
+                copied = text_size - 1 - text_length;
+            }
+            memcpy(text + text_length, buffer, copied);
+            text_length += copied;
+        }
+        else {
+            result.output_hash = hash_bytes(result.output_hash, buffer, received);
+        }
+    }
+    close(pipe_fds[0]);
+    if (read_stderr) {
+        text[text_length] = '\0';
+    }
+
+    int status;
+    struct rusage usage;
+    while (wait4(pid, &status, 0, &usage) < 0) {
+        if (errno != EINTR) {
+            perror("wait4");
+            exit(1);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    result.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    result.seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    result.max_rss = usage.ru_maxrss;
+    return result;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/** The nearest-rank percentile of sorted values */
+static double percentile(const double *sorted, int count, int percent) {
+    int rank = (percent * count + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static result_t measure(const jvm_t *jvm, const char *class_file, int runs,
+                        int warmup) {
+    for (int i = 0; i < warmup; i++) {
+        run(jvm->path, class_file, false, NULL, 0);
+    }
+
+    result_t result = {.ok = true};
+    double *seconds = malloc(runs * sizeof(*seconds));
+    for (int i = 0; i < runs; i++) {
+        run_t outcome = run(jvm->path, class_file, false, NULL, 0);
+        seconds[i] = outcome.seconds;
+        if (!outcome.ok || (i > 0 && outcome.output_hash != result.output_hash)) {
+            result.ok = false;
+        }
+        result.output_hash = outcome.output_hash;
+        if (outcome.max_rss > result.max_rss) {
+            result.max_rss = outcome.max_rss;
+        }
+    }
+    qsort(seconds, runs, sizeof(*seconds), compare_doubles);
+    result.median = runs % 2 == 1 ? seconds[runs / 2]
+                                  : (seconds[runs / 2 - 1] + seconds[runs / 2]) / 2;
+    result.p90 = percentile(seconds, runs, 90);
+    result.p99 = percentile(seconds, runs, 99);
+    result.min = seconds[0];
+    result.max = seconds[runs - 1];
+    free(seconds);
+    return result;
+}
+
+/** @return the number of instructions the program executes, or 0 if unknown */
+static uint64_t count_instructions(const char *count_path, const char *class_file) {
+    char text[4096];
+    run_t outcome = run(count_path, class_file, true, text, sizeof(text));
+    // The count comes last, after anything else the program printed to stderr
+    const char *line = strstr(text, "Executed ");
+    uint64_t instructions;
+    if (!outcome.ok || line == NULL ||
+        sscanf(line, INSTRUCTIONS_FORMAT, &instructions) != 1) {
+        return 0;
+    }
+    return instructions;
+}
+
+/** The name of a benchmark: its class file's name without directory or extension */
+static void benchmark_name(const char *class_file, char *name, size_t size) {
+    const char *slash = strrchr(class_file, '/');
+    snprintf(name, size, "%s", slash != NULL ? slash + 1 : class_file);
+    char *extension = strrchr(name, '.');
+    if (extension != NULL) {
+        *extension = '\0';
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int runs = DEFAULT_RUNS;
+    int warmup = DEFAULT_WARMUP;
+    const char *count_path = NULL;
+    const char *json_path = NULL;
+    jvm_t jvms[MAX_JVMS];
+    int jvm_count = 0;
+    int arg = 1;
+    for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+        if (arg + 1 == argc) {
+            break;
+        }
+        const char *value = argv[++arg];
+        if (strcmp(argv[arg - 1], "--runs") == 0) {
+            runs = atoi(value);
+        }
+        else if (strcmp(argv[arg - 1], "--warmup") == 0) {
+            warmup = atoi(value);
+        }
+        else if (strcmp(argv[arg - 1], "--count") == 0) {
+            count_path = value;
+        }
+        else if (strcmp(argv[arg - 1], "--json") == 0) {
+            json_path = value;
+        }
+        else if (strcmp(argv[arg - 1], "--jvm") == 0 && jvm_count < MAX_JVMS &&
+                 strchr(value, '=') != NULL) {
+            char *separator = strchr(value, '=');
+            jvms[jvm_count].name = strndup(value, separator - value);
+            jvms[jvm_count].path = separator + 1;
+            jvm_count++;
+        }
+        else {
+            arg = argc;
+        }
+    }
+    if (arg >= argc || jvm_count == 0 || runs < 1 || warmup < 0) {
+        fprintf(stderr, USAGE, argv[0]);
+        return 1;
+    }
+
+    FILE *json = NULL;
+    if (json_path != NULL) {
+        json = fopen(json_path, "w");
+        if (json == NULL) {
+            perror(json_path);
+            return 1;
+        }
+        fprintf(json, "{\n  \"runs\": %d,\n  \"warmup\": %d,\n  \"benchmarks\": [", runs,
+                warmup);
+    }
+
+    printf("%-14s %-8s %9s %9s %9s %9s %9s %10s %12s\n", "benchmark", "jvm", "median",
+           "p90", "p99", "min", "max", "max RSS", "instr/s");
+    bool all_ok = true;
+    for (int i = arg; i < argc; i++) {
+        const char *class_file = argv[i];
+        char name[256];
+        benchmark_name(class_file, name, sizeof(name));
+        uint64_t instructions =
+            count_path != NULL ? count_instructions(count_path, class_file) : 0;
+        if (json != NULL) {
+            fprintf(json, "%s\n    {\n      \"name\": \"%s\",\n", i > arg ? "," : "",
+                    name);
+            fprintf(json, "      \"instructions\": %" PRIu64 ",\n      \"results\": [",
+                    instructions);
+        }
+
+        uint64_t expected_hash = 0;
+        for (int j = 0; j < jvm_count; j++) {
+            result_t result = measure(&jvms[j], class_file, runs, warmup);
+            if (j == 0) {
+                expected_hash = result.output_hash;
+            }
+            result.matches = result.output_hash == expected_hash;
+            all_ok = all_ok && result.ok && result.matches;
+            double rate = instructions / result.median;
+
+            const char *status = !result.ok        ? "  (failed)"
+                                 : !result.matches ? "  (wrong output)"
+                                                   : "";
+            printf("%-14s %-8s %8.3fs %8.3fs %8.3fs %8.3fs %8.3fs %7ld KiB", name,
+                   jvms[j].name, result.median, result.p90, result.p99, result.min,
+                   result.max, result.max_rss);
+            if (instructions > 0) {
+                printf(" %12.4g", rate);
+            }
+            printf("%s\n", status);
+
+            if (json != NULL) {
+                fprintf(json,
+                        "%s\n        {\"jvm\": \"%s\", \"ok\": %s, "
+                        "\"output_matches\": %s, \"median\": %.6f, \"p90\": %.6f, "
+                        "\"p99\": %.6f, \"min\": %.6f, \"max\": %.6f, "
+                        "\"max_rss_kib\": %ld, \"instructions_per_second\": %.0f}",
+                        j > 0 ? "," : "", jvms[j].name, result.ok ? "true" : "false",
+                        result.matches ? "true" : "false", result.median, result.p90,
+                        result.p99, result.min, result.max, result.max_rss, rate);
+            }
+        }
+        if (json != NULL) {
+            fprintf(json, "\n      ]\n    }");
+        }
+    }
+    if (json != NULL) {
+        fprintf(json, "\n  ]\n}\n");
+        fclose(json);
+    }
+    return all_ok ? 0 : 1;
+}
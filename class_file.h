@@ -10,7 +10,11 @@
  * we use the same names although they don't follow the code quality guidelines.
  */
 
+#include <assert.h>
 #include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 /* Integer type aliases used in the JVM documentation.
  * You may use these aliases or the corresponding inttypes.h types. */
@@ -42,7 +46,10 @@ typedef struct {
     u4 attribute_length;
 } attribute_info;
 
-/** The JVM's representation of a Java method's code */
+/**
+ * The JVM's representation of a Java method's code.
+ * This is only filled in once the method has been prepared (see `prepare_method()`).
+ */
 typedef struct {
     /** The maximum number of ints that will be on the operand stack */
     u2 max_stack;
@@ -53,17 +60,21 @@ typedef struct {
     /**
      * The method's bytecode, a list of JVM instructions represented as bytes.
      * See the project01 spec for how to interpret these bytes.
+     * This points into the class file image (see `class_file_t.data`).
      */
     u1 *code;
 } code_t;
 
+struct class_file;
+
 /** A Java method */
 typedef struct {
     /**
      * The method name, e.g. "main".
      * This is used with the descriptor string to look up the method.
+     * Names are interned (see symbols.h), so they can be compared by pointer.
      */
-    char *name;
+    const char *name;
     /**
      * The method descriptor, e.g. "([Ljava/lang/String;)V",
      * which represents the method's signature.
@@ -71,10 +82,41 @@ typedef struct {
      * which allows for method overloading.
      * If you're interested, descriptor strings are explained at
      * https://docs.oracle.com/javase/specs/jvms/se12/html/jvms-4.html#jvms-4.3.2.
+     * Like the name, the descriptor is interned.
+     */
+    const char *descriptor;
+    /** The number of parameters in the descriptor, computed when the class is loaded */
+    u2 parameter_count;
+    /**
+     * The first character of each parameter's type, e.g. "I[" for "(I[I)V".
+     * This is interned and has `parameter_count` characters.
      */
-    char *descriptor;
+    const char *parameter_types;
+    /** The first character of the return type, e.g. 'V' or 'I' */
+    char return_type;
     /** The method's bytecode (see the comments for `code_t`) */
     code_t code;
+    /**
+     * The offset of the method's Code attribute in the class file image, and its
+     * length. Loading a class only records where each method's code is; it is
+     * decoded and verified the first time the method is invoked.
+     */
+    u4 code_attribute;
+    u4 code_attribute_length;
+    /** Whether `code` has been decoded and verified */
+    atomic_bool prepared;
+    /** Set by the thread that claims the work of preparing the method */
+    atomic_flag preparing;
+    /** The id a trace refers to the method by, or 0 until it has one (see trace.h) */
+    atomic_uint trace_id;
+    /** The address of the method's trampoline, or 0 until it has one (see perf.h) */
+    atomic_uintptr_t perf_trampoline;
+    /** The number of times the method has been invoked, if metrics are being collected */
+    _Atomic uint64_t invocations;
+    /** The method's id plus 1, or 0 until it has one (see counters.c) */
+    atomic_uint counters_id;
+    /** The class the method belongs to */
+    struct class_file *class;
 } method_t;
 
 /**
@@ -82,58 +124,132 @@ typedef struct {
  * You will only need to handle the CONSTANT_Integer case.
  */
 typedef enum {
+    /** Slot 0, and the second slot of every Long or Double constant */
+    CONSTANT_Unusable = 0,
     CONSTANT_Utf8 = 1,
     CONSTANT_Integer = 3,
+    CONSTANT_Float = 4,
+    CONSTANT_Long = 5,
+    CONSTANT_Double = 6,
     CONSTANT_Class = 7,
+    CONSTANT_String = 8,
     CONSTANT_Fieldref = 9,
     CONSTANT_Methodref = 10,
-    CONSTANT_NameAndType = 12
+    CONSTANT_InterfaceMethodref = 11,
+    CONSTANT_NameAndType = 12,
+    CONSTANT_MethodHandle = 15,
+    CONSTANT_MethodType = 16,
+    CONSTANT_InvokeDynamic = 18
 } cp_tag_t;
 
+/**
+ * A class file's constant pool, stored as parallel arrays indexed directly by the
+ * (1-indexed) constant pool indices that appear in the bytecode.
+ *
+ * Every constant's payload fits in 32 bits:
+ * - Integer and Float constants hold their bits.
+ * - Long and Double constants hold their high word, with the low word in the next
+ *   slot (which is tagged CONSTANT_Unusable, as the JVM specification requires).
+ * - Class, String and MethodType constants hold the index of a UTF8 constant.
+ * - Fieldref, Methodref, InterfaceMethodref, NameAndType and InvokeDynamic constants
+ *   hold their two u2 indices, packed high then low as they appear in the file.
+ * - MethodHandle constants hold their reference kind above their reference index.
+ * - UTF8 constants hold an index into `strings`.
+ */
 typedef struct {
-    u2 string_index;
-} CONSTANT_Class_info;
-
-typedef struct {
-    u2 class_index;
-    u2 name_and_type_index;
-} CONSTANT_FieldOrMethodref_info;
-
-/** The representation of an int in a constant pool entry */
-typedef struct {
-    int32_t bytes;
-} CONSTANT_Integer_info;
-
-typedef struct {
-    u2 name_index;
-    u2 descriptor_index;
-} CONSTANT_NameAndType_info;
-
-/** An entry in a class file's constant pool */
-typedef struct {
-    /** The type of constant, which determines how to interpret `info` */
-    cp_tag_t tag;
+    /** The number of slots, including the unused slot 0 */
+    u2 count;
+    /** The type of each constant (`cp_tag_t` values) */
+    u1 *tags;
+    /** The 32-bit payload of each constant */
+    u4 *values;
     /**
-     * A pointer to the constant's value.
-     * `tag` determines what type of value `info` points to.
-     * For example, an integer constant's `info` points to a CONSTANT_Integer_info struct.
+     * The interned strings of the UTF8 constants. `tags` and `values` live in the
+     * same allocation, so freeing this frees the whole pool.
      */
-    void *info;
-} cp_info;
+    const char **strings;
+} constant_pool_t;
+
+/*
+ * Typed accessors for constant pool entries. These are plain loads: the caller is
+ * responsible for checking the constant's tag with `cp_tag()` where the bytecode
+ * could refer to the wrong kind of constant.
+ */
+static inline cp_tag_t cp_tag(const constant_pool_t *pool, u2 index) {
+    assert(0 < index && index < pool->count && "Invalid constant pool index");
+    return pool->tags[index];
+}
+static inline int32_t cp_integer(const constant_pool_t *pool, u2 index) {
+    return (int32_t) pool->values[index];
+}
+static inline int64_t cp_long(const constant_pool_t *pool, u2 index) {
+    return (int64_t)((uint64_t) pool->values[index] << 32 | pool->values[index + 1]);
+}
+static inline const char *cp_utf8(const constant_pool_t *pool, u2 index) {
+    return pool->strings[pool->values[index]];
+}
+/** The UTF8 index of a Class, String or MethodType constant */
+static inline u2 cp_string_index(const constant_pool_t *pool, u2 index) {
+    return (u2) pool->values[index];
+}
+/** The class index of a Fieldref, Methodref or InterfaceMethodref constant */
+static inline u2 cp_class_index(const constant_pool_t *pool, u2 index) {
+    return (u2)(pool->values[index] >> 16);
+}
+/** The NameAndType index of a Fieldref, Methodref or InterfaceMethodref constant */
+static inline u2 cp_name_and_type_index(const constant_pool_t *pool, u2 index) {
+    return (u2) pool->values[index];
+}
+/** The name's UTF8 index of a NameAndType constant */
+static inline u2 cp_name_index(const constant_pool_t *pool, u2 index) {
+    return (u2)(pool->values[index] >> 16);
+}
+/** The descriptor's UTF8 index of a NameAndType constant */
+static inline u2 cp_descriptor_index(const constant_pool_t *pool, u2 index) {
+    return (u2) pool->values[index];
+}
+
+struct class_loader;
 
 /** A class file, consisting of an array of constants and an array of methods */
-typedef struct {
+typedef struct class_file {
+    /**
+     * The raw class file image. Method bytecode points into it,
+     * so it must outlive the rest of the class.
+     */
+    u1 *data;
+    /** The number of bytes in `data` */
+    size_t data_length;
+    /** Whether `data` is an mmap()ed view of the file rather than a heap buffer */
+    bool data_mapped;
+    /** The class's internal name, e.g. "pkg/Main" (interned) */
+    const char *name;
+    /** The class loader that registered this class, or NULL (see class_loader.h) */
+    struct class_loader *loader;
+    /** The class's constants (see `constant_pool_t`) */
+    constant_pool_t constant_pool;
     /**
-     * The class's array of constants.
-     * Note that this array is 0-indexed, but the bytecode refers to 1-indexed constants.
-     * The array is "null-terminated": `constant_pool[length].info == NULL`.
+     * The methods that Methodref constants have been resolved to, indexed like the
+     * constant pool. Entries are NULL until the call site is first executed.
      */
-    cp_info *constant_pool;
+    method_t **resolved_methods;
+    /**
+     * Whether the class named by each Fieldref constant has been resolved, indexed
+     * like the constant pool. Entries are false until the field is first accessed.
+     */
+    bool *resolved_fields;
     /**
      * The class's methods, in no particular order.
      * The array is "null-terminated": `methods[length].name == NULL`.
      */
     method_t *methods;
+    /**
+     * An open-addressing hash index from (name, descriptor) to method.
+     * Empty slots are NULL; see `find_interned_method()`.
+     */
+    method_t **method_table;
+    /** The number of slots in `method_table` minus one (it's a power of two) */
+    size_t method_table_mask;
 } class_file_t;
 
 #endif /* CLASS_FILE_H */
@@ -0,0 +1,593 @@
+#include "class_loader.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "output.h"
+#include "read_class.h"
+#include "symbols.h"
+#include "thread_pool.h"
+#include "zip.h"
+
+/** The package whose classes are built into the VM rather than loaded */
+const char BUILTIN_PACKAGE[] = "java/";
+const char CLASS_FILE_EXTENSION[] = ".class";
+const char CLASSPATH_SEPARATOR = ':';
+
+/** A directory or archive on the classpath */
+typedef struct {
+    /** The directory's path, or NULL if this entry is an archive */
+    char *directory;
+    /** The opened archive, or NULL if this entry is a directory */
+    zip_t *archive;
+} classpath_entry_t;
+
+/** A file that classes were read from, and when it was last modified */
+typedef struct {
+    char *path;
+    struct timespec modified;
+} class_source_t;
+
+typedef struct class_loader {
+    /** The classpath entries, searched in order */
+    classpath_entry_t *classpath;
+    size_t classpath_length;
+    /** Whether the classpath should come from the first class loaded by path */
+    bool implicit_classpath;
+    /** Protects the class table, since classes may be loaded on several threads */
+    pthread_mutex_t lock;
+    /**
+     * An open-addressing hash table of the loaded classes, keyed by their interned
+     * names. Empty slots are NULL.
+     */
+    class_file_t **classes;
+    /** The number of slots in `classes` (always a power of two) */
+    size_t capacity;
+    /** The number of loaded classes */
+    size_t count;
+    /** The class files and archives classes were read from (protected by `lock`) */
+    class_source_t *sources;
+    size_t source_count;
+} class_loader_t;
+
+/**
+ * Records a file that classes were read from, so that changes to it can be
+ * detected (see `class_loader_stale()`).
+ */
+static void source_add(class_loader_t *loader, const char *path,
+                       const struct stat *status) {
+    char *source_path = strdup(path);
+    assert(source_path != NULL && "Failed to allocate class source");
+    pthread_mutex_lock(&loader->lock);
+    // Grow whenever the count reaches a power of two
+    size_t count = loader->source_count;
+    if ((count & (count - 1)) == 0) {
+        loader->sources =
+            realloc(loader->sources, sizeof(class_source_t[count == 0 ? 1 : 2 * count]));
+        assert(loader->sources != NULL && "Failed to allocate class sources");
+    }
+    loader->sources[loader->source_count++] =
+        (class_source_t){.path = source_path, .modified = status->st_mtim};
+    pthread_mutex_unlock(&loader->lock);
+}
+
+static void classpath_add(class_loader_t *loader, const char *path, size_t length) {
+    char *entry_path = strndup(path, length);
+    assert(entry_path != NULL && "Failed to allocate classpath entry");
+
+    classpath_entry_t entry = {.directory = NULL, .archive = NULL};
+    struct stat status;
+    if (stat(entry_path, &status) == 0 && S_ISDIR(status.st_mode)) {
+        entry.directory = entry_path;
+    }
+    else {
+        entry.archive = zip_open(entry_path);
+        if (entry.archive == NULL) {
+            fprintf(stderr, "Ignoring classpath entry %s\n", entry_path);
+            free(entry_path);
+            return;
+        }
+        source_add(loader, entry_path, &status);
+        free(entry_path);
+    }
+
+    size_t classpath_length = loader->classpath_length + 1;
+    loader->classpath =
+        realloc(loader->classpath, classpath_length * sizeof(classpath_entry_t));
+    assert(loader->classpath != NULL && "Failed to allocate classpath");
+    loader->classpath[loader->classpath_length++] = entry;
+}
+
+class_loader_t *class_loader_init(const char *classpath) {
+    class_loader_t *loader = calloc(1, sizeof(*loader));
+    assert(loader != NULL && "Failed to allocate class loader");
+    loader->implicit_classpath = classpath == NULL;
+    pthread_mutex_init(&loader->lock, NULL);
+
+    while (classpath != NULL && *classpath != '\0') {
+        const char *separator = strchr(classpath, CLASSPATH_SEPARATOR);
+        size_t length = separator != NULL ? (size_t)(separator - classpath)
+                                          : strlen(classpath);
+        if (length > 0) {
+            classpath_add(loader, classpath, length);
+        }
+        classpath = separator != NULL ? separator + 1 : NULL;
+    }
+    return loader;
+}
+
+/**
+ * Finds the slot holding a class, or the empty slot where it belongs.
+ * Names are interned, so their addresses identify them.
+ */
+static class_file_t **class_slot(const class_loader_t *loader, const char *name) {
+    size_t mask = loader->capacity - 1;
+    for (size_t index = ((uintptr_t) name >> 4) * 0x9e3779b97f4a7c15;;
+         index = (index + 1) & mask) {
+        class_file_t **slot = &loader->classes[index & mask];
+        if (*slot == NULL || (*slot)->name == name) {
+            return slot;
+        }
+    }
+}
+
+/**
+ * Adds a class to the class table, unless a class with the same name got there
+ * first. The loader's lock must be held.
+ *
+ * @return the class registered under the class's name
+ */
+static class_file_t *class_insert(class_loader_t *loader, class_file_t *class) {
+    if (loader->count > 0) {
+        class_file_t *loaded = *class_slot(loader, class->name);
+        if (loaded != NULL) {
+            return loaded;
+        }
+    }
+
+    // Keep the load factor at or below one half
+    if (2 * (loader->count + 1) > loader->capacity) {
+        class_file_t **old_classes = loader->classes;
+        size_t old_capacity = loader->capacity;
+        loader->capacity = old_capacity == 0 ? 16 : 2 * old_capacity;
+        loader->classes = calloc(loader->capacity, sizeof(class_file_t *));
+        assert(loader->classes != NULL && "Failed to allocate class table");
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old_classes[i] != NULL) {
+                *class_slot(loader, old_classes[i]->name) = old_classes[i];
+            }
+        }
+        free(old_classes);
+    }
+
+    *class_slot(loader, class->name) = class;
+    class->loader = loader;
+    loader->count++;
+    return class;
+}
+
+void class_loader_register(class_loader_t *loader, class_file_t *class) {
+    pthread_mutex_lock(&loader->lock);
+    class_file_t *registered = class_insert(loader, class);
+    pthread_mutex_unlock(&loader->lock);
+    assert(registered == class && "Class was loaded twice");
+}
+
+/**
+ * Registers a class that was loaded without holding the loader's lock.
+ * If another thread loaded the same class in the meantime, its copy wins.
+ */
+static class_file_t *class_publish(class_loader_t *loader, class_file_t *class) {
+    pthread_mutex_lock(&loader->lock);
+    class_file_t *registered = class_insert(loader, class);
+    pthread_mutex_unlock(&loader->lock);
+    if (registered != class) {
+        free_class(class);
+    }
+    return registered;
+}
+
+/**
+ * Finds a loaded class by its interned name.
+ *
+ * @return the class, or NULL if it hasn't been loaded
+ */
+static class_file_t *class_find(class_loader_t *loader, const char *name) {
+    pthread_mutex_lock(&loader->lock);
+    class_file_t *loaded = loader->count > 0 ? *class_slot(loader, name) : NULL;
+    pthread_mutex_unlock(&loader->lock);
+    return loaded;
+}
+
+static bool is_builtin(const char *name) {
+    return strncmp(name, BUILTIN_PACKAGE, strlen(BUILTIN_PACKAGE)) == 0;
+}
+
+/**
+ * Reads a class out of a classpath entry.
+ *
+ * @return the parsed class, or NULL if the entry doesn't contain it
+ */
+static class_file_t *classpath_entry_read(class_loader_t *loader,
+                                          const classpath_entry_t *entry,
+                                          const char *name) {
+    size_t file_name_length = strlen(name) + sizeof(CLASS_FILE_EXTENSION);
+    if (entry->directory != NULL) {
+        size_t path_length = strlen(entry->directory) + 1 + file_name_length;
+        char path[path_length];
+        snprintf(path, path_length, "%s/%s%s", entry->directory, name,
+                 CLASS_FILE_EXTENSION);
+        FILE *class_file = fopen(path, "r");
+        if (class_file == NULL) {
+            return NULL;
+        }
+        struct stat status;
+        int error = fstat(fileno(class_file), &status);
+        assert(error == 0 && "Failed to stat file");
+        source_add(loader, path, &status);
+        class_file_t *class = get_class(class_file);
+        error = fclose(class_file);
+        assert(error == 0 && "Failed to close file");
+        return class;
+    }
+
+    char entry_name[file_name_length];
+    snprintf(entry_name, file_name_length, "%s%s", name, CLASS_FILE_EXTENSION);
+    size_t length;
+    u1 *data = zip_read(entry->archive, entry_name, &length);
+    return data != NULL ? get_class_from_buffer(data, length) : NULL;
+}
+
+/**
+ * Parses a class from the first classpath entry that contains it.
+ * This doesn't touch the class table, so it can run on any thread.
+ *
+ * @return the class, or NULL if no classpath entry contains it
+ */
+static class_file_t *classpath_read(class_loader_t *loader, const char *name) {
+    for (size_t i = 0; i < loader->classpath_length; i++) {
+        class_file_t *class = classpath_entry_read(loader, &loader->classpath[i], name);
+        if (class != NULL) {
+            assert(class->name == name && "Class file contains the wrong class");
+            return class;
+        }
+    }
+    return NULL;
+}
+
+class_file_t *class_loader_load(class_loader_t *loader, const char *name) {
+    name = symbol_intern(name, strlen(name));
+    class_file_t *loaded = class_find(loader, name);
+    if (loaded != NULL) {
+        return loaded;
+    }
+
+    // Parse outside the lock, so that other classes can load in the meantime
+    class_file_t *class = classpath_read(loader, name);
+    return class != NULL ? class_publish(loader, class) : NULL;
+}
+
+/**
+ * Adds the classpath root implied by a class file's path, e.g. "out" for
+ * "out/pkg/Main.class" containing pkg/Main, or the file's directory otherwise.
+ */
+static void classpath_add_root(class_loader_t *loader, const char *path,
+                               const char *name) {
+    size_t path_length = strlen(path);
+    size_t suffix_length = strlen(name) + strlen(CLASS_FILE_EXTENSION);
+    size_t root_length;
+    if (path_length >= suffix_length &&
+        strncmp(path + path_length - suffix_length, name, strlen(name)) == 0 &&
+        (path_length == suffix_length || path[path_length - suffix_length - 1] == '/')) {
+        root_length = path_length - suffix_length;
+    }
+    else {
+        const char *slash = strrchr(path, '/');
+        root_length = slash != NULL ? (size_t)(slash - path) + 1 : 0;
+    }
+
+    // Drop the trailing slash, but keep "/" itself
+    if (root_length > 1 && path[root_length - 1] == '/') {
+        root_length--;
+    }
+    if (root_length == 0) {
+        classpath_add(loader, ".", 1);
+    }
+    else {
+        classpath_add(loader, path, root_length);
+    }
+}
+
+class_file_t *class_loader_load_file(class_loader_t *loader, const char *path) {
+    FILE *class_file = fopen(path, "r");
+    if (class_file == NULL) {
+        return NULL;
+    }
+    struct stat status;
+    int error = fstat(fileno(class_file), &status);
+    assert(error == 0 && "Failed to stat file");
+    source_add(loader, path, &status);
+    class_file_t *class = get_class(class_file);
+    error = fclose(class_file);
+    assert(error == 0 && "Failed to close file");
+
+    if (loader->implicit_classpath && loader->classpath_length == 0) {
+        classpath_add_root(loader, path, class->name);
+    }
+    return class_publish(loader, class);
+}
+
+class_file_t *class_loader_load_main(class_loader_t *loader, const char *main_class) {
+    size_t length = strlen(main_class);
+    size_t extension_length = strlen(CLASS_FILE_EXTENSION);
+    if (length >= extension_length &&
+        strcmp(main_class + length - extension_length, CLASS_FILE_EXTENSION) == 0) {
+        return class_loader_load_file(loader, main_class);
+    }
+    return class_loader_load(loader, main_class);
+}
+
+class_file_t *resolve_class(class_file_t *class, u2 index) {
+    const constant_pool_t *constant_pool = &class->constant_pool;
+    assert(cp_tag(constant_pool, index) == CONSTANT_Class && "Expected a Class");
+    const char *name = cp_utf8(constant_pool, cp_string_index(constant_pool, index));
+    if (name == class->name) {
+        return class;
+    }
+    if (is_builtin(name)) {
+        return NULL;
+    }
+
+    assert(class->loader != NULL && "Class was not loaded by a class loader");
+    class_file_t *resolved = class_loader_load(class->loader, name);
+    if (resolved == NULL) {
+        output_flush_all();
+        fprintf(stderr, "Class not found: %s\n", name);
+    }
+    assert(resolved != NULL && "Failed to resolve class");
+    return resolved;
+}
+
+void resolve_field(class_file_t *class, u2 index) {
+    if (class->resolved_fields[index]) {
+        return;
+    }
+    const constant_pool_t *constant_pool = &class->constant_pool;
+    assert(cp_tag(constant_pool, index) == CONSTANT_Fieldref && "Expected a FieldRef");
+    resolve_class(class, cp_class_index(constant_pool, index));
+    class->resolved_fields[index] = true;
+}
+
+method_t *resolve_method(class_file_t *class, u2 index) {
+    method_t *method = class->resolved_methods[index];
+    if (method != NULL) {
+        return method;
+    }
+
+    const constant_pool_t *constant_pool = &class->constant_pool;
+    assert(cp_tag(constant_pool, index) == CONSTANT_Methodref && "Expected a MethodRef");
+    class_file_t *target = resolve_class(class, cp_class_index(constant_pool, index));
+    assert(target != NULL && "Can't invoke methods of built-in classes");
+
+    u2 name_and_type = cp_name_and_type_index(constant_pool, index);
+    assert(cp_tag(constant_pool, name_and_type) == CONSTANT_NameAndType &&
+           "Expected a NameAndType");
+    u2 name = cp_name_index(constant_pool, name_and_type);
+    assert(cp_tag(constant_pool, name) == CONSTANT_Utf8 && "Expected a UTF8");
+    u2 descriptor = cp_descriptor_index(constant_pool, name_and_type);
+    assert(cp_tag(constant_pool, descriptor) == CONSTANT_Utf8 && "Expected a UTF8");
+
+    method = find_interned_method(cp_utf8(constant_pool, name),
+                                  cp_utf8(constant_pool, descriptor), target);
+    class->resolved_methods[index] = method;
+    return method;
+}
+
+static int compare_class_names(const void *a, const void *b) {
+    const class_file_t *const *first = a, *const *second = b;
+    return strcmp((*first)->name, (*second)->name);
+}
+
+class_file_t **class_loader_classes(class_loader_t *loader, size_t *count) {
+    pthread_mutex_lock(&loader->lock);
+    class_file_t **classes = malloc(sizeof(class_file_t *[loader->count + 1]));
+    assert(classes != NULL && "Failed to allocate class list");
+    size_t length = 0;
+    for (size_t i = 0; i < loader->capacity; i++) {
+        if (loader->classes[i] != NULL) {
+            classes[length++] = loader->classes[i];
+        }
+    }
+    pthread_mutex_unlock(&loader->lock);
+    qsort(classes, length, sizeof(class_file_t *), compare_class_names);
+    *count = length;
+    return classes;
+}
+
+void class_loader_link(class_loader_t *loader) {
+    // Resolving a call site can load another class, so repeat until none are loaded
+    size_t count;
+    do {
+        class_file_t **classes = class_loader_classes(loader, &count);
+        for (size_t i = 0; i < count; i++) {
+            for (method_t *method = classes[i]->methods; method->name != NULL;
+                 method++) {
+                if (method_invocable(method)) {
+                    prepare_method(method);
+                }
+            }
+
+            const constant_pool_t *constant_pool = &classes[i]->constant_pool;
+            for (u2 index = 1; index < constant_pool->count; index++) {
+                if (cp_tag(constant_pool, index) == CONSTANT_Fieldref) {
+                    resolve_field(classes[i], index);
+                }
+                if (cp_tag(constant_pool, index) != CONSTANT_Methodref) {
+                    continue;
+                }
+                u2 class_index = cp_class_index(constant_pool, index);
+                const char *class_name =
+                    cp_utf8(constant_pool, cp_string_index(constant_pool, class_index));
+                if (!is_builtin(class_name)) {
+                    resolve_method(classes[i], index);
+                }
+            }
+        }
+        free(classes);
+    } while (loader->count != count);
+}
+
+/** A class to parse and verify on the thread pool */
+typedef struct {
+    class_loader_t *loader;
+    const char *name;
+    /** The parsed class, or NULL if it isn't on the classpath */
+    class_file_t *class;
+} load_task_t;
+
+static void load_task(void *argument) {
+    load_task_t *task = argument;
+    task->class = classpath_read(task->loader, task->name);
+    // Loading eagerly, so prepare every method now rather than on first invoke
+    if (task->class != NULL) {
+        for (method_t *method = task->class->methods; method->name != NULL; method++) {
+            if (method_invocable(method)) {
+                prepare_method(method);
+            }
+        }
+    }
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(const char *const *) a, *(const char *const *) b);
+}
+
+static bool contains_name(const char **names, size_t count, const char *name) {
+    for (size_t i = 0; i < count; i++) {
+        if (names[i] == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Appends a name to a growable array of names.
+ */
+static void push_name(const char ***names, size_t *count, const char *name) {
+    // Grow whenever the count reaches a power of two
+    if ((*count & (*count - 1)) == 0) {
+        *names = realloc(*names, sizeof(const char *[*count == 0 ? 1 : 2 * *count]));
+        assert(*names != NULL && "Failed to allocate class names");
+    }
+    (*names)[(*count)++] = name;
+}
+
+void class_loader_preload(class_loader_t *loader, size_t threads) {
+    thread_pool_t *pool = thread_pool_init(threads);
+    // Classes that are referenced but aren't on the classpath, so they aren't retried
+    const char **missing = NULL;
+    size_t missing_count = 0;
+    while (true) {
+        // Find the classes referenced by the loaded classes that haven't been loaded
+        const char **names = NULL;
+        size_t name_count = 0;
+        size_t class_count;
+        class_file_t **classes = class_loader_classes(loader, &class_count);
+        for (size_t i = 0; i < class_count; i++) {
+            const constant_pool_t *constant_pool = &classes[i]->constant_pool;
+            for (u2 index = 1; index < constant_pool->count; index++) {
+                if (cp_tag(constant_pool, index) != CONSTANT_Class) {
+                    continue;
+                }
+                const char *name =
+                    cp_utf8(constant_pool, cp_string_index(constant_pool, index));
+                // Array classes like "[I" are built in, like the "java/" package
+                if (!is_builtin(name) && name[0] != '[' &&
+                    class_find(loader, name) == NULL &&
+                    !contains_name(missing, missing_count, name)) {
+                    push_name(&names, &name_count, name);
+                }
+            }
+        }
+        free(classes);
+        if (name_count == 0) {
+            break;
+        }
+
+        // Sort the names, dropping duplicates (names are interned)
+        qsort(names, name_count, sizeof(const char *), compare_names);
+        size_t unique_count = 0;
+        for (size_t i = 0; i < name_count; i++) {
+            if (unique_count == 0 || names[unique_count - 1] != names[i]) {
+                names[unique_count++] = names[i];
+            }
+        }
+
+        // These classes don't depend on each other, so they can load concurrently
+        load_task_t *tasks = malloc(sizeof(load_task_t[unique_count]));
+        assert(tasks != NULL && "Failed to allocate load tasks");
+        for (size_t i = 0; i < unique_count; i++) {
+            tasks[i] = (load_task_t){.loader = loader, .name = names[i], .class = NULL};
+            thread_pool_submit(pool, load_task, &tasks[i]);
+        }
+        thread_pool_wait(pool);
+
+        // Register in name order, so the result doesn't depend on thread timing
+        for (size_t i = 0; i < unique_count; i++) {
+            if (tasks[i].class != NULL) {
+                class_publish(loader, tasks[i].class);
+            }
+            else {
+                push_name(&missing, &missing_count, tasks[i].name);
+            }
+        }
+        free(tasks);
+        free(names);
+    }
+    free(missing);
+    thread_pool_free(pool);
+}
+
+bool class_loader_stale(class_loader_t *loader) {
+    pthread_mutex_lock(&loader->lock);
+    bool stale = false;
+    for (size_t i = 0; !stale && i < loader->source_count; i++) {
+        const class_source_t *source = &loader->sources[i];
+        struct stat status;
+        stale = stat(source->path, &status) != 0 ||
+                status.st_mtim.tv_sec != source->modified.tv_sec ||
+                status.st_mtim.tv_nsec != source->modified.tv_nsec;
+    }
+    pthread_mutex_unlock(&loader->lock);
+    return stale;
+}
+
+void class_loader_free(class_loader_t *loader) {
+    for (size_t i = 0; i < loader->capacity; i++) {
+        if (loader->classes[i] != NULL) {
+            free_class(loader->classes[i]);
+        }
+    }
+    free(loader->classes);
+
+    for (size_t i = 0; i < loader->classpath_length; i++) {
+        if (loader->classpath[i].archive != NULL) {
+            zip_close(loader->classpath[i].archive);
+        }
+        free(loader->classpath[i].directory);
+    }
+    free(loader->classpath);
+    for (size_t i = 0; i < loader->source_count; i++) {
+        free(loader->sources[i].path);
+    }
+    free(loader->sources);
+    pthread_mutex_destroy(&loader->lock);
+    free(loader);
+}
@@ -0,0 +1,139 @@
+#ifndef CLASS_LOADER_H
+#define CLASS_LOADER_H
+
+#include "class_file.h"
+
+/**
+ * A registry of loaded classes, keyed by internal name (e.g. "pkg/Main"), together
+ * with the classpath that classes are loaded from. Classes are loaded lazily: only
+ * when a reference to them is first resolved. Each method's code is only decoded
+ * and verified when the method is first invoked (see `prepare_method()`).
+ *
+ * Classes may be loaded from several threads at once. Each class is parsed outside
+ * the loader's lock; if two threads race to load the same class, both get the copy
+ * that was registered first.
+ */
+typedef struct class_loader class_loader_t;
+
+/**
+ * Creates a class loader.
+ *
+ * @param classpath a colon-separated list of directories and JAR (zip) archives,
+ *   or NULL to use the directory containing the first class loaded by path
+ * @return the class loader
+ */
+class_loader_t *class_loader_init(const char *classpath);
+
+/**
+ * Loads a class by name, searching the classpath entries in order.
+ * Loading a class that has already been loaded returns the same class.
+ *
+ * @param loader the class loader
+ * @param name the class's internal name, e.g. "pkg/Main"
+ * @return the class, or NULL if no classpath entry contains it
+ */
+class_file_t *class_loader_load(class_loader_t *loader, const char *name);
+
+/**
+ * Loads the class file at the given path and registers it under its own name.
+ * If a class with that name has already been loaded, that class is returned instead.
+ *
+ * @param loader the class loader
+ * @param path the path of the class file
+ * @return the class, or NULL if the file can't be opened
+ */
+class_file_t *class_loader_load_file(class_loader_t *loader, const char *path);
+
+/**
+ * Loads a program's main class, which is given either by the path of its class file
+ * (ending in ".class") or by its name on the classpath.
+ *
+ * @param loader the class loader
+ * @param main_class the class file's path or the class's name
+ * @return the class, or NULL if it can't be found
+ */
+class_file_t *class_loader_load_main(class_loader_t *loader, const char *main_class);
+
+/**
+ * Registers an already parsed class, e.g. one read from an image (see image.h),
+ * so that references to it resolve to it. The loader takes ownership of the class.
+ *
+ * @param loader the class loader
+ * @param class the class, which must not have the same name as a loaded class
+ */
+void class_loader_register(class_loader_t *loader, class_file_t *class);
+
+/**
+ * Gets every class the loader has loaded.
+ *
+ * @param loader the class loader
+ * @param count set to the number of classes
+ * @return a heap-allocated array of the classes, sorted by name
+ */
+class_file_t **class_loader_classes(class_loader_t *loader, size_t *count);
+
+/**
+ * Eagerly loads every class reachable from the loaded classes, parsing them and
+ * preparing their methods on a pool of threads. Classes are loaded a level of
+ * references at a time: the classes referenced by the loaded classes (which can't
+ * depend on each other) load concurrently, and are then registered in name order,
+ * so the result is the same however the threads are scheduled. Referenced classes
+ * that aren't on the classpath are skipped; resolving them later fails as usual.
+ *
+ * @param loader the class loader
+ * @param threads the number of threads to load on, or 0 for one per online CPU
+ */
+void class_loader_preload(class_loader_t *loader, size_t threads);
+
+/**
+ * Checks whether any class file or archive that the loader has read classes from
+ * has been modified or removed since it was read.
+ */
+bool class_loader_stale(class_loader_t *loader);
+
+/**
+ * Resolves every field and method reference of every loaded class, loading the
+ * classes they refer to, until every call site outside the built-in classes and
+ * every field access has been resolved.
+ * Every method the interpreter can invoke is prepared as well, so once a loader is
+ * linked its classes are never modified again and can be shared freely between
+ * threads.
+ */
+void class_loader_link(class_loader_t *loader);
+
+/**
+ * Resolves a Class constant, loading the class if it hasn't been loaded yet.
+ * Classes in the "java/" package are provided by the VM itself and are never loaded.
+ *
+ * @param class the class whose constant pool holds the constant
+ * @param index the constant pool index of the Class constant
+ * @return the class, or NULL if it is a built-in class
+ */
+class_file_t *resolve_class(class_file_t *class, u2 index);
+
+/**
+ * Resolves the class of a Fieldref constant, loading it if it hasn't been loaded yet,
+ * and records in `class->resolved_fields` that the constant has been resolved.
+ *
+ * @param class the class whose constant pool holds the constant
+ * @param index the constant pool index of the Fieldref constant
+ */
+void resolve_field(class_file_t *class, u2 index);
+
+/**
+ * Resolves a Methodref constant to the method it names, loading the method's class
+ * if necessary. The result is cached, so later calls through the same constant
+ * don't need to look the method up again.
+ *
+ * @param class the class whose constant pool holds the constant
+ * @param index the constant pool index of the Methodref constant
+ * @return the method, or NULL if it wasn't found
+ */
+method_t *resolve_method(class_file_t *class, u2 index);
+
+/**
+ * Frees a class loader along with every class it has loaded.
+ */
+void class_loader_free(class_loader_t *loader);
+
+#endif /* CLASS_LOADER_H */
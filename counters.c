@@ -0,0 +1,381 @@
+#include "counters.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/** The number of hardware events, which follow wall-clock time in the counters */
+#define EVENT_COUNT (COUNTER_COUNT - 1)
+
+typedef struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} counter_event_t;
+
+/** A cache event: reads from `cache` that missed */
+#define CACHE_READ_MISSES(cache)                                                        \
+    ((cache) | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+
+static const counter_event_t EVENTS[EVENT_COUNT] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"L1D-misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_L1D)},
+    {"LLC-misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_LL)}};
+
+/** The indices of some events in `EVENTS` */
+enum { CYCLES_EVENT = 0, INSTRUCTIONS_EVENT = 1 };
+
+/** Counters hold wall-clock time, then each event's count */
+#define TIME_COUNTER 0
+#define EVENT_COUNTER(event) ((event) + 1)
+
+/** One method's counts on one thread */
+typedef struct {
+    uint64_t calls;
+    /** The number of the method's calls in progress on the thread */
+    uint64_t active;
+    uint64_t inclusive[COUNTER_COUNT];
+    uint64_t exclusive[COUNTER_COUNT];
+} method_counts_t;
+
+/** One thread's counters, and the counts it has taken */
+typedef struct counters_thread {
+    /** Each event's perf_event_open() file descriptor, or -1 if it's unavailable */
+    int fds[EVENT_COUNT];
+    /** Each event's mapped page, for reading it with rdpmc, or NULL */
+    struct perf_event_mmap_page *pages[EVENT_COUNT];
+    /** The innermost call in progress */
+    counters_frame_t *frame;
+    /** The counts of each method, indexed by its id */
+    method_counts_t *methods;
+    size_t method_capacity;
+    /** The next thread (see `register_thread()`) */
+    struct counters_thread *next;
+} counters_thread_t;
+
+bool counters_enabled = false;
+static _Thread_local counters_thread_t *current_thread = NULL;
+
+/** Protects everything below */
+static pthread_mutex_t counters_lock = PTHREAD_MUTEX_INITIALIZER;
+/** Every thread's counters, newest first */
+static counters_thread_t *threads;
+/** Every method that has been called, indexed by its id */
+static method_t **methods;
+static size_t method_count;
+static size_t method_capacity;
+/** Which events could be opened by the first thread; later threads only try those */
+static bool event_available[EVENT_COUNT];
+static size_t report_rows;
+
+static int open_event(const counter_event_t *event) {
+    struct perf_event_attr attributes = {.size = sizeof(attributes),
+                                         .type = event->type,
+                                         .config = event->config,
+                                         .exclude_kernel = 1,
+                                         .exclude_hv = 1};
+    // Count the calling thread, on any CPU
+    return (int) syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+}
+
+/** Opens the calling thread's counters. Called with `counters_lock` held. */
+static counters_thread_t *register_thread(void) {
+    counters_thread_t *thread = calloc(1, sizeof(*thread));
+    assert(thread != NULL && "Failed to allocate counters");
+    long page_size = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < EVENT_COUNT; i++) {
+        thread->fds[i] = event_available[i] ? open_event(&EVENTS[i]) : -1;
+        if (thread->fds[i] >= 0) {
+            void *page = mmap(NULL, page_size, PROT_READ, MAP_SHARED, thread->fds[i], 0);
+            thread->pages[i] = page != MAP_FAILED ? page : NULL;
+        }
+    }
+    thread->next = threads;
+    threads = thread;
+    current_thread = thread;
+    return thread;
+}
+
+#if defined(__x86_64__)
+static inline uint64_t rdpmc(uint32_t counter) {
+    uint32_t low, high;
+    __asm__ volatile("rdpmc" : "=a"(low), "=d"(high) : "c"(counter));
+    return (uint64_t) high << 32 | low;
+}
+
+/**
+ * Reads an event with rdpmc, following the protocol documented in
+ * linux/perf_event.h.
+ *
+ * @return whether the kernel let it be read that way
+ */
+static bool read_event_rdpmc(volatile struct perf_event_mmap_page *page,
+                             uint64_t *count) {
+    uint32_t sequence;
+    bool readable;
+    do {
+        sequence = page->lock;
+        atomic_signal_fence(memory_order_seq_cst);
+        uint32_t index = page->index;
+        readable = page->cap_user_rdpmc && index != 0;
+        if (readable) {
+            // The counter is pmc_width bits wide, and signed
+            unsigned shift = 64 - page->pmc_width;
+            int64_t value = (int64_t) (rdpmc(index - 1) << shift) >> shift;
+            *count = page->offset + (uint64_t) value;
+        }
+        atomic_signal_fence(memory_order_seq_cst);
+    } while (page->lock != sequence);
+    return readable;
+}
+#endif
+
+static uint64_t read_event(const counters_thread_t *thread, size_t event) {
+    if (thread->fds[event] < 0) {
+        return 0;
+    }
+    uint64_t count = 0;
+#if defined(__x86_64__)
+    if (thread->pages[event] != NULL && read_event_rdpmc(thread->pages[event], &count)) {
+        return count;
+    }
+#endif
+    if (read(thread->fds[event], &count, sizeof(count)) != sizeof(count)) {
+        return 0;
+    }
+    return count;
+}
+
+static void read_counters(const counters_thread_t *thread, uint64_t counters[]) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    counters[TIME_COUNTER] = (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+    for (size_t i = 0; i < EVENT_COUNT; i++) {
+        counters[EVENT_COUNTER(i)] = read_event(thread, i);
+    }
+}
+
+/** Gets the id of a method, giving it one the first time it is called */
+static u4 method_id(method_t *method) {
+    u4 id = atomic_load_explicit(&method->counters_id, memory_order_acquire);
+    if (id != 0) {
+        return id - 1;
+    }
+    pthread_mutex_lock(&counters_lock);
+    // Another thread may have given it one first
+    id = atomic_load_explicit(&method->counters_id, memory_order_relaxed);
+    if (id == 0) {
+        if (method_count == method_capacity) {
+            method_capacity = method_capacity > 0 ? method_capacity * 2 : 64;
+            methods = realloc(methods, sizeof(method_t *[method_capacity]));
+            assert(methods != NULL && "Failed to allocate counters");
+        }
+        methods[method_count++] = method;
+        id = method_count;
+        atomic_store_explicit(&method->counters_id, id, memory_order_release);
+    }
+    pthread_mutex_unlock(&counters_lock);
+    return id - 1;
+}
+
+void counters_enter(counters_frame_t *frame, method_t *method) {
+    counters_thread_t *thread = current_thread;
+    if (thread == NULL) {
+        pthread_mutex_lock(&counters_lock);
+        thread = register_thread();
+        pthread_mutex_unlock(&counters_lock);
+    }
+    u4 id = method_id(method);
+    if (id >= thread->method_capacity) {
+        size_t capacity = thread->method_capacity > 0 ? thread->method_capacity : 64;
+        while (capacity <= id) {
+            capacity *= 2;
+        }
+        thread->methods = realloc(thread->methods, sizeof(method_counts_t[capacity]));
+        assert(thread->methods != NULL && "Failed to allocate counters");
+        memset(&thread->methods[thread->method_capacity], 0,
+               sizeof(method_counts_t[capacity - thread->method_capacity]));
+        thread->method_capacity = capacity;
+    }
+    thread->methods[id].active++;
+
+    frame->method = id;
+    memset(frame->callees, 0, sizeof(frame->callees));
+    frame->caller = thread->frame;
+    thread->frame = frame;
+    // Read last, so that little of the above is counted
+    read_counters(thread, frame->start);
+}
+
+void counters_leave(counters_frame_t *frame) {
+    uint64_t end[COUNTER_COUNT];
+    counters_thread_t *thread = current_thread;
+    read_counters(thread, end);
+
+    method_counts_t *counts = &thread->methods[frame->method];
+    counts->calls++;
+    bool outermost = --counts->active == 0;
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        uint64_t inclusive = end[i] - frame->start[i];
+        counts->exclusive[i] += inclusive - frame->callees[i];
+        if (outermost) {
+            counts->inclusive[i] += inclusive;
+        }
+        if (frame->caller != NULL) {
+            frame->caller->callees[i] += inclusive;
+        }
+    }
+    thread->frame = frame->caller;
+}
+
+void counters_start(size_t rows) {
+    assert(!counters_enabled && "Counters already started");
+    report_rows = rows;
+    bool any_available = false;
+    int error = 0;
+    for (size_t i = 0; i < EVENT_COUNT; i++) {
+        int fd = open_event(&EVENTS[i]);
+        if (fd >= 0) {
+            close(fd);
+            event_available[i] = true;
+            any_available = true;
+        }
+        else if (error == 0) {
+            error = errno;
+        }
+    }
+    if (!any_available) {
+        fprintf(stderr,
+                "Hardware performance counters are unavailable (%s), so only time is "
+                "counted\n",
+                strerror(error));
+    }
+    counters_enabled = true;
+}
+
+/** Every thread's counts of one method */
+typedef struct {
+    method_t *method;
+    method_counts_t counts;
+} method_total_t;
+
+/** The counter methods are ranked by */
+static size_t rank_counter;
+
+/** Orders methods by exclusive counts, most first */
+static int compare_exclusive(const void *a, const void *b) {
+    uint64_t a_count = ((const method_total_t *) a)->counts.exclusive[rank_counter];
+    uint64_t b_count = ((const method_total_t *) b)->counts.exclusive[rank_counter];
+    return (a_count < b_count) - (a_count > b_count);
+}
+
+/** Prints one line of a method's counts */
+static void print_counts(const char *label, const uint64_t counts[]) {
+    fprintf(stderr, "  %-10s %16" PRIu64, label, counts[TIME_COUNTER]);
+    for (size_t i = 0; i < EVENT_COUNT; i++) {
+        if (event_available[i]) {
+            fprintf(stderr, " %16" PRIu64, counts[EVENT_COUNTER(i)]);
+        }
+    }
+    fprintf(stderr, "\n");
+}
+
+static void print_report(void) {
+    method_total_t *totals = calloc(method_count + 1, sizeof(method_total_t));
+    assert(totals != NULL && "Failed to allocate counters");
+    for (size_t id = 0; id < method_count; id++) {
+        totals[id].method = methods[id];
+        for (counters_thread_t *thread = threads; thread != NULL; thread = thread->next) {
+            if (id >= thread->method_capacity) {
+                continue;
+            }
+            const method_counts_t *counts = &thread->methods[id];
+            totals[id].counts.calls += counts->calls;
+            for (size_t i = 0; i < COUNTER_COUNT; i++) {
+                totals[id].counts.inclusive[i] += counts->inclusive[i];
+                totals[id].counts.exclusive[i] += counts->exclusive[i];
+            }
+        }
+    }
+    bool have_cycles = event_available[CYCLES_EVENT];
+    rank_counter = have_cycles ? EVENT_COUNTER(CYCLES_EVENT) : TIME_COUNTER;
+    qsort(totals, method_count, sizeof(totals[0]), compare_exclusive);
+
+    fprintf(stderr, "Methods by exclusive %s\n",
+            have_cycles ? EVENTS[CYCLES_EVENT].name : "time");
+    fprintf(stderr, "  %-10s %16s", "", "ns");
+    for (size_t i = 0; i < EVENT_COUNT; i++) {
+        if (event_available[i]) {
+            fprintf(stderr, " %16s", EVENTS[i].name);
+        }
+    }
+    fprintf(stderr, "\n");
+    size_t rows = method_count;
+    if (report_rows > 0 && report_rows < rows) {
+        rows = report_rows;
+    }
+    for (size_t row = 0; row < rows; row++) {
+        const method_total_t *total = &totals[row];
+        const uint64_t *exclusive = total->counts.exclusive;
+        fprintf(stderr, "%s.%s%s, %" PRIu64 " calls\n", total->method->class->name,
+                total->method->name, total->method->descriptor, total->counts.calls);
+        print_counts("exclusive", exclusive);
+        print_counts("inclusive", total->counts.inclusive);
+        // What the method's own code is limited by, per instruction
+        uint64_t cycles = exclusive[EVENT_COUNTER(CYCLES_EVENT)];
+        uint64_t instructions = exclusive[EVENT_COUNTER(INSTRUCTIONS_EVENT)];
+        if (have_cycles && event_available[INSTRUCTIONS_EVENT] && cycles > 0 &&
+            instructions > 0) {
+            fprintf(stderr, "  %-10s IPC %.2f", "",
+                    (double) instructions / (double) cycles);
+            for (size_t i = INSTRUCTIONS_EVENT + 1; i < EVENT_COUNT; i++) {
+                if (event_available[i]) {
+                    fprintf(stderr, ", %s %.2f", EVENTS[i].name,
+                            (double) exclusive[EVENT_COUNTER(i)] * 1000 /
+                                (double) instructions);
+                }
+            }
+            fprintf(stderr, " per 1000 instructions\n");
+        }
+    }
+    free(totals);
+}
+
+void counters_stop(void) {
+    if (!counters_enabled) {
+        return;
+    }
+    counters_enabled = false;
+    print_report();
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    while (threads != NULL) {
+        counters_thread_t *thread = threads;
+        threads = thread->next;
+        for (size_t i = 0; i < EVENT_COUNT; i++) {
+            if (thread->pages[i] != NULL) {
+                munmap(thread->pages[i], page_size);
+            }
+            if (thread->fds[i] >= 0) {
+                close(thread->fds[i]);
+            }
+        }
+        free(thread->methods);
+        free(thread);
+    }
+    current_thread = NULL;
+    free(methods);
+    methods = NULL;
+    method_count = method_capacity = 0;
+}
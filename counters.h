@@ -0,0 +1,78 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "class_file.h"
+
+/**
+ * Hardware performance counters per Java method (see `--perf-counters` in main.c),
+ * for telling whether a hot method is limited by mispredicted dispatch branches, by
+ * cache misses on array accesses, or by the arithmetic itself.
+ *
+ * Each thread that runs bytecode opens its own counters with perf_event_open():
+ * cycles, instructions, branch misses, L1 data cache read misses and last-level
+ * cache read misses. Wall-clock time is counted too, so if the hardware counters
+ * can't be opened (e.g. in a VM without a PMU, or if perf_event_paranoid forbids
+ * it), methods are still ranked by time. Counters are read on every call's entry
+ * and exit, with rdpmc where the kernel allows it and read() otherwise.
+ *
+ * A method's exclusive counts leave out the methods it calls, and its inclusive
+ * counts include them. Inclusive counts of recursive calls are only taken at the
+ * outermost call, so that they aren't counted more than once. Counts are kept per
+ * thread and added up when the table is printed, at exit.
+ */
+
+/** The number of counters: wall-clock time, then the hardware events */
+#define COUNTER_COUNT 6
+
+/**
+ * A call in progress. It lives on the C stack of the `execute()` call it counts.
+ */
+typedef struct counters_frame {
+    /** The method's id, an index into each thread's per-method counts */
+    u4 method;
+    /** The counters when the call started */
+    uint64_t start[COUNTER_COUNT];
+    /** The inclusive counts of the calls this call has made */
+    uint64_t callees[COUNTER_COUNT];
+    /** The frame of the calling method, or NULL */
+    struct counters_frame *caller;
+} counters_frame_t;
+
+/** Whether calls are being counted. Only changes while no bytecode is running. */
+extern bool counters_enabled;
+
+/**
+ * Starts counting calls. This must be done before any bytecode runs, and at most
+ * once per process. If the hardware counters are unavailable, this says so on
+ * stderr and counts time only.
+ *
+ * @param rows the number of methods to print at exit, or 0 for all of them
+ */
+void counters_start(size_t rows);
+
+/**
+ * Stops counting calls, and prints the methods with the most exclusive cycles (or
+ * time) to stderr. Call this once no bytecode is running.
+ */
+void counters_stop(void);
+
+/**
+ * Reads the calling thread's counters at the start of a call.
+ *
+ * @param frame the call's frame, which must stay in place until `counters_leave()`
+ * @param method the method called
+ */
+void counters_enter(counters_frame_t *frame, method_t *method);
+
+/**
+ * Reads the calling thread's counters at the end of a call, and adds the call's
+ * counts to its method.
+ */
+void counters_leave(counters_frame_t *frame);
+
+#endif /* COUNTERS_H */
@@ -0,0 +1,662 @@
+#include "daemon.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "class_loader.h"
+#include "heap.h"
+#include "jvm.h"
+#include "output.h"
+
+/** How long a client may take to send its request, in seconds */
+const time_t REQUEST_TIMEOUT = 5;
+/** How many clients may wait to be accepted */
+const int LISTEN_BACKLOG = 64;
+
+/**
+ * A program's classes, loaded and linked in a process of their own: a zygote, which
+ * forks a run for each request so that every run inherits the loaded classes. A
+ * class that fails to load or link only takes the zygote down, never the daemon.
+ */
+typedef struct {
+    /** The main class, as given in the request */
+    char *main_class;
+    pid_t pid;
+    /**
+     * The daemon's end of a socket pair with the zygote. Run requests go to the
+     * zygote, along with the client's streams, and each run's result comes back.
+     * The zygote's runs hold the other end too, so once it is closed at the daemon's
+     * end, every run the zygote started has sent its result.
+     */
+    int channel;
+    /** Whether the classes went stale, so new runs shouldn't go to the zygote */
+    bool retired;
+} cached_program_t;
+
+/** A run request, sent to a zygote along with the client's stdout and stderr */
+typedef struct {
+    uint64_t run_id;
+} zygote_request_t;
+
+/** What a zygote sends back about a run */
+typedef struct {
+    uint64_t run_id;
+    /** Whether the classes were stale, so the zygote didn't start the run */
+    bool stale;
+    /** The run's wait() status, if it was started */
+    int status;
+} zygote_result_t;
+
+/** A run in progress, in a child process or in a zygote's */
+typedef struct {
+    uint64_t id;
+    /** The run's process, or 0 if a zygote forked it */
+    pid_t pid;
+    /** The zygote that forked the run, or 0 */
+    pid_t zygote;
+    /** The client's connection, which gets the reply once the run finishes */
+    int connection;
+    /** The client's stdout and stderr, in case the run has to be started again */
+    int client_fds[2];
+    /** The main class, as given in the request */
+    char *main_class;
+    /** Whether the run loads its own classes, rather than inheriting a zygote's */
+    bool uncached;
+} daemon_run_t;
+
+typedef struct {
+    const char *classpath;
+    const daemon_limits_t *limits;
+    int listener;
+    cached_program_t *cache;
+    size_t cache_count;
+    daemon_run_t *runs;
+    size_t run_count;
+    uint64_t next_run_id;
+} daemon_t;
+
+/** Written to when a child exits, so that poll() wakes up to reap it */
+static int child_exited[2];
+
+static void on_child_exit(int signal) {
+    (void) signal;
+    int saved_errno = errno;
+    ssize_t written = write(child_exited[1], "", 1);
+    (void) written;
+    errno = saved_errno;
+}
+
+/**
+ * Closes the daemon's file descriptors in a child process, which only needs its own
+ * client's streams (or, in a zygote, its channel).
+ *
+ * @param keep the run whose client's streams to leave open, or NULL
+ */
+static void close_daemon_fds(const daemon_t *daemon, const daemon_run_t *keep) {
+    close(daemon->listener);
+    close(child_exited[0]);
+    close(child_exited[1]);
+    for (size_t i = 0; i < daemon->run_count; i++) {
+        const daemon_run_t *run = &daemon->runs[i];
+        close(run->connection);
+        if (run != keep) {
+            close(run->client_fds[0]);
+            close(run->client_fds[1]);
+        }
+    }
+    for (size_t i = 0; i < daemon->cache_count; i++) {
+        close(daemon->cache[i].channel);
+    }
+    signal(SIGCHLD, SIG_DFL);
+}
+
+/**
+ * Runs a program with the client's stdout and stderr, in a child process.
+ * This never returns.
+ *
+ * @param class the program's main class, inherited from a zygote, or NULL to load
+ *   it (lazily, like a standalone run)
+ */
+static void run_program(const daemon_t *daemon, const char *main_class,
+                        class_file_t *class, const int *client_fds) {
+    if (dup2(client_fds[0], STDOUT_FILENO) < 0 ||
+        dup2(client_fds[1], STDERR_FILENO) < 0) {
+        _exit(EXIT_FAILURE);
+    }
+    close(client_fds[0]);
+    close(client_fds[1]);
+    signal(SIGPIPE, SIG_DFL);
+
+    const daemon_limits_t *limits = daemon->limits;
+    if (limits->memory_limit > 0) {
+        struct rlimit memory = {.rlim_cur = limits->memory_limit,
+                                .rlim_max = limits->memory_limit};
+        setrlimit(RLIMIT_AS, &memory);
+    }
+    // SIGALRM isn't handled, so it kills the run
+    alarm(limits->time_limit);
+
+    if (class == NULL) {
+        class_loader_t *loader = class_loader_init(daemon->classpath);
+        class = class_loader_load_main(loader, main_class);
+        if (class == NULL) {
+            fprintf(stderr, "Main class not found: %s\n", main_class);
+            _exit(EXIT_FAILURE);
+        }
+    }
+
+    heap_t *heap = heap_init();
+    output_t *output = output_init(stdout);
+    execute_main(class, heap, output);
+    output_free(output);
+    // Everything is freed with the process, and the daemon's state isn't ours to free
+    _exit(EXIT_SUCCESS);
+}
+
+/**
+ * Sends a run request to a zygote.
+ *
+ * @return whether it was sent
+ */
+static bool send_run(int channel, const daemon_run_t *run) {
+    zygote_request_t request = {.run_id = run->id};
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int[2]))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec data = {.iov_base = &request, .iov_len = sizeof(request)};
+    struct msghdr message = {.msg_iov = &data,
+                             .msg_iovlen = 1,
+                             .msg_control = control.buffer,
+                             .msg_controllen = sizeof(control.buffer)};
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int[2]));
+    memcpy(CMSG_DATA(header), run->client_fds, sizeof(int[2]));
+    return sendmsg(channel, &message, MSG_NOSIGNAL) == (ssize_t) sizeof(request);
+}
+
+/**
+ * Receives a run request in a zygote.
+ *
+ * @return false once the daemon has closed the channel
+ */
+static bool receive_run(int channel, zygote_request_t *request, int *client_fds) {
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int[2]))];
+    } control;
+    struct iovec data = {.iov_base = request, .iov_len = sizeof(*request)};
+    struct msghdr message = {.msg_iov = &data,
+                             .msg_iovlen = 1,
+                             .msg_control = control.buffer,
+                             .msg_controllen = sizeof(control.buffer)};
+    ssize_t received;
+    do {
+        received = recvmsg(channel, &message, 0);
+    } while (received < 0 && errno == EINTR);
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (received != sizeof(*request) || header == NULL ||
+        header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN(sizeof(int[2]))) {
+        return false;
+    }
+    memcpy(client_fds, CMSG_DATA(header), sizeof(int[2]));
+    return true;
+}
+
+/**
+ * Runs a zygote: loads and links a program's classes, then forks a run for each
+ * request until the daemon closes the channel. This never returns.
+ *
+ * Each run is forked by a waiter process, which sends the run's result once it
+ * exits, so that the zygote itself never waits for its runs.
+ */
+static void run_zygote(const daemon_t *daemon, const char *main_class, int channel) {
+    close_daemon_fds(daemon, NULL);
+    // Waiters are reaped as soon as they exit
+    signal(SIGCHLD, SIG_IGN);
+
+    class_loader_t *loader = class_loader_init(daemon->classpath);
+    class_file_t *class = class_loader_load_main(loader, main_class);
+    if (class == NULL) {
+        _exit(EXIT_FAILURE);
+    }
+    class_loader_link(loader);
+
+    // Once the classes are stale they stay stale, so no more runs start here
+    bool stale = false;
+    zygote_request_t request;
+    int client_fds[2];
+    while (receive_run(channel, &request, client_fds)) {
+        stale = stale || class_loader_stale(loader);
+        zygote_result_t result = {.run_id = request.run_id,
+                                  .stale = stale,
+                                  .status = W_EXITCODE(EXIT_FAILURE, 0)};
+        pid_t waiter = stale ? -1 : fork();
+        if (waiter == 0) {
+            signal(SIGCHLD, SIG_DFL);
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(channel);
+                run_program(daemon, main_class, class, client_fds);
+            }
+            close(client_fds[0]);
+            close(client_fds[1]);
+            while (pid > 0 && waitpid(pid, &result.status, 0) < 0 && errno == EINTR) {
+            }
+            send(channel, &result, sizeof(result), MSG_NOSIGNAL);
+            _exit(EXIT_SUCCESS);
+        }
+        if (waiter < 0) {
+            // If the classes are stale, the daemon starts the run itself instead
+            send(channel, &result, sizeof(result), MSG_NOSIGNAL);
+        }
+        close(client_fds[0]);
+        close(client_fds[1]);
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+/**
+ * Finds the zygote with a program's classes.
+ *
+ * @return the zygote, or NULL if the program isn't cached
+ */
+static cached_program_t *cache_find(daemon_t *daemon, const char *main_class) {
+    for (size_t i = 0; i < daemon->cache_count; i++) {
+        cached_program_t *program = &daemon->cache[i];
+        if (!program->retired && strcmp(program->main_class, main_class) == 0) {
+            return program;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Starts a zygote for a program, once a run has shown that its classes load.
+ * The daemon itself never loads any classes.
+ */
+static void cache_add(daemon_t *daemon, const char *main_class) {
+    if (cache_find(daemon, main_class) != NULL) {
+        return;
+    }
+    int channel[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, channel) != 0) {
+        return;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(channel[0]);
+        run_zygote(daemon, main_class, channel[1]);
+    }
+    close(channel[1]);
+    if (pid < 0) {
+        close(channel[0]);
+        return;
+    }
+
+    daemon->cache =
+        realloc(daemon->cache, sizeof(cached_program_t[daemon->cache_count + 1]));
+    assert(daemon->cache != NULL && "Failed to allocate class cache");
+    char *key = strdup(main_class);
+    assert(key != NULL && "Failed to allocate class cache");
+    daemon->cache[daemon->cache_count++] = (cached_program_t){
+        .main_class = key, .pid = pid, .channel = channel[0], .retired = false};
+}
+
+/**
+ * Stops a zygote by closing its channel, once none of its runs are in progress.
+ * It exits once it sees the channel close, and is reaped like any other child.
+ */
+static void cache_remove(daemon_t *daemon, cached_program_t *program) {
+    free(program->main_class);
+    close(program->channel);
+    *program = daemon->cache[--daemon->cache_count];
+}
+
+/** Stops the zygotes with stale classes that have no runs in progress */
+static void cache_remove_retired(daemon_t *daemon) {
+    for (size_t i = 0; i < daemon->cache_count;) {
+        cached_program_t *program = &daemon->cache[i];
+        bool busy = false;
+        for (size_t j = 0; !busy && j < daemon->run_count; j++) {
+            busy = daemon->runs[j].zygote == program->pid;
+        }
+        if (program->retired && !busy) {
+            cache_remove(daemon, program);
+        }
+        else {
+            i++;
+        }
+    }
+}
+
+/**
+ * Starts a run in a child process that loads the program's classes itself.
+ *
+ * @return whether the child could be forked
+ */
+static bool start_uncached(daemon_t *daemon, daemon_run_t *run) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        close_daemon_fds(daemon, run);
+        run_program(daemon, run->main_class, NULL, run->client_fds);
+    }
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    run->pid = pid;
+    run->zygote = 0;
+    run->uncached = true;
+    return true;
+}
+/**
+ * Receives a request line, along with the client's stdout and stderr.
+ *
+ * @return whether a complete request was received
+ */
+static bool receive_request(int connection, char *request, int *client_fds) {
+    client_fds[0] = client_fds[1] = -1;
+    struct timeval timeout = {.tv_sec = REQUEST_TIMEOUT};
+    setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int[2]))];
+    } control;
+    struct iovec data = {.iov_base = request, .iov_len = DAEMON_MAX_REQUEST};
+    struct msghdr message = {.msg_iov = &data,
+                             .msg_iovlen = 1,
+                             .msg_control = control.buffer,
+                             .msg_controllen = sizeof(control.buffer)};
+    ssize_t received = recvmsg(connection, &message, 0);
+    if (received <= 0) {
+        return false;
+    }
+
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (header != NULL && header->cmsg_level == SOL_SOCKET &&
+        header->cmsg_type == SCM_RIGHTS &&
+        header->cmsg_len == CMSG_LEN(sizeof(int[2]))) {
+        memcpy(client_fds, CMSG_DATA(header), sizeof(int[2]));
+    }
+
+    // The rest of the line may arrive separately
+    size_t length = received;
+    while (memchr(request, '\n', length) == NULL && length < DAEMON_MAX_REQUEST) {
+        received = read(connection, request + length, DAEMON_MAX_REQUEST - length);
+        if (received <= 0) {
+            break;
+        }
+        length += received;
+    }
+    char *newline = memchr(request, '\n', length);
+    if (newline == NULL) {
+        return false;
+    }
+    *newline = '\0';
+    return true;
+}
+
+
+/**
+ * Writes the reply to a finished run, and caches its classes if it succeeded.
+ */
+static void finish_run(daemon_t *daemon, daemon_run_t *run, int status) {
+    char reply[32];
+    int length = WIFSIGNALED(status)
+                     ? snprintf(reply, sizeof(reply), "%s %d\n", DAEMON_SIGNAL_REPLY,
+                                WTERMSIG(status))
+                     : snprintf(reply, sizeof(reply), "%s %d\n", DAEMON_EXIT_REPLY,
+                                WEXITSTATUS(status));
+    // The client may have gone away, which doesn't matter to the daemon
+    ssize_t written = write(run->connection, reply, length);
+    (void) written;
+    close(run->connection);
+    close(run->client_fds[0]);
+    close(run->client_fds[1]);
+
+    char *main_class = run->main_class;
+    bool cache =
+        run->uncached && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+    *run = daemon->runs[--daemon->run_count];
+    if (cache) {
+        cache_add(daemon, main_class);
+    }
+    free(main_class);
+}
+
+static void reap_runs(daemon_t *daemon) {
+    char drained[64];
+    while (read(child_exited[0], drained, sizeof(drained)) > 0) {
+    }
+
+    // Zygotes are reaped here too, once they exit
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (size_t i = 0; i < daemon->run_count; i++) {
+            if (daemon->runs[i].pid == pid) {
+                finish_run(daemon, &daemon->runs[i], status);
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Starts a run in a child process of its own, or fails it if it can't be started.
+ */
+static void restart_uncached(daemon_t *daemon, daemon_run_t *run) {
+    if (!start_uncached(daemon, run)) {
+        finish_run(daemon, run, W_EXITCODE(EXIT_FAILURE, 0));
+    }
+}
+
+/**
+ * Handles a message from a zygote: a run's result, or the channel closing.
+ */
+static void receive_result(daemon_t *daemon, int channel) {
+    cached_program_t *program = NULL;
+    for (size_t i = 0; program == NULL && i < daemon->cache_count; i++) {
+        if (daemon->cache[i].channel == channel) {
+            program = &daemon->cache[i];
+        }
+    }
+    if (program == NULL) {
+        return;
+    }
+    pid_t zygote = program->pid;
+
+    zygote_result_t result;
+    ssize_t received = recv(channel, &result, sizeof(result), MSG_DONTWAIT);
+    if (received < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return;
+    }
+    if (received != sizeof(result)) {
+        // The zygote is gone (e.g. its classes failed to load), and so are the runs it
+        // started, which all sent their results. So its other runs never started.
+        cache_remove(daemon, program);
+        for (size_t i = 0; i < daemon->run_count;) {
+            daemon_run_t *run = &daemon->runs[i];
+            if (run->zygote == zygote) {
+                size_t run_count = daemon->run_count;
+                restart_uncached(daemon, run);
+                if (daemon->run_count < run_count) {
+                    continue;
+                }
+            }
+            i++;
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < daemon->run_count; i++) {
+        daemon_run_t *run = &daemon->runs[i];
+        if (run->id != result.run_id || run->zygote != zygote) {
+            continue;
+        }
+        if (result.stale) {
+            program->retired = true;
+            restart_uncached(daemon, run);
+        }
+        else {
+            finish_run(daemon, run, result.status);
+        }
+        break;
+    }
+}
+
+/**
+ * Handles a client's request.
+ *
+ * @return false if the client asked the daemon to stop
+ */
+static bool handle_request(daemon_t *daemon, int connection) {
+    char request[DAEMON_MAX_REQUEST + 1];
+    int client_fds[2];
+    bool received = receive_request(connection, request, client_fds);
+
+    size_t run_length = strlen(DAEMON_RUN_REQUEST);
+    bool is_run = received && strncmp(request, DAEMON_RUN_REQUEST, run_length) == 0 &&
+                  request[run_length] == ' ' && request[run_length + 1] != '\0';
+    bool is_stop = received && strcmp(request, DAEMON_STOP_REQUEST) == 0;
+    if (!is_run || client_fds[0] < 0) {
+        if (client_fds[0] >= 0) {
+            close(client_fds[0]);
+            close(client_fds[1]);
+        }
+        close(connection);
+        return !is_stop;
+    }
+
+    const char *main_class = request + run_length + 1;
+    char *key = strdup(main_class);
+    assert(key != NULL && "Failed to allocate run");
+    daemon_run_t *run = &daemon->runs[daemon->run_count++];
+    *run = (daemon_run_t){.id = daemon->next_run_id++,
+                          .connection = connection,
+                          .client_fds = {client_fds[0], client_fds[1]},
+                          .main_class = key};
+
+    cached_program_t *program = cache_find(daemon, main_class);
+    if (program != NULL && send_run(program->channel, run)) {
+        run->zygote = program->pid;
+        return true;
+    }
+    if (program != NULL) {
+        // The zygote is gone; its channel closing cleans it up
+        program->retired = true;
+    }
+    if (!start_uncached(daemon, run)) {
+        close(connection);
+        close(client_fds[0]);
+        close(client_fds[1]);
+        free(key);
+        daemon->run_count--;
+    }
+    return true;
+}
+
+bool daemon_run(const char *socket_path, const char *classpath,
+                const daemon_limits_t *limits) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return false;
+    }
+    strcpy(address.sun_path, socket_path);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path);
+    if (listener < 0 || bind(listener, (struct sockaddr *) &address, sizeof(address)) ||
+        listen(listener, LISTEN_BACKLOG)) {
+        perror(socket_path);
+        if (listener >= 0) {
+            close(listener);
+        }
+        return false;
+    }
+
+    int error = pipe(child_exited);
+    assert(error == 0 && "Failed to create pipe");
+    for (size_t i = 0; i < 2; i++) {
+        int flags = fcntl(child_exited[i], F_GETFL);
+        fcntl(child_exited[i], F_SETFL, flags | O_NONBLOCK);
+    }
+    struct sigaction action = {.sa_handler = on_child_exit, .sa_flags = SA_RESTART};
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGCHLD, &action, NULL);
+    // Clients that hang up before their reply shouldn't kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    size_t max_runs = limits->max_runs;
+    if (max_runs == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        max_runs = cpus > 0 ? (size_t) cpus : 1;
+    }
+    daemon_t daemon = {.classpath = classpath, .limits = limits, .listener = listener};
+    daemon.runs = malloc(sizeof(daemon_run_t[max_runs]));
+    assert(daemon.runs != NULL && "Failed to allocate runs");
+
+    bool running = true;
+    while (running || daemon.run_count > 0) {
+        // Wait for exited children, zygotes' results, and new clients, but stop
+        // accepting while every run slot is taken (or once stopping)
+        size_t channel_count = daemon.cache_count;
+        struct pollfd fds[channel_count + 2];
+        fds[0] = (struct pollfd){.fd = child_exited[0], .events = POLLIN};
+        for (size_t i = 0; i < channel_count; i++) {
+            fds[i + 1] = (struct pollfd){.fd = daemon.cache[i].channel, .events = POLLIN};
+        }
+        fds[channel_count + 1] = (struct pollfd){.fd = listener, .events = POLLIN};
+        bool accepting = running && daemon.run_count < max_runs;
+        if (poll(fds, channel_count + (accepting ? 2 : 1), -1) < 0) {
+            assert(errno == EINTR && "Failed to poll");
+            continue;
+        }
+        if (fds[0].revents & POLLIN) {
+            reap_runs(&daemon);
+        }
+        for (size_t i = 0; i < channel_count; i++) {
+            if (fds[i + 1].revents != 0) {
+                receive_result(&daemon, fds[i + 1].fd);
+            }
+        }
+        if (accepting && (fds[channel_count + 1].revents & POLLIN)) {
+            int connection = accept(listener, NULL, NULL);
+            if (connection >= 0) {
+                running = handle_request(&daemon, connection);
+            }
+        }
+        cache_remove_retired(&daemon);
+    }
+
+    close(listener);
+    unlink(socket_path);
+    // Each zygote exits once its channel closes
+    while (daemon.cache_count > 0) {
+        pid_t zygote = daemon.cache[0].pid;
+        cache_remove(&daemon, &daemon.cache[0]);
+        waitpid(zygote, NULL, 0);
+    }
+    signal(SIGCHLD, SIG_DFL);
+    close(child_exited[0]);
+    close(child_exited[1]);
+    free(daemon.cache);
+    free(daemon.runs);
+    return true;
+}
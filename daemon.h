@@ -0,0 +1,58 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * A daemon that keeps classes loaded between runs, so that running a program costs
+ * a fork() rather than starting a process and loading its classes from scratch.
+ *
+ * Clients connect to the daemon's Unix domain socket and send one request line:
+ *
+ *     run <class file | class name>
+ *
+ * passing their stdout and stderr along with it (as SCM_RIGHTS ancillary data), so
+ * the program's output streams straight to the client as it runs. Once the program
+ * finishes, the daemon replies with one line, either "exit <status>" or
+ * "signal <number>" if the run was killed (e.g. for exceeding its time limit).
+ * The request "stop" shuts the daemon down. jvm_client.c is a client.
+ *
+ * Each program's classes are cached, keyed by the main class given in the request,
+ * until any of the class files or archives they were read from is modified (see
+ * `class_loader_stale()`). The daemon itself never loads a class, so a malformed
+ * class can't bring it down. A program's first run loads its classes lazily in the
+ * child, like a standalone run. Once a run has succeeded, a zygote process loads
+ * and links the program's classes, and forks later runs so that they inherit them.
+ * If the zygote fails to load them, or they go stale, runs load their own again.
+ */
+
+#define DAEMON_RUN_REQUEST "run"
+#define DAEMON_STOP_REQUEST "stop"
+#define DAEMON_EXIT_REPLY "exit"
+#define DAEMON_SIGNAL_REPLY "signal"
+/** The longest request line, including its newline */
+#define DAEMON_MAX_REQUEST 4096
+
+/** What each run may use; 0 means no limit */
+typedef struct {
+    /** The most runs in progress at once, or 0 for one per online CPU */
+    size_t max_runs;
+    /** The wall-clock seconds a run may take before it is killed */
+    unsigned time_limit;
+    /** The bytes of address space a run may use */
+    size_t memory_limit;
+} daemon_limits_t;
+
+/**
+ * Serves requests until a client asks the daemon to stop.
+ *
+ * @param socket_path the path to create the socket at, replacing any existing file
+ * @param classpath the classpath to load programs from (see `class_loader_init()`)
+ * @param limits the limits to enforce on each run
+ * @return false if the socket can't be created
+ */
+bool daemon_run(const char *socket_path, const char *classpath,
+                const daemon_limits_t *limits);
+
+#endif /* DAEMON_H */
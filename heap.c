@@ -2,6 +2,8 @@
 
 #include <stdlib.h>
 
+#include "metrics.h"
+
 typedef struct heap {
     /** Generic array of pointers. */
     int32_t **ptr;
@@ -9,6 +11,14 @@ typedef struct heap {
     int32_t count;
 } heap_t;
 
+/**
+ * Gets the size of an array in bytes. Its length is stored in its first element
+ * (see `newarray_helper()`).
+ */
+static size_t array_size(const int32_t *array) {
+    return sizeof(int32_t[array[0] + 1]);
+}
+
 heap_t *heap_init() {
     // The heap array is initially allocated to hold zero elements.
     heap_t *heap = malloc(sizeof(heap_t));
@@ -22,6 +32,11 @@ int32_t heap_add(heap_t *heap, int32_t *ptr) {
     heap->ptr[heap->count] = ptr;
     int32_t temp = heap->count;
     heap->count += 1;
+    if (metrics_enabled) {
+        metrics_thread_t *metrics = metrics_thread();
+        metrics_add(&metrics->arrays_allocated, 1);
+        metrics_add(&metrics->bytes_allocated, array_size(ptr));
+    }
     return temp;
 }
 
@@ -30,6 +45,13 @@ int32_t *heap_get(heap_t *heap, int32_t ref) {
 }
 
 void heap_free(heap_t *heap) {
+    if (metrics_enabled) {
+        metrics_thread_t *metrics = metrics_thread();
+        for (int32_t i = 0; i < heap->count; i++) {
+            metrics_add(&metrics->bytes_freed, array_size(heap->ptr[i]));
+        }
+        metrics_add(&metrics->arrays_freed, heap->count);
+    }
     for (int32_t i = 0; i < heap->count; i++) {
         free(heap->ptr[i]);
     }
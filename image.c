@@ -0,0 +1,544 @@
+#include "image.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "read_class.h"
+#include "symbols.h"
+
+const char IMAGE_MAGIC[8] = "JVMIMAGE";
+const u4 IMAGE_VERSION = 1;
+/** Written in the host's byte order, so a foreign image reads it back scrambled */
+const u4 IMAGE_BYTE_ORDER = 0x01020304;
+/** Every section starts at a multiple of this */
+const size_t IMAGE_ALIGNMENT = sizeof(u4);
+
+/*
+ * The image file format. Every reference within the image is an offset rather than
+ * a pointer: sections are offsets from the start of the image, and strings are
+ * offsets into the strings section, which holds each symbol once, NUL-terminated.
+ */
+
+typedef struct {
+    char magic[sizeof(IMAGE_MAGIC)];
+    u4 version;
+    u4 byte_order;
+    /** The number of bytes in the image */
+    u4 length;
+    u4 class_count;
+    /** The offset of the classes (`image_class_t[class_count]`), sorted by name */
+    u4 classes;
+    /** The index of the class whose main() method runs */
+    u4 main_class;
+    /** The offset and length of the strings section */
+    u4 strings;
+    u4 strings_length;
+} image_header_t;
+
+typedef struct {
+    /** The class's name (a string) */
+    u4 name;
+    /** The number of constant pool slots, including slot 0 */
+    u2 constant_count;
+    /** The number of UTF8 constants */
+    u2 utf8_count;
+    u2 method_count;
+    u2 call_site_count;
+    /** The offset of the constant pool's tags (`u1[constant_count]`) */
+    u4 tags;
+    /** The offset of the constant pool's values (`u4[constant_count]`) */
+    u4 values;
+    /** The offset of the UTF8 constants' strings (`u4[utf8_count]`) */
+    u4 utf8s;
+    /** The offset of the methods (`image_method_t[method_count]`) */
+    u4 methods;
+    /** The offset of the resolved call sites (`image_call_site_t[call_site_count]`) */
+    u4 call_sites;
+} image_class_t;
+
+typedef struct {
+    /** The method's name, descriptor and parameter types (strings) */
+    u4 name;
+    u4 descriptor;
+    u4 parameter_types;
+    /** The offset of the method's bytecode */
+    u4 code;
+    u4 code_length;
+    u2 max_stack;
+    u2 max_locals;
+    u2 parameter_count;
+    u1 return_type;
+    u1 padding;
+} image_method_t;
+
+/** A Methodref constant that has been resolved to a method */
+typedef struct {
+    /** The constant pool index of the Methodref */
+    u2 constant;
+    /** The index of the class that declares the method */
+    u2 class;
+    /** The index of the method within its class */
+    u4 method;
+} image_call_site_t;
+
+typedef struct image {
+    /** The mmap()ed image */
+    u1 *data;
+    size_t length;
+    class_file_t *main_class;
+} image_t;
+
+/** A growable buffer that an image (or its strings section) is built in */
+typedef struct {
+    u1 *bytes;
+    size_t length;
+    size_t capacity;
+} image_buffer_t;
+
+/**
+ * Reserves zeroed space at the end of a buffer.
+ *
+ * @return the offset of the space
+ */
+static size_t buffer_reserve(image_buffer_t *buffer, size_t size, size_t alignment) {
+    size_t offset = (buffer->length + alignment - 1) / alignment * alignment;
+    if (offset + size > buffer->capacity) {
+        size_t capacity = buffer->capacity == 0 ? 4096 : buffer->capacity;
+        while (offset + size > capacity) {
+            capacity *= 2;
+        }
+        buffer->bytes = realloc(buffer->bytes, capacity);
+        assert(buffer->bytes != NULL && "Failed to allocate image buffer");
+        buffer->capacity = capacity;
+    }
+    memset(buffer->bytes + buffer->length, 0, offset + size - buffer->length);
+    buffer->length = offset + size;
+    return offset;
+}
+
+static size_t buffer_append(image_buffer_t *buffer, const void *data, size_t size) {
+    size_t offset = buffer_reserve(buffer, size, IMAGE_ALIGNMENT);
+    if (size > 0) {
+        memcpy(buffer->bytes + offset, data, size);
+    }
+    return offset;
+}
+
+/**
+ * The strings section being built, with a hash table from each interned string to
+ * its offset so that every symbol is stored once.
+ */
+typedef struct {
+    image_buffer_t buffer;
+    const char **keys;
+    u4 *offsets;
+    /** The number of slots (always a power of two) */
+    size_t capacity;
+    size_t count;
+} image_strings_t;
+
+static size_t string_slot(const image_strings_t *strings, const char *string) {
+    size_t mask = strings->capacity - 1;
+    size_t index = ((uintptr_t) string >> 3) * 0x9e3779b97f4a7c15;
+    while (strings->keys[index & mask] != NULL && strings->keys[index & mask] != string) {
+        index++;
+    }
+    return index & mask;
+}
+
+/**
+ * Adds an interned string to the strings section, if it isn't there already.
+ *
+ * @return the string's offset in the strings section
+ */
+static u4 image_string(image_strings_t *strings, const char *string) {
+    // Keep the load factor at or below one half
+    if (2 * (strings->count + 1) > strings->capacity) {
+        const char **old_keys = strings->keys;
+        u4 *old_offsets = strings->offsets;
+        size_t old_capacity = strings->capacity;
+        strings->capacity = old_capacity == 0 ? 256 : 2 * old_capacity;
+        strings->keys = calloc(strings->capacity, sizeof(const char *));
+        strings->offsets = malloc(sizeof(u4[strings->capacity]));
+        assert(strings->keys != NULL && strings->offsets != NULL &&
+               "Failed to allocate image strings");
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old_keys[i] != NULL) {
+                size_t slot = string_slot(strings, old_keys[i]);
+                strings->keys[slot] = old_keys[i];
+                strings->offsets[slot] = old_offsets[i];
+            }
+        }
+        free(old_keys);
+        free(old_offsets);
+    }
+
+    size_t slot = string_slot(strings, string);
+    if (strings->keys[slot] == NULL) {
+        size_t size = strlen(string) + 1;
+        size_t offset = buffer_reserve(&strings->buffer, size, 1);
+        memcpy(strings->buffer.bytes + offset, string, size);
+        strings->keys[slot] = string;
+        strings->offsets[slot] = offset;
+        strings->count++;
+    }
+    return strings->offsets[slot];
+}
+
+static int compare_class_name(const void *name, const void *class) {
+    return strcmp(name, (*(class_file_t *const *) class)->name);
+}
+
+/**
+ * Finds a class's index in the (sorted) list of classes being written.
+ */
+static u2 image_class_index(class_file_t *const *classes, size_t class_count,
+                            const class_file_t *class) {
+    class_file_t *const *found = bsearch(class->name, classes, class_count,
+                                         sizeof(class_file_t *), compare_class_name);
+    assert(found != NULL && "Call site refers to a class that isn't in the image");
+    return found - classes;
+}
+
+/**
+ * Appends a class's constant pool, methods and call sites to the image.
+ */
+static image_class_t write_class(image_buffer_t *image, image_strings_t *strings,
+                                 class_file_t *const *classes, size_t class_count,
+                                 class_file_t *class) {
+    const constant_pool_t *constant_pool = &class->constant_pool;
+    image_class_t entry = {
+        .name = image_string(strings, class->name),
+        .constant_count = constant_pool->count,
+    };
+    size_t count = entry.constant_count;
+    entry.tags = buffer_append(image, constant_pool->tags, sizeof(u1[count]));
+    entry.values = buffer_append(image, constant_pool->values, sizeof(u4[count]));
+
+    // UTF8 values index `strings`, which only has as many entries as are in use
+    for (u2 index = 1; index < constant_pool->count; index++) {
+        if (cp_tag(constant_pool, index) == CONSTANT_Utf8) {
+            entry.utf8_count++;
+        }
+    }
+    entry.utf8s = buffer_reserve(image, sizeof(u4[entry.utf8_count]), IMAGE_ALIGNMENT);
+    for (u2 i = 0; i < entry.utf8_count; i++) {
+        u4 string = image_string(strings, constant_pool->strings[i]);
+        memcpy(image->bytes + entry.utf8s + i * sizeof(u4), &string, sizeof(u4));
+    }
+
+    for (method_t *method = class->methods; method->name != NULL; method++) {
+        entry.method_count++;
+    }
+    entry.methods = buffer_reserve(image, sizeof(image_method_t[entry.method_count]),
+                                   IMAGE_ALIGNMENT);
+    for (u2 i = 0; i < entry.method_count; i++) {
+        method_t *method = &class->methods[i];
+        // The image holds prepared code, whether or not the method has run yet.
+        // Methods that can't be invoked (i.e. constructors) are stored without code.
+        if (method_invocable(method)) {
+            prepare_method(method);
+        }
+        image_method_t image_method = {
+            .name = image_string(strings, method->name),
+            .descriptor = image_string(strings, method->descriptor),
+            .parameter_types = image_string(strings, method->parameter_types),
+            .code_length = method->code.code_length,
+            .max_stack = method->code.max_stack,
+            .max_locals = method->code.max_locals,
+            .parameter_count = method->parameter_count,
+            .return_type = method->return_type,
+        };
+        image_method.code =
+            buffer_append(image, method->code.code, method->code.code_length);
+        memcpy(image->bytes + entry.methods + i * sizeof(image_method_t), &image_method,
+               sizeof(image_method_t));
+    }
+
+    for (u2 index = 1; index < constant_pool->count; index++) {
+        if (class->resolved_methods[index] != NULL) {
+            entry.call_site_count++;
+        }
+    }
+    entry.call_sites = buffer_reserve(
+        image, sizeof(image_call_site_t[entry.call_site_count]), IMAGE_ALIGNMENT);
+    u2 call_site = 0;
+    for (u2 index = 1; index < constant_pool->count; index++) {
+        const method_t *method = class->resolved_methods[index];
+        if (method != NULL) {
+            image_call_site_t site = {
+                .constant = index,
+                .class = image_class_index(classes, class_count, method->class),
+                .method = method - method->class->methods,
+            };
+            memcpy(image->bytes + entry.call_sites + call_site * sizeof(site), &site,
+                   sizeof(site));
+            call_site++;
+        }
+    }
+    return entry;
+}
+
+bool image_write(const char *path, class_loader_t *loader,
+                 const class_file_t *main_class) {
+    size_t class_count;
+    class_file_t **classes = class_loader_classes(loader, &class_count);
+    assert(class_count <= UINT16_MAX && "Too many classes for an image");
+
+    image_buffer_t image = {NULL, 0, 0};
+    image_strings_t strings = {{NULL, 0, 0}, NULL, NULL, 0, 0};
+    image_header_t header = {
+        .version = IMAGE_VERSION,
+        .byte_order = IMAGE_BYTE_ORDER,
+        .class_count = class_count,
+        .main_class = image_class_index(classes, class_count, main_class),
+    };
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+    buffer_reserve(&image, sizeof(header), IMAGE_ALIGNMENT);
+    header.classes =
+        buffer_reserve(&image, sizeof(image_class_t[class_count]), IMAGE_ALIGNMENT);
+    for (size_t i = 0; i < class_count; i++) {
+        image_class_t entry = write_class(&image, &strings, classes, class_count,
+                                          classes[i]);
+        memcpy(image.bytes + header.classes + i * sizeof(entry), &entry, sizeof(entry));
+    }
+    header.strings_length = strings.buffer.length;
+    header.strings = buffer_append(&image, strings.buffer.bytes, strings.buffer.length);
+    assert(image.length <= UINT32_MAX && "Image is too large");
+    header.length = image.length;
+    memcpy(image.bytes, &header, sizeof(header));
+
+    FILE *file = fopen(path, "w");
+    bool written =
+        file != NULL && fwrite(image.bytes, 1, image.length, file) == image.length;
+    if (file != NULL && fclose(file) != 0) {
+        written = false;
+    }
+
+    free(image.bytes);
+    free(strings.buffer.bytes);
+    free(strings.keys);
+    free(strings.offsets);
+    free(classes);
+    return written;
+}
+
+static bool in_bounds(size_t length, u4 offset, size_t size) {
+    return offset <= length && size <= length - offset;
+}
+
+static bool is_string(const image_header_t *header, u4 string) {
+    return string < header->strings_length;
+}
+
+/**
+ * Checks that every offset in the image stays within it, so that a truncated or
+ * corrupt image is rejected rather than read out of bounds.
+ */
+static bool image_valid(const u1 *data, size_t length) {
+    if (length < sizeof(image_header_t)) {
+        return false;
+    }
+    const image_header_t *header = (const image_header_t *) data;
+    if (memcmp(header->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0 ||
+        header->version != IMAGE_VERSION || header->byte_order != IMAGE_BYTE_ORDER ||
+        header->length != length ||
+        !in_bounds(length, header->classes,
+                   sizeof(image_class_t[header->class_count])) ||
+        header->main_class >= header->class_count ||
+        !in_bounds(length, header->strings, header->strings_length) ||
+        header->strings_length == 0 ||
+        data[header->strings + header->strings_length - 1] != '\0') {
+        return false;
+    }
+
+    const image_class_t *classes = (const image_class_t *) (data + header->classes);
+    for (u4 i = 0; i < header->class_count; i++) {
+        const image_class_t *class = &classes[i];
+        if (!is_string(header, class->name) || class->constant_count == 0 ||
+            !in_bounds(length, class->tags, sizeof(u1[class->constant_count])) ||
+            !in_bounds(length, class->values, sizeof(u4[class->constant_count])) ||
+            !in_bounds(length, class->utf8s, sizeof(u4[class->utf8_count])) ||
+            !in_bounds(length, class->methods,
+                       sizeof(image_method_t[class->method_count])) ||
+            !in_bounds(length, class->call_sites,
+                       sizeof(image_call_site_t[class->call_site_count]))) {
+            return false;
+        }
+
+        const u4 *utf8s = (const u4 *) (data + class->utf8s);
+        for (u2 j = 0; j < class->utf8_count; j++) {
+            if (!is_string(header, utf8s[j])) {
+                return false;
+            }
+        }
+        const u1 *tags = data + class->tags;
+        const u4 *values = (const u4 *) (data + class->values);
+        for (u2 index = 1; index < class->constant_count; index++) {
+            if (tags[index] == CONSTANT_Utf8 && values[index] >= class->utf8_count) {
+                return false;
+            }
+        }
+        const image_method_t *methods = (const image_method_t *) (data + class->methods);
+        for (u2 j = 0; j < class->method_count; j++) {
+            if (!is_string(header, methods[j].name) ||
+                !is_string(header, methods[j].descriptor) ||
+                !is_string(header, methods[j].parameter_types) ||
+                !in_bounds(length, methods[j].code, methods[j].code_length)) {
+                return false;
+            }
+        }
+        const image_call_site_t *call_sites =
+            (const image_call_site_t *) (data + class->call_sites);
+        for (u2 j = 0; j < class->call_site_count; j++) {
+            if (call_sites[j].constant >= class->constant_count ||
+                call_sites[j].class >= header->class_count ||
+                call_sites[j].method >= classes[call_sites[j].class].method_count) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Builds a class whose constant pool and bytecode point into the image.
+ */
+static class_file_t *image_class(u1 *data, const char *strings,
+                                 const image_class_t *entry) {
+    class_file_t *class = malloc(sizeof(*class));
+    assert(class != NULL && "Failed to allocate class");
+    // The class has no class file image of its own; free_class() leaves the mapping
+    class->data = NULL;
+    class->data_length = 0;
+    class->data_mapped = false;
+    class->name = strings + entry->name;
+    class->loader = NULL;
+
+    constant_pool_t *constant_pool = &class->constant_pool;
+    constant_pool->count = entry->constant_count;
+    constant_pool->tags = data + entry->tags;
+    constant_pool->values = (u4 *) (data + entry->values);
+    // Always allocate `strings`, since freeing it frees the constant pool
+    constant_pool->strings = malloc(sizeof(const char *[entry->utf8_count + 1]));
+    assert(constant_pool->strings != NULL && "Failed to allocate constant pool");
+    const u4 *utf8s = (const u4 *) (data + entry->utf8s);
+    for (u2 i = 0; i < entry->utf8_count; i++) {
+        constant_pool->strings[i] = strings + utf8s[i];
+    }
+    class->resolved_methods = calloc(constant_pool->count, sizeof(method_t *));
+    assert(class->resolved_methods != NULL && "Failed to allocate resolved methods");
+    class->resolved_fields = calloc(constant_pool->count, sizeof(bool));
+    assert(class->resolved_fields != NULL && "Failed to allocate resolved fields");
+
+    class->methods = malloc(sizeof(method_t[entry->method_count + 1]));
+    assert(class->methods != NULL && "Failed to allocate methods");
+    const image_method_t *image_methods =
+        (const image_method_t *) (data + entry->methods);
+    for (u2 i = 0; i < entry->method_count; i++) {
+        const image_method_t *image_method = &image_methods[i];
+        class->methods[i] = (method_t){
+            .name = strings + image_method->name,
+            .descriptor = strings + image_method->descriptor,
+            .parameter_count = image_method->parameter_count,
+            .parameter_types = strings + image_method->parameter_types,
+            .return_type = image_method->return_type,
+            .prepared = true,
+            .code =
+                {
+                    .max_stack = image_method->max_stack,
+                    .max_locals = image_method->max_locals,
+                    .code_length = image_method->code_length,
+                    .code = data + image_method->code,
+                },
+            .class = class,
+        };
+    }
+    class->methods[entry->method_count].name = NULL;
+    index_methods(class);
+    return class;
+}
+
+image_t *image_open(const char *path, class_loader_t *loader) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    // The mapping is never written, so its pages are shared by every process using it
+    u1 *data = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    if (!image_valid(data, status.st_size)) {
+        munmap(data, status.st_size);
+        return NULL;
+    }
+
+    const image_header_t *header = (const image_header_t *) data;
+    const char *strings = (const char *) (data + header->strings);
+    // Each symbol is stored once, so it can be adopted as the interned copy in place
+    u4 offset = 0;
+    while (offset < header->strings_length) {
+        size_t length = strlen(strings + offset);
+        if (!symbol_adopt(strings + offset, length)) {
+            break;
+        }
+        offset += length + 1;
+    }
+    if (offset < header->strings_length) {
+        // The symbol was already interned (the image was opened too late, or stores
+        // it twice), so give back the symbols adopted before it and reject the image
+        for (u4 adopted = 0; adopted < offset;) {
+            size_t length = strlen(strings + adopted);
+            symbol_disown(strings + adopted, length);
+            adopted += length + 1;
+        }
+        munmap(data, status.st_size);
+        return NULL;
+    }
+
+    const image_class_t *entries = (const image_class_t *) (data + header->classes);
+    class_file_t *classes[header->class_count];
+    for (u4 i = 0; i < header->class_count; i++) {
+        classes[i] = image_class(data, strings, &entries[i]);
+    }
+    for (u4 i = 0; i < header->class_count; i++) {
+        const image_call_site_t *call_sites =
+            (const image_call_site_t *) (data + entries[i].call_sites);
+        for (u2 j = 0; j < entries[i].call_site_count; j++) {
+            classes[i]->resolved_methods[call_sites[j].constant] =
+                &classes[call_sites[j].class]->methods[call_sites[j].method];
+        }
+        class_loader_register(loader, classes[i]);
+    }
+
+    image_t *image = malloc(sizeof(*image));
+    assert(image != NULL && "Failed to allocate image");
+    image->data = data;
+    image->length = status.st_size;
+    image->main_class = classes[header->main_class];
+    return image;
+}
+
+class_file_t *image_main_class(const image_t *image) {
+    return image->main_class;
+}
+
+void image_close(image_t *image) {
+    munmap(image->data, image->length);
+    free(image);
+}
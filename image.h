@@ -0,0 +1,58 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "class_file.h"
+#include "class_loader.h"
+
+/**
+ * A startup image: a snapshot of every class a program loads, with its constant
+ * pool, methods, bytecode and resolved call sites, written in a position-independent
+ * format so that it can be mapped and used without parsing any class files.
+ *
+ * The image is mapped read-only and shared, so bytecode, constant pool tags and
+ * values, and symbol strings are used in place and shared between every process
+ * running the same image. Only the pointer tables (method arrays, method indices
+ * and resolved call sites) are rebuilt in each process.
+ *
+ * Images store integers in the host's byte order, so they are only portable between
+ * machines of the same architecture (and are rejected elsewhere).
+ */
+typedef struct image image_t;
+
+/**
+ * Writes an image of every class a loader has loaded.
+ * The loader should be linked first (see `class_loader_link()`) so that the image
+ * contains the program's classes and resolved call sites.
+ *
+ * @param path the path of the image to write
+ * @param loader the class loader
+ * @param main_class the class whose main() method runs when the image is used
+ * @return whether the image was written successfully
+ */
+bool image_write(const char *path, class_loader_t *loader,
+                 const class_file_t *main_class);
+
+/**
+ * Maps an image and registers its classes with a class loader.
+ * This must be done before any other class is loaded, since the image's strings
+ * become the interned copies of its symbols (see `symbol_adopt()`).
+ *
+ * @param path the path of the image
+ * @param loader the class loader to register the classes with
+ * @return the image, or NULL if it can't be opened, isn't a valid image, or some of
+ *         its symbols were already interned
+ */
+image_t *image_open(const char *path, class_loader_t *loader);
+
+/**
+ * Gets the class whose main() method runs when the image is used.
+ */
+class_file_t *image_main_class(const image_t *image);
+
+/**
+ * Unmaps an image. The classes registered from it point into the mapping,
+ * so this must only be called after the class loader has been freed.
+ */
+void image_close(image_t *image);
+
+#endif /* IMAGE_H */
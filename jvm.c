@@ -1,16 +1,16 @@
 #include "jvm.h"
 
 #include <assert.h>
-#include <inttypes.h>
-#include <stdbool.h>
-#include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 
+#include "counters.h"
 #include "heap.h"
+#include "metrics.h"
 #include "opcodes.h"
+#include "perf.h"
 #include "read_class.h"
 #include "stack.h"
+#include "trace.h"
 
 /** The name of the method to invoke to run the class file */
 const char MAIN_METHOD[] = "main";
@@ -22,18 +22,42 @@ const char MAIN_METHOD[] = "main";
  */
 const char MAIN_DESCRIPTOR[] = "([Ljava/lang/String;)V";
 
+#ifdef COUNT_INSTRUCTIONS
+uint64_t instructions_executed = 0;
+#endif
+
+/** The hooks a copy of the interpreter loop calls, besides running the method */
+typedef enum {
+    NO_HOOKS = 0,
+    /** Records each instruction, call and return in the trace (see trace.h) */
+    TRACE_HOOKS = 1 << 0,
+    /** Counts the call and each instruction in the thread's metrics (see metrics.h) */
+    METRICS_HOOKS = 1 << 1,
+    /** Reads the hardware counters before and after the call (see counters.h) */
+    COUNTERS_HOOKS = 1 << 2,
+} hooks_t;
+
 /**
- * Runs a method's instructions until the method returns.
- *
- * @param method the method to run
- * @param locals the array of local variables, including the method parameters.
- *   Except for parameters, the locals are uninitialized.
- * @param class the class file the method belongs to
- * @param heap an array of heap-allocated pointers, useful for references
- * @return an optional int containing the method's return value
+ * Runs a method's instructions until the method returns. `hooks` must be a constant,
+ * so that each copy of the loop only checks for the hooks it calls, and the copy
+ * without hooks doesn't check for any.
  */
-optional_value_t execute(method_t *method, int32_t *locals, class_file_t *class,
-                         heap_t *heap) {
+__attribute__((always_inline)) static inline optional_value_t interpret(
+    method_t *method, int32_t *locals, class_file_t *class, heap_t *heap,
+    output_t *output, hooks_t hooks) {
+    counters_frame_t counters;
+    if (hooks & COUNTERS_HOOKS) {
+        counters_enter(&counters, method);
+    }
+    u4 trace_method = 0;
+    if (hooks & TRACE_HOOKS) {
+        trace_method = trace_call(method, locals);
+    }
+    metrics_thread_t *metrics = NULL;
+    if (hooks & METRICS_HOOKS) {
+        metrics = metrics_call(method);
+    }
+
     size_t program_counter = 0;
     stack_t *stack = stack_init(method->code.max_stack);
 
@@ -43,46 +67,248 @@ optional_value_t execute(method_t *method, int32_t *locals, class_file_t *class,
     while (program_counter < method->code.code_length) {
         // I'm forcing this function and invokestatic to be always inlined to avoid
         // overflowing the stack in the recursion test.
-        opcode_helper(stack, &program_counter, method, locals, class, heap, &result);
+#ifdef COUNT_INSTRUCTIONS
+        instructions_executed++;
+#endif
+        if (hooks & TRACE_HOOKS) {
+            trace_instruction(trace_method, program_counter,
+                              method->code.code[program_counter], stack->contents,
+                              stack->top);
+        }
+        if (hooks & METRICS_HOOKS) {
+            metrics_add(&metrics->instructions, 1);
+        }
+        opcode_helper(stack, &program_counter, method, locals, class, heap, output,
+                      &result);
     }
 
+    if (hooks & TRACE_HOOKS) {
+        trace_return(trace_method, result.has_value, result.value);
+    }
+    if (hooks & METRICS_HOOKS) {
+        metrics_return(metrics);
+    }
     stack_free(stack);
-
+    if (hooks & COUNTERS_HOOKS) {
+        counters_leave(&counters);
+    }
     return result;
 }
 
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "USAGE: %s <class file>\n", argv[0]);
-        return 1;
+/** `interpret()` with the trace hooks */
+__attribute__((noinline)) static optional_value_t execute_traced(method_t *method,
+                                                                 int32_t *locals,
+                                                                 class_file_t *class,
+                                                                 heap_t *heap,
+                                                                 output_t *output) {
+    return interpret(method, locals, class, heap, output, TRACE_HOOKS);
+}
+
+/** `interpret()` with the metrics hooks */
+__attribute__((noinline)) static optional_value_t execute_metered(method_t *method,
+                                                                  int32_t *locals,
+                                                                  class_file_t *class,
+                                                                  heap_t *heap,
+                                                                  output_t *output) {
+    return interpret(method, locals, class, heap, output, METRICS_HOOKS);
+}
+
+/** `interpret()` with the hardware counter hooks */
+__attribute__((noinline)) static optional_value_t execute_counted(method_t *method,
+                                                                  int32_t *locals,
+                                                                  class_file_t *class,
+                                                                  heap_t *heap,
+                                                                  output_t *output) {
+    return interpret(method, locals, class, heap, output, COUNTERS_HOOKS);
+}
+
+/** `interpret()`, for methods' trampolines to call (see perf.h) */
+static optional_value_t interpret_from_trampoline(method_t *method, int32_t *locals,
+                                                  class_file_t *class, heap_t *heap,
+                                                  output_t *output) {
+    return interpret(method, locals, class, heap, output, NO_HOOKS);
+}
+
+optional_value_t execute(method_t *method, int32_t *locals, class_file_t *class,
+                         heap_t *heap, output_t *output) {
+    if (trace_enabled) {
+        return execute_traced(method, locals, class, heap, output);
+    }
+    if (perf_enabled) {
+        return perf_trampoline(method)(
+            method, locals, class, heap, output,
+            metrics_enabled ? execute_metered : interpret_from_trampoline);
+    }
+    if (metrics_enabled) {
+        return execute_metered(method, locals, class, heap, output);
+    }
+    if (counters_enabled) {
+        return execute_counted(method, locals, class, heap, output);
+    }
+    return interpret(method, locals, class, heap, output, NO_HOOKS);
+}
+
+/** A method call in progress on a green thread */
+typedef struct frame {
+    method_t *method;
+    size_t program_counter;
+    int32_t *locals;
+    stack_t *stack;
+    /** Set when the method returns */
+    optional_value_t result;
+    /** The frame of the method that called this one, or NULL for the first */
+    struct frame *caller;
+    /** The method's trace id, if a trace is being recorded (see trace.h) */
+    u4 trace_method;
+} frame_t;
+
+typedef struct green_thread {
+    /** The innermost frame, or NULL once the thread has finished */
+    frame_t *frame;
+    heap_t *heap;
+    output_t *output;
+    /** The value returned by the thread's first method */
+    optional_value_t result;
+} green_thread_t;
+
+static frame_t *frame_init(method_t *method, frame_t *caller) {
+    frame_t *frame = malloc(sizeof(*frame));
+    assert(frame != NULL && "Failed to allocate frame");
+    frame->method = method;
+    frame->program_counter = 0;
+    frame->locals = calloc(method->code.max_locals, sizeof(int32_t));
+    frame->stack = stack_init(method->code.max_stack);
+    frame->result = (optional_value_t){.has_value = false};
+    frame->caller = caller;
+    frame->trace_method = 0;
+    if (metrics_enabled) {
+        metrics_call(method);
+    }
+    return frame;
+}
+
+/**
+ * Pops a frame, returning to its caller.
+ */
+static frame_t *frame_free(frame_t *frame) {
+    frame_t *caller = frame->caller;
+    if (metrics_enabled) {
+        metrics_return(metrics_thread());
     }
+    stack_free(frame->stack);
+    free(frame->locals);
+    free(frame);
+    return caller;
+}
 
-    // Open the class file for reading
-    FILE *class_file = fopen(argv[1], "r");
-    assert(class_file != NULL && "Failed to open file");
+green_thread_t *green_thread_init(method_t *method, heap_t *heap, output_t *output) {
+    prepare_method(method);
+    green_thread_t *thread = malloc(sizeof(*thread));
+    assert(thread != NULL && "Failed to allocate green thread");
+    thread->frame = frame_init(method, NULL);
+    if (trace_enabled) {
+        thread->frame->trace_method = trace_call(method, thread->frame->locals);
+    }
+    thread->heap = heap;
+    thread->output = output;
+    thread->result = (optional_value_t){.has_value = false};
+    return thread;
+}
 
-    // Parse the class file
-    class_file_t *class = get_class(class_file);
-    int error = fclose(class_file);
-    assert(error == 0 && "Failed to close file");
+/**
+ * Calls the method an invokestatic instruction refers to, by pushing a frame for it
+ * instead of recursing like `invokestatic_helper()`.
+ */
+static frame_t *green_thread_invoke(frame_t *frame) {
+    const u1 *operands = &frame->method->code.code[frame->program_counter + 1];
+    method_t *method = resolve_method(frame->method->class,
+                                      (u2) operands[0] << 8 | operands[1]);
+    assert(method != NULL);
+    prepare_method(method);
+    frame->program_counter += 3;
 
-    // The heap array is initially allocated to hold zero elements.
-    heap_t *heap = heap_init();
+    frame_t *callee = frame_init(method, frame);
+    for (u2 i = get_number_of_parameters(method); i > 0; i--) {
+        assert(stack_pop(frame->stack, &callee->locals[i - 1]) == 1);
+    }
+    if (trace_enabled) {
+        callee->trace_method = trace_call(method, callee->locals);
+    }
+    return callee;
+}
 
-    // Execute the main method
+bool green_thread_run(green_thread_t *thread, uint64_t *fuel) {
+    assert(*fuel > 0 && "Green thread has no fuel");
+    while (thread->frame != NULL) {
+        frame_t *frame = thread->frame;
+        method_t *method = frame->method;
+        size_t program_counter = frame->program_counter;
+        if (program_counter >= method->code.code_length) {
+            // The method returned, so pass its result to its caller
+            optional_value_t result = frame->result;
+            if (trace_enabled) {
+                trace_return(frame->trace_method, result.has_value, result.value);
+            }
+            thread->frame = frame_free(frame);
+            if (thread->frame == NULL) {
+                thread->result = result;
+            }
+            else if (result.has_value) {
+                assert(stack_push(thread->frame->stack, result.value) == 1);
+            }
+            continue;
+        }
+
+#ifdef COUNT_INSTRUCTIONS
+        instructions_executed++;
+#endif
+        if (metrics_enabled) {
+            metrics_add(&metrics_thread()->instructions, 1);
+        }
+        if (trace_enabled) {
+            trace_instruction(frame->trace_method, program_counter,
+                              method->code.code[program_counter], frame->stack->contents,
+                              frame->stack->top);
+        }
+        if (method->code.code[program_counter] == i_invokestatic) {
+            thread->frame = green_thread_invoke(frame);
+        }
+        else {
+            opcode_helper(frame->stack, &frame->program_counter, method, frame->locals,
+                          method->class, thread->heap, thread->output, &frame->result);
+            if (frame->program_counter > program_counter) {
+                continue;
+            }
+        }
+
+        // This was a call or a backward branch, which uses fuel
+        if (--*fuel == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+optional_value_t green_thread_result(const green_thread_t *thread) {
+    return thread->result;
+}
+
+void green_thread_free(green_thread_t *thread) {
+    while (thread->frame != NULL) {
+        thread->frame = frame_free(thread->frame);
+    }
+    free(thread);
+}
+
+void execute_main(class_file_t *class, heap_t *heap, output_t *output) {
     method_t *main_method = find_method(MAIN_METHOD, MAIN_DESCRIPTOR, class);
     assert(main_method != NULL && "Missing main() method");
+    prepare_method(main_method);
     /* In a real JVM, locals[0] would contain a reference to String[] args.
      * But since TeenyJVM doesn't support Objects, we leave it uninitialized. */
     int32_t locals[main_method->code.max_locals];
     // Initialize all local variables to 0
     memset(locals, 0, sizeof(locals));
-    optional_value_t result = execute(main_method, locals, class, heap);
+    optional_value_t result = execute(main_method, locals, class, heap, output);
     assert(!result.has_value && "main() should return void");
-
-    // Free the internal data structures
-    free_class(class);
-
-    // Free the heap
-    heap_free(heap);
-}
\ No newline at end of file
+}
@@ -6,6 +6,7 @@
 
 #include "class_file.h"
 #include "heap.h"
+#include "output.h"
 
 /**
  * JVM integer instruction mnemonics and opcodes. If you're interested,
@@ -73,6 +74,8 @@ typedef enum {
     i_if_icmpgt = 0xa3,
     i_if_icmple = 0xa4,
     i_goto = 0xa7,
+    i_tableswitch = 0xaa,
+    i_lookupswitch = 0xab,
     i_ireturn = 0xac,
     i_areturn = 0xb0,
     i_return = 0xb1,
@@ -96,7 +99,83 @@ typedef struct {
     int32_t value;
 } optional_value_t;
 
+#ifdef COUNT_INSTRUCTIONS
+/**
+ * The number of instructions executed so far, in builds with COUNT_INSTRUCTIONS
+ * defined (see `make bench`). It isn't synchronized, so it is only exact when
+ * a single thread runs bytecode.
+ */
+extern uint64_t instructions_executed;
+#endif
+
+/** The name and descriptor of the method that runs a program */
+extern const char MAIN_METHOD[];
+extern const char MAIN_DESCRIPTOR[];
+
+/**
+ * Runs a method's instructions until the method returns.
+ *
+ * @param method the method to run, which must have been prepared
+ *   (see `prepare_method()`)
+ * @param locals the array of local variables, including the method parameters.
+ *   Except for parameters, the locals are uninitialized.
+ * @param class the class file the method belongs to
+ * @param heap an array of heap-allocated pointers, useful for references
+ * @param output where the program's output goes
+ * @return an optional int containing the method's return value
+ */
 optional_value_t execute(method_t *method, int32_t *locals, class_file_t *class,
-                         heap_t *heap);
+                         heap_t *heap, output_t *output);
+
+/**
+ * Runs a class's main() method to completion.
+ *
+ * @param class the class to run
+ * @param heap the heap for the program's arrays
+ * @param output where the program's output goes
+ */
+void execute_main(class_file_t *class, heap_t *heap, output_t *output);
+
+/**
+ * A resumable execution of a method. Unlike `execute()`, which calls methods
+ * recursively on the C stack, a green thread keeps its call stack in explicit
+ * frames, so it can stop between any two instructions and pick up where it left
+ * off later (see scheduler.h).
+ */
+typedef struct green_thread green_thread_t;
+
+/**
+ * Creates a green thread that will run a method, e.g. main(), from the beginning.
+ *
+ * @param method the method to run, which takes no arguments other than main()'s
+ *   String[] (which isn't supported and is left as 0)
+ * @param heap the heap for the thread's arrays
+ * @param output where the thread's output goes
+ * @return the green thread, which hasn't started running yet
+ */
+green_thread_t *green_thread_init(method_t *method, heap_t *heap, output_t *output);
+
+/**
+ * Runs a green thread until it finishes or runs out of fuel. Each backward branch
+ * and each method call uses one unit of fuel, so a thread can't run for long
+ * without using some; once the last unit is used, the thread stops right after the
+ * instruction that used it.
+ *
+ * @param thread the thread to run
+ * @param fuel the fuel the thread may use (at least 1), which is decremented as it
+ *   is used
+ * @return whether the thread finished (otherwise `*fuel` is 0)
+ */
+bool green_thread_run(green_thread_t *thread, uint64_t *fuel);
+
+/**
+ * Gets the value returned by a green thread's method, once it has finished.
+ */
+optional_value_t green_thread_result(const green_thread_t *thread);
+
+/**
+ * Frees a green thread, along with its frames if it hasn't finished.
+ */
+void green_thread_free(green_thread_t *thread);
 
 #endif /* JVM_H */
@@ -0,0 +1,103 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "daemon.h"
+
+/** The argument that asks the daemon to stop instead of running a program */
+const char STOP_ARGUMENT[] = "--stop";
+const char CLASS_FILE_EXTENSION[] = ".class";
+
+/**
+ * Sends a request to the daemon, passing this process's stdout and stderr so the
+ * program's output goes straight to them.
+ */
+static bool send_request(int connection, const char *request) {
+    int fds[2] = {STDOUT_FILENO, STDERR_FILENO};
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(fds))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec data = {.iov_base = (char *) request, .iov_len = strlen(request)};
+    struct msghdr message = {.msg_iov = &data,
+                             .msg_iovlen = 1,
+                             .msg_control = control.buffer,
+                             .msg_controllen = sizeof(control.buffer)};
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(header), fds, sizeof(fds));
+    return sendmsg(connection, &message, 0) == (ssize_t) data.iov_len;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "USAGE: %s <socket> <class file | class name | %s>\n", argv[0],
+                STOP_ARGUMENT);
+        return 1;
+    }
+
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    strncpy(address.sun_path, argv[1], sizeof(address.sun_path) - 1);
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0 ||
+        connect(connection, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    // The daemon runs in its own directory, so class files are given by absolute path
+    const char *main_class = argv[2];
+    char path[PATH_MAX];
+    size_t length = strlen(main_class);
+    size_t extension_length = strlen(CLASS_FILE_EXTENSION);
+    if (length >= extension_length &&
+        strcmp(main_class + length - extension_length, CLASS_FILE_EXTENSION) == 0) {
+        if (realpath(main_class, path) == NULL) {
+            perror(main_class);
+            return 1;
+        }
+        main_class = path;
+    }
+
+    char request[DAEMON_MAX_REQUEST];
+    int request_length =
+        strcmp(main_class, STOP_ARGUMENT) == 0
+            ? snprintf(request, sizeof(request), "%s\n", DAEMON_STOP_REQUEST)
+            : snprintf(request, sizeof(request), "%s %s\n", DAEMON_RUN_REQUEST,
+                       main_class);
+    if (request_length >= (int) sizeof(request) || !send_request(connection, request)) {
+        fprintf(stderr, "Failed to send request\n");
+        return 1;
+    }
+
+    // Wait for the run to finish; the daemon closes the connection after replying
+    char reply[64];
+    size_t reply_length = 0;
+    ssize_t received;
+    while (reply_length < sizeof(reply) - 1 &&
+           (received = read(connection, reply + reply_length,
+                            sizeof(reply) - 1 - reply_length)) > 0) {
+        reply_length += received;
+    }
+    reply[reply_length] = '\0';
+    close(connection);
+
+    char kind[16];
+    int status;
+    if (sscanf(reply, "%15s %d", kind, &status) != 2) {
+        // A stop request has no reply
+        return strcmp(main_class, STOP_ARGUMENT) == 0 ? 0 : 1;
+    }
+    if (strcmp(kind, DAEMON_SIGNAL_REPLY) == 0) {
+        fprintf(stderr, "Run killed by signal %d (%s)\n", status, strsignal(status));
+        return 128 + status;
+    }
+    return status;
+}
@@ -0,0 +1,374 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jvm.h"
+#include "trace.h"
+
+/*
+ * Decodes an execution trace written by `jvm --trace` (see trace.h), either printing
+ * every event, indented by call depth, or summarizing where the time went.
+ *
+ * Green threads (see scheduler.h) record into the ring of the thread that runs them,
+ * so their events are interleaved under that thread.
+ */
+
+/** The option that prints totals instead of every event */
+const char SUMMARY_OPTION[] = "--summary";
+/** How many methods and opcodes a summary lists */
+#define SUMMARY_LENGTH 20
+
+static const char *const OPCODE_NAMES[256] = {
+    [i_nop] = "nop",
+    [i_iconst_m1] = "iconst_m1",
+    [i_iconst_0] = "iconst_0",
+    [i_iconst_1] = "iconst_1",
+    [i_iconst_2] = "iconst_2",
+    [i_iconst_3] = "iconst_3",
+    [i_iconst_4] = "iconst_4",
+    [i_iconst_5] = "iconst_5",
+    [i_bipush] = "bipush",
+    [i_sipush] = "sipush",
+    [i_ldc] = "ldc",
+    [i_iload] = "iload",
+    [i_aload] = "aload",
+    [i_iload_0] = "iload_0",
+    [i_iload_1] = "iload_1",
+    [i_iload_2] = "iload_2",
+    [i_iload_3] = "iload_3",
+    [i_aload_0] = "aload_0",
+    [i_aload_1] = "aload_1",
+    [i_aload_2] = "aload_2",
+    [i_aload_3] = "aload_3",
+    [i_iaload] = "iaload",
+    [i_istore] = "istore",
+    [i_astore] = "astore",
+    [i_istore_0] = "istore_0",
+    [i_istore_1] = "istore_1",
+    [i_istore_2] = "istore_2",
+    [i_istore_3] = "istore_3",
+    [i_astore_0] = "astore_0",
+    [i_astore_1] = "astore_1",
+    [i_astore_2] = "astore_2",
+    [i_astore_3] = "astore_3",
+    [i_iastore] = "iastore",
+    [i_dup] = "dup",
+    [i_iadd] = "iadd",
+    [i_isub] = "isub",
+    [i_imul] = "imul",
+    [i_idiv] = "idiv",
+    [i_irem] = "irem",
+    [i_ineg] = "ineg",
+    [i_ishl] = "ishl",
+    [i_ishr] = "ishr",
+    [i_iushr] = "iushr",
+    [i_iand] = "iand",
+    [i_ior] = "ior",
+    [i_ixor] = "ixor",
+    [i_iinc] = "iinc",
+    [i_ifeq] = "ifeq",
+    [i_ifne] = "ifne",
+    [i_iflt] = "iflt",
+    [i_ifge] = "ifge",
+    [i_ifgt] = "ifgt",
+    [i_ifle] = "ifle",
+    [i_if_icmpeq] = "if_icmpeq",
+    [i_if_icmpne] = "if_icmpne",
+    [i_if_icmplt] = "if_icmplt",
+    [i_if_icmpge] = "if_icmpge",
+    [i_if_icmpgt] = "if_icmpgt",
+    [i_if_icmple] = "if_icmple",
+    [i_goto] = "goto",
+    [i_tableswitch] = "tableswitch",
+    [i_lookupswitch] = "lookupswitch",
+    [i_ireturn] = "ireturn",
+    [i_areturn] = "areturn",
+    [i_return] = "return",
+    [i_getstatic] = "getstatic",
+    [i_invokevirtual] = "invokevirtual",
+    [i_invokestatic] = "invokestatic",
+    [i_newarray] = "newarray",
+    [i_arraylength] = "arraylength",
+};
+
+/** What a trace says about a method */
+typedef struct {
+    /** "Class.name(descriptor)", or NULL if the method hasn't been defined */
+    char *name;
+    uint64_t calls;
+    uint64_t instructions;
+} method_summary_t;
+
+/** What a trace says about a thread */
+typedef struct {
+    /** The current call depth, for indenting the thread's events */
+    size_t depth;
+    uint64_t records;
+    uint64_t lost;
+} thread_summary_t;
+
+typedef struct {
+    method_summary_t *methods;
+    size_t method_capacity;
+    thread_summary_t *threads;
+    size_t thread_capacity;
+    uint64_t opcodes[256];
+} summary_t;
+
+/** Grows an array so that `index` is in bounds, zeroing the new elements */
+static void *grow(void *array, size_t *capacity, size_t index, size_t element_size) {
+    if (index < *capacity) {
+        return array;
+    }
+    size_t new_capacity = *capacity > 0 ? *capacity : 16;
+    while (new_capacity <= index) {
+        new_capacity *= 2;
+    }
+    array = realloc(array, new_capacity * element_size);
+    assert(array != NULL && "Failed to allocate summary");
+    memset((char *) array + *capacity * element_size, 0,
+           (new_capacity - *capacity) * element_size);
+    *capacity = new_capacity;
+    return array;
+}
+
+static method_summary_t *get_method(summary_t *summary, u4 id) {
+    summary->methods = grow(summary->methods, &summary->method_capacity, id,
+                            sizeof(method_summary_t));
+    return &summary->methods[id];
+}
+
+static thread_summary_t *get_thread(summary_t *summary, u4 thread) {
+    summary->threads = grow(summary->threads, &summary->thread_capacity, thread,
+                            sizeof(thread_summary_t));
+    return &summary->threads[thread];
+}
+
+static const char *method_name(summary_t *summary, u4 id) {
+    const char *name = get_method(summary, id)->name;
+    return name != NULL ? name : "<undefined method>";
+}
+
+/** Gets the string after a NUL-terminated one, or `end` if there isn't one */
+static const char *next_string(const char *string, const char *end) {
+    const char *next = string + strlen(string) + 1;
+    return next < end ? next : end;
+}
+
+/** Reads a method block's payload: its id, then its class name, name and descriptor */
+static bool read_method(summary_t *summary, FILE *file, u4 length) {
+    u4 id;
+    if (length < sizeof(id)) {
+        return false;
+    }
+    char *payload = malloc(length + 1);
+    assert(payload != NULL && "Failed to allocate method");
+    if (fread(payload, 1, length, file) != length) {
+        free(payload);
+        return false;
+    }
+    // So that a corrupt payload's strings still end
+    const char *end = payload + length;
+    payload[length] = '\0';
+    memcpy(&id, payload, sizeof(id));
+    const char *class_name = payload + sizeof(id);
+    const char *name = next_string(class_name, end);
+    const char *descriptor = next_string(name, end);
+
+    method_summary_t *method = get_method(summary, id);
+    free(method->name);
+    size_t size = strlen(class_name) + strlen(name) + strlen(descriptor) + 2;
+    method->name = malloc(size);
+    assert(method->name != NULL && "Failed to allocate method");
+    snprintf(method->name, size, "%s.%s%s", class_name, name, descriptor);
+    free(payload);
+    return true;
+}
+
+static void print_record(summary_t *summary, u4 thread, const trace_record_t *record) {
+    thread_summary_t *thread_summary = get_thread(summary, thread);
+    if (record->event == TRACE_RETURN && thread_summary->depth > 0) {
+        thread_summary->depth--;
+    }
+    int indent = (int) (2 * thread_summary->depth);
+    switch (record->event) {
+        case TRACE_CALL:
+            printf("%" PRIu32 " %*scall %s", thread, indent, "",
+                   method_name(summary, record->method));
+            if (record->count > 0) {
+                printf(" (%" PRId32 "%s)", record->value, record->count > 1 ? ", ..." : "");
+            }
+            printf("\n");
+            thread_summary->depth++;
+            break;
+        case TRACE_RETURN:
+            printf("%" PRIu32 " %*sreturn", thread, indent, "");
+            if (record->count > 0) {
+                printf(" %" PRId32, record->value);
+            }
+            printf("\n");
+            break;
+        default: {
+            const char *opcode = OPCODE_NAMES[record->opcode];
+            printf("%" PRIu32 " %*s%5" PRIu32 ": %-14s stack %" PRIu16, thread, indent, "",
+                   record->program_counter, opcode != NULL ? opcode : "<unknown>",
+                   record->count);
+            if (record->count > 0) {
+                printf(", top %" PRId32, record->value);
+            }
+            printf("\n");
+            break;
+        }
+    }
+}
+
+static void count_record(summary_t *summary, const trace_record_t *record) {
+    method_summary_t *method = get_method(summary, record->method);
+    if (record->event == TRACE_CALL) {
+        method->calls++;
+    }
+    else if (record->event == TRACE_INSTRUCTION) {
+        method->instructions++;
+        summary->opcodes[record->opcode]++;
+    }
+}
+
+/** Orders methods by the number of instructions they ran, most first */
+static int compare_methods(const void *a, const void *b) {
+    const method_summary_t *first = a, *second = b;
+    return (first->instructions < second->instructions) -
+           (first->instructions > second->instructions);
+}
+
+static void print_summary(summary_t *summary) {
+    uint64_t records = 0;
+    uint64_t lost = 0;
+    size_t threads = 0;
+    for (size_t i = 0; i < summary->thread_capacity; i++) {
+        if (summary->threads[i].records > 0 || summary->threads[i].lost > 0) {
+            threads++;
+            records += summary->threads[i].records;
+            lost += summary->threads[i].lost;
+            printf("thread %zu: %" PRIu64 " records, %" PRIu64 " lost\n", i,
+                   summary->threads[i].records, summary->threads[i].lost);
+        }
+    }
+    printf("%" PRIu64 " records on %zu threads, %" PRIu64 " lost\n\n", records, threads,
+           lost);
+
+    uint64_t instructions = 0;
+    for (size_t i = 0; i < 256; i++) {
+        instructions += summary->opcodes[i];
+    }
+    if (instructions == 0) {
+        return;
+    }
+    qsort(summary->methods, summary->method_capacity, sizeof(method_summary_t),
+          compare_methods);
+    printf("%-40s %12s %14s %7s\n", "method", "calls", "instructions", "%");
+    for (size_t i = 0; i < summary->method_capacity && i < SUMMARY_LENGTH; i++) {
+        method_summary_t *method = &summary->methods[i];
+        if (method->calls == 0 && method->instructions == 0) {
+            break;
+        }
+        printf("%-40s %12" PRIu64 " %14" PRIu64 " %6.2f%%\n",
+               method->name != NULL ? method->name : "<undefined method>", method->calls,
+               method->instructions, 100.0 * method->instructions / instructions);
+    }
+
+    printf("\n%-40s %12s %14s %7s\n", "opcode", "", "instructions", "%");
+    for (size_t shown = 0; shown < SUMMARY_LENGTH; shown++) {
+        size_t most = 0;
+        for (size_t i = 1; i < 256; i++) {
+            if (summary->opcodes[i] > summary->opcodes[most]) {
+                most = i;
+            }
+        }
+        if (summary->opcodes[most] == 0) {
+            break;
+        }
+        printf("%-40s %12s %14" PRIu64 " %6.2f%%\n",
+               OPCODE_NAMES[most] != NULL ? OPCODE_NAMES[most] : "<unknown>", "",
+               summary->opcodes[most], 100.0 * summary->opcodes[most] / instructions);
+        summary->opcodes[most] = 0;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bool summarize = argc == 3 && strcmp(argv[1], SUMMARY_OPTION) == 0;
+    if (argc != 2 && !summarize) {
+        fprintf(stderr, "USAGE: %s [%s] <trace>\n", argv[0], SUMMARY_OPTION);
+        return 1;
+    }
+    const char *path = argv[argc - 1];
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return 1;
+    }
+    trace_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TRACE_VERSION || header.record_size != sizeof(trace_record_t)) {
+        fprintf(stderr, "%s isn't a trace this version of %s can read\n", path, argv[0]);
+        fclose(file);
+        return 1;
+    }
+
+    summary_t summary = {0};
+    trace_block_t block;
+    trace_record_t *records = malloc(sizeof(trace_record_t[TRACE_RING_SIZE]));
+    assert(records != NULL && "Failed to allocate records");
+    bool truncated = false;
+    while (!truncated && fread(&block, sizeof(block), 1, file) == 1) {
+        switch (block.type) {
+            case TRACE_BLOCK_METHOD:
+                truncated = !read_method(&summary, file, block.count);
+                break;
+            case TRACE_BLOCK_LOST:
+                get_thread(&summary, block.thread)->lost += block.count;
+                if (!summarize) {
+                    printf("%" PRIu32 " ... %" PRIu32 " records lost\n", block.thread,
+                           block.count);
+                }
+                break;
+            case TRACE_BLOCK_RECORDS:
+                if (block.count > TRACE_RING_SIZE ||
+                    fread(records, sizeof(trace_record_t), block.count, file) !=
+                        block.count) {
+                    truncated = true;
+                    break;
+                }
+                get_thread(&summary, block.thread)->records += block.count;
+                for (u4 i = 0; i < block.count; i++) {
+                    if (summarize) {
+                        count_record(&summary, &records[i]);
+                    }
+                    else {
+                        print_record(&summary, block.thread, &records[i]);
+                    }
+                }
+                break;
+            default:
+                truncated = true;
+                break;
+        }
+    }
+    if (summarize) {
+        print_summary(&summary);
+    }
+    if (truncated) {
+        fprintf(stderr, "%s is truncated or corrupt\n", path);
+    }
+
+    free(records);
+    for (size_t i = 0; i < summary.method_capacity; i++) {
+        free(summary.methods[i].name);
+    }
+    free(summary.methods);
+    free(summary.threads);
+    fclose(file);
+    return truncated ? 1 : 0;
+}
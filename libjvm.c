@@ -0,0 +1,105 @@
+#include "libjvm.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "class_loader.h"
+#include "heap.h"
+#include "output.h"
+#include "read_class.h"
+#include "symbols.h"
+
+typedef struct jvm_runtime {
+    class_loader_t *loader;
+} jvm_runtime_t;
+
+typedef struct jvm_context {
+    heap_t *heap;
+    output_t *output;
+} jvm_context_t;
+
+/**
+ * The number of runtimes that haven't been freed. The symbol table is shared by
+ * every runtime in the process, so it is only freed along with the last one.
+ */
+static atomic_size_t runtime_count;
+
+jvm_runtime_t *jvm_runtime_init(const char *classpath) {
+    jvm_runtime_t *runtime = malloc(sizeof(*runtime));
+    assert(runtime != NULL && "Failed to allocate runtime");
+    runtime->loader = class_loader_init(classpath);
+    atomic_fetch_add(&runtime_count, 1);
+    return runtime;
+}
+
+const class_file_t *jvm_load_class(jvm_runtime_t *runtime, const char *class_name) {
+    class_file_t *class = class_loader_load_main(runtime->loader, class_name);
+    if (class != NULL) {
+        // Nothing the class calls is loaded or prepared lazily after this
+        class_loader_link(runtime->loader);
+    }
+    return class;
+}
+
+void jvm_runtime_free(jvm_runtime_t *runtime) {
+    class_loader_free(runtime->loader);
+    free(runtime);
+    if (atomic_fetch_sub(&runtime_count, 1) == 1) {
+        symbols_free();
+    }
+}
+
+jvm_context_t *jvm_context_init(FILE *stream) {
+    jvm_context_t *context = malloc(sizeof(*context));
+    assert(context != NULL && "Failed to allocate context");
+    context->heap = heap_init();
+    context->output = stream != NULL ? output_init(stream) : output_init_buffer();
+    return context;
+}
+
+bool jvm_invoke(jvm_context_t *context, const class_file_t *class, const char *name,
+                const char *descriptor, const int32_t *arguments,
+                size_t argument_count, optional_value_t *result) {
+    method_t *method = find_method(name, descriptor, class);
+    if (method == NULL || !method_invocable(method) ||
+        method->parameter_count != argument_count ||
+        strspn(method->parameter_types, "I") != argument_count) {
+        return false;
+    }
+
+    // Linking prepared the method, so this only checks that it is prepared
+    prepare_method(method);
+    int32_t *locals = calloc(method->code.max_locals, sizeof(int32_t));
+    assert((locals != NULL || method->code.max_locals == 0) &&
+           "Failed to allocate locals");
+    if (argument_count > 0) {
+        memcpy(locals, arguments, sizeof(int32_t[argument_count]));
+    }
+    optional_value_t returned = execute(method, locals, method->class, context->heap,
+                                        context->output);
+    free(locals);
+    // A stream context's output should appear as soon as the call returns
+    output_flush(context->output);
+    if (result != NULL) {
+        *result = returned;
+    }
+    return true;
+}
+
+const char *jvm_context_output(const jvm_context_t *context, size_t *length) {
+    return output_contents(context->output, length);
+}
+
+void jvm_context_reset(jvm_context_t *context) {
+    heap_free(context->heap);
+    context->heap = heap_init();
+    output_reset(context->output);
+}
+
+void jvm_context_free(jvm_context_t *context) {
+    output_free(context->output);
+    heap_free(context->heap);
+    free(context);
+}
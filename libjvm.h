@@ -0,0 +1,97 @@
+#ifndef LIBJVM_H
+#define LIBJVM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "jvm.h"
+
+/**
+ * An API for running bytecode inside another program, built as libjvm.so.
+ *
+ * A runtime loads classes once, and each loaded class is an immutable handle that
+ * can be shared between threads. Methods run in a context, which holds a program's
+ * heap and output. A context is cheap to create, can be reset and reused for any
+ * number of invocations, and must only be used by one thread at a time; run
+ * concurrent invocations in separate contexts.
+ *
+ * Errors in the bytecode itself (e.g. failed verification) abort, as in the `jvm`
+ * executable; errors in how the API is used are reported by return values.
+ */
+typedef struct jvm_runtime jvm_runtime_t;
+typedef struct jvm_context jvm_context_t;
+
+/**
+ * Creates a runtime, which owns every class it loads.
+ *
+ * @param classpath where to look for classes (see `class_loader_init()`), or NULL
+ *   for the current directory
+ * @return the runtime
+ */
+jvm_runtime_t *jvm_runtime_init(const char *classpath);
+
+/**
+ * Loads a class, along with every class it can call into, and prepares every method
+ * they can invoke, so that invoking them never loads or modifies a class. Loading
+ * the same class again returns the same handle.
+ *
+ * @param runtime the runtime to load the class into
+ * @param class_name the class's name on the classpath, or the path of a ".class" file
+ * @return the class, or NULL if it can't be found
+ */
+const class_file_t *jvm_load_class(jvm_runtime_t *runtime, const char *class_name);
+
+/**
+ * Frees a runtime and every class it loaded.
+ * Every context used with the runtime's classes must be freed first.
+ */
+void jvm_runtime_free(jvm_runtime_t *runtime);
+
+/**
+ * Creates an execution context.
+ *
+ * @param stream the stream the program's output goes to, or NULL to collect it in
+ *   memory (see `jvm_context_output()`)
+ * @return the context
+ */
+jvm_context_t *jvm_context_init(FILE *stream);
+
+/**
+ * Invokes a static method. Only methods whose parameters are all ints can be invoked.
+ *
+ * @param context the context to run the method in
+ * @param class a class loaded by `jvm_load_class()`
+ * @param name the method's name, e.g. "fib"
+ * @param descriptor the method's descriptor, e.g. "(I)I"
+ * @param arguments the method's arguments
+ * @param argument_count the number of arguments
+ * @param result set to the method's return value, if it isn't NULL
+ * @return false if there is no such static method or it takes different arguments
+ */
+bool jvm_invoke(jvm_context_t *context, const class_file_t *class, const char *name,
+                const char *descriptor, const int32_t *arguments,
+                size_t argument_count, optional_value_t *result);
+
+/**
+ * Gets the output collected by a context created without a stream.
+ *
+ * @param context the context
+ * @param length set to the number of bytes of output
+ * @return the output since the context was created or last reset (not
+ *   NUL-terminated)
+ */
+const char *jvm_context_output(const jvm_context_t *context, size_t *length);
+
+/**
+ * Discards a context's heap and collected output, so that it can be reused as if
+ * it had just been created.
+ */
+void jvm_context_reset(jvm_context_t *context);
+
+/**
+ * Frees a context.
+ */
+void jvm_context_free(jvm_context_t *context);
+
+#endif /* LIBJVM_H */
@@ -0,0 +1,353 @@
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "class_loader.h"
+#include "counters.h"
+#include "daemon.h"
+#include "heap.h"
+#include "image.h"
+#include "jvm.h"
+#include "metrics.h"
+#include "output.h"
+#include "perf.h"
+#include "read_class.h"
+#include "symbols.h"
+#include "trace.h"
+
+/** The option that sets the classpath */
+const char CLASSPATH_OPTION[] = "-cp";
+/** The option that writes a startup image instead of running the program */
+const char DUMP_IMAGE_OPTION[] = "--dump-image";
+/** The option that runs the program from a startup image */
+const char USE_IMAGE_OPTION[] = "--use-image";
+/**
+ * The option that loads every class the program references up front, on the given
+ * number of threads (0 for one per CPU), instead of lazily
+ */
+const char LOAD_THREADS_OPTION[] = "--load-threads";
+/** The option that runs a list of jobs concurrently (see batch.h) */
+const char BATCH_OPTION[] = "--batch";
+/**
+ * The option that sets the number of threads to run a batch on, or the most runs a
+ * daemon runs at once (0 for one per CPU)
+ */
+const char THREADS_OPTION[] = "--threads";
+/** The option that serves run requests on the given socket (see daemon.h) */
+const char DAEMON_OPTION[] = "--daemon";
+/** The option that sets how many seconds each of a daemon's runs may take */
+const char TIME_LIMIT_OPTION[] = "--time-limit";
+/** The option that sets how many MiB of memory each of a daemon's runs may use */
+const char MEMORY_LIMIT_OPTION[] = "--memory-limit";
+/**
+ * The option that runs a batch's runs as green threads on one thread, each using at
+ * most the given fuel per turn (see scheduler.h)
+ */
+const char QUANTUM_OPTION[] = "--quantum";
+/**
+ * The option that cuts off a program (or each of a batch's runs, as green threads)
+ * once it has made the given number of backward branches and calls
+ */
+const char FUEL_OPTION[] = "--fuel";
+/** The option that records an execution trace in the given file (see trace.h) */
+const char TRACE_OPTION[] = "--trace";
+/**
+ * The option that runs each method through a trampoline of its own, which perf can
+ * name, and lists the trampolines in a perf map, or in a jitdump file too (see perf.h)
+ */
+const char PERF_OPTION[] = "--perf";
+const char PERF_MAP_FORMAT[] = "map";
+const char PERF_JITDUMP_FORMAT[] = "jitdump";
+/** The option that serves live metrics on the given socket (see metrics.h) */
+const char METRICS_OPTION[] = "--metrics";
+/**
+ * The option that counts cycles, cache misses and so on per method, and prints the
+ * given number of methods with the most at exit (0 for all of them; see counters.h)
+ */
+const char PERF_COUNTERS_OPTION[] = "--perf-counters";
+
+/** glibc's handler for failed assertions, which prints the message and aborts */
+_Noreturn void __real___assert_fail(const char *assertion, const char *file,
+                                    unsigned int line, const char *function);
+
+/**
+ * Stands in for glibc's handler for failed assertions (the jvm is linked with
+ * `--wrap=__assert_fail`), so that the program's buffered output is written out
+ * before the assertion's message, rather than being lost when the process aborts.
+ */
+_Noreturn void __wrap___assert_fail(const char *assertion, const char *file,
+                                    unsigned int line, const char *function) {
+    output_flush_all();
+    __real___assert_fail(assertion, file, line, function);
+}
+
+/**
+ * Parses the number given to an option, if the option was given.
+ *
+ * @param value the option's value, or NULL if the option wasn't given
+ * @param allow_zero whether 0 means something for the option (e.g. "one per CPU")
+ * @param number set to the number, or 0 if the option wasn't given
+ * @return whether the value is a decimal number, and isn't 0 unless that is allowed
+ */
+static bool parse_number(const char *value, bool allow_zero, uint64_t *number) {
+    *number = 0;
+    if (value == NULL) {
+        return true;
+    }
+    // strtoull() would accept leading whitespace and a minus sign
+    if (!isdigit((unsigned char) value[0])) {
+        return false;
+    }
+    char *end;
+    errno = 0;
+    *number = strtoull(value, &end, 10);
+    return *end == '\0' && errno == 0 && (allow_zero || *number > 0);
+}
+
+int main(int argc, char *argv[]) {
+    const char *classpath = NULL;
+    const char *dump_image = NULL;
+    const char *use_image = NULL;
+    const char *load_threads = NULL;
+    const char *batch = NULL;
+    const char *threads = NULL;
+    const char *daemon = NULL;
+    const char *time_limit = NULL;
+    const char *memory_limit = NULL;
+    const char *quantum = NULL;
+    const char *fuel = NULL;
+    const char *trace = NULL;
+    const char *perf = NULL;
+    const char *metrics = NULL;
+    const char *perf_counters = NULL;
+    int arg = 1;
+    while (arg + 1 < argc) {
+        if (strcmp(argv[arg], CLASSPATH_OPTION) == 0) {
+            classpath = argv[arg + 1];
+        }
+        else if (strcmp(argv[arg], DUMP_IMAGE_OPTION) == 0) {
+            dump_image = argv[arg + 1];
+        }
+        else if (strcmp(argv[arg], USE_IMAGE_OPTION) == 0) {
+            use_image = argv[arg + 1];
+        }
+        else if (strcmp(argv[arg], LOAD_THREADS_OPTION) == 0) {
+            load_threads = argv[arg + 1];
+        }
+        else if (strcmp(argv[arg], BATCH_OPTION) == 0) {
+            batch = argv[arg + 1];
+        }
+        else if (strcmp(argv[arg], THREADS_OPTION) == 0) {
+            threads = argv[arg + 1];
+        }
+        else if (strcmp(argv[arg], DAEMON_OPTION) == 0) {
+            daemon = argv[arg + 1];
+        }
+        else if (strcmp(argv[arg], TIME_LIMIT_OPTION) == 0) {
+            time_limit = argv[arg + 1];
+        }
+        else if (strcmp(argv[arg], MEMORY_LIMIT_OPTION) == 0) {
+            memory_limit = argv[arg + 1];
+        }
+        else if (strcmp(argv[arg], QUANTUM_OPTION) == 0) {
+            quantum = argv[arg + 1];
+        }
+        else if (strcmp(argv[arg], FUEL_OPTION) == 0) {
+            fuel = argv[arg + 1];
+        }
+        else if (strcmp(argv[arg], TRACE_OPTION) == 0) {
+            trace = argv[arg + 1];
+        }
+        else if (strcmp(argv[arg], PERF_OPTION) == 0) {
+            perf = argv[arg + 1];
+        }
+        else if (strcmp(argv[arg], METRICS_OPTION) == 0) {
+            metrics = argv[arg + 1];
+        }
+        else if (strcmp(argv[arg], PERF_COUNTERS_OPTION) == 0) {
+            perf_counters = argv[arg + 1];
+        }
+        else {
+            break;
+        }
+        arg += 2;
+    }
+    // A limit of 0 would mean no limit, which is the default anyway
+    uint64_t fuel_limit, quantum_fuel, thread_count, load_thread_count;
+    uint64_t time_limit_seconds, memory_limit_mib, counted_methods;
+    bool numbers_valid = parse_number(fuel, false, &fuel_limit) &&
+                         parse_number(quantum, false, &quantum_fuel) &&
+                         parse_number(threads, true, &thread_count) &&
+                         parse_number(load_threads, true, &load_thread_count) &&
+                         parse_number(time_limit, true, &time_limit_seconds) &&
+                         parse_number(memory_limit, true, &memory_limit_mib) &&
+                         parse_number(perf_counters, true, &counted_methods);
+    // An image, a batch or a daemon's requests name the main classes; otherwise one
+    // must be given
+    bool main_class_given = use_image == NULL && batch == NULL && daemon == NULL;
+    if (!numbers_valid || (main_class_given ? arg + 1 != argc : arg != argc) ||
+        (dump_image != NULL && !main_class_given) ||
+        (use_image != NULL && batch != NULL) ||
+        (daemon != NULL &&
+         (use_image != NULL || batch != NULL || load_threads != NULL)) ||
+        ((time_limit != NULL || memory_limit != NULL) && daemon == NULL) ||
+        (quantum != NULL && batch == NULL) ||
+        (fuel != NULL && (daemon != NULL || dump_image != NULL)) ||
+        (trace != NULL && (daemon != NULL || dump_image != NULL)) ||
+        (perf != NULL && (daemon != NULL || dump_image != NULL || trace != NULL ||
+                          (strcmp(perf, PERF_MAP_FORMAT) != 0 &&
+                           strcmp(perf, PERF_JITDUMP_FORMAT) != 0))) ||
+        (metrics != NULL && (daemon != NULL || dump_image != NULL || trace != NULL)) ||
+        // Counting only follows calls of execute(), so not green threads, and
+        // counting alongside other instrumentation would measure it too
+        (perf_counters != NULL &&
+         (daemon != NULL || dump_image != NULL || fuel != NULL || quantum != NULL ||
+          trace != NULL || perf != NULL || metrics != NULL))) {
+        fprintf(stderr,
+                "USAGE: %s [%s <classpath>] [%s <threads>] [%s <image>]\n"
+                "           [%s <fuel>] [%s <trace> | %s %s | %s] [%s <socket>]\n"
+                "           [%s <methods>] <class file | class name>\n"
+                "       %s [%s <classpath>] [%s <fuel>] [%s <trace> | %s %s | %s]\n"
+                "           [%s <socket>] [%s <methods>] %s <image>\n"
+                "       %s [%s <classpath>] [%s <threads> | %s <fuel>] [%s <fuel>]\n"
+                "           [%s <trace> | %s %s | %s] [%s <socket>]\n"
+                "           [%s <methods>] %s <job list>\n"
+                "       %s [%s <classpath>] [%s <runs>] [%s <seconds>]\n"
+                "           [%s <MiB>] %s <socket>\n",
+                argv[0], CLASSPATH_OPTION, LOAD_THREADS_OPTION, DUMP_IMAGE_OPTION,
+                FUEL_OPTION, TRACE_OPTION, PERF_OPTION, PERF_MAP_FORMAT,
+                PERF_JITDUMP_FORMAT, METRICS_OPTION, PERF_COUNTERS_OPTION, argv[0],
+                CLASSPATH_OPTION, FUEL_OPTION, TRACE_OPTION, PERF_OPTION, PERF_MAP_FORMAT,
+                PERF_JITDUMP_FORMAT, METRICS_OPTION, PERF_COUNTERS_OPTION,
+                USE_IMAGE_OPTION, argv[0], CLASSPATH_OPTION, THREADS_OPTION,
+                QUANTUM_OPTION, FUEL_OPTION, TRACE_OPTION, PERF_OPTION, PERF_MAP_FORMAT,
+                PERF_JITDUMP_FORMAT, METRICS_OPTION, PERF_COUNTERS_OPTION, BATCH_OPTION,
+                argv[0], CLASSPATH_OPTION, THREADS_OPTION, TIME_LIMIT_OPTION,
+                MEMORY_LIMIT_OPTION, DAEMON_OPTION);
+        return 1;
+    }
+
+    if (daemon != NULL) {
+        daemon_limits_t limits = {.max_runs = thread_count,
+                                  .time_limit = time_limit_seconds,
+                                  .memory_limit = memory_limit_mib << 20};
+        bool success = daemon_run(daemon, classpath, &limits);
+        symbols_free();
+        return success ? 0 : 1;
+    }
+
+    if (trace != NULL && !trace_start(trace)) {
+        fprintf(stderr, "Failed to create trace %s\n", trace);
+        return 1;
+    }
+    if (perf != NULL &&
+        !perf_start(strcmp(perf, PERF_JITDUMP_FORMAT) == 0 ? PERF_JITDUMP : PERF_MAP)) {
+        fprintf(stderr, "Failed to set up %s %s\n", PERF_OPTION, perf);
+        return 1;
+    }
+    if (metrics != NULL && !metrics_start(metrics)) {
+        perf_stop();
+        return 1;
+    }
+    if (perf_counters != NULL) {
+        counters_start(counted_methods);
+    }
+
+    /* Classes are loaded lazily, the first time they are referenced. The main class
+     * can be named either by its path or by its name on the classpath, or it can
+     * come from an image along with every class it uses. */
+    class_loader_t *loader = class_loader_init(classpath);
+    if (batch != NULL) {
+        batch_options_t options = {
+            .threads = thread_count,
+            .green_threads = quantum != NULL || fuel != NULL,
+            .quantum = quantum_fuel,
+            .fuel_limit = fuel_limit};
+        bool success = batch_run(loader, batch, &options);
+        trace_stop();
+        perf_stop();
+        metrics_stop();
+        counters_stop();
+        class_loader_free(loader);
+        symbols_free();
+        return success ? 0 : 1;
+    }
+
+    image_t *image = NULL;
+    class_file_t *class;
+    if (use_image != NULL) {
+        image = image_open(use_image, loader);
+        assert(image != NULL && "Failed to open image");
+        class = image_main_class(image);
+    }
+    else {
+        class = class_loader_load_main(loader, argv[arg]);
+        assert(class != NULL && "Main class not found");
+    }
+
+    if (load_threads != NULL) {
+        class_loader_preload(loader, load_thread_count);
+    }
+
+    if (dump_image != NULL) {
+        // Load and resolve everything the program could use, instead of running it
+        class_loader_link(loader);
+        bool written = image_write(dump_image, loader, class);
+        if (!written) {
+            fprintf(stderr, "Failed to write image %s\n", dump_image);
+        }
+        class_loader_free(loader);
+        symbols_free();
+        return written ? 0 : 1;
+    }
+
+    // The heap array is initially allocated to hold zero elements.
+    heap_t *heap = heap_init();
+
+    // Execute the main method
+    output_t *output = output_init(stdout);
+    bool finished = true;
+    if (fuel_limit > 0) {
+        // Run it as a green thread, so it can be stopped once it runs out of fuel
+        method_t *main_method = find_method(MAIN_METHOD, MAIN_DESCRIPTOR, class);
+        assert(main_method != NULL && "Missing main() method");
+        green_thread_t *thread = green_thread_init(main_method, heap, output);
+        finished = green_thread_run(thread, &fuel_limit);
+        green_thread_free(thread);
+        if (!finished) {
+            output_flush(output);
+            fprintf(stderr, "Program cut off after %s backward branches and calls\n",
+                    fuel);
+        }
+    }
+    else {
+        execute_main(class, heap, output);
+    }
+    output_free(output);
+    trace_stop();
+    perf_stop();
+    metrics_stop();
+    counters_stop();
+
+    // Free the internal data structures, including every class that was loaded
+    class_loader_free(loader);
+    // Image classes point into the image, so it can only be unmapped afterwards
+    if (image != NULL) {
+        image_close(image);
+    }
+
+    // Free the heap
+    heap_free(heap);
+
+    // Free the interned strings, now that no class refers to them
+    symbols_free();
+#ifdef COUNT_INSTRUCTIONS
+    fprintf(stderr, "Executed %" PRIu64 " instructions\n", instructions_executed);
+#endif
+    return finished ? 0 : 1;
+}
@@ -0,0 +1,239 @@
+#include "metrics.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/** How many clients may wait for a snapshot */
+#define METRICS_LISTEN_BACKLOG 16
+
+bool metrics_enabled = false;
+_Thread_local metrics_thread_t *metrics_current_thread = NULL;
+
+/** Protects `threads` and `methods` */
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+/** Every thread's counters, newest first */
+static metrics_thread_t *threads;
+/** Every method that has been invoked, in the order they were first invoked */
+static method_t **methods;
+static size_t method_count;
+static size_t method_capacity;
+
+static const char *socket_path;
+static int listener;
+/** Written to when metrics stop, so that poll() wakes up */
+static int stop_pipe[2];
+static pthread_t server;
+static struct timespec start_time;
+/** When the last snapshot was taken, and the bytes allocated by then */
+static struct timespec last_snapshot_time;
+static uint64_t last_bytes_allocated;
+
+static double seconds_since(const struct timespec *since, const struct timespec *now) {
+    return (double) (now->tv_sec - since->tv_sec) +
+           (double) (now->tv_nsec - since->tv_nsec) / 1e9;
+}
+
+static uint64_t load(_Atomic uint64_t *counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+/** A method's invocation count at the time of a snapshot */
+typedef struct {
+    method_t *method;
+    uint64_t invocations;
+} method_invocations_t;
+
+/** Orders methods by invocations, most first */
+static int compare_invocations(const void *a, const void *b) {
+    uint64_t a_invocations = ((const method_invocations_t *) a)->invocations;
+    uint64_t b_invocations = ((const method_invocations_t *) b)->invocations;
+    return (a_invocations < b_invocations) - (a_invocations > b_invocations);
+}
+
+/** Writes a snapshot of the metrics */
+static void write_snapshot(FILE *client) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&metrics_lock);
+    uint64_t thread_count = 0, instructions = 0, depth = 0, max_depth = 0;
+    uint64_t arrays_allocated = 0, bytes_allocated = 0, arrays_freed = 0, bytes_freed = 0;
+    uint64_t output_bytes = 0;
+    for (metrics_thread_t *thread = threads; thread != NULL; thread = thread->next) {
+        thread_count++;
+        instructions += load(&thread->instructions);
+        depth += load(&thread->depth);
+        uint64_t thread_max_depth = load(&thread->max_depth);
+        if (thread_max_depth > max_depth) {
+            max_depth = thread_max_depth;
+        }
+        arrays_allocated += load(&thread->arrays_allocated);
+        bytes_allocated += load(&thread->bytes_allocated);
+        arrays_freed += load(&thread->arrays_freed);
+        bytes_freed += load(&thread->bytes_freed);
+        output_bytes += load(&thread->output_bytes);
+    }
+    // The invocation counts keep changing, so sort a copy of them
+    size_t count = method_count;
+    method_invocations_t *sorted = malloc(sizeof(method_invocations_t[count + 1]));
+    assert(sorted != NULL && "Failed to allocate snapshot");
+    for (size_t i = 0; i < count; i++) {
+        sorted[i] = (method_invocations_t){
+            .method = methods[i],
+            .invocations = load(&methods[i]->invocations)};
+    }
+    pthread_mutex_unlock(&metrics_lock);
+    qsort(sorted, count, sizeof(sorted[0]), compare_invocations);
+
+    // The allocation rate since the previous snapshot, or since metrics started
+    double interval = seconds_since(&last_snapshot_time, &now);
+    double allocation_rate =
+        interval > 0 ? (double) (bytes_allocated - last_bytes_allocated) / interval : 0;
+    last_snapshot_time = now;
+    last_bytes_allocated = bytes_allocated;
+
+    fprintf(client, "uptime_seconds %.3f\n", seconds_since(&start_time, &now));
+    fprintf(client, "threads %" PRIu64 "\n", thread_count);
+    fprintf(client, "instructions %" PRIu64 "\n", instructions);
+    fprintf(client, "frame_depth %" PRIu64 "\n", depth);
+    fprintf(client, "frame_depth_max %" PRIu64 "\n", max_depth);
+    // Arrays may be freed by a different thread than allocated them, so only the
+    // totals are meaningful
+    fprintf(client, "heap_live_arrays %" PRIu64 "\n", arrays_allocated - arrays_freed);
+    fprintf(client, "heap_live_bytes %" PRIu64 "\n", bytes_allocated - bytes_freed);
+    fprintf(client, "heap_allocated_arrays %" PRIu64 "\n", arrays_allocated);
+    fprintf(client, "heap_allocated_bytes %" PRIu64 "\n", bytes_allocated);
+    fprintf(client, "heap_allocation_rate_bytes_per_second %.0f\n", allocation_rate);
+    fprintf(client, "output_bytes %" PRIu64 "\n", output_bytes);
+    for (size_t i = 0; i < count; i++) {
+        method_t *method = sorted[i].method;
+        fprintf(client, "invocations %s.%s%s %" PRIu64 "\n", method->class->name,
+                method->name, method->descriptor, sorted[i].invocations);
+    }
+    free(sorted);
+}
+
+/** Serves snapshots until metrics stop */
+static void *serve(void *unused) {
+    (void) unused;
+    while (true) {
+        struct pollfd fds[] = {{.fd = stop_pipe[0], .events = POLLIN},
+                               {.fd = listener, .events = POLLIN}};
+        if (poll(fds, 2, -1) < 0) {
+            assert(errno == EINTR && "Failed to poll");
+            continue;
+        }
+        if (fds[0].revents & POLLIN) {
+            return NULL;
+        }
+        if (fds[1].revents & POLLIN) {
+            int connection = accept(listener, NULL, NULL);
+            if (connection < 0) {
+                continue;
+            }
+            // Take the snapshot in memory, so that a client that hangs up early
+            // can't kill the process with SIGPIPE
+            char *snapshot;
+            size_t length;
+            FILE *buffer = open_memstream(&snapshot, &length);
+            assert(buffer != NULL && "Failed to allocate snapshot");
+            write_snapshot(buffer);
+            fclose(buffer);
+            for (size_t sent = 0; sent < length;) {
+                ssize_t written =
+                    send(connection, snapshot + sent, length - sent, MSG_NOSIGNAL);
+                if (written <= 0) {
+                    break;
+                }
+                sent += written;
+            }
+            free(snapshot);
+            close(connection);
+        }
+    }
+}
+
+bool metrics_start(const char *path) {
+    assert(!metrics_enabled && "Metrics already started");
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return false;
+    }
+    strcpy(address.sun_path, path);
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (listener < 0 || bind(listener, (struct sockaddr *) &address, sizeof(address)) ||
+        listen(listener, METRICS_LISTEN_BACKLOG)) {
+        perror(path);
+        if (listener >= 0) {
+            close(listener);
+        }
+        return false;
+    }
+    socket_path = path;
+
+    int error = pipe(stop_pipe);
+    assert(error == 0 && "Failed to create pipe");
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    last_snapshot_time = start_time;
+    error = pthread_create(&server, NULL, serve, NULL);
+    assert(error == 0 && "Failed to start metrics thread");
+    metrics_enabled = true;
+    return true;
+}
+
+void metrics_stop(void) {
+    if (!metrics_enabled) {
+        return;
+    }
+    metrics_enabled = false;
+    ssize_t written = write(stop_pipe[1], "", 1);
+    assert(written == 1 && "Failed to stop metrics thread");
+    pthread_join(server, NULL);
+    close(stop_pipe[0]);
+    close(stop_pipe[1]);
+    close(listener);
+    unlink(socket_path);
+
+    while (threads != NULL) {
+        metrics_thread_t *thread = threads;
+        threads = thread->next;
+        free(thread);
+    }
+    free(methods);
+    methods = NULL;
+    method_count = method_capacity = 0;
+}
+
+metrics_thread_t *metrics_thread_register(void) {
+    metrics_thread_t *thread = calloc(1, sizeof(*thread));
+    assert(thread != NULL && "Failed to allocate metrics");
+    pthread_mutex_lock(&metrics_lock);
+    thread->next = threads;
+    threads = thread;
+    pthread_mutex_unlock(&metrics_lock);
+    metrics_current_thread = thread;
+    return thread;
+}
+
+void metrics_define_method(method_t *method) {
+    pthread_mutex_lock(&metrics_lock);
+    if (method_count == method_capacity) {
+        method_capacity = method_capacity > 0 ? method_capacity * 2 : 64;
+        methods = realloc(methods, sizeof(method_t *[method_capacity]));
+        assert(methods != NULL && "Failed to allocate metrics");
+    }
+    methods[method_count++] = method;
+    pthread_mutex_unlock(&metrics_lock);
+}
@@ -0,0 +1,115 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "class_file.h"
+
+/**
+ * Live metrics about a running VM, for looking inside a long-running job without
+ * stopping it (see `--metrics` in main.c).
+ *
+ * A background thread serves a snapshot of the metrics to every client that
+ * connects to a Unix domain socket, e.g. with `nc -U <socket>`, then closes the
+ * connection. A snapshot is plain text, one metric per line:
+ *
+ *     uptime_seconds 12.034
+ *     instructions 1234567890
+ *     frame_depth 25
+ *     ...
+ *     invocations Fib.fib(I)I 4650005
+ *
+ * Every thread that runs bytecode counts into a `metrics_thread_t` of its own,
+ * which only it writes, so counting takes no atomic read-modify-writes. A snapshot
+ * adds up the threads' counters. The exception is each method's invocation count,
+ * which every thread adds to with relaxed atomics.
+ */
+
+/** One thread's counters. Each is only written by its thread, and read by snapshots. */
+typedef struct metrics_thread {
+    /** The instructions the thread has run */
+    _Atomic uint64_t instructions;
+    /** The frames the thread has in progress, and the most it has had at once */
+    _Atomic uint64_t depth;
+    _Atomic uint64_t max_depth;
+    /** The arrays the thread has allocated and freed, and their sizes in bytes */
+    _Atomic uint64_t arrays_allocated;
+    _Atomic uint64_t bytes_allocated;
+    _Atomic uint64_t arrays_freed;
+    _Atomic uint64_t bytes_freed;
+    /** The bytes of output the thread's programs have printed */
+    _Atomic uint64_t output_bytes;
+    /** The next thread (see `metrics_thread_register()`) */
+    struct metrics_thread *next;
+} metrics_thread_t;
+
+/** Whether metrics are being collected. Only changes while no bytecode is running. */
+extern bool metrics_enabled;
+/** The calling thread's counters, or NULL if it hasn't counted anything yet */
+extern _Thread_local metrics_thread_t *metrics_current_thread;
+
+/**
+ * Starts collecting metrics and serving them on a socket. This must be done before
+ * any bytecode runs, and at most once per process.
+ *
+ * @param socket_path the path to create the socket at, replacing any existing file
+ * @return false if the socket can't be created
+ */
+bool metrics_start(const char *socket_path);
+
+/**
+ * Stops serving metrics, and removes the socket. Call this once no bytecode is
+ * running.
+ */
+void metrics_stop(void);
+
+/**
+ * Creates the calling thread's counters, the first time the thread counts something.
+ */
+metrics_thread_t *metrics_thread_register(void);
+
+/**
+ * Lists a method in snapshots, the first time it is invoked.
+ */
+void metrics_define_method(method_t *method);
+
+/** Gets the calling thread's counters */
+static inline metrics_thread_t *metrics_thread(void) {
+    metrics_thread_t *thread = metrics_current_thread;
+    return thread != NULL ? thread : metrics_thread_register();
+}
+
+/** Adds to one of the calling thread's counters (see `metrics_thread()`) */
+static inline void metrics_add(_Atomic uint64_t *counter, uint64_t amount) {
+    uint64_t value = atomic_load_explicit(counter, memory_order_relaxed);
+    atomic_store_explicit(counter, value + amount, memory_order_relaxed);
+}
+
+/**
+ * Counts a call of a method, which is entering a new frame.
+ *
+ * @return the calling thread's counters
+ */
+static inline metrics_thread_t *metrics_call(method_t *method) {
+    if (atomic_fetch_add_explicit(&method->invocations, 1, memory_order_relaxed) == 0) {
+        metrics_define_method(method);
+    }
+    metrics_thread_t *thread = metrics_thread();
+    uint64_t depth = atomic_load_explicit(&thread->depth, memory_order_relaxed) + 1;
+    atomic_store_explicit(&thread->depth, depth, memory_order_relaxed);
+    if (depth > atomic_load_explicit(&thread->max_depth, memory_order_relaxed)) {
+        atomic_store_explicit(&thread->max_depth, depth, memory_order_relaxed);
+    }
+    return thread;
+}
+
+/** Counts a method returning, leaving its frame */
+static inline void metrics_return(metrics_thread_t *thread) {
+    uint64_t depth = atomic_load_explicit(&thread->depth, memory_order_relaxed);
+    atomic_store_explicit(&thread->depth, depth - 1, memory_order_relaxed);
+}
+
+#endif /* METRICS_H */
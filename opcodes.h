@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "class_loader.h"
 #include "jvm.h"
 #include "read_class.h"
 #include "stack.h"
@@ -58,16 +59,13 @@ void sipush_helper(stack_t *stack, size_t *program_counter, method_t *method) {
     assert(stack_push(stack, result) == 1);
 }
 
-// switches on the constant type to determine how we should process pool_const's info
-// field.
-void constant_pool_helper(stack_t *stack, cp_info *pool_const) {
-    assert(pool_const->info != NULL);
-
-    switch (pool_const->tag) {
+// switches on the constant type to determine how we should process the constant's
+// payload.
+void constant_pool_helper(stack_t *stack, const constant_pool_t *constant_pool,
+                          u2 pool_index) {
+    switch (cp_tag(constant_pool, pool_index)) {
         case CONSTANT_Integer: {
-            int32_t cast_int =
-                (int32_t)((CONSTANT_Integer_info *) pool_const->info)->bytes;
-            assert(stack_push(stack, cast_int) == 1);
+            assert(stack_push(stack, cp_integer(constant_pool, pool_index)) == 1);
             break;
         }
         default: {
@@ -83,14 +81,11 @@ void ldc_helper(stack_t *stack, size_t *program_counter, method_t *method,
     // itself, and another for the operand designating what index we should use to select
     // the constant we want to load.
     (*program_counter)++;
-    size_t pool_index = 1;
+    u2 pool_index = 1;
     // the (unsigned char) cast is necessary to remember the operand in the code is
     // unsigned. remember the second program_counter increment here
-    pool_index = (size_t)((unsigned char) method->code.code[(*program_counter)++]);
-    cp_info pool_const = class->constant_pool[pool_index - 1];
-    if (class->constant_pool[pool_index - 1].info != NULL) {
-        constant_pool_helper(stack, &pool_const);
-    }
+    pool_index = (u2)((unsigned char) method->code.code[(*program_counter)++]);
+    constant_pool_helper(stack, &class->constant_pool, pool_index);
 }
 
 void iload_helper(stack_t *stack, size_t *program_counter, method_t *method,
@@ -689,6 +684,68 @@ void goto_helper(size_t *program_counter, method_t *method) {
     (*program_counter) += jump_offset;
 }
 
+// reads a signed big-endian 4-byte operand.
+int32_t read_s4_helper(const u1 *bytes) {
+    return (int32_t)((u4) bytes[0] << 24 | (u4) bytes[1] << 16 | (u4) bytes[2] << 8 |
+                     bytes[3]);
+}
+
+// the operands of tableswitch and lookupswitch start after 0-3 bytes of padding, at
+// the next multiple of four bytes from the start of the method's code.
+const u1 *switch_operands_helper(size_t *program_counter, method_t *method) {
+    return &method->code.code[(*program_counter + 4) & ~(size_t) 3];
+}
+
+void tableswitch_helper(stack_t *stack, size_t *program_counter, method_t *method) {
+    // tableswitch <padding> default low high offsets...
+    // jumps by the offset for the popped index, or by the default offset if it isn't in
+    // [low, high].
+    int32_t index = 0;
+    assert(stack_pop(stack, &index) == 1);
+    const u1 *operands = switch_operands_helper(program_counter, method);
+    int32_t jump_offset = read_s4_helper(operands);
+    u4 low = (u4) read_s4_helper(operands + 4);
+    u4 high = (u4) read_s4_helper(operands + 8);
+
+    // a single unsigned comparison bounds checks both ends: indices below `low` wrap
+    // around to large values. The verifier has checked that low <= high.
+    u4 entry = (u4) index - low;
+    if (entry <= high - low) {
+        jump_offset = read_s4_helper(operands + 12 + 4 * (size_t) entry);
+    }
+    (*program_counter) += jump_offset;
+}
+
+void lookupswitch_helper(stack_t *stack, size_t *program_counter, method_t *method) {
+    // lookupswitch <padding> default npairs (key offset)...
+    // jumps by the offset paired with the popped key, or by the default offset if no
+    // pair matches. The verifier has checked that the keys are sorted, so this is a
+    // binary search.
+    int32_t key = 0;
+    assert(stack_pop(stack, &key) == 1);
+    const u1 *operands = switch_operands_helper(program_counter, method);
+    int32_t jump_offset = read_s4_helper(operands);
+    const u1 *pairs = operands + 8;
+
+    size_t low = 0;
+    size_t high = (size_t) read_s4_helper(operands + 4);
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int32_t middle_key = read_s4_helper(pairs + 8 * middle);
+        if (middle_key < key) {
+            low = middle + 1;
+        }
+        else if (middle_key > key) {
+            high = middle;
+        }
+        else {
+            jump_offset = read_s4_helper(pairs + 8 * middle + 4);
+            break;
+        }
+    }
+    (*program_counter) += jump_offset;
+}
+
 void ireturn_helper(stack_t *stack, size_t *program_counter, method_t *method,
                     optional_value_t *result) {
     (*program_counter)++;
@@ -708,16 +765,26 @@ void return_helper(size_t *program_counter, method_t *method) {
     *program_counter = method->code.code_length;
 }
 
-void getstatic_helper(size_t *program_counter) {
+void getstatic_helper(size_t *program_counter, method_t *method, class_file_t *class) {
     // increment the program counter for the `getstatic` opcode itself.
     (*program_counter)++;
 
+    // the two operands are the index of the Fieldref. Resolving the field's class
+    // loads it if it hasn't been loaded yet; the only field we actually support is
+    // the built-in System.out, so nothing is pushed. Each Fieldref is only resolved
+    // the first time it is executed.
+    u1 *operands = &method->code.code[*program_counter];
+    u2 field_index = (operands[0] << 8) | operands[1];
+    if (!class->resolved_fields[field_index]) {
+        resolve_field(class, field_index);
+    }
+
     // increment it past the next two opcodes, for a total incrementation for each
     // use of this instruction of three, per the spec.
     (*program_counter) += TWO_OPERAND_OFFSET;
 }
 
-void invokevirtual_helper(stack_t *stack, size_t *program_counter) {
+void invokevirtual_helper(stack_t *stack, size_t *program_counter, output_t *output) {
     // invokevirtual b1 b2
     // Pops and prints the top value of the operand stack followed by a newline
     // character. Then, moves the program counter past b2 (i.e., increments it by
@@ -727,12 +794,13 @@ void invokevirtual_helper(stack_t *stack, size_t *program_counter) {
     int32_t value = 0;
     // pop_result = stack_pop(stack, &value);
     assert(stack_pop(stack, &value) == 1);
-    fprintf(stdout, "%d\n", value);
+    output_int(output, value);
     (*program_counter) += TWO_OPERAND_OFFSET;
 }
 
 void not_implemented_helper(size_t *program_counter, jvm_instruction_t *opcode) {
     (*program_counter)++;
+    output_flush_all();
     fprintf(stderr, "Running unimplemented opcode: %d\n\n", *opcode);
     (*program_counter)++;
     assert(false);
@@ -744,7 +812,8 @@ __attribute__((always_inline)) inline void invokestatic_helper(stack_t *stack,
                                                                size_t *program_counter,
                                                                method_t *method,
                                                                class_file_t *class,
-                                                               heap_t *heap) {
+                                                               heap_t *heap,
+                                                               output_t *output) {
     (*program_counter)++;
     // the instruction takes two operands from the two opcodes that follow it in the
     // code array. It then recursively executes the submethod indexed by the fusion of
@@ -756,12 +825,18 @@ __attribute__((always_inline)) inline void invokestatic_helper(stack_t *stack,
     second_operand = method->code.code[(*program_counter)++];
 
     // fuse the unsigned bytes to get an index that we can use to get a pointer to the sub
-    // method we want to recursively execute.
+    // method we want to recursively execute. The sub method may belong to another
+    // class, which is loaded the first time it's called.
     u2 sub_method_index = (first_operand << 8) | second_operand;
-    method_t *sub_method = find_method_from_index(sub_method_index, class);
+    method_t *sub_method = resolve_method(class, sub_method_index);
 
     // double check that the sub method we got isn't NULL
     assert(sub_method != NULL);
+    // the first call to a method decodes and verifies its code. (This is
+    // prepare_method(), which can't be called from a non-static inline function.)
+    if (!atomic_load_explicit(&sub_method->prepared, memory_order_acquire)) {
+        materialize_method(sub_method);
+    }
 
     // the caller of execute needs to allocate the local array using the information
     // contained in the sub method's code's max_locals variable.
@@ -780,7 +855,8 @@ __attribute__((always_inline)) inline void invokestatic_helper(stack_t *stack,
     }
 
     // execute our sub method by recursively calling execute.
-    optional_value_t returned_value = execute(sub_method, locals_ptr, class, heap);
+    optional_value_t returned_value =
+        execute(sub_method, locals_ptr, sub_method->class, heap, output);
 
     // if our sub method has a return value, we push that value onto the stack.
     if (returned_value.has_value == true) {
@@ -846,7 +922,7 @@ void areturn_helper(stack_t *stack, size_t *program_counter, method_t *method,
 // or the stack will overflow on the Recursion test.
 __attribute__((always_inline)) inline void opcode_helper(
     stack_t *stack, size_t *program_counter, method_t *method, int32_t *locals,
-    class_file_t *class, heap_t *heap, optional_value_t *result) {
+    class_file_t *class, heap_t *heap, output_t *output, optional_value_t *result) {
     jvm_instruction_t opcode = (jvm_instruction_t) method->code.code[*program_counter];
     switch (opcode) {
         case i_nop:
@@ -1026,6 +1102,14 @@ __attribute__((always_inline)) inline void opcode_helper(
             goto_helper(program_counter, method);
             break;
 
+        case i_tableswitch:
+            tableswitch_helper(stack, program_counter, method);
+            break;
+
+        case i_lookupswitch:
+            lookupswitch_helper(stack, program_counter, method);
+            break;
+
         case i_ireturn:
             ireturn_helper(stack, program_counter, method, result);
             break;
@@ -1035,15 +1119,15 @@ __attribute__((always_inline)) inline void opcode_helper(
             break;
 
         case i_getstatic:
-            getstatic_helper(program_counter);
+            getstatic_helper(program_counter, method, class);
             break;
 
         case i_invokevirtual:
-            invokevirtual_helper(stack, program_counter);
+            invokevirtual_helper(stack, program_counter, output);
             break;
 
         case i_invokestatic:
-            invokestatic_helper(stack, program_counter, method, class, heap);
+            invokestatic_helper(stack, program_counter, method, class, heap, output);
             break;
 
         case i_newarray:
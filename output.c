@@ -0,0 +1,220 @@
+#include "output.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+/** How much a stream output collects before writing it out */
+#define STREAM_BUFFER_SIZE (64 * 1024)
+/** Enough for "-2147483648\n" */
+#define INT_LINE_SIZE 12
+
+/** "00" to "99", so that integers can be formatted two digits at a time */
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859606162636465666768697071727374757677787980"
+    "81828384858687888990919293949596979899";
+
+typedef struct output {
+    /** The stream to write to, or NULL to collect everything in `buffer` */
+    FILE *stream;
+    /** The stream's file descriptor, or -1 if it doesn't have one */
+    int fd;
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    /** The next stream output (see `output_flush_all()`) */
+    struct output *next;
+} output_t;
+
+/** Every stream output that hasn't been freed, so that they can all be flushed */
+static output_t *streams;
+static pthread_mutex_t streams_lock = PTHREAD_MUTEX_INITIALIZER;
+
+output_t *output_init(FILE *stream) {
+    output_t *output = calloc(1, sizeof(*output));
+    assert(output != NULL && "Failed to allocate output");
+    output->stream = stream;
+    output->fd = -1;
+    if (stream == NULL) {
+        return output;
+    }
+
+    // Anything already written to the stream has to come out first
+    fflush(stream);
+    output->fd = fileno(stream);
+    output->capacity = STREAM_BUFFER_SIZE;
+    output->buffer = malloc(output->capacity);
+    assert(output->buffer != NULL && "Failed to allocate output buffer");
+    pthread_mutex_lock(&streams_lock);
+    output->next = streams;
+    streams = output;
+    pthread_mutex_unlock(&streams_lock);
+    return output;
+}
+
+output_t *output_init_buffer(void) {
+    return output_init(NULL);
+}
+
+/**
+ * Writes out chunks of bytes to a stream output's stream, in as few system calls as
+ * possible, retrying after partial writes and interruptions.
+ */
+static void write_chunks(output_t *output, struct iovec *chunks, int count) {
+    if (output->fd < 0) {
+        // E.g. a memory stream, which has no file descriptor
+        for (int i = 0; i < count; i++) {
+            fwrite(chunks[i].iov_base, 1, chunks[i].iov_len, output->stream);
+        }
+        return;
+    }
+
+    while (count > 0) {
+        ssize_t written = writev(output->fd, chunks, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // E.g. the reader went away; there is nobody left to write to
+            return;
+        }
+        while (count > 0 && (size_t) written >= chunks->iov_len) {
+            written -= chunks->iov_len;
+            chunks++;
+            count--;
+        }
+        if (count > 0) {
+            chunks->iov_base = (char *) chunks->iov_base + written;
+            chunks->iov_len -= written;
+        }
+    }
+}
+
+void output_flush(output_t *output) {
+    if (output->stream == NULL || output->length == 0) {
+        return;
+    }
+    struct iovec chunk = {.iov_base = output->buffer, .iov_len = output->length};
+    write_chunks(output, &chunk, 1);
+    output->length = 0;
+}
+
+void output_flush_all(void) {
+    pthread_mutex_lock(&streams_lock);
+    for (output_t *output = streams; output != NULL; output = output->next) {
+        output_flush(output);
+    }
+    pthread_mutex_unlock(&streams_lock);
+}
+
+/**
+ * Makes room for at least `length` more bytes in an output's buffer, either by
+ * writing out a stream output's buffer or by growing a buffered output's buffer.
+ */
+static void output_reserve(output_t *output, size_t length) {
+    if (output->capacity - output->length >= length) {
+        return;
+    }
+    if (output->stream != NULL) {
+        output_flush(output);
+        return;
+    }
+
+    do {
+        output->capacity = output->capacity == 0 ? 256 : 2 * output->capacity;
+    } while (output->capacity - output->length < length);
+    output->buffer = realloc(output->buffer, output->capacity);
+    assert(output->buffer != NULL && "Failed to allocate output buffer");
+}
+
+/**
+ * Formats an int in decimal, right-aligned so that it ends just before `end`.
+ *
+ * @return where the formatted int starts
+ */
+static char *format_int(int32_t value, char *end) {
+    // Format the magnitude as unsigned, so that negating INT32_MIN can't overflow
+    uint32_t magnitude = value < 0 ? -(uint32_t) value : (uint32_t) value;
+    char *start = end;
+    while (magnitude >= 100) {
+        const char *pair = &DIGIT_PAIRS[2 * (magnitude % 100)];
+        magnitude /= 100;
+        *--start = pair[1];
+        *--start = pair[0];
+    }
+    if (magnitude >= 10) {
+        const char *pair = &DIGIT_PAIRS[2 * magnitude];
+        *--start = pair[1];
+        *--start = pair[0];
+    }
+    else {
+        *--start = (char) ('0' + magnitude);
+    }
+    if (value < 0) {
+        *--start = '-';
+    }
+    return start;
+}
+
+void output_int(output_t *output, int32_t value) {
+    char line[INT_LINE_SIZE];
+    char *end = &line[INT_LINE_SIZE - 1];
+    *end = '\n';
+    char *start = format_int(value, end);
+    size_t length = end + 1 - start;
+
+    output_reserve(output, length);
+    memcpy(output->buffer + output->length, start, length);
+    output->length += length;
+    if (metrics_enabled) {
+        metrics_add(&metrics_thread()->output_bytes, length);
+    }
+}
+
+void output_write(output_t *output, const char *bytes, size_t length) {
+    if (output->stream != NULL && output->capacity - output->length < length) {
+        // Too big to buffer, so write it out along with what is already buffered
+        struct iovec chunks[] = {{.iov_base = output->buffer, .iov_len = output->length},
+                                 {.iov_base = (char *) bytes, .iov_len = length}};
+        write_chunks(output, chunks, 2);
+        output->length = 0;
+        return;
+    }
+
+    output_reserve(output, length);
+    memcpy(output->buffer + output->length, bytes, length);
+    output->length += length;
+}
+
+const char *output_contents(const output_t *output, size_t *length) {
+    *length = output->length;
+    return output->buffer;
+}
+
+void output_reset(output_t *output) {
+    if (output->stream == NULL) {
+        output->length = 0;
+    }
+}
+
+void output_free(output_t *output) {
+    if (output->stream != NULL) {
+        output_flush(output);
+        pthread_mutex_lock(&streams_lock);
+        output_t **link = &streams;
+        while (*link != output) {
+            link = &(*link)->next;
+        }
+        *link = output->next;
+        pthread_mutex_unlock(&streams_lock);
+    }
+    free(output->buffer);
+    free(output);
+}
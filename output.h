@@ -0,0 +1,77 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * Where a running program's output goes: either to a stream, or into an in-memory
+ * buffer, so that programs running concurrently don't interleave their output
+ * (see batch.h).
+ *
+ * A stream output bypasses stdio: it collects output in its own large buffer and
+ * writes it to the stream's file descriptor in big chunks. Its output only appears
+ * once it is flushed (see `output_flush()`), which happens when the buffer fills
+ * up and when the output is freed. Before writing diagnostics to stderr, flush
+ * every output so that they appear after the output that came before them.
+ */
+typedef struct output output_t;
+
+/**
+ * Creates an output that writes to a stream. Anything the stream has buffered is
+ * flushed first, and the stream shouldn't be written to directly while the output
+ * is in use.
+ *
+ * @param stream the stream to write to, e.g. stdout
+ */
+output_t *output_init(FILE *stream);
+
+/**
+ * Creates an output that collects everything written to it in memory.
+ */
+output_t *output_init_buffer(void);
+
+/**
+ * Writes an int followed by a newline, as System.out.println(int) does.
+ */
+void output_int(output_t *output, int32_t value);
+
+/**
+ * Writes bytes to an output as they are. Writes too big to buffer are written out
+ * right away, along with whatever was already buffered.
+ */
+void output_write(output_t *output, const char *bytes, size_t length);
+
+/**
+ * Gets the contents of a buffered output.
+ *
+ * @param output an output created by `output_init_buffer()`
+ * @param length set to the number of bytes written to the output
+ * @return the bytes written to the output (not NUL-terminated)
+ */
+const char *output_contents(const output_t *output, size_t *length);
+
+/**
+ * Writes out everything a stream output has buffered. Does nothing to a buffered
+ * output.
+ */
+void output_flush(output_t *output);
+
+/**
+ * Flushes every stream output, e.g. before writing diagnostics to stderr.
+ * Safe to call from several threads at once.
+ */
+void output_flush_all(void);
+
+/**
+ * Discards everything written to a buffered output. A stream output is unaffected.
+ */
+void output_reset(output_t *output);
+
+/**
+ * Frees an output, flushing it first. A stream output doesn't close its stream.
+ */
+void output_free(output_t *output);
+
+#endif /* OUTPUT_H */
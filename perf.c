@@ -0,0 +1,260 @@
+#include "perf.h"
+
+#include <assert.h>
+#include <elf.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The code every trampoline is a copy of. It keeps the arguments in their registers
+ * and calls the sixth, `target`, under a frame-pointer frame, so that perf can unwind
+ * through it.
+ */
+#if defined(__x86_64__)
+static const u1 TRAMPOLINE_CODE[] = {
+    0x55,             // push %rbp
+    0x48, 0x89, 0xe5, // mov %rsp, %rbp
+    0x41, 0xff, 0xd1, // call *%r9
+    0x5d,             // pop %rbp
+    0xc3              // ret
+};
+#define TRAMPOLINE_MACHINE EM_X86_64
+#elif defined(__aarch64__)
+static const uint32_t TRAMPOLINE_CODE[] = {
+    0xa9bf7bfd, // stp x29, x30, [sp, #-16]!
+    0x910003fd, // mov x29, sp
+    0xd63f00a0, // blr x5
+    0xa8c17bfd, // ldp x29, x30, [sp], #16
+    0xd65f03c0  // ret
+};
+#define TRAMPOLINE_MACHINE EM_AARCH64
+#endif
+
+bool perf_enabled = false;
+
+#ifdef TRAMPOLINE_MACHINE
+
+/** The distance between trampolines, which keeps each one aligned */
+#define TRAMPOLINE_STRIDE 16
+/** The number of bytes of trampolines mapped at a time */
+#define TRAMPOLINE_CHUNK_SIZE (64 * 1024)
+
+/**
+ * The jitdump format, as specified in perf's
+ * tools/perf/Documentation/jitdump-specification.txt
+ */
+#define JITDUMP_MAGIC 0x4A695444
+#define JITDUMP_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t elf_mach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+} jitdump_header_t;
+
+typedef enum { JIT_CODE_LOAD = 0, JIT_CODE_CLOSE = 3 } jitdump_record_type_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;
+} jitdump_record_t;
+
+/** Followed by the NUL-terminated name of the code, then the code itself */
+typedef struct {
+    jitdump_record_t record;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t code_addr;
+    uint64_t code_size;
+    uint64_t code_index;
+} jitdump_code_load_t;
+
+/** Protects everything below */
+static pthread_mutex_t perf_lock = PTHREAD_MUTEX_INITIALIZER;
+/** /tmp/perf-<pid>.map */
+static FILE *perf_map;
+/** /tmp/jit-<pid>.dump, or NULL if it isn't being written */
+static FILE *jitdump;
+/**
+ * A page of the jitdump file, mapped executable. perf only looks for a jitdump file
+ * among the files a process maps executable.
+ */
+static void *jitdump_marker;
+/** The next trampoline to hand out, and the end of its chunk */
+static u1 *next_trampoline;
+static u1 *chunk_end;
+static uint64_t trampoline_count;
+
+/** The time, in perf's clock for `perf record -k 1` */
+static uint64_t timestamp(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+static bool open_jitdump(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/jit-%d.dump", (int) pid);
+    jitdump = fopen(path, "w+b");
+    if (jitdump == NULL) {
+        return false;
+    }
+    jitdump_header_t header = {.magic = JITDUMP_MAGIC,
+                               .version = JITDUMP_VERSION,
+                               .total_size = sizeof(header),
+                               .elf_mach = TRAMPOLINE_MACHINE,
+                               .pid = (uint32_t) pid,
+                               .timestamp = timestamp()};
+    fwrite(&header, sizeof(header), 1, jitdump);
+    fflush(jitdump);
+    jitdump_marker = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ | PROT_EXEC,
+                          MAP_PRIVATE, fileno(jitdump), 0);
+    if (jitdump_marker == MAP_FAILED) {
+        fclose(jitdump);
+        jitdump = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool perf_start(perf_format_t format) {
+    assert(!perf_enabled && "perf support already started");
+    pid_t pid = getpid();
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int) pid);
+    perf_map = fopen(path, "w");
+    if (perf_map == NULL) {
+        return false;
+    }
+    if (format == PERF_JITDUMP && !open_jitdump(pid)) {
+        fclose(perf_map);
+        perf_map = NULL;
+        return false;
+    }
+    perf_enabled = true;
+    return true;
+}
+
+void perf_stop(void) {
+    if (!perf_enabled) {
+        return;
+    }
+    perf_enabled = false;
+    fclose(perf_map);
+    perf_map = NULL;
+    if (jitdump != NULL) {
+        jitdump_record_t close = {.id = JIT_CODE_CLOSE,
+                                  .total_size = sizeof(close),
+                                  .timestamp = timestamp()};
+        fwrite(&close, sizeof(close), 1, jitdump);
+        munmap(jitdump_marker, sysconf(_SC_PAGESIZE));
+        fclose(jitdump);
+        jitdump = NULL;
+    }
+}
+
+/**
+ * Maps a chunk of trampolines. Every trampoline is the same code, so the chunk is
+ * filled with copies up front, and can then be made executable for good, without
+ * ever being writable and executable at once. Called with `perf_lock` held.
+ */
+static void map_chunk(void) {
+    u1 *chunk = mmap(NULL, TRAMPOLINE_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(chunk != MAP_FAILED && "Failed to map trampolines");
+    for (size_t offset = 0; offset < TRAMPOLINE_CHUNK_SIZE; offset += TRAMPOLINE_STRIDE) {
+        memcpy(chunk + offset, TRAMPOLINE_CODE, sizeof(TRAMPOLINE_CODE));
+    }
+    int error = mprotect(chunk, TRAMPOLINE_CHUNK_SIZE, PROT_READ | PROT_EXEC);
+    assert(error == 0 && "Failed to map trampolines");
+    __builtin___clear_cache((char *) chunk, (char *) chunk + TRAMPOLINE_CHUNK_SIZE);
+    next_trampoline = chunk;
+    chunk_end = chunk + TRAMPOLINE_CHUNK_SIZE;
+}
+
+/** Describes a new trampoline in the jitdump file. Called with `perf_lock` held. */
+static void write_code_load(const u1 *trampoline, const char *name) {
+    size_t name_length = strlen(name) + 1;
+    jitdump_code_load_t load = {
+        .record = {.id = JIT_CODE_LOAD,
+                   .total_size = sizeof(load) + name_length + sizeof(TRAMPOLINE_CODE),
+                   .timestamp = timestamp()},
+        .pid = (uint32_t) getpid(),
+        .tid = (uint32_t) syscall(SYS_gettid),
+        .vma = (uintptr_t) trampoline,
+        .code_addr = (uintptr_t) trampoline,
+        .code_size = sizeof(TRAMPOLINE_CODE),
+        .code_index = trampoline_count};
+    fwrite(&load, sizeof(load), 1, jitdump);
+    fwrite(name, 1, name_length, jitdump);
+    fwrite(trampoline, 1, sizeof(TRAMPOLINE_CODE), jitdump);
+    fflush(jitdump);
+}
+
+uintptr_t perf_define_trampoline(method_t *method) {
+    pthread_mutex_lock(&perf_lock);
+    // Another thread may have defined it first
+    uintptr_t address =
+        atomic_load_explicit(&method->perf_trampoline, memory_order_relaxed);
+    if (address == 0) {
+        if (next_trampoline == chunk_end) {
+            map_chunk();
+        }
+        u1 *trampoline = next_trampoline;
+        next_trampoline += TRAMPOLINE_STRIDE;
+        trampoline_count++;
+
+        // perf names code after the Java method, e.g. "Fib.fib(I)I"
+        size_t name_length = strlen(method->class->name) + strlen(method->name) +
+                             strlen(method->descriptor) + 2;
+        char *name = malloc(name_length);
+        assert(name != NULL && "Failed to allocate trampoline name");
+        snprintf(name, name_length, "%s.%s%s", method->class->name, method->name,
+                 method->descriptor);
+        fprintf(perf_map, "%" PRIxPTR " %zx %s\n", (uintptr_t) trampoline,
+                sizeof(TRAMPOLINE_CODE), name);
+        // perf reads the map after the process exits, which may be by aborting
+        fflush(perf_map);
+        if (jitdump != NULL) {
+            write_code_load(trampoline, name);
+        }
+        free(name);
+
+        address = (uintptr_t) trampoline;
+        atomic_store_explicit(&method->perf_trampoline, address, memory_order_release);
+    }
+    pthread_mutex_unlock(&perf_lock);
+    return address;
+}
+
+#else
+
+// There is no trampoline code for this architecture
+bool perf_start(perf_format_t format) {
+    (void) format;
+    return false;
+}
+
+void perf_stop(void) {}
+
+uintptr_t perf_define_trampoline(method_t *method) {
+    (void) method;
+    assert(false && "Trampolines aren't supported on this architecture");
+    return 0;
+}
+
+#endif /* TRAMPOLINE_MACHINE */
@@ -0,0 +1,85 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "class_file.h"
+#include "jvm.h"
+
+/**
+ * Support for profiling with Linux perf (see `--perf` in main.c).
+ *
+ * perf only sees native code, so it attributes all of the interpreter's time to
+ * `execute()`. To let it tell Java methods apart, each method can be given a small
+ * trampoline of its own: a copy of the same few instructions, which sets up a frame
+ * and calls the interpreter. Every call of the method then goes through its
+ * trampoline, so the trampoline shows up in perf's call graphs (`perf record -g`)
+ * in the method's place.
+ *
+ * Trampolines are code generated at runtime, so perf can only name them if told
+ * about them. Each one is listed in /tmp/perf-<pid>.map, which `perf report` reads
+ * by itself, and optionally described in /tmp/jit-<pid>.dump, in the jitdump format
+ * that `perf inject --jit` merges into a recording made with `perf record -k 1`.
+ *
+ * Methods run on green threads (see `green_thread_run()`) don't get trampolines,
+ * since they don't run in a C call of their own.
+ */
+
+typedef enum {
+    /** Write /tmp/perf-<pid>.map only */
+    PERF_MAP,
+    /** Write /tmp/jit-<pid>.dump as well */
+    PERF_JITDUMP
+} perf_format_t;
+
+/** The function a trampoline calls, which runs the method's bytecode */
+typedef optional_value_t (*perf_target_t)(method_t *method, int32_t *locals,
+                                          class_file_t *class, heap_t *heap,
+                                          output_t *output);
+
+/**
+ * A method's trampoline. It calls `target` with the other arguments, which it
+ * passes through untouched, and returns what `target` returns.
+ */
+typedef optional_value_t (*perf_trampoline_t)(method_t *method, int32_t *locals,
+                                              class_file_t *class, heap_t *heap,
+                                              output_t *output, perf_target_t target);
+
+/** Whether methods are run through trampolines. Only changes while no bytecode runs. */
+extern bool perf_enabled;
+
+/**
+ * Starts giving methods trampolines. This must be done before any bytecode runs, and
+ * at most once per process.
+ *
+ * @param format which files to describe the trampolines in
+ * @return whether trampolines are supported on this machine and the files could be
+ *   created
+ */
+bool perf_start(perf_format_t format);
+
+/**
+ * Stops giving methods trampolines, and closes the files that describe them. Call
+ * this once no bytecode is running. The trampolines stay mapped, so that the
+ * process's remaining samples can still be attributed to them.
+ */
+void perf_stop(void);
+
+/**
+ * Creates a method's trampoline, the first time it is called.
+ */
+uintptr_t perf_define_trampoline(method_t *method);
+
+/** Gets a method's trampoline, creating it the first time. */
+static inline perf_trampoline_t perf_trampoline(method_t *method) {
+    uintptr_t address =
+        atomic_load_explicit(&method->perf_trampoline, memory_order_acquire);
+    if (address == 0) {
+        address = perf_define_trampoline(method);
+    }
+    return (perf_trampoline_t) address;
+}
+
+#endif /* PERF_H */
@@ -1,96 +1,178 @@
 #include "read_class.h"
 
 #include <assert.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "symbols.h"
+#include "verify.h"
 
 const u4 CLASS_MAGIC = 0xCAFEBABE;
 const u2 IS_STATIC = 0x0008;
 
+/**
+ * A cursor over the in-memory image of a class file. Every field is decoded
+ * straight out of this buffer; nothing is read through stdio.
+ */
+typedef struct {
+    /** The start of the class file image */
+    u1 *start;
+    /** The next byte to decode */
+    u1 *cursor;
+    /** One past the last byte of the image */
+    u1 *end;
+} class_reader_t;
+
 /*
  * Functions for reading unsigned big-endian integers. We can't read directly
  * into a u2 or u4 variable because x86 stores integers in little-endian.
  */
-u1 read_u1(FILE *class_file) {
-    int result = fgetc(class_file);
-    assert(result != EOF && "Reached end of file prematurely");
-    return result;
+static inline u1 *read_bytes(class_reader_t *reader, size_t length) {
+    assert((size_t)(reader->end - reader->cursor) >= length &&
+           "Reached end of file prematurely");
+    u1 *bytes = reader->cursor;
+    reader->cursor += length;
+    return bytes;
 }
-u2 read_u2(FILE *class_file) {
-    return (u2) read_u1(class_file) << 8 | read_u1(class_file);
+static inline u1 read_u1(class_reader_t *reader) {
+    return *read_bytes(reader, 1);
 }
-u4 read_u4(FILE *class_file) {
-    return (u4) read_u2(class_file) << 16 | read_u2(class_file);
-}
-
-u2 constant_pool_size(cp_info *constant_pool) {
-    cp_info *constant = constant_pool;
-    while (constant->info != NULL) {
-        constant++;
-    }
-    return constant - constant_pool;
+static inline u2 read_u2(class_reader_t *reader) {
+    u1 *bytes = read_bytes(reader, 2);
+    return (u2) bytes[0] << 8 | bytes[1];
 }
-
-cp_info *get_constant(cp_info *constant_pool, u2 index) {
-    assert(0 < index && index <= constant_pool_size(constant_pool) &&
-           "Invalid constant pool index");
-    // Convert 1-indexed index to 0-indexed index
-    return &constant_pool[index - 1];
+static inline u4 read_u4(class_reader_t *reader) {
+    u1 *bytes = read_bytes(reader, 4);
+    return (u4) bytes[0] << 24 | (u4) bytes[1] << 16 | (u4) bytes[2] << 8 | bytes[3];
 }
 
-CONSTANT_NameAndType_info *get_method_name_and_type(cp_info *constant_pool, u2 index) {
-    cp_info *method_constant = get_constant(constant_pool, index);
-    assert(method_constant->tag == CONSTANT_Methodref && "Expected a MethodRef");
-    CONSTANT_FieldOrMethodref_info *method_ref = method_constant->info;
-    cp_info *name_and_type_constant =
-        get_constant(constant_pool, method_ref->name_and_type_index);
-    assert(name_and_type_constant->tag == CONSTANT_NameAndType &&
+/**
+ * Gets the NameAndType constant of the Methodref constant at the given index.
+ */
+u2 get_method_name_and_type(const constant_pool_t *constant_pool, u2 index) {
+    assert(cp_tag(constant_pool, index) == CONSTANT_Methodref && "Expected a MethodRef");
+    u2 name_and_type = cp_name_and_type_index(constant_pool, index);
+    assert(cp_tag(constant_pool, name_and_type) == CONSTANT_NameAndType &&
            "Expected a NameAndType");
-    return name_and_type_constant->info;
+    return name_and_type;
 }
 
 u2 get_number_of_parameters(const method_t *method) {
+    return method->parameter_count;
+}
+
+/**
+ * Decodes a method's descriptor into its parameter slot types and return type,
+ * so that invoking the method doesn't need to look at the descriptor again.
+ */
+void parse_descriptor(method_t *method) {
     // Type descriptors will always have the length ( + #params + ) + return type
-    char *end = strchr(method->descriptor, ')');
-    char *start = strchr(method->descriptor, '(');
+    const char *type = method->descriptor;
+    assert(*type == '(' && "Expected a method descriptor");
+
+    // A method can take at most 255 parameter slots
+    char parameter_types[UINT8_MAX];
+    u2 parameters = 0;
+    for (type++; *type != ')'; type++) {
+        assert(*type != '\0' && "Unterminated method descriptor");
+        assert(parameters < UINT8_MAX && "Too many method parameters");
+        parameter_types[parameters++] = *type;
+
+        // Skip over the rest of an array or class type
+        while (*type == '[') {
+            type++;
+        }
+        if (*type == 'L') {
+            type = strchr(type, ';');
+            assert(type != NULL && "Unterminated class name in descriptor");
+        }
+    }
+
+    method->parameter_count = parameters;
+    method->parameter_types = symbol_intern(parameter_types, parameters);
+    method->return_type = type[1];
+}
+
+/**
+ * Hashes a (name, descriptor) pair. Both are interned, so their addresses
+ * identify them.
+ */
+static size_t method_hash(const char *name, const char *descriptor) {
+    uint64_t hash = (uintptr_t) name * 31 + (uintptr_t) descriptor;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccd;
+    hash ^= hash >> 33;
+    return hash;
+}
 
-    u2 params = 0;
+/**
+ * Builds the hash index from (name, descriptor) to method.
+ */
+void index_methods(class_file_t *class) {
+    size_t method_count = 0;
+    for (method_t *method = class->methods; method->name != NULL; method++) {
+        method_count++;
+    }
+
+    // Size the table to a power of two that keeps it at most half full
+    size_t capacity = 1;
+    while (capacity < 2 * method_count) {
+        capacity *= 2;
+    }
+    class->method_table = calloc(capacity, sizeof(method_t *));
+    assert(class->method_table != NULL && "Failed to allocate method table");
+    class->method_table_mask = capacity - 1;
 
-    for (start++; start < end; start++) {
-        if (start[0] == '[') {
-            start++;
+    for (method_t *method = class->methods; method->name != NULL; method++) {
+        size_t index = method_hash(method->name, method->descriptor);
+        while (class->method_table[index & class->method_table_mask] != NULL) {
+            index++;
         }
-        params++;
+        class->method_table[index & class->method_table_mask] = method;
     }
+}
 
-    return params;
+method_t *find_interned_method(const char *name, const char *descriptor,
+                               const class_file_t *class) {
+    for (size_t index = method_hash(name, descriptor);; index++) {
+        method_t *method = class->method_table[index & class->method_table_mask];
+        if (method == NULL ||
+            (method->name == name && method->descriptor == descriptor)) {
+            return method;
+        }
+    }
 }
 
 method_t *find_method(const char *name, const char *descriptor,
                       const class_file_t *class) {
-    for (method_t *method = class->methods; method->name != NULL; method++) {
-        if (strcmp(method->name, name) == 0 &&
-            strcmp(method->descriptor, descriptor) == 0) {
-            return method;
-        }
+    // If either string was never interned, no loaded method can have it
+    const char *name_symbol = symbol_lookup(name);
+    const char *descriptor_symbol = symbol_lookup(descriptor);
+    if (name_symbol == NULL || descriptor_symbol == NULL) {
+        return NULL;
     }
-    return NULL;
+    return find_interned_method(name_symbol, descriptor_symbol, class);
 }
 
 method_t *find_method_from_index(u2 index, const class_file_t *class) {
-    CONSTANT_NameAndType_info *name_and_type =
-        get_method_name_and_type(class->constant_pool, index);
-    cp_info *name = get_constant(class->constant_pool, name_and_type->name_index);
-    assert(name->tag == CONSTANT_Utf8 && "Expected a UTF8");
-    cp_info *descriptor =
-        get_constant(class->constant_pool, name_and_type->descriptor_index);
-    assert(descriptor->tag == CONSTANT_Utf8 && "Expected a UTF8");
-    return find_method(name->info, descriptor->info, class);
+    const constant_pool_t *constant_pool = &class->constant_pool;
+    u2 name_and_type = get_method_name_and_type(constant_pool, index);
+    u2 name = cp_name_index(constant_pool, name_and_type);
+    assert(cp_tag(constant_pool, name) == CONSTANT_Utf8 && "Expected a UTF8");
+    u2 descriptor = cp_descriptor_index(constant_pool, name_and_type);
+    assert(cp_tag(constant_pool, descriptor) == CONSTANT_Utf8 && "Expected a UTF8");
+    return find_interned_method(cp_utf8(constant_pool, name),
+                                cp_utf8(constant_pool, descriptor), class);
 }
 
-class_header_t get_class_header(FILE *class_file) {
+class_header_t get_class_header(class_reader_t *class_file) {
     class_header_t header;
     header.magic = read_u4(class_file);
     assert(header.magic == CLASS_MAGIC);
@@ -99,76 +181,84 @@ class_header_t get_class_header(FILE *class_file) {
     return header;
 }
 
-cp_info *get_constant_pool(FILE *class_file) {
+void get_constant_pool(class_reader_t *class_file, constant_pool_t *constant_pool) {
     // Constant pool count includes unused constant at index 0
-    u2 constant_pool_count = read_u2(class_file) - 1;
-    cp_info *constant_pool = malloc(sizeof(cp_info[constant_pool_count + 1]));
-    assert(constant_pool != NULL && "Failed to allocate constant pool");
-
-    cp_info *constant = constant_pool;
-    while (constant_pool_count > 0) {
-        constant->tag = read_u1(class_file);
-        switch (constant->tag) {
+    u2 count = read_u2(class_file);
+    assert(count > 0 && "Invalid constant pool count");
+
+    /* Allocate all three arrays at once, largest alignment first. There can be at
+     * most `count` UTF8 constants, so `strings` is sized for that many. */
+    size_t strings_size = sizeof(const char *[count]);
+    size_t values_size = sizeof(u4[count]);
+    char *block = malloc(strings_size + values_size + sizeof(u1[count]));
+    assert(block != NULL && "Failed to allocate constant pool");
+    constant_pool->count = count;
+    constant_pool->strings = (const char **) block;
+    constant_pool->values = (u4 *) (block + strings_size);
+    constant_pool->tags = (u1 *) (block + strings_size + values_size);
+
+    constant_pool->tags[0] = CONSTANT_Unusable;
+    constant_pool->values[0] = 0;
+    u4 string_count = 0;
+    for (u2 index = 1; index < count; index++) {
+        u1 tag = read_u1(class_file);
+        constant_pool->tags[index] = tag;
+        switch (tag) {
             case CONSTANT_Utf8: {
                 u2 length = read_u2(class_file);
-                char *info = malloc(length + 1);
-                assert(info != NULL && "Failed to allocate UTF8 constant");
-                size_t bytes_read = fread(info, 1, length, class_file);
-                assert(bytes_read == length && "Failed to read UTF8 constant");
-                info[length] = '\0';
-                constant->info = info;
+                char *bytes = (char *) read_bytes(class_file, length);
+                constant_pool->strings[string_count] = symbol_intern(bytes, length);
+                constant_pool->values[index] = string_count++;
                 break;
             }
 
-            case CONSTANT_Integer: {
-                CONSTANT_Integer_info *value = malloc(sizeof(*value));
-                assert(value != NULL && "Failed to allocate integer constant");
-                value->bytes = read_u4(class_file);
-                constant->info = value;
+            case CONSTANT_Integer:
+            case CONSTANT_Float:
+                constant_pool->values[index] = read_u4(class_file);
                 break;
-            }
 
-            case CONSTANT_Class: {
-                CONSTANT_Class_info *value = malloc(sizeof(*value));
-                assert(value != NULL && "Failed to allocate class constant");
-                value->string_index = read_u2(class_file);
-                constant->info = value;
+            case CONSTANT_Long:
+            case CONSTANT_Double:
+                // These take up two slots: the high word here, the low word in the next
+                constant_pool->values[index] = read_u4(class_file);
+                index++;
+                assert(index < count && "Long or Double constant overruns the pool");
+                constant_pool->tags[index] = CONSTANT_Unusable;
+                constant_pool->values[index] = read_u4(class_file);
                 break;
-            }
 
+            case CONSTANT_Class:
+            case CONSTANT_String:
+            case CONSTANT_MethodType:
+                constant_pool->values[index] = read_u2(class_file);
+                break;
+
+            case CONSTANT_Fieldref:
             case CONSTANT_Methodref:
-            case CONSTANT_Fieldref: {
-                CONSTANT_FieldOrMethodref_info *value = malloc(sizeof(*value));
-                assert(value != NULL && "Failed to allocate FieldRef/MethodRef constant");
-                value->class_index = read_u2(class_file);
-                value->name_and_type_index = read_u2(class_file);
-                constant->info = value;
+            case CONSTANT_InterfaceMethodref:
+            case CONSTANT_NameAndType:
+            case CONSTANT_InvokeDynamic:
+                // Two u2 indices; read as one big-endian u4 they come out packed
+                constant_pool->values[index] = read_u4(class_file);
                 break;
-            }
 
-            case CONSTANT_NameAndType: {
-                CONSTANT_NameAndType_info *value = malloc(sizeof(*value));
-                assert(value != NULL && "Failed to allocate NameAndType constant");
-                value->name_index = read_u2(class_file);
-                value->descriptor_index = read_u2(class_file);
-                constant->info = value;
+            case CONSTANT_MethodHandle: {
+                u1 reference_kind = read_u1(class_file);
+                u2 reference_index = read_u2(class_file);
+                constant_pool->values[index] =
+                    (u4) reference_kind << 16 | reference_index;
                 break;
             }
 
             default:
-                fprintf(stderr, "Unknown constant type %d\n", constant->tag);
+                output_flush_all();
+                fprintf(stderr, "Unknown constant type %d\n", tag);
                 assert(false);
         }
-        constant++;
-        constant_pool_count--;
     }
-
-    // Mark end of array with NULL info
-    constant->info = NULL;
-    return constant_pool;
 }
 
-class_info_t get_class_info(FILE *class_file) {
+class_info_t get_class_info(class_reader_t *class_file) {
     class_info_t info;
     info.access_flags = read_u2(class_file);
     info.this_class = read_u2(class_file);
@@ -180,35 +270,31 @@ class_info_t get_class_info(FILE *class_file) {
     return info;
 }
 
-void read_method_attributes(FILE *class_file, method_info *info, code_t *code,
-                            cp_info *constant_pool) {
+void read_method_attributes(class_reader_t *class_file, method_info *info,
+                            method_t *method, const constant_pool_t *constant_pool) {
+    const char *code_attribute = symbol_intern("Code", strlen("Code"));
     bool found_code = false;
     for (u2 attributes = info->attributes_count; attributes > 0; attributes--) {
         attribute_info ainfo;
         ainfo.attribute_name_index = read_u2(class_file);
         ainfo.attribute_length = read_u4(class_file);
-        long attribute_end = ftell(class_file) + ainfo.attribute_length;
-        cp_info *type_constant = get_constant(constant_pool, ainfo.attribute_name_index);
-        assert(type_constant->tag == CONSTANT_Utf8 && "Expected a UTF8");
-        if (strcmp(type_constant->info, "Code") == 0) {
+        u1 *attribute = read_bytes(class_file, ainfo.attribute_length);
+        assert(cp_tag(constant_pool, ainfo.attribute_name_index) == CONSTANT_Utf8 &&
+               "Expected a UTF8");
+        if (cp_utf8(constant_pool, ainfo.attribute_name_index) == code_attribute) {
             assert(!found_code && "Duplicate method code");
             found_code = true;
 
-            code->max_stack = read_u2(class_file);
-            code->max_locals = read_u2(class_file);
-            code->code_length = read_u4(class_file);
-            code->code = malloc(code->code_length);
-            assert(code->code != NULL && "Failed to allocate method code");
-            size_t bytes_read = fread(code->code, 1, code->code_length, class_file);
-            assert(bytes_read == code->code_length && "Failed to read method code");
+            // Only remember where the code is; prepare_method() decodes it
+            method->code_attribute = attribute - class_file->start;
+            method->code_attribute_length = ainfo.attribute_length;
         }
-        // Skip the rest of the attribute
-        fseek(class_file, attribute_end, SEEK_SET);
     }
     assert(found_code && "Missing method code");
 }
 
-method_t *get_methods(FILE *class_file, cp_info *constant_pool) {
+method_t *get_methods(class_reader_t *class_file, const constant_pool_t *constant_pool) {
+    const char *constructor = symbol_intern("<init>", strlen("<init>"));
     u2 method_count = read_u2(class_file);
     method_t *methods = malloc(sizeof(method_t[method_count + 1]));
     assert(methods != NULL && "Failed to allocate methods");
@@ -221,21 +307,30 @@ method_t *get_methods(FILE *class_file, cp_info *constant_pool) {
         info.descriptor_index = read_u2(class_file);
         info.attributes_count = read_u2(class_file);
 
-        cp_info *name = get_constant(constant_pool, info.name_index);
-        assert(name->tag == CONSTANT_Utf8 && "Expected a UTF8");
-        method->name = name->info;
-        cp_info *descriptor = get_constant(constant_pool, info.descriptor_index);
-        assert(descriptor->tag == CONSTANT_Utf8 && "Expected a UTF8");
-        method->descriptor = descriptor->info;
+        assert(cp_tag(constant_pool, info.name_index) == CONSTANT_Utf8 &&
+               "Expected a UTF8");
+        method->name = cp_utf8(constant_pool, info.name_index);
+        assert(cp_tag(constant_pool, info.descriptor_index) == CONSTANT_Utf8 &&
+               "Expected a UTF8");
+        method->descriptor = cp_utf8(constant_pool, info.descriptor_index);
+        parse_descriptor(method);
+        method->code = (code_t){0, 0, 0, NULL};
+        atomic_init(&method->prepared, false);
+        atomic_flag_clear(&method->preparing);
+        atomic_init(&method->trace_id, 0);
+        atomic_init(&method->perf_trampoline, 0);
+        atomic_init(&method->invocations, 0);
+        atomic_init(&method->counters_id, 0);
+        method->class = NULL;
 
         /* Our JVM can only execute static methods, so ensure all methods are static.
          * However, javac creates a constructor method <init> we need to ignore. */
-        if (strcmp(method->name, "<init>") != 0) {
+        if (method->name != constructor) {
             assert((info.access_flags & IS_STATIC) != 0 &&
                    "This VM only supports static methods.");
         }
 
-        read_method_attributes(class_file, &info, &method->code, constant_pool);
+        read_method_attributes(class_file, &info, method, constant_pool);
 
         method++;
         method_count--;
@@ -246,36 +341,149 @@ method_t *get_methods(FILE *class_file, cp_info *constant_pool) {
     return methods;
 }
 
-class_file_t *get_class(FILE *class_file) {
-    class_file_t *class = malloc(sizeof(*class));
-    assert(class != NULL && "Failed to allocate class");
+void materialize_method(method_t *method) {
+    // Only the first thread to get here prepares the method; any others wait for it.
+    // Verifying a method doesn't prepare any others, so the wait is always short.
+    if (atomic_flag_test_and_set_explicit(&method->preparing, memory_order_relaxed)) {
+        while (!atomic_load_explicit(&method->prepared, memory_order_acquire)) {
+            sched_yield();
+        }
+        return;
+    }
+
+    const class_file_t *class = method->class;
+    u1 *attribute = class->data + method->code_attribute;
+    class_reader_t code_reader = {
+        .start = class->data,
+        .cursor = attribute,
+        .end = attribute + method->code_attribute_length,
+    };
+    // The bytecode is used in place, so only the attribute itself is decoded
+    method->code.max_stack = read_u2(&code_reader);
+    method->code.max_locals = read_u2(&code_reader);
+    method->code.code_length = read_u4(&code_reader);
+    method->code.code = read_bytes(&code_reader, method->code.code_length);
+
+    bool verified = verify_method(method, &class->constant_pool);
+    assert(verified && "Method failed verification");
+    atomic_store_explicit(&method->prepared, true, memory_order_release);
+}
+
+/**
+ * Maps the class file into memory. The mapping is read-only, so the method bytecode
+ * stays shared with the page cache. Falls back to reading the whole file into a heap
+ * buffer when it can't be mapped (e.g. it is a pipe).
+ */
+void load_class_file(FILE *class_file, class_file_t *class) {
+    int fd = fileno(class_file);
+    struct stat status;
+    bool regular_file =
+        fstat(fd, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0;
+    if (regular_file) {
+        void *data = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            class->data = data;
+            class->data_length = status.st_size;
+            class->data_mapped = true;
+            return;
+        }
+    }
+
+    // A regular file is normally read in a single read() call
+    size_t capacity = regular_file ? (size_t) status.st_size : 4096;
+    u1 *data = malloc(capacity);
+    assert(data != NULL && "Failed to allocate class file buffer");
+    size_t length = 0;
+    while (true) {
+        if (length == capacity) {
+            capacity *= 2;
+            data = realloc(data, capacity);
+            assert(data != NULL && "Failed to allocate class file buffer");
+        }
+        ssize_t bytes_read = read(fd, data + length, capacity - length);
+        assert(bytes_read >= 0 && "Failed to read class file");
+        if (bytes_read == 0) {
+            break;
+        }
+        length += bytes_read;
+    }
+    class->data = data;
+    class->data_length = length;
+    class->data_mapped = false;
+}
+
+/**
+ * Parses a class out of the image in `class->data`.
+ */
+void parse_class(class_file_t *class) {
+    class_reader_t reader = {
+        .start = class->data,
+        .cursor = class->data,
+        .end = class->data + class->data_length,
+    };
 
     /* Read the leading header of the class file.
      * We don't need the result, but we need to skip past the header. */
-    get_class_header(class_file);
+    get_class_header(&reader);
 
     // Read the constant pool
-    class->constant_pool = get_constant_pool(class_file);
-
-    /* Read information about the class that was compiled.
-     * We don't need the result, but we need to skip past it. */
-    get_class_info(class_file);
+    get_constant_pool(&reader, &class->constant_pool);
+    class->resolved_methods = calloc(class->constant_pool.count, sizeof(method_t *));
+    assert(class->resolved_methods != NULL && "Failed to allocate resolved methods");
+    class->resolved_fields = calloc(class->constant_pool.count, sizeof(bool));
+    assert(class->resolved_fields != NULL && "Failed to allocate resolved fields");
+
+    // Read information about the class that was compiled
+    class_info_t info = get_class_info(&reader);
+    assert(cp_tag(&class->constant_pool, info.this_class) == CONSTANT_Class &&
+           "Expected a Class");
+    class->name = cp_utf8(&class->constant_pool,
+                          cp_string_index(&class->constant_pool, info.this_class));
+    class->loader = NULL;
 
     // Read the list of static methods
-    class->methods = get_methods(class_file, class->constant_pool);
+    class->methods = get_methods(&reader, &class->constant_pool);
+    for (method_t *method = class->methods; method->name != NULL; method++) {
+        method->class = class;
+    }
+    index_methods(class);
+}
+
+class_file_t *get_class(FILE *class_file) {
+    class_file_t *class = malloc(sizeof(*class));
+    assert(class != NULL && "Failed to allocate class");
 
+    load_class_file(class_file, class);
+    parse_class(class);
+    return class;
+}
+
+class_file_t *get_class_from_buffer(u1 *data, size_t length) {
+    class_file_t *class = malloc(sizeof(*class));
+    assert(class != NULL && "Failed to allocate class");
+
+    class->data = data;
+    class->data_length = length;
+    class->data_mapped = false;
+    parse_class(class);
     return class;
 }
 
 void free_class(class_file_t *class) {
-    for (cp_info *constant = class->constant_pool; constant->info != NULL; constant++) {
-        free(constant->info);
-    }
-    free(class->constant_pool);
+    // The strings themselves live in the symbol table
+    free(class->constant_pool.strings);
+    free(class->resolved_methods);
+    free(class->resolved_fields);
 
-    for (method_t *method = class->methods; method->name != NULL; method++) {
-        free(method->code.code);
-    }
+    // Method bytecode lives in the class file image
     free(class->methods);
+    free(class->method_table);
+
+    if (class->data_mapped) {
+        munmap(class->data, class->data_length);
+    }
+    else {
+        free(class->data);
+    }
     free(class);
 }
@@ -1,6 +1,7 @@
 #ifndef READ_CLASS_H
 #define READ_CLASS_H
 
+#include <stdatomic.h>
 #include <stdio.h>
 #include "class_file.h"
 
@@ -8,7 +9,7 @@
  * Finds the method with the given name and signature.
  * The descriptor is necessary because Java allows method overloading.
  * This only needs to be called directly to invoke main();
- * for the invokestatic instruction, use find_method_from_index().
+ * for the invokestatic instruction, use resolve_method() (see class_loader.h).
  *
  * @param name the method name, e.g. "factorial"
  * @param descriptor the method descriptor string, e.g. "(I)I"
@@ -18,8 +19,23 @@
 method_t *find_method(const char *name, const char *descriptor,
                       const class_file_t *class);
 
+/**
+ * Finds the method with the given interned name and descriptor.
+ * This is a single hash lookup comparing pointers, so both strings must come from
+ * `symbol_intern()` (as all constant pool strings do).
+ *
+ * @param name the interned method name
+ * @param descriptor the interned method descriptor
+ * @param class the parsed class file
+ * @return the method if it was found, NULL otherwise
+ */
+method_t *find_interned_method(const char *name, const char *descriptor,
+                               const class_file_t *class);
+
 /**
  * Finds the method corresponding to the given constant pool index.
+ * This only searches the given class; use `resolve_method()` (see class_loader.h)
+ * for references that may name another class.
  *
  * @param index the constant pool index of the Methodref to call
  * @param class the parsed class file
@@ -27,14 +43,52 @@ method_t *find_method(const char *name, const char *descriptor,
  */
 method_t *find_method_from_index(uint16_t index, const class_file_t *class);
 
+/**
+ * Builds a class's hash index from (name, descriptor) to method, which
+ * `find_interned_method()` searches. Called once the class's methods are complete.
+ */
+void index_methods(class_file_t *class);
+
 /**
  * Gets the number of (integer) parameters a method takes.
- * Uses the descriptor string of the method to determine its signature.
+ * The descriptor string is parsed once when the class is loaded.
  */
 uint16_t get_number_of_parameters(const method_t *method);
 
+/**
+ * Checks whether the interpreter can ever invoke a method. javac gives every class a
+ * constructor `<init>` (and classes with static fields a `<clinit>`), which this VM
+ * never calls, so their code is never prepared. Only these special methods have
+ * names starting with '<'.
+ */
+static inline bool method_invocable(const method_t *method) {
+    return method->name[0] != '<';
+}
+
+/**
+ * Decodes and verifies a method's code (see `prepare_method()`).
+ * Safe to call from several threads; only the first call does any work.
+ */
+void materialize_method(method_t *method);
+
+/**
+ * Prepares a method to run: the first time it is called for a method, the method's
+ * Code attribute is decoded into `method->code` and verified (see verify.h).
+ * This must be called before `method->code` is used.
+ *
+ * @param method the method to prepare
+ */
+static inline void prepare_method(method_t *method) {
+    if (!atomic_load_explicit(&method->prepared, memory_order_acquire)) {
+        materialize_method(method);
+    }
+}
+
 /**
  * Reads an entire class file.
+ * The file is mapped into memory (or read in one go if it can't be mapped) and
+ * decoded in place: method bytecode points into that image rather than being
+ * copied out of it. Method code isn't decoded until the method is prepared.
  * The end of the parsed methods array is marked by a method with a NULL name.
  *
  * @param class_file the open file to read
@@ -42,6 +96,16 @@ uint16_t get_number_of_parameters(const method_t *method);
  */
 class_file_t *get_class(FILE *class_file);
 
+/**
+ * Parses a class file that has already been read into memory.
+ *
+ * @param data the contents of the class file, allocated on the heap.
+ *   The class takes ownership of it, and frees it in `free_class()`.
+ * @param length the number of bytes in `data`
+ * @return the parsed class file, allocated on the heap
+ */
+class_file_t *get_class_from_buffer(u1 *data, size_t length);
+
 /**
  * Frees the memory used by a parsed class file.
  *
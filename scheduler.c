@@ -0,0 +1,89 @@
+#include "scheduler.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+/** The fuel per turn if none is given: enough to amortize switching threads */
+const uint64_t DEFAULT_QUANTUM = 10000;
+
+/** A spawned thread, queued in a singly linked list */
+typedef struct scheduled_thread {
+    green_thread_t *thread;
+    /** The fuel the thread has used so far */
+    uint64_t fuel_used;
+    scheduler_callback_t callback;
+    void *argument;
+    struct scheduled_thread *next;
+} scheduled_thread_t;
+
+typedef struct scheduler {
+    uint64_t quantum;
+    uint64_t fuel_limit;
+    /** The run queue, next to run first */
+    scheduled_thread_t *head;
+    scheduled_thread_t *tail;
+} scheduler_t;
+
+scheduler_t *scheduler_init(uint64_t quantum, uint64_t fuel_limit) {
+    scheduler_t *scheduler = calloc(1, sizeof(*scheduler));
+    assert(scheduler != NULL && "Failed to allocate scheduler");
+    scheduler->quantum = quantum > 0 ? quantum : DEFAULT_QUANTUM;
+    scheduler->fuel_limit = fuel_limit;
+    return scheduler;
+}
+
+static void enqueue(scheduler_t *scheduler, scheduled_thread_t *scheduled) {
+    scheduled->next = NULL;
+    if (scheduler->tail == NULL) {
+        scheduler->head = scheduled;
+    }
+    else {
+        scheduler->tail->next = scheduled;
+    }
+    scheduler->tail = scheduled;
+}
+
+void scheduler_spawn(scheduler_t *scheduler, green_thread_t *thread,
+                     scheduler_callback_t callback, void *argument) {
+    scheduled_thread_t *scheduled = malloc(sizeof(*scheduled));
+    assert(scheduled != NULL && "Failed to allocate scheduled thread");
+    *scheduled = (scheduled_thread_t){
+        .thread = thread, .callback = callback, .argument = argument};
+    enqueue(scheduler, scheduled);
+}
+
+void scheduler_run(scheduler_t *scheduler) {
+    while (scheduler->head != NULL) {
+        scheduled_thread_t *scheduled = scheduler->head;
+        scheduler->head = scheduled->next;
+        if (scheduler->head == NULL) {
+            scheduler->tail = NULL;
+        }
+
+        // A turn is one quantum, or whatever is left of the thread's fuel limit
+        uint64_t turn = scheduler->quantum;
+        if (scheduler->fuel_limit > 0 &&
+            scheduler->fuel_limit - scheduled->fuel_used < turn) {
+            turn = scheduler->fuel_limit - scheduled->fuel_used;
+        }
+        uint64_t fuel = turn;
+        bool finished = green_thread_run(scheduled->thread, &fuel);
+        scheduled->fuel_used += turn - fuel;
+
+        bool cut_off = scheduler->fuel_limit > 0 &&
+                       scheduled->fuel_used == scheduler->fuel_limit;
+        if (finished || cut_off) {
+            scheduled->callback(scheduled->argument, scheduled->thread, finished);
+            green_thread_free(scheduled->thread);
+            free(scheduled);
+        }
+        else {
+            enqueue(scheduler, scheduled);
+        }
+    }
+}
+
+void scheduler_free(scheduler_t *scheduler) {
+    assert(scheduler->head == NULL && "Scheduler still has threads to run");
+    free(scheduler);
+}
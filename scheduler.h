@@ -0,0 +1,63 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "jvm.h"
+
+/**
+ * Runs many green threads (see `green_thread_t`) on the calling thread.
+ *
+ * Threads take turns in the order they were spawned: each turn runs one thread until
+ * it has used a quantum of fuel (or finishes), then moves it to the back of the run
+ * queue. Since fuel is counted in instructions rather than time, scheduling is
+ * deterministic, and a thread that runs forever (e.g. an infinite loop) is cut off
+ * after exactly the same instruction every time once it has used its fuel limit.
+ */
+typedef struct scheduler scheduler_t;
+
+/**
+ * Called once a green thread has finished or been cut off. The scheduler frees the
+ * thread afterwards.
+ *
+ * @param argument the argument given to `scheduler_spawn()`
+ * @param thread the thread, whose result is available if it finished
+ * @param finished whether the thread finished, rather than running out of fuel
+ */
+typedef void (*scheduler_callback_t)(void *argument, const green_thread_t *thread,
+                                     bool finished);
+
+/**
+ * Creates a scheduler.
+ *
+ * @param quantum the fuel each thread may use per turn, or 0 for a default
+ * @param fuel_limit the total fuel each thread may use before it is cut off,
+ *   or 0 for no limit
+ * @return the scheduler
+ */
+scheduler_t *scheduler_init(uint64_t quantum, uint64_t fuel_limit);
+
+/**
+ * Adds a thread to the back of the run queue.
+ *
+ * @param scheduler the scheduler
+ * @param thread the thread, which the scheduler takes ownership of
+ * @param callback called once the thread finishes or is cut off
+ * @param argument passed to `callback`
+ */
+void scheduler_spawn(scheduler_t *scheduler, green_thread_t *thread,
+                     scheduler_callback_t callback, void *argument);
+
+/**
+ * Runs threads until every thread has finished or been cut off. Callbacks may spawn
+ * more threads, which are run too.
+ */
+void scheduler_run(scheduler_t *scheduler);
+
+/**
+ * Frees a scheduler, which must not have any threads left to run.
+ */
+void scheduler_free(scheduler_t *scheduler);
+
+#endif /* SCHEDULER_H */
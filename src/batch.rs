@@ -0,0 +1,272 @@
+/* *
+ * Runs a batch of programs concurrently in one process, like the C build's --batch.
+ *
+ * The job list has one job per line: a class file optionally followed by how many
+ * times to run its main(), e.g.
+ *
+ *     tests/Primes.class 100
+ *     tests/Recursion.class
+ *
+ * Blank lines and lines starting with '#' are ignored.
+ *
+ * Every job's class is loaded up front and then shared, unmodified, by a pool of
+ * worker threads, which take runs off a shared counter, so the runs of one job
+ * spread across the threads too. Each run gets a fresh heap and output buffer, as a
+ * separate process would, and each worker's runs share one context, so its frames
+ * are allocated once. Once every run has finished, the runs' output is written to
+ * stdout in job order, and a report of each job's latency and the batch's
+ * throughput is written to stderr.
+ */
+use std::collections::HashMap;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+use std::time::Instant;
+
+use crate::heap::heap_init;
+use crate::jvm::{context_init, context_t, execute_main, MAIN_DESCRIPTOR, MAIN_METHOD};
+use crate::output::{
+    output_contents, output_flush, output_init_buffer, output_init_stdout, output_write,
+};
+use crate::read_class::{class_file_t, find_method, get_class, method_t};
+
+/* * The option that runs a list of jobs concurrently */
+pub const BATCH_OPTION: &str = "--batch";
+/* * The option that sets the number of threads to run a batch on */
+pub const THREADS_OPTION: &str = "--threads";
+const BATCH_COMMENT: char = '#';
+
+/* * A program to run, and how its runs went */
+struct batch_job_t {
+    /* * The class file, as given in the job list */
+    path: String,
+    /* * The index of the job's class among the loaded classes */
+    class: usize,
+    repeat: usize,
+    /* * The number of runs that have finished */
+    finished: usize,
+    /* * The message of each run that failed an assertion */
+    failures: Vec<String>,
+    /* * The total, fastest and slowest run times, in seconds */
+    total_time: f64,
+    min_time: f64,
+    max_time: f64,
+}
+
+fn record_run(job: &mut batch_job_t, time: f64) {
+    job.total_time += time;
+    if job.finished == 0 || time < job.min_time {
+        job.min_time = time;
+    }
+    if job.finished == 0 || time > job.max_time {
+        job.max_time = time;
+    }
+    job.finished += 1;
+}
+
+/* * One run of a job, and how it went */
+struct batch_run_t {
+    /* * The index of the run's job */
+    job: usize,
+    /* * The run's output */
+    output: Vec<u8>,
+    /* * The run's time in seconds, or the message of the assertion it failed */
+    result: Result<f64, String>,
+}
+
+/* * Runs one run of a job on the calling thread, in the calling worker's context. */
+fn run_job(
+    run: &mut batch_run_t,
+    class: &class_file_t,
+    main_method: &method_t,
+    context: &mut context_t,
+) {
+    let start = Instant::now();
+    // Each run gets a fresh heap and output, just like a separate process would
+    context.heap = heap_init();
+    context.output = output_init_buffer();
+    run.result = match execute_main(class, main_method, context) {
+        Ok(None) => Ok(start.elapsed().as_secs_f64()),
+        Ok(Some(_)) => Err("main() should return void".to_string()),
+        Err(message) => Err(message),
+    };
+    run.output = output_contents(&context.output).to_vec();
+}
+
+/* *
+ * Reads the job list.
+ *
+ * @return the jobs' class files and repeat counts, or None if the list can't be read
+ *   or a repeat count isn't a positive integer
+ */
+fn read_jobs(jobs_path: &str) -> Option<Vec<(String, usize)>> {
+    let contents = std::fs::read_to_string(jobs_path).ok()?;
+    let mut jobs = Vec::new();
+    for line in contents.lines() {
+        let mut fields = line.split_whitespace();
+        let path = match fields.next() {
+            Some(path) if !path.starts_with(BATCH_COMMENT) => path,
+            _ => continue,
+        };
+        let repeat = match fields.next() {
+            // The repeat count defaults to 1
+            None => 1,
+            // parse() would accept a plus sign
+            Some(repeat) if repeat.bytes().all(|byte| byte.is_ascii_digit()) => {
+                repeat.parse().ok()?
+            }
+            Some(_) => return None,
+        };
+        if repeat == 0 || fields.next().is_some() {
+            return None;
+        }
+        jobs.push((path.to_string(), repeat));
+    }
+    Some(jobs)
+}
+
+/* * Checks at compile time that a value can be shared by the worker threads. */
+fn assert_shareable<T: Send + Sync + ?Sized>(_: &T) {}
+
+/* *
+ * Runs a batch of programs concurrently.
+ *
+ * @param jobs_path the path of the job list
+ * @param threads the number of worker threads, or 0 for one per available CPU
+ * @return whether the job list could be read, every job's class was loaded, and every
+ *   run succeeded
+ */
+pub fn batch_run(jobs_path: &str, threads: usize) -> bool {
+    let job_list = match read_jobs(jobs_path) {
+        Some(job_list) => job_list,
+        None => {
+            eprintln!("Failed to read job list {}", jobs_path);
+            return false;
+        }
+    };
+
+    // Read each class file once, however many jobs run it
+    let mut class_indices: HashMap<&str, usize> = HashMap::new();
+    let mut datas: Vec<Vec<u8>> = Vec::new();
+    for (path, _) in &job_list {
+        if class_indices.contains_key(path.as_str()) {
+            continue;
+        }
+        match std::fs::read(path) {
+            Ok(data) => datas.push(data),
+            Err(error) => {
+                eprintln!("{}: {}", path, error);
+                return false;
+            }
+        }
+        class_indices.insert(path, datas.len() - 1);
+    }
+    // Load everything up front, so that the workers only ever read the classes
+    let classes: Vec<class_file_t> = datas.iter().map(|data| get_class(data)).collect();
+    let mut main_methods: Vec<&method_t> = Vec::with_capacity(classes.len());
+    for (path, _) in &job_list {
+        let class = &classes[class_indices[path.as_str()]];
+        match find_method(MAIN_METHOD, MAIN_DESCRIPTOR, class) {
+            Some(main_method) => main_methods.push(main_method),
+            None => {
+                eprintln!("Missing main() method in {}", path);
+                return false;
+            }
+        }
+    }
+    assert_shareable(&classes[..]);
+
+    let mut jobs: Vec<batch_job_t> = job_list
+        .iter()
+        .map(|(path, repeat)| batch_job_t {
+            path: path.clone(),
+            class: class_indices[path.as_str()],
+            repeat: *repeat,
+            finished: 0,
+            failures: Vec::new(),
+            total_time: 0.0,
+            min_time: 0.0,
+            max_time: 0.0,
+        })
+        .collect();
+    // Every run of every job, in job order
+    let mut runs: Vec<batch_run_t> = Vec::new();
+    for (index, job) in jobs.iter().enumerate() {
+        for _ in 0..job.repeat {
+            runs.push(batch_run_t { job: index, output: Vec::new(), result: Ok(0.0) });
+        }
+    }
+    let available = std::thread::available_parallelism().map_or(1, |threads| threads.get());
+    let threads = (if threads > 0 { threads } else { available }).clamp(1, runs.len().max(1));
+
+    let start = Instant::now();
+    {
+        // Each worker takes the next run that no other worker has taken
+        let next_run = AtomicUsize::new(0);
+        let slots: Vec<Mutex<&mut batch_run_t>> = runs.iter_mut().map(Mutex::new).collect();
+        let jobs = &jobs;
+        std::thread::scope(|scope| {
+            for _ in 0..threads {
+                scope.spawn(|| {
+                    let mut context = context_init(output_init_buffer());
+                    loop {
+                        let index = next_run.fetch_add(1, Ordering::Relaxed);
+                        if index >= slots.len() {
+                            break;
+                        }
+                        let mut run = slots[index].lock().unwrap();
+                        let job = run.job;
+                        let class = &classes[jobs[job].class];
+                        run_job(&mut run, class, main_methods[job], &mut context);
+                    }
+                });
+            }
+        });
+    }
+    let elapsed = start.elapsed().as_secs_f64();
+
+    let mut stdout = output_init_stdout();
+    for run in runs {
+        output_write(&mut stdout, &run.output);
+        let job = &mut jobs[run.job];
+        match run.result {
+            Ok(time) => record_run(job, time),
+            Err(message) => job.failures.push(message),
+        }
+    }
+    output_flush(&mut stdout);
+
+    eprintln!(
+        "{:<4} {:<32} {:>8} {:>12} {:>12} {:>12} {:>12}",
+        "job", "class", "runs", "total ms", "mean us", "min us", "max us"
+    );
+    let mut runs = 0;
+    let mut failed = 0;
+    for (i, job) in jobs.iter().enumerate() {
+        let mean = if job.finished > 0 { job.total_time / job.finished as f64 } else { 0.0 };
+        eprintln!(
+            "{:<4} {:<32} {:>8} {:>12.3} {:>12.3} {:>12.3} {:>12.3}",
+            i,
+            job.path,
+            job.finished,
+            job.total_time * 1e3,
+            mean * 1e6,
+            job.min_time * 1e6,
+            job.max_time * 1e6
+        );
+        if let Some(message) = job.failures.first() {
+            let message = message.replace('\n', " ");
+            eprintln!("     {} runs failed, the first with: {}", job.failures.len(), message);
+        }
+        runs += job.finished;
+        failed += job.failures.len();
+    }
+    eprintln!(
+        "{} jobs, {} runs on {} threads in {:.3} ms ({:.1} runs/s)",
+        jobs.len(),
+        runs,
+        threads,
+        elapsed * 1e3,
+        if elapsed > 0.0 { runs as f64 / elapsed } else { 0.0 }
+    );
+    failed == 0
+}
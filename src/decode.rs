@@ -0,0 +1,365 @@
+/* *
+ * Decodes a method's bytecode, when the method is first called, into a list of
+ * instructions that the interpreter can run without looking at the bytecode again.
+ *
+ * Each decoded instruction is a small `Copy` value with its operands already read:
+ * constants are sign-extended or looked up in the constant pool, local indices are
+ * widened, called methods are resolved to their index in the class, and branch targets
+ * are indices into the decoded instructions rather than byte offsets. The interpreter's
+ * program counter is such an index, so every instruction but a branch just moves on to
+ * the next one.
+ *
+ * The decoded list always ends with a `return_void` that stands for running off the
+ * end of the code, and branches that leave the code jump to it, so the program counter
+ * can never leave the list (see `code_fetch()`). Bytecode that can't be decoded, or a
+ * branch into the middle of an instruction, decodes to a `trap` that fails only if it
+ * is reached, since a method's unreachable code may be anything.
+ */
+use crate::opcode::jvm_instruction_t;
+use crate::read_class::{class_file_t, cp_info_t, cp_info_tag, method_t, resolve_method_index};
+use crate::verify::verify_method;
+use std::convert::TryFrom;
+
+/* * Marks a byte of the code that doesn't start an instruction */
+const NOT_AN_INSTRUCTION: u32 = u32::MAX;
+
+/* * Why a decoded instruction can't run */
+#[derive(Copy, Clone, Debug, PartialEq)]
+pub enum trap_t {
+    UnknownOpcode,
+    /* * An instruction's operands run past the end of the code */
+    Truncated,
+    /* * A branch lands inside another instruction */
+    MisalignedBranch,
+    /* * An ldc of something other than an integer */
+    NotAnInteger,
+    /* * An invokestatic of a method the class doesn't define */
+    UnresolvedMethod,
+    /* * A newarray of something other than ints */
+    NotAnIntArray,
+}
+
+impl trap_t {
+    pub fn message(self) -> &'static str {
+        match self {
+            trap_t::UnknownOpcode => "Unknown opcode",
+            trap_t::Truncated => "Ran off the end of the code",
+            trap_t::MisalignedBranch => "Branch into the middle of an instruction",
+            trap_t::NotAnInteger => "Expected an integer",
+            trap_t::UnresolvedMethod => "Called a method the class doesn't define",
+            trap_t::NotAnIntArray => "Only int arrays are supported",
+        }
+    }
+}
+
+/* *
+ * A decoded instruction. Branch targets are indices into the method's decoded
+ * instructions. Every variant fits in 8 bytes.
+ */
+#[allow(non_camel_case_types)]
+#[derive(Copy, Clone, Debug, PartialEq)]
+pub enum instruction_t {
+    /* * nop and getstatic, which only ever gets System.out */
+    nop,
+    /* * iconst_<n>, bipush, sipush and ldc */
+    push(i32),
+    /* * iload, aload and their _<n> forms */
+    load(u16),
+    /* * istore, astore and their _<n> forms */
+    store(u16),
+    iaload,
+    iastore,
+    dup,
+    iadd,
+    isub,
+    imul,
+    idiv,
+    irem,
+    ineg,
+    ishl,
+    ishr,
+    iushr,
+    iand,
+    ior,
+    ixor,
+    iinc(u16, i16),
+    ifeq(u32),
+    ifne(u32),
+    iflt(u32),
+    ifge(u32),
+    ifgt(u32),
+    ifle(u32),
+    if_icmpeq(u32),
+    if_icmpne(u32),
+    if_icmplt(u32),
+    if_icmpge(u32),
+    if_icmpgt(u32),
+    if_icmple(u32),
+    goto(u32),
+    /* * ireturn and areturn */
+    return_value,
+    return_void,
+    /* * invokevirtual, which only ever calls System.out.println(int) */
+    println,
+    /* * invokestatic, with the index of the called method in the class's methods */
+    invokestatic(u16),
+    newarray,
+    arraylength,
+    trap(trap_t),
+}
+
+/* * A method, ready to run */
+#[derive(Debug)]
+pub struct prepared_t {
+    /* * The method's decoded instructions, ending with a `return_void` */
+    pub code: Vec<instruction_t>,
+    /* * Whether the method passed `verify_method()`, so it can run unchecked */
+    pub verified: bool,
+}
+
+/* * Gets the length in bytes of an instruction, including its operands. */
+pub fn instruction_length(opcode: jvm_instruction_t) -> usize {
+    match opcode {
+        jvm_instruction_t::i_bipush
+        | jvm_instruction_t::i_ldc
+        | jvm_instruction_t::i_iload
+        | jvm_instruction_t::i_aload
+        | jvm_instruction_t::i_istore
+        | jvm_instruction_t::i_astore
+        | jvm_instruction_t::i_newarray => 2,
+        jvm_instruction_t::i_sipush
+        | jvm_instruction_t::i_iinc
+        | jvm_instruction_t::i_ifeq
+        | jvm_instruction_t::i_ifne
+        | jvm_instruction_t::i_iflt
+        | jvm_instruction_t::i_ifge
+        | jvm_instruction_t::i_ifgt
+        | jvm_instruction_t::i_ifle
+        | jvm_instruction_t::i_if_icmpeq
+        | jvm_instruction_t::i_if_icmpne
+        | jvm_instruction_t::i_if_icmplt
+        | jvm_instruction_t::i_if_icmpge
+        | jvm_instruction_t::i_if_icmpgt
+        | jvm_instruction_t::i_if_icmple
+        | jvm_instruction_t::i_goto
+        | jvm_instruction_t::i_getstatic
+        | jvm_instruction_t::i_invokevirtual
+        | jvm_instruction_t::i_invokestatic => 3,
+        _ => 1,
+    }
+}
+
+/* * Reads the big-endian 2-byte operand that follows an instruction's opcode. */
+pub fn operand_u16(code: &[u8], program_counter: usize) -> u16 {
+    (code[program_counter + 1] as u16) << 8 | code[program_counter + 2] as u16
+}
+
+/* *
+ * Decodes one instruction whose operands are known to fit in the code. Branches are
+ * decoded with their target as a byte offset, which `decode_method()` then replaces.
+ *
+ * @return the decoded instruction, and the byte offset of its branch target, if any
+ */
+fn decode_instruction(
+    opcode: jvm_instruction_t,
+    code: &[u8],
+    program_counter: usize,
+    class: &class_file_t,
+) -> (instruction_t, Option<i64>) {
+    let operand_u8 = code.get(program_counter + 1).copied().unwrap_or(0);
+    // A branch target, which is relative to the branch itself
+    let target = || program_counter as i64 + operand_u16(code, program_counter) as i16 as i64;
+    let instruction = match opcode {
+        jvm_instruction_t::i_nop | jvm_instruction_t::i_getstatic => instruction_t::nop,
+        jvm_instruction_t::i_iconst_m1
+        | jvm_instruction_t::i_iconst_0
+        | jvm_instruction_t::i_iconst_1
+        | jvm_instruction_t::i_iconst_2
+        | jvm_instruction_t::i_iconst_3
+        | jvm_instruction_t::i_iconst_4
+        | jvm_instruction_t::i_iconst_5 => {
+            instruction_t::push(opcode as i32 - jvm_instruction_t::i_iconst_0 as i32)
+        }
+        jvm_instruction_t::i_bipush => instruction_t::push(operand_u8 as i8 as i32),
+        jvm_instruction_t::i_sipush => {
+            instruction_t::push(operand_u16(code, program_counter) as i16 as i32)
+        }
+        jvm_instruction_t::i_ldc => {
+            // Constant pool indices are 1-indexed
+            match class
+                .constant_pool
+                .get((operand_u8 as usize).wrapping_sub(1))
+            {
+                Some(constant) => match (constant.tag, constant.info) {
+                    (
+                        cp_info_tag::CONSTANT_Integer,
+                        Some(cp_info_t::CONSTANT_Integer_info { bytes }),
+                    ) => instruction_t::push(bytes),
+                    _ => instruction_t::trap(trap_t::NotAnInteger),
+                },
+                None => instruction_t::trap(trap_t::NotAnInteger),
+            }
+        }
+        jvm_instruction_t::i_iload | jvm_instruction_t::i_aload => {
+            instruction_t::load(operand_u8 as u16)
+        }
+        jvm_instruction_t::i_iload_0
+        | jvm_instruction_t::i_iload_1
+        | jvm_instruction_t::i_iload_2
+        | jvm_instruction_t::i_iload_3 => {
+            instruction_t::load(opcode as u16 - jvm_instruction_t::i_iload_0 as u16)
+        }
+        jvm_instruction_t::i_aload_0
+        | jvm_instruction_t::i_aload_1
+        | jvm_instruction_t::i_aload_2
+        | jvm_instruction_t::i_aload_3 => {
+            instruction_t::load(opcode as u16 - jvm_instruction_t::i_aload_0 as u16)
+        }
+        jvm_instruction_t::i_istore | jvm_instruction_t::i_astore => {
+            instruction_t::store(operand_u8 as u16)
+        }
+        jvm_instruction_t::i_istore_0
+        | jvm_instruction_t::i_istore_1
+        | jvm_instruction_t::i_istore_2
+        | jvm_instruction_t::i_istore_3 => {
+            instruction_t::store(opcode as u16 - jvm_instruction_t::i_istore_0 as u16)
+        }
+        jvm_instruction_t::i_astore_0
+        | jvm_instruction_t::i_astore_1
+        | jvm_instruction_t::i_astore_2
+        | jvm_instruction_t::i_astore_3 => {
+            instruction_t::store(opcode as u16 - jvm_instruction_t::i_astore_0 as u16)
+        }
+        jvm_instruction_t::i_iaload => instruction_t::iaload,
+        jvm_instruction_t::i_iastore => instruction_t::iastore,
+        jvm_instruction_t::i_dup => instruction_t::dup,
+        jvm_instruction_t::i_iadd => instruction_t::iadd,
+        jvm_instruction_t::i_isub => instruction_t::isub,
+        jvm_instruction_t::i_imul => instruction_t::imul,
+        jvm_instruction_t::i_idiv => instruction_t::idiv,
+        jvm_instruction_t::i_irem => instruction_t::irem,
+        jvm_instruction_t::i_ineg => instruction_t::ineg,
+        jvm_instruction_t::i_ishl => instruction_t::ishl,
+        jvm_instruction_t::i_ishr => instruction_t::ishr,
+        jvm_instruction_t::i_iushr => instruction_t::iushr,
+        jvm_instruction_t::i_iand => instruction_t::iand,
+        jvm_instruction_t::i_ior => instruction_t::ior,
+        jvm_instruction_t::i_ixor => instruction_t::ixor,
+        jvm_instruction_t::i_iinc => {
+            instruction_t::iinc(operand_u8 as u16, code[program_counter + 2] as i8 as i16)
+        }
+        jvm_instruction_t::i_ifeq => return (instruction_t::ifeq(0), Some(target())),
+        jvm_instruction_t::i_ifne => return (instruction_t::ifne(0), Some(target())),
+        jvm_instruction_t::i_iflt => return (instruction_t::iflt(0), Some(target())),
+        jvm_instruction_t::i_ifge => return (instruction_t::ifge(0), Some(target())),
+        jvm_instruction_t::i_ifgt => return (instruction_t::ifgt(0), Some(target())),
+        jvm_instruction_t::i_ifle => return (instruction_t::ifle(0), Some(target())),
+        jvm_instruction_t::i_if_icmpeq => return (instruction_t::if_icmpeq(0), Some(target())),
+        jvm_instruction_t::i_if_icmpne => return (instruction_t::if_icmpne(0), Some(target())),
+        jvm_instruction_t::i_if_icmplt => return (instruction_t::if_icmplt(0), Some(target())),
+        jvm_instruction_t::i_if_icmpge => return (instruction_t::if_icmpge(0), Some(target())),
+        jvm_instruction_t::i_if_icmpgt => return (instruction_t::if_icmpgt(0), Some(target())),
+        jvm_instruction_t::i_if_icmple => return (instruction_t::if_icmple(0), Some(target())),
+        jvm_instruction_t::i_goto => return (instruction_t::goto(0), Some(target())),
+        jvm_instruction_t::i_ireturn | jvm_instruction_t::i_areturn => instruction_t::return_value,
+        jvm_instruction_t::i_return => instruction_t::return_void,
+        jvm_instruction_t::i_invokevirtual => instruction_t::println,
+        jvm_instruction_t::i_invokestatic => {
+            match resolve_method_index(operand_u16(code, program_counter), class) {
+                Some(index) => instruction_t::invokestatic(index),
+                None => instruction_t::trap(trap_t::UnresolvedMethod),
+            }
+        }
+        // Only int arrays are supported
+        jvm_instruction_t::i_newarray if operand_u8 == 10 => instruction_t::newarray,
+        jvm_instruction_t::i_newarray => instruction_t::trap(trap_t::NotAnIntArray),
+        jvm_instruction_t::i_arraylength => instruction_t::arraylength,
+    };
+    (instruction, None)
+}
+
+/* * Sets a decoded branch's target, an index into the decoded instructions. */
+fn with_target(instruction: instruction_t, target: u32) -> instruction_t {
+    match instruction {
+        instruction_t::ifeq(_) => instruction_t::ifeq(target),
+        instruction_t::ifne(_) => instruction_t::ifne(target),
+        instruction_t::iflt(_) => instruction_t::iflt(target),
+        instruction_t::ifge(_) => instruction_t::ifge(target),
+        instruction_t::ifgt(_) => instruction_t::ifgt(target),
+        instruction_t::ifle(_) => instruction_t::ifle(target),
+        instruction_t::if_icmpeq(_) => instruction_t::if_icmpeq(target),
+        instruction_t::if_icmpne(_) => instruction_t::if_icmpne(target),
+        instruction_t::if_icmplt(_) => instruction_t::if_icmplt(target),
+        instruction_t::if_icmpge(_) => instruction_t::if_icmpge(target),
+        instruction_t::if_icmpgt(_) => instruction_t::if_icmpgt(target),
+        instruction_t::if_icmple(_) => instruction_t::if_icmple(target),
+        instruction_t::goto(_) => instruction_t::goto(target),
+        _ => instruction,
+    }
+}
+
+/* *
+ * Decodes a method's bytecode, one instruction after another from the start.
+ *
+ * @param method the method to decode
+ * @param class the class the method belongs to, to look up constants and methods in
+ * @return the decoded instructions, ending with a `return_void`
+ */
+pub fn decode_method(method: &method_t, class: &class_file_t) -> Vec<instruction_t> {
+    let code: &[u8] = method.code.code;
+    // The index of the decoded instruction at each byte of the code
+    let mut indices: Vec<u32> = vec![NOT_AN_INSTRUCTION; code.len()];
+    let mut decoded: Vec<instruction_t> = Vec::with_capacity(code.len() + 1);
+    // The byte offset of each branch's target
+    let mut branches: Vec<(usize, i64)> = Vec::new();
+    let mut program_counter: usize = 0;
+    while program_counter < code.len() {
+        indices[program_counter] = decoded.len() as u32;
+        let opcode = match jvm_instruction_t::try_from(code[program_counter]) {
+            Ok(opcode) => opcode,
+            Err(()) => {
+                decoded.push(instruction_t::trap(trap_t::UnknownOpcode));
+                program_counter += 1;
+                continue;
+            }
+        };
+        if program_counter + instruction_length(opcode) > code.len() {
+            decoded.push(instruction_t::trap(trap_t::Truncated));
+            break;
+        }
+        let (instruction, target) = decode_instruction(opcode, code, program_counter, class);
+        if let Some(target) = target {
+            branches.push((decoded.len(), target));
+        }
+        decoded.push(instruction);
+        program_counter += instruction_length(opcode);
+    }
+    // Running off the end of the code returns, as does branching outside it
+    let end = decoded.len() as u32;
+    decoded.push(instruction_t::return_void);
+
+    for (branch, target) in branches {
+        decoded[branch] = if 0 <= target && (target as usize) < code.len() {
+            match indices[target as usize] {
+                NOT_AN_INSTRUCTION => instruction_t::trap(trap_t::MisalignedBranch),
+                index => with_target(decoded[branch], index),
+            }
+        } else {
+            with_target(decoded[branch], end)
+        };
+    }
+    decoded
+}
+
+/* *
+ * Gets a method ready to run, decoding and verifying it if this is its first call.
+ * Threads that call a method for the first time at once wait for one of them to
+ * prepare it, so it is prepared at most once.
+ */
+#[inline(always)]
+pub fn prepare_method<'m>(method: &'m method_t, class: &class_file_t) -> &'m prepared_t {
+    method.prepared.get_or_init(|| prepared_t {
+        code: decode_method(method, class),
+        verified: verify_method(method, &class.constant_pool),
+    })
+}
@@ -0,0 +1,121 @@
+/* *
+ * The local variables and operand stack of a method invocation.
+ *
+ * Every frame lives in one block of ints that is allocated once, before main() runs.
+ * A frame's locals come first, followed by room for `max_stack` operands. Calling a
+ * method doesn't copy its arguments: the callee's frame starts at the arguments on
+ * top of the caller's operand stack, so they become the callee's first locals.
+ *
+ * This is the only module with unsafe code. A frame is `CHECKED` unless its method
+ * passed `verify_method()`, in which case the verifier has already proven that every
+ * access stays in bounds, so the accessors skip the checks. Keep it that way: each
+ * unchecked access below is justified by the verifier or decoder check named next to
+ * it.
+ */
+use crate::decode::instruction_t;
+
+/* * How many ints the frames of every method invocation can use between them */
+pub const FRAME_VALUES: usize = 1 << 20;
+
+pub struct frame_t<'f, const CHECKED: bool> {
+    /* * This frame's values, and everything after them, for the frames it calls */
+    values: &'f mut [i32],
+    /* * The number of locals, which is where the operand stack starts */
+    locals: usize,
+    /* * Where the operand stack ends: `locals + max_stack` */
+    end: usize,
+    /* * Where the next operand is pushed */
+    top: usize,
+}
+
+/* *
+ * Creates the frame of a method invocation.
+ *
+ * @param values the values the frame starts at, beginning with its arguments
+ * @param arguments the number of arguments
+ * @param max_locals the method's number of locals, including its parameters
+ * @param max_stack the most operands the method's stack can hold
+ */
+#[inline(always)]
+pub fn frame_new<const CHECKED: bool>(
+    values: &mut [i32],
+    arguments: usize,
+    max_locals: usize,
+    max_stack: usize,
+) -> frame_t<'_, CHECKED> {
+    // These hold for every frame, so the accessors can rely on them
+    assert!(arguments <= max_locals, "Too few locals for the method's arguments");
+    assert!(max_locals + max_stack <= values.len(), "Stack overflow");
+    values[arguments..max_locals].fill(0);
+    frame_t {
+        values,
+        locals: max_locals,
+        end: max_locals + max_stack,
+        top: max_locals,
+    }
+}
+
+#[inline(always)]
+pub fn frame_push<const CHECKED: bool>(frame: &mut frame_t<CHECKED>, value: i32) {
+    if CHECKED {
+        assert!(frame.top < frame.end, "Stack overflow");
+    }
+    // SAFETY: the verifier checked that the stack never grows past `max_stack`, and
+    // `frame_new()` checked that `values` has room for that many operands
+    unsafe { *frame.values.get_unchecked_mut(frame.top) = value };
+    frame.top += 1;
+}
+
+#[inline(always)]
+pub fn frame_pop<const CHECKED: bool>(frame: &mut frame_t<CHECKED>) -> i32 {
+    if CHECKED {
+        assert!(frame.top > frame.locals, "Stack underflow");
+    }
+    frame.top -= 1;
+    // SAFETY: the verifier checked that no instruction pops from an empty stack, so
+    // `top` is still at least `locals` and below `end`
+    unsafe { *frame.values.get_unchecked(frame.top) }
+}
+
+#[inline(always)]
+pub fn frame_load<const CHECKED: bool>(frame: &frame_t<CHECKED>, index: usize) -> i32 {
+    if CHECKED {
+        assert!(index < frame.locals, "Invalid local variable");
+    }
+    // SAFETY: the verifier checked that every local index is below `max_locals`
+    unsafe { *frame.values.get_unchecked(index) }
+}
+
+#[inline(always)]
+pub fn frame_store<const CHECKED: bool>(frame: &mut frame_t<CHECKED>, index: usize, value: i32) {
+    if CHECKED {
+        assert!(index < frame.locals, "Invalid local variable");
+    }
+    // SAFETY: as for `frame_load()`
+    unsafe { *frame.values.get_unchecked_mut(index) = value };
+}
+
+/* *
+ * Pops the arguments of a call.
+ *
+ * @return the values the callee's frame starts at, beginning with the arguments
+ */
+#[inline(always)]
+pub fn frame_arguments<'c, const CHECKED: bool>(
+    frame: &'c mut frame_t<CHECKED>,
+    count: usize,
+) -> &'c mut [i32] {
+    if CHECKED {
+        assert!(frame.top - frame.locals >= count, "Stack underflow");
+    }
+    frame.top -= count;
+    &mut frame.values[frame.top..]
+}
+
+/* * Fetches a decoded instruction. */
+#[inline(always)]
+pub fn code_fetch(code: &[instruction_t], index: usize) -> instruction_t {
+    // SAFETY: `decode_method()` ends the code with a return, and makes every branch
+    // target an index into the code, so the program counter never leaves it
+    unsafe { *code.get_unchecked(index) }
+}
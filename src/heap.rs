@@ -0,0 +1,158 @@
+/* *
+ * The JVM's heap of int arrays.
+ *
+ * Every array's elements live one after another in a single contiguous store, rather
+ * than in an allocation per array. An array is referred to by its index in the list
+ * of arrays (the int that bytecode passes around), and that list records where each
+ * array starts, so the length of array `r` is `starts[r + 1] - starts[r]`. Reading a
+ * length, loading an element and storing one are all bounds-checked index operations
+ * that never allocate or copy. Arrays are never freed, as in the C heap.
+ */
+pub struct heap_t {
+    /* * The elements of every array, in the order the arrays were allocated */
+    elements: Vec<i32>,
+    /* *
+     * Where each array starts in `elements`, followed by where the next array would
+     * start, so there is always one more entry than there are arrays
+     */
+    starts: Vec<usize>,
+}
+
+/* * Creates an empty heap. */
+pub fn heap_init() -> heap_t {
+    heap_t {
+        elements: Vec::new(),
+        starts: vec![0],
+    }
+}
+
+/* *
+ * Allocates a zero-filled array.
+ *
+ * @return a reference to the array
+ */
+pub fn heap_new_array(heap: &mut heap_t, length: i32) -> i32 {
+    assert!(length >= 0, "Negative array size");
+    let reference = heap.starts.len() - 1;
+    assert!(reference < i32::MAX as usize, "Too many arrays");
+    heap.elements.resize(heap.elements.len() + length as usize, 0);
+    heap.starts.push(heap.elements.len());
+    reference as i32
+}
+
+/* * Where an array's elements are in `heap.elements` */
+#[inline(always)]
+fn heap_range(heap: &heap_t, reference: i32) -> (usize, usize) {
+    let reference = reference as usize;
+    assert!(reference + 1 < heap.starts.len(), "Invalid array reference");
+    (heap.starts[reference], heap.starts[reference + 1])
+}
+
+/* * Borrows an array's elements. */
+#[inline(always)]
+pub fn heap_get(heap: &heap_t, reference: i32) -> &[i32] {
+    let (start, end) = heap_range(heap, reference);
+    &heap.elements[start..end]
+}
+
+/* * Mutably borrows an array's elements. */
+#[inline(always)]
+pub fn heap_get_mut(heap: &mut heap_t, reference: i32) -> &mut [i32] {
+    let (start, end) = heap_range(heap, reference);
+    &mut heap.elements[start..end]
+}
+
+#[inline(always)]
+pub fn heap_length(heap: &heap_t, reference: i32) -> i32 {
+    let (start, end) = heap_range(heap, reference);
+    (end - start) as i32
+}
+
+/* * Loads `array[index]`, panicking if the index is out of bounds. */
+#[inline(always)]
+pub fn heap_load(heap: &heap_t, reference: i32, index: i32) -> i32 {
+    let array = heap_get(heap, reference);
+    assert!((index as usize) < array.len(), "Array index out of bounds");
+    array[index as usize]
+}
+
+/* * Stores `array[index] = value`, panicking if the index is out of bounds. */
+#[inline(always)]
+pub fn heap_store(heap: &mut heap_t, reference: i32, index: i32, value: i32) {
+    let array = heap_get_mut(heap, reference);
+    assert!((index as usize) < array.len(), "Array index out of bounds");
+    array[index as usize] = value;
+}
+
+/* *
+ * Copies `length` elements from one array to another (or within one array, in which
+ * case the ranges may overlap), as System.arraycopy does.
+ */
+#[allow(dead_code)]
+pub fn heap_copy(
+    heap: &mut heap_t,
+    source: i32,
+    source_index: i32,
+    destination: i32,
+    destination_index: i32,
+    length: i32,
+) {
+    assert!(
+        source_index >= 0
+            && destination_index >= 0
+            && length >= 0
+            && source_index as usize + length as usize <= heap_length(heap, source) as usize
+            && destination_index as usize + length as usize
+                <= heap_length(heap, destination) as usize,
+        "Array index out of bounds"
+    );
+    let from = source_index as usize;
+    let to = destination_index as usize;
+    let length = length as usize;
+    if source == destination {
+        heap_get_mut(heap, source).copy_within(from..from + length, to);
+    } else {
+        // Two arrays can't be borrowed mutably at once, but they never overlap either
+        let from = heap_range(heap, source).0 + from;
+        let to = heap_range(heap, destination).0 + to;
+        heap.elements.copy_within(from..from + length, to);
+    }
+}
+
+/* * Sets every element of an array to `value`, as Arrays.fill does. */
+#[allow(dead_code)]
+pub fn heap_fill(heap: &mut heap_t, reference: i32, value: i32) {
+    heap_get_mut(heap, reference).fill(value);
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn copy_and_fill() {
+        let mut heap = heap_init();
+        let first = heap_new_array(&mut heap, 4);
+        let second = heap_new_array(&mut heap, 3);
+        heap_get_mut(&mut heap, first).copy_from_slice(&[1, 2, 3, 4]);
+        heap_fill(&mut heap, second, 7);
+        assert_eq!(heap_get(&heap, second), &[7, 7, 7]);
+
+        // Overlapping ranges within one array
+        heap_copy(&mut heap, first, 0, first, 1, 3);
+        assert_eq!(heap_get(&heap, first), &[1, 1, 2, 3]);
+        heap_copy(&mut heap, first, 2, second, 1, 2);
+        assert_eq!(heap_get(&heap, second), &[7, 2, 3]);
+        heap_copy(&mut heap, second, 0, first, 3, 0);
+        assert_eq!(heap_get(&heap, first), &[1, 1, 2, 3]);
+    }
+
+    #[test]
+    #[should_panic(expected = "Array index out of bounds")]
+    fn copy_out_of_bounds() {
+        let mut heap = heap_init();
+        let first = heap_new_array(&mut heap, 4);
+        let second = heap_new_array(&mut heap, 2);
+        heap_copy(&mut heap, first, 1, second, 0, 3);
+    }
+}
@@ -1,912 +1,148 @@
-use crate::opcode::jvm_instruction_t;
-use crate::read_class::{
-    class_file_t, code_t, cp_info, cp_info_t, cp_info_tag, find_method, find_method_from_index,
-    get_class, get_number_of_parameters, method_t,
-};
-use crate::stack::{
-    stack_init, stack_is_empty, stack_is_full, stack_pop, stack_print, stack_push, stack_t,
+use crate::batch::{batch_run, BATCH_OPTION, THREADS_OPTION};
+use crate::decode::{instruction_t, prepare_method};
+use crate::frame::{
+    code_fetch, frame_arguments, frame_load, frame_new, frame_pop, frame_push, frame_store,
+    frame_t, FRAME_VALUES,
 };
+use crate::heap::{heap_init, heap_length, heap_load, heap_new_array, heap_store, heap_t};
+use crate::output::{output_flush, output_init_stdout, output_int, output_t};
+use crate::read_class::{class_file_t, find_method, get_class, get_number_of_parameters, method_t};
+use crate::verify::method_returns_value;
 
 use std::cell::RefCell;
-use std::fs::File;
-use std::io::prelude::*;
-use std::io::BufReader;
-use std::ops::Deref;
+use std::panic::AssertUnwindSafe;
 use std::process::exit;
-use std::rc::Rc;
-
-pub type heap_t = Vec<Vec<i32>>;
-
-pub const TWO_OPERAND_OFFSET: usize = 2;
-
-// pub const NEGATIVE_ONE: i32 = -1;
-
-// pub const ZERO: i32 = 0;
-
-// pub const ONE: i32 = 1;
-
-// pub const TWO: i32 = 2;
-
-pub const THREE: i32 = 3;
-
-// pub const FOUR: i32 = 4;
-
-// pub const FIVE: i32 = 5;
-
-pub fn iconst_helper(opcode: jvm_instruction_t, stack: &mut stack_t, program_counter: &mut usize) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    assert!(stack_push(stack, (opcode as i32) - THREE));
-}
-
-pub fn bipush_helper(stack: &mut stack_t, program_counter: &mut usize, method: &method_t) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let fresh0 = *program_counter;
-    *program_counter = (*program_counter).wrapping_add(1);
-    assert!(stack_push(stack, (*method).code.code[fresh0] as i8 as i32,));
-}
-
-pub fn sipush_helper(stack: &mut stack_t, program_counter: &mut usize, method: &method_t) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let fresh1 = *program_counter;
-    *program_counter = (*program_counter).wrapping_add(1);
-    let first_operand: u8 = (*method).code.code[fresh1 as usize];
-    let fresh2 = *program_counter;
-    *program_counter = (*program_counter).wrapping_add(1);
-    let second_operand: u8 = (*method).code.code[fresh2];
-    let result: i16 = ((first_operand as i16 as i32) << 8_i32 | second_operand as i32) as i16;
-    assert!(stack_push(stack, result as i32));
-}
-
-pub fn constant_pool_helper(stack: &mut stack_t, pool_const: &cp_info) {
-    assert!(pool_const.info.is_some());
-    match pool_const.tag {
-        cp_info_tag::CONSTANT_Integer => match pool_const.info.as_deref() {
-            Some(cp_info_t::CONSTANT_Integer_info { bytes }) => {
-                assert!(stack_push(stack, *bytes as i32))
-            }
-            _ => {
-                eprintln!("Expected an integer");
-                std::process::exit(1);
-            }
-        },
-        _ => {}
-    };
-}
-
-pub fn ldc_helper(
-    stack: &mut stack_t,
-    program_counter: &mut usize,
-    method: &method_t,
-    class: &class_file_t,
-) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let fresh3 = *program_counter;
-    *program_counter = (*program_counter).wrapping_add(1);
-    let pool_index = (*method).code.code[fresh3] as usize;
-
-    let pool_const: cp_info = (*class).constant_pool[pool_index.wrapping_sub(1) as usize].clone();
-    if (*class).constant_pool[pool_index.wrapping_sub(1) as usize]
-        .info
-        .is_some()
-    {
-        constant_pool_helper(stack, &pool_const);
-    };
-}
-
-pub fn iload_helper(
-    stack: &mut stack_t,
-    program_counter: &mut usize,
-    method: &method_t,
-    locals: &[i32],
-) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let fresh4 = *program_counter;
-    *program_counter = (*program_counter).wrapping_add(1);
-    let first_operand: u8 = (*method).code.code[fresh4];
-    assert!(stack_push(stack, locals[first_operand as usize]));
-}
-
-pub fn aload_helper(
-    stack: &mut stack_t,
-    program_counter: &mut usize,
-    method: &method_t,
-    locals: &[i32],
-) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let fresh5 = *program_counter;
-    *program_counter = (*program_counter).wrapping_add(1);
-    assert!(stack_push(
-        stack,
-        locals[(*method).code.code[fresh5] as usize],
-    ));
-}
-
-pub fn iload_n_helper(
-    opcode: jvm_instruction_t,
-    stack: &mut stack_t,
-    program_counter: &mut usize,
-    locals: &[i32],
-) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    assert!(stack_push(
-        stack,
-        locals[(opcode as usize).wrapping_sub(jvm_instruction_t::i_iload_0 as usize)]
-    ));
-}
-
-pub fn aload_n_helper(
-    opcode: jvm_instruction_t,
-    stack: &mut stack_t,
-    program_counter: &mut usize,
-    locals: &[i32],
-) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    assert!(stack_push(
-        stack,
-        locals[(opcode as usize).wrapping_sub(jvm_instruction_t::i_aload_0 as usize) as usize]
-    ));
-}
-
-pub fn iaload_helper(stack: &mut stack_t, program_counter: &mut usize, heap: &mut heap_t) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut index: i32 = 0;
-    assert!(stack_pop(stack, &mut index));
-    let mut reference: i32 = 0;
-    assert!(stack_pop(stack, &mut reference));
-    let array: Vec<i32> = heap[reference as usize].clone();
-    assert!((index as usize) < array.len());
-    let value: i32 = array[index as usize];
-    assert!(stack_push(stack, value));
-}
-
-pub fn istore_helper(
-    stack: &mut stack_t,
-    program_counter: &mut usize,
-    method: &method_t,
-    locals: &mut Vec<i32>,
-) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let fresh6 = *program_counter;
-    *program_counter = (*program_counter).wrapping_add(1);
-    let first_operand: u8 = (*method).code.code[fresh6];
-    let mut value: i32 = 0;
-    assert!(stack_pop(stack, &mut value));
-    locals[first_operand as usize] = value;
-}
-
-pub fn astore_helper(
-    stack: &mut stack_t,
-    program_counter: &mut usize,
-    method: &method_t,
-    locals: &mut Vec<i32>,
-) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let fresh7 = *program_counter;
-    *program_counter = (*program_counter).wrapping_add(1);
-    let first_operand: u8 = (*method).code.code[fresh7];
-    let mut reference: i32 = 0;
-    assert!(stack_pop(stack, &mut reference));
-    locals[first_operand as usize] = reference;
-}
-
-pub fn istore_n_helper(
-    opcode: jvm_instruction_t,
-    stack: &mut stack_t,
-    program_counter: &mut usize,
-    locals: &mut Vec<i32>,
-) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let locals_index: usize =
-        (opcode as usize).wrapping_sub(jvm_instruction_t::i_istore_0 as usize);
-    let mut value: i32 = 0;
-    assert!(stack_pop(stack, &mut value));
-    locals[locals_index] = value;
-}
-
-pub fn astore_n_helper(
-    opcode: jvm_instruction_t,
-    stack: &mut stack_t,
-    program_counter: &mut usize,
-    locals: &mut Vec<i32>,
-) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let locals_index: usize =
-        (opcode as usize).wrapping_sub(jvm_instruction_t::i_astore_0 as usize);
-    let mut reference: i32 = 0;
-    assert!(stack_pop(stack, &mut reference));
-    locals[locals_index] = reference;
-}
-
-pub fn iastore_helper(stack: &mut stack_t, program_counter: &mut usize, heap: &mut heap_t) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut value: i32 = 0;
-    assert!(stack_pop(stack, &mut value));
-    let mut index: i32 = 0;
-    assert!(stack_pop(stack, &mut index));
-    let mut reference: i32 = 0;
-    assert!(stack_pop(stack, &mut reference));
-    let array: &mut Vec<i32> = &mut heap[reference as usize];
-    assert!((index as usize) < array.len());
-    array[index as usize] = value;
-}
-
-pub fn dup_helper(stack: &mut stack_t, program_counter: &mut usize) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut value: i32 = 0;
-    assert!(stack_pop(stack, &mut value));
-    assert!(stack_push(stack, value));
-    assert!(stack_push(stack, value));
-}
-
-pub fn iadd_helper(stack: &mut stack_t, program_counter: &mut usize) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut first_operand: i32 = 0;
-    let mut second_operand: i32 = 0;
-    assert!(stack_pop(stack, &mut second_operand));
-    assert!(stack_pop(stack, &mut first_operand));
-    assert!(stack_push(
-        stack,
-        first_operand.wrapping_add(second_operand)
-    ));
-}
-
-pub fn isub_helper(stack: &mut stack_t, program_counter: &mut usize) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut first_operand: i32 = 0;
-    let mut second_operand: i32 = 0;
-    assert!(stack_pop(stack, &mut second_operand));
-    assert!(stack_pop(stack, &mut first_operand));
-    assert!(stack_push(
-        stack,
-        first_operand.wrapping_sub(second_operand)
-    ));
-}
-
-pub fn imul_helper(stack: &mut stack_t, program_counter: &mut usize) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut first_operand: i32 = 0;
-    let mut second_operand: i32 = 0;
-    assert!(stack_pop(stack, &mut second_operand));
-    assert!(stack_pop(stack, &mut first_operand));
-    assert!(stack_push(
-        stack,
-        first_operand.wrapping_mul(second_operand)
-    ));
-}
-
-pub fn idiv_helper(stack: &mut stack_t, program_counter: &mut usize) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut first_operand: i32 = 0;
-    let mut second_operand: i32 = 0;
-    assert!(stack_pop(stack, &mut second_operand));
-    assert!(stack_pop(stack, &mut first_operand));
-    // eprintln!("idiv First Operand: {first_operand}, Second Operand: {second_operand}");
-    assert!(stack_push(stack, second_operand / first_operand));
-}
-
-pub fn irem_helper(stack: &mut stack_t, program_counter: &mut usize) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut first_operand: i32 = 0;
-    let mut second_operand: i32 = 0;
-    assert!(stack_pop(stack, &mut second_operand));
-    assert!(stack_pop(stack, &mut first_operand));
-    assert!(stack_push(stack, second_operand % first_operand));
-}
-
-pub fn ineg_helper(stack: &mut stack_t, program_counter: &mut usize) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut first_operand: i32 = 0;
-    assert!(stack_pop(stack, &mut first_operand));
-    assert!(stack_push(stack, first_operand.wrapping_neg()));
-}
-
-pub fn ishl_helper(stack: &mut stack_t, program_counter: &mut usize) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut first_operand: i32 = 0;
-    let mut second_operand: i32 = 0;
-    assert!(stack_pop(stack, &mut second_operand));
-    assert!(stack_pop(stack, &mut first_operand));
-    assert!(stack_push(stack, first_operand << second_operand));
-}
-
-pub fn ishr_helper(stack: &mut stack_t, program_counter: &mut usize) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut first_operand: i32 = 0;
-    let mut second_operand: i32 = 0;
-    assert!(stack_pop(stack, &mut second_operand));
-    assert!(stack_pop(stack, &mut first_operand));
-    assert!(stack_push(stack, first_operand >> second_operand));
-}
-
-pub fn iushr_helper(stack: &mut stack_t, program_counter: &mut usize) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut first_operand: i32 = 0;
-    let mut second_operand: i32 = 0;
-    assert!(stack_pop(stack, &mut second_operand));
-    assert!(stack_pop(stack, &mut first_operand));
-    assert!(stack_push(
-        stack,
-        (first_operand as u32 >> second_operand) as i32,
-    ));
-}
 
-pub fn iand_helper(stack: &mut stack_t, program_counter: &mut usize) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut first_operand: i32 = 0;
-    let mut second_operand: i32 = 0;
-    assert!(stack_pop(stack, &mut second_operand));
-    assert!(stack_pop(stack, &mut first_operand));
-    assert!(stack_push(stack, first_operand & second_operand));
-}
+/*
+ * Methods run from their decoded instructions (see decode.rs), so the interpreter
+ * never reads bytecode: the program counter is an index into the decoded instructions,
+ * and each instruction's operands are already in it.
+ *
+ * Every helper below is generic over whether its frame is CHECKED (see frame.rs), so
+ * that verified and unverified methods share one interpreter, which is compiled once
+ * with every operand stack and local access checked and once without.
+ */
 
-pub fn ior_helper(stack: &mut stack_t, program_counter: &mut usize) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut first_operand: i32 = 0;
-    let mut second_operand: i32 = 0;
-    assert!(stack_pop(stack, &mut second_operand));
-    assert!(stack_pop(stack, &mut first_operand));
-    assert!(stack_push(stack, first_operand | second_operand));
+pub fn load_helper<const CHECKED: bool>(frame: &mut frame_t<CHECKED>, index: u16) {
+    let value = frame_load(frame, index as usize);
+    frame_push(frame, value);
 }
 
-pub fn ixor_helper(stack: &mut stack_t, program_counter: &mut usize) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut first_operand: i32 = 0;
-    let mut second_operand: i32 = 0;
-    assert!(stack_pop(stack, &mut second_operand));
-    assert!(stack_pop(stack, &mut first_operand));
-    assert!(stack_push(stack, first_operand ^ second_operand));
+pub fn store_helper<const CHECKED: bool>(frame: &mut frame_t<CHECKED>, index: u16) {
+    let value = frame_pop(frame);
+    frame_store(frame, index as usize, value);
 }
 
-pub fn iinc_helper(program_counter: &mut usize, method: &method_t, locals: &mut Vec<i32>) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let fresh8 = *program_counter;
-    *program_counter = (*program_counter).wrapping_add(1);
-    let first_operand: u8 = (*method).code.code[fresh8];
-    let fresh9 = *program_counter;
-    *program_counter = (*program_counter).wrapping_add(1);
-    let second_operand: i32 = (*method).code.code[fresh9] as i32;
-    locals[first_operand as usize] += second_operand;
+pub fn iaload_helper<const CHECKED: bool>(frame: &mut frame_t<CHECKED>, heap: &heap_t) {
+    let index = frame_pop(frame);
+    let reference = frame_pop(frame);
+    frame_push(frame, heap_load(heap, reference, index));
 }
 
-pub const JUMP_TWO_OPCODES_OFFSET: i32 = -3;
-
-pub fn jump_offset_helper(program_counter: &mut usize, method: &method_t) -> i32 {
-    let fresh11 = *program_counter;
-    *program_counter = (*program_counter).wrapping_add(1);
-    let first_operand: i8 = (*method).code.code[fresh11] as i8;
-    let fresh12 = *program_counter;
-    *program_counter = (*program_counter).wrapping_add(1);
-    let second_operand: i8 = (*method).code.code[fresh12] as i8;
-    let jump_offset: i32 = (((first_operand as i16 as i32) << 8_i32) as i16 as i32
-        | second_operand as i32)
-        + JUMP_TWO_OPCODES_OFFSET;
-    jump_offset
+pub fn iastore_helper<const CHECKED: bool>(frame: &mut frame_t<CHECKED>, heap: &mut heap_t) {
+    let value = frame_pop(frame);
+    let index = frame_pop(frame);
+    let reference = frame_pop(frame);
+    heap_store(heap, reference, index, value);
 }
 
-pub fn jump_one_op_helper(
-    stack: &mut stack_t,
-    program_counter: &mut usize,
-    method: &method_t,
-    first_stack_operand: &mut i32,
-    jump_offset: &mut i32,
-) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    *jump_offset = jump_offset_helper(program_counter, method);
-    assert!(stack_pop(stack, first_stack_operand));
+pub fn dup_helper<const CHECKED: bool>(frame: &mut frame_t<CHECKED>) {
+    let value = frame_pop(frame);
+    frame_push(frame, value);
+    frame_push(frame, value);
 }
 
-pub fn jump_two_ops_helper(
-    stack: &mut stack_t,
-    program_counter: &mut usize,
-    method: &method_t,
-    first_stack_operand: &mut i32,
-    second_stack_operand: &mut i32,
-    jump_offset: &mut i32,
+/* *
+ * An arithmetic or bitwise instruction, which pops two operands and pushes
+ * `operation(first_operand, second_operand)`, where the second was on top.
+ */
+#[inline(always)]
+pub fn binary_helper<const CHECKED: bool>(
+    frame: &mut frame_t<CHECKED>,
+    operation: impl FnOnce(i32, i32) -> i32,
 ) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    *jump_offset = jump_offset_helper(program_counter, method);
-    assert!(stack_pop(stack, second_stack_operand));
-    assert!(stack_pop(stack, first_stack_operand));
+    let second_operand = frame_pop(frame);
+    let first_operand = frame_pop(frame);
+    frame_push(frame, operation(first_operand, second_operand));
 }
 
-pub fn ifeq_helper(stack: &mut stack_t, program_counter: &mut usize, method: &method_t) {
-    let mut first_stack_operand: i32 = 0;
-    let mut jump_offset: i32 = 0;
-    jump_one_op_helper(
-        stack,
-        program_counter,
-        method,
-        &mut first_stack_operand,
-        &mut jump_offset,
-    );
-    if first_stack_operand == 0 {
-        *program_counter = (*program_counter).wrapping_add(jump_offset as usize)
-    };
-}
-
-pub fn ifne_helper(stack: &mut stack_t, program_counter: &mut usize, method: &method_t) {
-    let mut first_stack_operand: i32 = 0;
-    let mut jump_offset: i32 = 0;
-    jump_one_op_helper(
-        stack,
-        program_counter,
-        method,
-        &mut first_stack_operand,
-        &mut jump_offset,
-    );
-    if first_stack_operand != 0 {
-        *program_counter = (*program_counter).wrapping_add(jump_offset as usize);
-    };
+pub fn ineg_helper<const CHECKED: bool>(frame: &mut frame_t<CHECKED>) {
+    let value = frame_pop(frame);
+    frame_push(frame, value.wrapping_neg());
 }
 
-pub fn iflt_helper(stack: &mut stack_t, program_counter: &mut usize, method: &method_t) {
-    let mut first_stack_operand: i32 = 0;
-    let mut jump_offset: i32 = 0;
-
-    jump_one_op_helper(
-        stack,
-        program_counter,
-        method,
-        &mut first_stack_operand,
-        &mut jump_offset,
-    );
-    if first_stack_operand < 0 {
-        *program_counter = (*program_counter).wrapping_add(jump_offset as usize);
-    };
+pub fn iinc_helper<const CHECKED: bool>(frame: &mut frame_t<CHECKED>, index: u16, increment: i16) {
+    let value = frame_load(frame, index as usize);
+    frame_store(frame, index as usize, value.wrapping_add(increment as i32));
 }
 
-pub fn ifge_helper(stack: &mut stack_t, program_counter: &mut usize, method: &method_t) {
-    let mut first_stack_operand: i32 = 0;
-    let mut jump_offset: i32 = 0;
-    jump_one_op_helper(
-        stack,
-        program_counter,
-        method,
-        &mut first_stack_operand,
-        &mut jump_offset,
-    );
-    if first_stack_operand >= 0 {
-        *program_counter = (*program_counter).wrapping_add(jump_offset as usize)
-    };
-}
-
-pub fn ifgt_helper(stack: &mut stack_t, program_counter: &mut usize, method: &method_t) {
-    let mut first_stack_operand: i32 = 0;
-    let mut jump_offset: i32 = 0;
-    jump_one_op_helper(
-        stack,
-        program_counter,
-        method,
-        &mut first_stack_operand,
-        &mut jump_offset,
-    );
-    if first_stack_operand > 0 {
-        *program_counter = (*program_counter).wrapping_add(jump_offset as usize)
-    };
-}
-
-pub fn ifle_helper(stack: &mut stack_t, program_counter: &mut usize, method: &method_t) {
-    let mut first_stack_operand: i32 = 0;
-    let mut jump_offset: i32 = 0;
-    jump_one_op_helper(
-        stack,
-        program_counter,
-        method,
-        &mut first_stack_operand,
-        &mut jump_offset,
-    );
-    if first_stack_operand <= 0 {
-        *program_counter = (*program_counter).wrapping_add(jump_offset as usize)
-    };
-}
-
-pub fn if_icmpeq_helper(stack: &mut stack_t, program_counter: &mut usize, method: &method_t) {
-    let mut first_stack_operand: i32 = 0;
-    let mut second_stack_operand: i32 = 0;
-    let mut jump_offset: i32 = 0;
-
-    jump_two_ops_helper(
-        stack,
-        program_counter,
-        method,
-        &mut first_stack_operand,
-        &mut second_stack_operand,
-        &mut jump_offset,
-    );
-    if first_stack_operand == second_stack_operand {
-        *program_counter = (*program_counter).wrapping_add(jump_offset as usize)
-    };
-}
-
-pub fn if_icmpne_helper(stack: &mut stack_t, program_counter: &mut usize, method: &method_t) {
-    let mut first_stack_operand: i32 = 0;
-    let mut second_stack_operand: i32 = 0;
-    let mut jump_offset: i32 = 0;
-    jump_two_ops_helper(
-        stack,
-        program_counter,
-        method,
-        &mut first_stack_operand,
-        &mut second_stack_operand,
-        &mut jump_offset,
-    );
-    if first_stack_operand != second_stack_operand {
-        *program_counter = (*program_counter).wrapping_add(jump_offset as usize);
-    };
-}
-
-pub fn if_icmplt_helper(stack: &mut stack_t, program_counter: &mut usize, method: &method_t) {
-    let mut first_stack_operand: i32 = 0;
-    let mut second_stack_operand: i32 = 0;
-    let mut jump_offset: i32 = 0;
-
-    jump_two_ops_helper(
-        stack,
-        program_counter,
-        method,
-        &mut first_stack_operand,
-        &mut second_stack_operand,
-        &mut jump_offset,
-    );
-    if first_stack_operand < second_stack_operand {
-        *program_counter = (*program_counter).wrapping_add(jump_offset as usize);
-    };
-}
-
-pub fn if_icmpge_helper(stack: &mut stack_t, program_counter: &mut usize, method: &method_t) {
-    let mut first_stack_operand: i32 = 0;
-    let mut second_stack_operand: i32 = 0;
-    let mut jump_offset: i32 = 0;
-    jump_two_ops_helper(
-        stack,
-        program_counter,
-        method,
-        &mut first_stack_operand,
-        &mut second_stack_operand,
-        &mut jump_offset,
-    );
-    if first_stack_operand >= second_stack_operand {
-        *program_counter = (*program_counter).wrapping_add(jump_offset as usize);
-    };
-}
-
-pub fn if_icmpgt_helper(stack: &mut stack_t, program_counter: &mut usize, method: &method_t) {
-    let mut first_stack_operand: i32 = 0;
-    let mut second_stack_operand: i32 = 0;
-    let mut jump_offset: i32 = 0;
-    jump_two_ops_helper(
-        stack,
-        program_counter,
-        method,
-        &mut first_stack_operand,
-        &mut second_stack_operand,
-        &mut jump_offset,
-    );
-    if first_stack_operand > second_stack_operand {
-        *program_counter = (*program_counter).wrapping_add(jump_offset as usize)
-    };
-}
-
-pub fn if_icmple_helper(stack: &mut stack_t, program_counter: &mut usize, method: &method_t) {
-    let mut jump_offset: i32 = 0;
-    let mut first_stack_operand: i32 = 0;
-    let mut second_stack_operand: i32 = 0;
-    jump_two_ops_helper(
-        stack,
-        program_counter,
-        method,
-        &mut first_stack_operand,
-        &mut second_stack_operand,
-        &mut jump_offset,
-    );
-    if first_stack_operand <= second_stack_operand {
-        *program_counter = (*program_counter).wrapping_add(jump_offset as usize);
-    };
-}
-
-pub fn goto_helper(program_counter: &mut usize, method: &method_t) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let jump_offset = jump_offset_helper(program_counter, method);
-    *program_counter = (*program_counter).wrapping_add(jump_offset as usize);
-}
-
-pub fn ireturn_helper(
-    stack: &mut stack_t,
-    program_counter: &mut usize,
-    method: &method_t,
-    result: &mut Option<i32>,
-) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut value: i32 = 0;
-    assert!(stack_pop(stack, &mut value));
-    *result = Some(value);
-
-    *program_counter = method.code.code_length as usize;
-}
-
-pub fn return_helper(program_counter: &mut usize, method: &method_t) {
-    *program_counter = (*method).code.code_length as usize;
+/* *
+ * if<cond>, which pops one operand and branches if `condition(operand)`
+ *
+ * @return the index of the next instruction to run
+ */
+#[inline(always)]
+pub fn if_helper<const CHECKED: bool>(
+    frame: &mut frame_t<CHECKED>,
+    program_counter: usize,
+    target: u32,
+    condition: impl FnOnce(i32) -> bool,
+) -> usize {
+    if condition(frame_pop(frame)) {
+        target as usize
+    } else {
+        program_counter + 1
+    }
 }
 
-pub fn invokevirtual_helper(stack: &mut stack_t, program_counter: &mut usize) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut value: i32 = 0;
-    assert!(stack_pop(stack, &mut value));
-
-    println!("{}", value,);
-    *program_counter = (*program_counter).wrapping_add(TWO_OPERAND_OFFSET);
+/* *
+ * if_icmp<cond>, which pops two operands and branches if `condition(first, second)`
+ *
+ * @return the index of the next instruction to run
+ */
+#[inline(always)]
+pub fn if_icmp_helper<const CHECKED: bool>(
+    frame: &mut frame_t<CHECKED>,
+    program_counter: usize,
+    target: u32,
+    condition: impl FnOnce(i32, i32) -> bool,
+) -> usize {
+    let second_operand = frame_pop(frame);
+    let first_operand = frame_pop(frame);
+    if condition(first_operand, second_operand) {
+        target as usize
+    } else {
+        program_counter + 1
+    }
 }
 
 #[inline(always)]
-pub fn invokestatic_helper(
-    stack: &mut stack_t,
-    program_counter: &mut usize,
-    method: &method_t,
+pub fn invokestatic_helper<const CHECKED: bool>(
+    frame: &mut frame_t<CHECKED>,
+    method_index: u16,
     class: &class_file_t,
     heap: &mut heap_t,
+    output: &mut output_t,
 ) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let fresh13 = *program_counter;
-    *program_counter = (*program_counter).wrapping_add(1);
-    let first_operand = (*method).code.code[fresh13];
-    let fresh14 = *program_counter;
-    *program_counter = (*program_counter).wrapping_add(1);
-    let second_operand: u8 = (*method).code.code[fresh14];
-    let sub_method_index: u16 = ((first_operand as i32) << 8_i32 | second_operand as i32) as u16;
-    let sub_method: Option<method_t> = find_method_from_index(sub_method_index, class);
-    assert!(sub_method.is_some());
-    let mut locals_ptr: Vec<i32> =
-        Vec::with_capacity(sub_method.clone().unwrap().code.max_locals.into());
-
-    let num_args: usize = get_number_of_parameters(sub_method.as_ref().unwrap()) as usize;
-    let mut popped_value: i32 = 0;
-    let mut i: usize = 0;
-    while i < num_args {
-        assert!(stack_pop(stack, &mut popped_value));
-
-        locals_ptr.push(popped_value);
-        i = i.wrapping_add(1)
-    }
-    let returned_value: Option<i32> = execute(&sub_method.unwrap(), &mut locals_ptr, class, heap);
-    if returned_value.is_some() {
-        assert!(stack_push(stack, returned_value.unwrap()));
+    // The method is borrowed from the class, so calling it doesn't copy its code
+    let sub_method: &method_t = &class.methods[method_index as usize];
+
+    // The arguments stay where they are and become the callee's first locals
+    let arguments = get_number_of_parameters(sub_method) as usize;
+    let values = frame_arguments(frame, arguments);
+    if let Some(value) = invoke(sub_method, values, arguments, class, heap, output) {
+        frame_push(frame, value);
     }
 }
 
-pub fn newarray_helper(
-    stack: &mut stack_t,
-    program_counter: &mut usize,
-    method: &method_t,
-    heap: &mut Vec<Vec<i32>>,
-) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let fresh15 = *program_counter;
-    *program_counter = (*program_counter).wrapping_add(1);
-    let first_operand: u8 = method.code.code[fresh15];
-    assert!(first_operand == 10);
-    let mut count: i32 = 0;
-    assert!(stack_pop(stack, &mut count));
-    let new_array: Vec<i32> = Vec::with_capacity(count.try_into().unwrap());
-    let tmp_ref = heap.len();
-    heap.push(new_array);
-    assert!(stack_push(stack, tmp_ref as i32));
-}
-
-pub fn arraylength_helper(stack: &mut stack_t, program_counter: &mut usize, heap: &mut heap_t) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut reference: i32 = 0;
-    assert!(stack_pop(stack, &mut reference));
-
-    let array: Vec<i32> = heap[reference as usize].clone();
-    assert!(stack_push(stack, array[0]));
-}
-
-pub fn getstatic_helper(program_counter: &mut usize) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    *program_counter = (*program_counter).wrapping_add(TWO_OPERAND_OFFSET);
-}
-
-pub fn areturn_helper(
-    stack: &mut stack_t,
-    program_counter: &mut usize,
-    method: &method_t,
-    return_value: &mut Option<i32>,
-) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    let mut reference: i32 = 0;
-    assert!(stack_pop(stack, &mut reference));
-    *return_value = Some(reference);
-    *program_counter = (*method).code.code_length as usize;
+pub fn newarray_helper<const CHECKED: bool>(frame: &mut frame_t<CHECKED>, heap: &mut heap_t) {
+    let count = frame_pop(frame);
+    frame_push(frame, heap_new_array(heap, count));
 }
 
-pub fn not_implemented_helper(program_counter: &mut usize, opcode: &jvm_instruction_t) {
-    *program_counter = (*program_counter).wrapping_add(1);
-    eprintln!("Running unimplemented opcode: {:#?}\n", *opcode);
-    *program_counter = (*program_counter).wrapping_add(1);
-}
-#[inline(always)]
-fn opcode_helper(
-    stack: &mut stack_t,
-    program_counter: &mut usize,
-    method: &method_t,
-    locals: &mut Vec<i32>,
-    class: &class_file_t,
-    heap: &mut heap_t,
-    result: &mut Option<i32>,
-) {
-    let opcode: jvm_instruction_t =
-        jvm_instruction_t::try_from(method.code.code[*program_counter]).unwrap();
-    match opcode {
-        jvm_instruction_t::i_nop => *program_counter += 1,
-        jvm_instruction_t::i_iconst_m1
-        | jvm_instruction_t::i_iconst_0
-        | jvm_instruction_t::i_iconst_1
-        | jvm_instruction_t::i_iconst_2
-        | jvm_instruction_t::i_iconst_3
-        | jvm_instruction_t::i_iconst_4
-        | jvm_instruction_t::i_iconst_5 => {
-            iconst_helper(opcode, stack, program_counter);
-        }
-        jvm_instruction_t::i_bipush => {
-            bipush_helper(stack, program_counter, method);
-        }
-        jvm_instruction_t::i_sipush => {
-            sipush_helper(stack, program_counter, method);
-        }
-        jvm_instruction_t::i_ldc => {
-            ldc_helper(stack, program_counter, method, class);
-        }
-        jvm_instruction_t::i_iload => {
-            iload_helper(stack, program_counter, method, locals);
-        }
-        jvm_instruction_t::i_aload => {
-            aload_helper(stack, program_counter, method, locals);
-        }
-        jvm_instruction_t::i_iload_0
-        | jvm_instruction_t::i_iload_1
-        | jvm_instruction_t::i_iload_2
-        | jvm_instruction_t::i_iload_3 => {
-            iload_n_helper(opcode, stack, program_counter, locals);
-        }
-        jvm_instruction_t::i_aload_0
-        | jvm_instruction_t::i_aload_1
-        | jvm_instruction_t::i_aload_2
-        | jvm_instruction_t::i_aload_3 => {
-            aload_n_helper(opcode, stack, program_counter, locals);
-        }
-        jvm_instruction_t::i_iaload => {
-            iaload_helper(stack, program_counter, heap);
-        }
-        jvm_instruction_t::i_istore => {
-            istore_helper(stack, program_counter, method, locals);
-        }
-        jvm_instruction_t::i_astore => {
-            astore_helper(stack, program_counter, method, locals);
-        }
-        jvm_instruction_t::i_istore_0
-        | jvm_instruction_t::i_istore_1
-        | jvm_instruction_t::i_istore_2
-        | jvm_instruction_t::i_istore_3 => {
-            istore_n_helper(opcode, stack, program_counter, locals);
-        }
-        jvm_instruction_t::i_astore_0
-        | jvm_instruction_t::i_astore_1
-        | jvm_instruction_t::i_astore_2
-        | jvm_instruction_t::i_astore_3 => {
-            astore_n_helper(opcode, stack, program_counter, locals);
-        }
-        jvm_instruction_t::i_iastore => {
-            iastore_helper(stack, program_counter, heap);
-        }
-        jvm_instruction_t::i_dup => {
-            dup_helper(stack, program_counter);
-        }
-        jvm_instruction_t::i_iadd => {
-            iadd_helper(stack, program_counter);
-        }
-        jvm_instruction_t::i_isub => {
-            isub_helper(stack, program_counter);
-        }
-        jvm_instruction_t::i_imul => {
-            imul_helper(stack, program_counter);
-        }
-        jvm_instruction_t::i_idiv => {
-            idiv_helper(stack, program_counter);
-        }
-        jvm_instruction_t::i_irem => {
-            irem_helper(stack, program_counter);
-        }
-        jvm_instruction_t::i_ineg => {
-            ineg_helper(stack, program_counter);
-        }
-        jvm_instruction_t::i_ishl => {
-            ishl_helper(stack, program_counter);
-        }
-        jvm_instruction_t::i_ishr => {
-            ishr_helper(stack, program_counter);
-        }
-        jvm_instruction_t::i_iushr => {
-            iushr_helper(stack, program_counter);
-        }
-        jvm_instruction_t::i_iand => {
-            iand_helper(stack, program_counter);
-        }
-        jvm_instruction_t::i_ior => {
-            ior_helper(stack, program_counter);
-        }
-        jvm_instruction_t::i_ixor => {
-            ixor_helper(stack, program_counter);
-        }
-        jvm_instruction_t::i_iinc => {
-            iinc_helper(program_counter, method, locals);
-        }
-        jvm_instruction_t::i_ifeq => {
-            ifeq_helper(stack, program_counter, method);
-        }
-        jvm_instruction_t::i_ifne => {
-            ifne_helper(stack, program_counter, method);
-        }
-        jvm_instruction_t::i_iflt => {
-            iflt_helper(stack, program_counter, method);
-        }
-        jvm_instruction_t::i_ifge => {
-            ifge_helper(stack, program_counter, method);
-        }
-        jvm_instruction_t::i_ifgt => {
-            ifgt_helper(stack, program_counter, method);
-        }
-        jvm_instruction_t::i_ifle => {
-            ifle_helper(stack, program_counter, method);
-        }
-        jvm_instruction_t::i_if_icmpeq => {
-            if_icmpeq_helper(stack, program_counter, method);
-        }
-        jvm_instruction_t::i_if_icmpne => {
-            if_icmpne_helper(stack, program_counter, method);
-        }
-        jvm_instruction_t::i_if_icmplt => {
-            if_icmplt_helper(stack, program_counter, method);
-        }
-        jvm_instruction_t::i_if_icmpge => {
-            if_icmpge_helper(stack, program_counter, method);
-        }
-        jvm_instruction_t::i_if_icmpgt => {
-            if_icmpgt_helper(stack, program_counter, method);
-        }
-        jvm_instruction_t::i_if_icmple => {
-            if_icmple_helper(stack, program_counter, method);
-        }
-        jvm_instruction_t::i_goto => {
-            goto_helper(program_counter, method);
-        }
-        jvm_instruction_t::i_ireturn => {
-            ireturn_helper(stack, program_counter, method, result);
-        }
-        jvm_instruction_t::i_return => {
-            return_helper(program_counter, method);
-        }
-        jvm_instruction_t::i_getstatic => {
-            getstatic_helper(program_counter);
-        }
-        jvm_instruction_t::i_invokevirtual => {
-            invokevirtual_helper(stack, program_counter);
-        }
-        jvm_instruction_t::i_invokestatic => {
-            invokestatic_helper(stack, program_counter, method, class, heap);
-        }
-        jvm_instruction_t::i_newarray => {
-            newarray_helper(stack, program_counter, method, heap);
-        }
-        jvm_instruction_t::i_arraylength => {
-            arraylength_helper(stack, program_counter, heap);
-        }
-        jvm_instruction_t::i_areturn => {
-            areturn_helper(stack, program_counter, method, result);
-        }
-        _ => {
-            not_implemented_helper(program_counter, &opcode);
-        }
-    };
+pub fn arraylength_helper<const CHECKED: bool>(frame: &mut frame_t<CHECKED>, heap: &heap_t) {
+    let reference = frame_pop(frame);
+    frame_push(frame, heap_length(heap, reference));
 }
 
 /* * The name of the method to invoke to run the class file */
@@ -922,73 +158,336 @@ pub const MAIN_DESCRIPTOR: &str = "([Ljava/lang/String;)V";
  * Runs a method's instructions until the method returns.
  *
  * @param method the method to run
- * @param locals the array of local variables, including the method parameters.
- *   Except for parameters, the locals are uninitialized.
+ * @param values where the method's frame starts, beginning with its arguments
+ * @param arguments the number of arguments
  * @param class the class file the method belongs to
- * @param heap an array of heap-allocated pointers, useful for references
+ * @param heap the heap of int arrays, which references index into
+ * @param output where the method's output goes
+ * @param code the method's decoded instructions
  * @return an optional int containing the method's return value
  */
-
-pub fn execute(
+pub fn execute<const CHECKED: bool>(
     method: &method_t,
-    locals: &mut Vec<i32>,
+    values: &mut [i32],
+    arguments: usize,
     class: &class_file_t,
     heap: &mut heap_t,
+    output: &mut output_t,
+    code: &[instruction_t],
 ) -> Option<i32> {
+    let mut frame: frame_t<CHECKED> = frame_new(
+        values,
+        arguments,
+        method.code.max_locals as usize,
+        method.code.max_stack as usize,
+    );
     let mut program_counter: usize = 0;
-    let mut stack = stack_init(method.deref().code.max_stack.into());
-    // Return void
-    let mut result: Option<i32> = None;
-    while program_counter < (*method).code.code_length as usize {
-        // I'm forcing this function and invokestatic to be always inlined to avoid
-        // overflowing the stack in the recursion test.
-        opcode_helper(
-            &mut stack,
-            &mut program_counter,
+    let result: Option<i32> = loop {
+        let instruction = code_fetch(code, program_counter);
+        program_counter = match instruction {
+            instruction_t::nop => program_counter + 1,
+            instruction_t::push(value) => {
+                frame_push(&mut frame, value);
+                program_counter + 1
+            }
+            instruction_t::load(index) => {
+                load_helper(&mut frame, index);
+                program_counter + 1
+            }
+            instruction_t::store(index) => {
+                store_helper(&mut frame, index);
+                program_counter + 1
+            }
+            instruction_t::iaload => {
+                iaload_helper(&mut frame, heap);
+                program_counter + 1
+            }
+            instruction_t::iastore => {
+                iastore_helper(&mut frame, heap);
+                program_counter + 1
+            }
+            instruction_t::dup => {
+                dup_helper(&mut frame);
+                program_counter + 1
+            }
+            instruction_t::iadd => {
+                binary_helper(&mut frame, i32::wrapping_add);
+                program_counter + 1
+            }
+            instruction_t::isub => {
+                binary_helper(&mut frame, i32::wrapping_sub);
+                program_counter + 1
+            }
+            instruction_t::imul => {
+                binary_helper(&mut frame, i32::wrapping_mul);
+                program_counter + 1
+            }
+            instruction_t::idiv => {
+                binary_helper(&mut frame, |a, b| {
+                    assert!(b != 0, "Division by zero");
+                    a.wrapping_div(b)
+                });
+                program_counter + 1
+            }
+            instruction_t::irem => {
+                binary_helper(&mut frame, |a, b| {
+                    assert!(b != 0, "Division by zero");
+                    a.wrapping_rem(b)
+                });
+                program_counter + 1
+            }
+            instruction_t::ineg => {
+                ineg_helper(&mut frame);
+                program_counter + 1
+            }
+            // Shifts use only the low 5 bits of the shift distance, as in Java
+            instruction_t::ishl => {
+                binary_helper(&mut frame, |a, b| a.wrapping_shl(b as u32));
+                program_counter + 1
+            }
+            instruction_t::ishr => {
+                binary_helper(&mut frame, |a, b| a.wrapping_shr(b as u32));
+                program_counter + 1
+            }
+            instruction_t::iushr => {
+                binary_helper(&mut frame, |a, b| (a as u32).wrapping_shr(b as u32) as i32);
+                program_counter + 1
+            }
+            instruction_t::iand => {
+                binary_helper(&mut frame, |a, b| a & b);
+                program_counter + 1
+            }
+            instruction_t::ior => {
+                binary_helper(&mut frame, |a, b| a | b);
+                program_counter + 1
+            }
+            instruction_t::ixor => {
+                binary_helper(&mut frame, |a, b| a ^ b);
+                program_counter + 1
+            }
+            instruction_t::iinc(index, increment) => {
+                iinc_helper(&mut frame, index, increment);
+                program_counter + 1
+            }
+            instruction_t::ifeq(target) => {
+                if_helper(&mut frame, program_counter, target, |a| a == 0)
+            }
+            instruction_t::ifne(target) => {
+                if_helper(&mut frame, program_counter, target, |a| a != 0)
+            }
+            instruction_t::iflt(target) => {
+                if_helper(&mut frame, program_counter, target, |a| a < 0)
+            }
+            instruction_t::ifge(target) => {
+                if_helper(&mut frame, program_counter, target, |a| a >= 0)
+            }
+            instruction_t::ifgt(target) => {
+                if_helper(&mut frame, program_counter, target, |a| a > 0)
+            }
+            instruction_t::ifle(target) => {
+                if_helper(&mut frame, program_counter, target, |a| a <= 0)
+            }
+            instruction_t::if_icmpeq(target) => {
+                if_icmp_helper(&mut frame, program_counter, target, |a, b| a == b)
+            }
+            instruction_t::if_icmpne(target) => {
+                if_icmp_helper(&mut frame, program_counter, target, |a, b| a != b)
+            }
+            instruction_t::if_icmplt(target) => {
+                if_icmp_helper(&mut frame, program_counter, target, |a, b| a < b)
+            }
+            instruction_t::if_icmpge(target) => {
+                if_icmp_helper(&mut frame, program_counter, target, |a, b| a >= b)
+            }
+            instruction_t::if_icmpgt(target) => {
+                if_icmp_helper(&mut frame, program_counter, target, |a, b| a > b)
+            }
+            instruction_t::if_icmple(target) => {
+                if_icmp_helper(&mut frame, program_counter, target, |a, b| a <= b)
+            }
+            instruction_t::goto(target) => target as usize,
+            instruction_t::return_value => break Some(frame_pop(&mut frame)),
+            instruction_t::return_void => break None,
+            instruction_t::println => {
+                output_int(output, frame_pop(&mut frame));
+                program_counter + 1
+            }
+            instruction_t::invokestatic(method_index) => {
+                invokestatic_helper(&mut frame, method_index, class, heap, output);
+                program_counter + 1
+            }
+            instruction_t::newarray => {
+                newarray_helper(&mut frame, heap);
+                program_counter + 1
+            }
+            instruction_t::arraylength => {
+                arraylength_helper(&mut frame, heap);
+                program_counter + 1
+            }
+            instruction_t::trap(trap) => panic!("{}", trap.message()),
+        };
+    };
+    if CHECKED {
+        // A verified caller relies on the callee returning what its descriptor says
+        assert!(
+            result.is_some() == method_returns_value(method),
+            "Method returned the wrong kind of value"
+        );
+    }
+    result
+}
+
+/* *
+ * Calls a method, running it unchecked if it passes verification.
+ *
+ * @param values where the method's frame starts, beginning with its arguments
+ * @param arguments the number of arguments
+ */
+#[inline(always)]
+pub fn invoke(
+    method: &method_t,
+    values: &mut [i32],
+    arguments: usize,
+    class: &class_file_t,
+    heap: &mut heap_t,
+    output: &mut output_t,
+) -> Option<i32> {
+    let prepared = prepare_method(method, class);
+    if prepared.verified {
+        execute::<false>(
             method,
-            locals,
+            values,
+            arguments,
             class,
             heap,
-            &mut result,
-        );
+            output,
+            &prepared.code,
+        )
+    } else {
+        execute::<true>(
+            method,
+            values,
+            arguments,
+            class,
+            heap,
+            output,
+            &prepared.code,
+        )
     }
-    // stack_free(stack);
-    result
 }
+
+/* *
+ * The mutable state of one run of a program. The class it runs is shared and never
+ * modified, so runs on different threads only need contexts of their own.
+ */
+pub struct context_t {
+    /* * The frames of every method invocation (see frame.rs) */
+    pub values: Vec<i32>,
+    pub heap: heap_t,
+    pub output: output_t,
+}
+
+pub fn context_init(output: output_t) -> context_t {
+    context_t {
+        values: vec![0; FRAME_VALUES],
+        heap: heap_init(),
+        output,
+    }
+}
+
+thread_local! {
+    /* * The message of the last failed assertion on this thread */
+    static PANIC_MESSAGE: RefCell<String> = RefCell::new(String::new());
+}
+
+/* *
+ * Keeps failed assertions' messages (see `execute_main()`) rather than printing them
+ * straight away, so that whoever runs the program can write out its output first.
+ */
+pub fn hold_panic_messages() {
+    std::panic::set_hook(Box::new(|info| {
+        let thread = std::thread::current();
+        let message = format!("thread '{}' {}", thread.name().unwrap_or("<unnamed>"), info);
+        PANIC_MESSAGE.with(|held| *held.borrow_mut() = message);
+    }));
+}
+
+/* *
+ * Runs a program's main() in a context.
+ *
+ * @return main()'s return value, which should be None, or the message of the
+ *   assertion that failed (see `hold_panic_messages()`)
+ */
+pub fn execute_main(
+    class: &class_file_t,
+    main_method: &method_t,
+    context: &mut context_t,
+) -> Result<Option<i32>, String> {
+    let context_t {
+        values,
+        heap,
+        output,
+    } = context;
+    /* In a real JVM, locals[0] would contain a reference to String[] args.
+     * But since TeenyJVM doesn't support Objects, main() is passed no arguments. */
+    std::panic::catch_unwind(AssertUnwindSafe(|| {
+        invoke(main_method, values, 0, class, heap, output)
+    }))
+    .map_err(|_| PANIC_MESSAGE.with(|held| held.take()))
+}
+
 pub fn main_0() -> i32 {
+    hold_panic_messages();
+
     let args: Vec<String> = std::env::args().collect();
-    if args.len() != 2 {
-        eprintln!("USAGE: {} <class file>", args.len(),);
+    if args.len() >= 3 && args[1] == BATCH_OPTION {
+        let threads = match args.get(3).map(String::as_str) {
+            None => Some(0),
+            Some(THREADS_OPTION) => args.get(4).and_then(|threads| threads.parse().ok()),
+            Some(_) => None,
+        };
+        if let (Some(threads), true) = (threads, args.len() == 3 || args.len() == 5) {
+            return if batch_run(&args[2], threads) { 0 } else { 1 };
+        }
+    }
+    if args.len() != 2 || args[1].starts_with("--") {
+        eprintln!(
+            "USAGE: {0} <class file>\n       {0} {1} <job list> [{2} <threads>]",
+            args[0], BATCH_OPTION, THREADS_OPTION
+        );
         return 1;
     }
-    // Open the class file for reading
-    let f = File::open(args[1].clone()).unwrap();
-    let class_file = Rc::new(RefCell::new(BufReader::new(f)));
+    // Read the whole class file into memory; the parsed class borrows from it
+    let data: Vec<u8> = match std::fs::read(&args[1]) {
+        Ok(data) => data,
+        Err(error) => {
+            eprintln!("{}: {}", args[1], error);
+            return 1;
+        }
+    };
 
     // Parse the class file
-    let class: Rc<RefCell<class_file_t>> = get_class(class_file);
+    let class: class_file_t = get_class(&data);
 
-    // The heap array is initially allocated to hold zero elements.
-    let mut heap: Vec<Vec<i32>> = Vec::new();
     // Execute the main method
-    let main_method: Option<method_t> = find_method(MAIN_METHOD, MAIN_DESCRIPTOR, &class.borrow());
+    let main_method: Option<&method_t> = find_method(MAIN_METHOD, MAIN_DESCRIPTOR, &class);
     if main_method.is_none() {
         eprintln!("Missing main() method");
         exit(1);
     }
-    /* In a real JVM, locals[0] would contain a reference to String[] args.
-     * But since TeenyJVM doesn't support Objects, we leave it uninitialized. */
-    let mut locals: Vec<i32> =
-        std::vec::from_elem(0, main_method.as_ref().unwrap().code.max_locals.into());
-    let result: Option<i32> = execute(
-        main_method.as_ref().unwrap(),
-        &mut locals,
-        &class.borrow(),
-        &mut heap,
-    );
-    if result.is_some() {
-        eprintln!("main() should return void");
-        exit(1);
+    let main_method: &method_t = main_method.unwrap();
+    let mut context: context_t = context_init(output_init_stdout());
+    let result = execute_main(&class, main_method, &mut context);
+    output_flush(&mut context.output);
+    match result {
+        Ok(None) => 0,
+        Ok(Some(_)) => {
+            eprintln!("main() should return void");
+            1
+        }
+        Err(message) => {
+            eprintln!("{}", message);
+            101
+        }
     }
-    0
 }
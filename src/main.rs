@@ -1,7 +1,12 @@
+mod batch;
+mod decode;
+mod frame;
+mod heap;
 mod jvm;
 mod opcode;
+mod output;
 mod read_class;
-mod stack;
+mod verify;
 
 use jvm::main_0;
 
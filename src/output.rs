@@ -0,0 +1,113 @@
+use std::fs::File;
+use std::io::Write;
+use std::mem::ManuallyDrop;
+use std::os::unix::io::FromRawFd;
+
+/* * How much a stdout output collects before writing it out */
+const BUFFER_SIZE: usize = 64 * 1024;
+/* * Enough for "-2147483648\n" */
+const INT_LINE_SIZE: usize = 12;
+
+/* * "00" to "99", so that integers can be formatted two digits at a time */
+const DIGIT_PAIRS: &[u8; 200] = b"\
+    0001020304050607080910111213141516171819\
+    2021222324252627282930313233343536373839\
+    4041424344454647484950515253545556575859\
+    6061626364656667686970717273747576777879\
+    8081828384858687888990919293949596979899";
+
+/* *
+ * Where a program's output goes. Rather than going through `println!` (which
+ * formats with `fmt` and locks stdout for every line), output is collected in one
+ * large buffer, which is either written straight to file descriptor 1 in big chunks
+ * or, for runs whose output must be kept apart (see batch.rs), kept in memory.
+ */
+pub struct output_t {
+    buffer: Vec<u8>,
+    /* * stdout, or None to collect everything in `buffer`. Never closed, since it
+     * doesn't own stdout. */
+    stdout: Option<ManuallyDrop<File>>,
+}
+
+/* * Creates an output that writes to stdout. */
+pub fn output_init_stdout() -> output_t {
+    output_t {
+        buffer: Vec::with_capacity(BUFFER_SIZE),
+        stdout: Some(ManuallyDrop::new(unsafe { File::from_raw_fd(1) })),
+    }
+}
+
+/* * Creates an output that collects everything in memory (see `output_contents()`). */
+pub fn output_init_buffer() -> output_t {
+    output_t {
+        buffer: Vec::new(),
+        stdout: None,
+    }
+}
+
+/* *
+ * Formats an int in decimal, right-aligned so that it ends at the end of `line`,
+ * which must have room for 11 bytes.
+ *
+ * @return where the formatted int starts
+ */
+fn format_int(value: i32, line: &mut [u8]) -> usize {
+    // Format the magnitude as unsigned, so that negating i32::MIN can't overflow
+    let mut magnitude = value.unsigned_abs();
+    let mut start = line.len();
+    while magnitude >= 100 {
+        let pair = 2 * (magnitude % 100) as usize;
+        magnitude /= 100;
+        start -= 2;
+        line[start..start + 2].copy_from_slice(&DIGIT_PAIRS[pair..pair + 2]);
+    }
+    if magnitude >= 10 {
+        let pair = 2 * magnitude as usize;
+        start -= 2;
+        line[start..start + 2].copy_from_slice(&DIGIT_PAIRS[pair..pair + 2]);
+    } else {
+        start -= 1;
+        line[start] = b'0' + magnitude as u8;
+    }
+    if value < 0 {
+        start -= 1;
+        line[start] = b'-';
+    }
+    start
+}
+
+/* * Writes an int followed by a newline, as System.out.println(int) does. */
+pub fn output_int(output: &mut output_t, value: i32) {
+    let mut line = [b'\n'; INT_LINE_SIZE];
+    let start = format_int(value, &mut line[..INT_LINE_SIZE - 1]);
+    if output.stdout.is_some() && output.buffer.len() + INT_LINE_SIZE > BUFFER_SIZE {
+        output_flush(output);
+    }
+    output.buffer.extend_from_slice(&line[start..]);
+}
+
+/* * Writes some bytes, e.g. the collected output of another output. */
+pub fn output_write(output: &mut output_t, bytes: &[u8]) {
+    if output.stdout.is_some() && output.buffer.len() + bytes.len() > BUFFER_SIZE {
+        output_flush(output);
+    }
+    output.buffer.extend_from_slice(bytes);
+}
+
+/* *
+ * Writes out everything buffered for stdout. Call this before exiting and before
+ * writing diagnostics to stderr, so that they appear after the output before them.
+ * Outputs that collect everything in memory are left as they are.
+ */
+pub fn output_flush(output: &mut output_t) {
+    if let Some(stdout) = output.stdout.as_mut() {
+        // Nobody is left to tell if stdout has gone away
+        let _ = stdout.write_all(&output.buffer);
+        output.buffer.clear();
+    }
+}
+
+/* * Everything an output has collected since it was created or last flushed */
+pub fn output_contents(output: &output_t) -> &[u8] {
+    &output.buffer
+}
@@ -1,11 +1,7 @@
-use std::borrow::Borrow;
-use std::cell::RefCell;
+use std::collections::HashMap;
+use std::sync::OnceLock;
 
-use std::fs::File;
-use std::io::prelude::*;
-use std::io::{BufRead, BufReader, Seek, SeekFrom};
-use std::ops::Deref;
-use std::rc::Rc;
+use crate::decode::prepared_t;
 
 #[derive(Copy, Clone, Debug, PartialEq)]
 #[repr(C)]
@@ -39,7 +35,7 @@ pub struct attribute_info {
 /** The JVM's representation of a Java method's code */
 #[derive(Clone, Debug, PartialEq)]
 #[repr(C)]
-pub struct code_t {
+pub struct code_t<'a> {
     /** The maximum number of ints that will be on the operand stack */
     pub max_stack: u16,
     /** The number of int locals (method parameters + local variables) */
@@ -49,19 +45,20 @@ pub struct code_t {
     /**
      * The method's bytecode, a list of JVM instructions represented as bytes.
      * See the project01 spec for how to interpret these bytes.
+     * This borrows from the class file's bytes rather than copying them.
      */
-    pub code: Vec<u8>,
+    pub code: &'a [u8],
 }
 
 /** A Java method */
-#[derive(Clone, Debug)]
+#[derive(Debug)]
 #[repr(C)]
-pub struct method_t {
+pub struct method_t<'a> {
     /**
      * The method name, e.g. "main".
      * This is used with the descriptor string to look up the method.
      */
-    pub name: String,
+    pub name: &'a str,
     /**
      * The method descriptor, e.g. "([Ljava/lang/String;)V",
      * which represents the method's signature.
@@ -70,8 +67,17 @@ pub struct method_t {
      * If you're interested, descriptor strings are explained at
      * https://docs.oracle.com/javase/specs/jvms/se12/html/jvms-4.html#jvms-4.3.2.
      */
-    pub descriptor: cp_info_t,
-    pub code: code_t,
+    pub descriptor: cp_info_t<'a>,
+    /** The number of parameters in the descriptor, computed when the class is loaded */
+    pub parameter_count: u16,
+    pub code: code_t<'a>,
+    /**
+     * The method's decoded instructions and whether it passed verification, which
+     * are worked out when the method is first called (see `prepare_method()`), so
+     * this is empty until then. It is a OnceLock so that threads running the same
+     * class can share it.
+     */
+    pub prepared: OnceLock<prepared_t>,
 }
 
 #[derive(Copy, Clone, Debug, PartialEq)]
@@ -116,8 +122,9 @@ impl std::convert::TryFrom<i32> for cp_info_tag {
     }
 }
 
-#[derive(Clone, Debug, PartialEq)]
-pub enum cp_info_t {
+/** A constant's contents. Strings borrow from the class file's bytes. */
+#[derive(Copy, Clone, Debug, PartialEq)]
+pub enum cp_info_t<'a> {
     CONSTANT_Integer_info {
         bytes: i32,
     },
@@ -133,59 +140,86 @@ pub enum cp_info_t {
         descriptor_index: u16,
     },
     CONSTANT_Utf8_info {
-        descriptor: String,
+        descriptor: &'a str,
     },
 }
 
-#[derive(Clone, Debug, PartialEq)]
+#[derive(Copy, Clone, Debug, PartialEq)]
 #[repr(C)]
-pub struct cp_info {
+pub struct cp_info<'a> {
     pub tag: cp_info_tag,
-    pub info: Option<Box<cp_info_t>>,
+    pub info: Option<cp_info_t<'a>>,
 }
-#[derive(Clone, Debug)]
+
+/**
+ * A parsed class file. It borrows from the class file's bytes, which must outlive it:
+ * names, descriptors and method bytecode all point into them.
+ *
+ * Nothing in a loaded class changes except each method's `prepared` state, which is
+ * set once, so a class is Send + Sync and can be shared by threads running it at once.
+ */
+#[derive(Debug)]
 #[repr(C)]
-pub struct class_file_t {
-    pub constant_pool: Vec<cp_info>,
-    pub methods: Vec<method_t>,
+pub struct class_file_t<'a> {
+    pub constant_pool: Vec<cp_info<'a>>,
+    /**
+     * The class's methods. Methods are referred to by their index in this list,
+     * so calling one never copies it.
+     */
+    pub methods: Vec<method_t<'a>>,
+    /**
+     * The index in `methods` of the method each Methodref constant refers to,
+     * indexed by constant pool index, or None if the class doesn't define it.
+     * Every Methodref is resolved when the class is loaded, so a loaded class is
+     * never modified and can be shared between threads.
+     */
+    pub resolved_methods: Vec<Option<u16>>,
 }
 
 pub const CLASS_MAGIC: u32 = 0xcafebabe;
 
 pub const IS_STATIC: u16 = 0x8;
 
-pub type ClassFile = Rc<RefCell<BufReader<File>>>;
+/**
+ * A cursor over the bytes of a class file, which is read into memory in one go.
+ * Reads are bounds-checked slice operations, so parsing does no IO or copying.
+ */
+pub struct class_reader_t<'a> {
+    pub data: &'a [u8],
+    /** The offset of the next byte to read */
+    pub position: usize,
+}
 
 /*
  * Functions for reading unsigned big-endian integers. We can't read directly
  * into a u16 or u32 variable because x86 stores integers in little-endian.
  */
 
-pub fn read_u8(class_file: ClassFile) -> u8 {
-    let mut value: [u8; 1] = [0; 1];
-    class_file.borrow_mut().read_exact(&mut value).unwrap();
-    u8::from_be_bytes(value)
+/** Takes the next `length` bytes, exiting if the class file ends first */
+pub fn read_bytes<'a>(reader: &mut class_reader_t<'a>, length: usize) -> &'a [u8] {
+    let end = reader.position + length;
+    if end > reader.data.len() {
+        eprintln!("Unexpected end of class file");
+        std::process::exit(1);
+    }
+    let bytes = &reader.data[reader.position..end];
+    reader.position = end;
+    bytes
 }
 
-pub fn read_u16(class_file: ClassFile) -> u16 {
-    let mut value: [u8; 2] = [0; 2];
-    class_file.borrow_mut().read_exact(&mut value).unwrap();
-    u16::from_be_bytes(value)
+pub fn read_u8(reader: &mut class_reader_t) -> u8 {
+    read_bytes(reader, 1)[0]
 }
 
-pub fn read_u32(class_file: ClassFile) -> u32 {
-    let mut value: [u8; 4] = [0; 4];
-    class_file.borrow_mut().read_exact(&mut value).unwrap();
-    u32::from_be_bytes(value)
+pub fn read_u16(reader: &mut class_reader_t) -> u16 {
+    u16::from_be_bytes(read_bytes(reader, 2).try_into().unwrap())
 }
 
-pub fn read_bytes(class_file: ClassFile, length: usize) -> Vec<u8> {
-    let mut value = vec![0_u8; length];
-    class_file.borrow_mut().read_exact(&mut value).unwrap();
-    value
+pub fn read_u32(reader: &mut class_reader_t) -> u32 {
+    u32::from_be_bytes(read_bytes(reader, 4).try_into().unwrap())
 }
 
-pub fn constant_pool_size(constant_pool: &Vec<cp_info>) -> u16 {
+pub fn constant_pool_size(constant_pool: &[cp_info]) -> u16 {
     let mut i: usize = 0;
     for constant in constant_pool {
         if constant.info.is_some() {
@@ -196,33 +230,33 @@ pub fn constant_pool_size(constant_pool: &Vec<cp_info>) -> u16 {
     i as u16
 }
 
-pub fn get_constant(constant_pool: &Vec<cp_info>, index: u16) -> cp_info {
-    let const_size = constant_pool_size(&constant_pool);
-    if 0 < index && index <= const_size {
-    } else {
+pub fn get_constant<'p, 'a>(constant_pool: &'p [cp_info<'a>], index: u16) -> &'p cp_info<'a> {
+    // The last entry marks the end of the pool
+    if !(0 < index && (index as usize) < constant_pool.len()) {
         eprintln!("Invalid constant pool index");
+        std::process::exit(1);
     }
     // Convert 1-indexed index to 0-indexed index
-    constant_pool[(index - 1) as usize].clone()
+    &constant_pool[(index - 1) as usize]
 }
 
-pub fn get_method_name_and_type(
-    constant_pool: &Vec<cp_info>,
+pub fn get_method_name_and_type<'a>(
+    constant_pool: &[cp_info<'a>],
     index: u16,
-) -> Option<Box<cp_info_t>> {
-    let method_constant: cp_info = get_constant(constant_pool, index);
+) -> Option<cp_info_t<'a>> {
+    let method_constant: &cp_info = get_constant(constant_pool, index);
     if method_constant.tag as u32 == cp_info_tag::CONSTANT_Methodref as u32 {
     } else {
         eprintln!("Expected a MethodRef");
         std::process::exit(1);
     }
 
-    match method_constant.info.as_deref() {
+    match method_constant.info {
         Some(cp_info_t::CONSTANT_FieldOrMethodref_info {
             class_index: _,
             name_and_type_index,
         }) => {
-            let name_and_type_constant: cp_info = get_constant(constant_pool, *name_and_type_index);
+            let name_and_type_constant: &cp_info = get_constant(constant_pool, name_and_type_index);
 
             if name_and_type_constant.tag as u32 == cp_info_tag::CONSTANT_NameAndType as i32 as u32
             {
@@ -230,7 +264,7 @@ pub fn get_method_name_and_type(
                 eprintln!("Expected a NameAndType");
                 std::process::exit(1);
             }
-            match (name_and_type_constant).info.as_deref() {
+            match name_and_type_constant.info {
                 Some(cp_info_t::CONSTANT_NameAndType_info { .. }) => name_and_type_constant.info,
                 _ => {
                     eprintln!("Expected a NameAndType");
@@ -246,25 +280,34 @@ pub fn get_method_name_and_type(
     // return None;
 }
 
+/**
+ * Gets the number of (integer) parameters a method takes.
+ * The descriptor string is parsed once when the class is loaded.
+ */
 pub fn get_number_of_parameters(method: &method_t) -> u16 {
+    method.parameter_count
+}
+
+/** Counts the (integer) parameters in a method descriptor string */
+pub fn count_parameters(d: &str) -> u16 {
     // Type descriptors will always have the length ( + #params + ) + return type
-    let end: usize;
-    let mut start: usize;
-    match &(*method).descriptor {
-        cp_info_t::CONSTANT_Utf8_info { descriptor: d } => {
-            end = d.find(')').unwrap();
-            start = d.find('(').unwrap();
-            let mut params: u16 = 0;
+    let end: usize = d.find(')').unwrap();
+    let mut start: usize = d.find('(').unwrap();
+    let mut params: u16 = 0;
+    start += 1;
+    while start < end {
+        if d.get(start..start + 1) == Some("[") {
             start += 1;
-            while start < end {
-                if d.get(start..start) == Some("[") {
-                    start += 1;
-                }
-                params = params.wrapping_add(1);
-                start += 1;
-            }
-            params
         }
+        params = params.wrapping_add(1);
+        start += 1;
+    }
+    params
+}
+
+fn parse_number_of_parameters(method: &method_t) -> u16 {
+    match &(*method).descriptor {
+        cp_info_t::CONSTANT_Utf8_info { descriptor: d } => count_parameters(d),
         _ => {
             eprintln!("Method descriptor should be a utf8 string");
             std::process::exit(1);
@@ -272,13 +315,22 @@ pub fn get_number_of_parameters(method: &method_t) -> u16 {
     }
 }
 
-pub fn find_method(name: &str, descriptor: &str, class: &class_file_t) -> Option<method_t> {
+pub fn find_method<'c, 'a>(
+    name: &str,
+    descriptor: &str,
+    class: &'c class_file_t<'a>,
+) -> Option<&'c method_t<'a>> {
+    find_method_index(name, descriptor, class).map(|i| &class.methods[i as usize])
+}
+
+/** Finds the index in `class.methods` of the method with the given name and descriptor */
+pub fn find_method_index(name: &str, descriptor: &str, class: &class_file_t) -> Option<u16> {
     let mut i: usize = 0;
     let mut method: &method_t = &(*class).methods[i];
     while !(*method).name.is_empty() {
         if (*method).name == name
             && descriptor
-                == match &(*method).descriptor {
+                == match (*method).descriptor {
                     cp_info_t::CONSTANT_Utf8_info { descriptor: d } => d,
                     _ => {
                         eprintln!("Descriptor of a method should be a utf8 string");
@@ -286,7 +338,7 @@ pub fn find_method(name: &str, descriptor: &str, class: &class_file_t) -> Option
                     }
                 }
         {
-            return Some(method.clone());
+            return Some(i as u16);
         }
         i += 1;
         method = &(*class).methods[i];
@@ -294,61 +346,85 @@ pub fn find_method(name: &str, descriptor: &str, class: &class_file_t) -> Option
     None
 }
 
-pub fn find_method_from_index(index: u16, class: &class_file_t) -> Option<method_t> {
-    let (name_index, descriptor_index) =
-        match get_method_name_and_type(class.deref().constant_pool.clone().as_ref(), index)
-            .as_deref()
-        {
-            Some(cp_info_t::CONSTANT_NameAndType_info {
-                name_index: n,
-                descriptor_index: d,
-            }) => (*n, *d),
-            _ => {
-                eprintln!("Expected a name and type");
-                std::process::exit(1);
-            }
-        };
+/**
+ * Finds the index in `class.methods` of the method a call site refers to, which was
+ * resolved when the class was loaded, so this is a single load.
+ *
+ * @param index the constant pool index of the Methodref to call
+ * @param class the parsed class file
+ * @return the method's index if it was found, None otherwise
+ */
+#[inline(always)]
+pub fn resolve_method_index(index: u16, class: &class_file_t) -> Option<u16> {
+    class.resolved_methods.get(index as usize).copied().flatten()
+}
 
-    let name: cp_info = get_constant(class.constant_pool.as_ref(), name_index);
-    if name.tag as u32 != cp_info_tag::CONSTANT_Utf8 as i32 as u32 {
-        eprintln!("Expected a UTF8");
-        std::process::exit(1);
-    }
-    let descriptor: cp_info = get_constant(class.constant_pool.as_ref(), descriptor_index);
-    if descriptor.tag as u32 != cp_info_tag::CONSTANT_Utf8 as i32 as u32 {
-        eprintln!("Expected a UTF8");
-        std::process::exit(1);
-    }
+/** Gets the name and descriptor of the method a Methodref constant refers to */
+fn get_methodref_signature<'a>(constant_pool: &[cp_info<'a>], index: u16) -> (&'a str, &'a str) {
+    let (name_index, descriptor_index) = match get_method_name_and_type(constant_pool, index) {
+        Some(cp_info_t::CONSTANT_NameAndType_info {
+            name_index: n,
+            descriptor_index: d,
+        }) => (n, d),
+        _ => {
+            eprintln!("Expected a name and type");
+            std::process::exit(1);
+        }
+    };
 
-    let (n, d) = match (*name.info.unwrap(), *descriptor.info.unwrap()) {
+    let name: &cp_info = get_constant(constant_pool, name_index);
+    let descriptor: &cp_info = get_constant(constant_pool, descriptor_index);
+    match (name.info, descriptor.info) {
         (
-            cp_info_t::CONSTANT_Utf8_info { descriptor: nam },
-            cp_info_t::CONSTANT_Utf8_info { descriptor: des },
+            Some(cp_info_t::CONSTANT_Utf8_info { descriptor: nam }),
+            Some(cp_info_t::CONSTANT_Utf8_info { descriptor: des }),
         ) => (nam, des),
         _ => {
             eprintln!("Expected a UTF8");
             std::process::exit(1);
         }
-    };
-    find_method(&n, &d, class)
+    }
+}
+
+/**
+ * Resolves every Methodref constant to the index in `methods` of the method it refers
+ * to, looking methods up by name and descriptor as `find_method_index()` does.
+ */
+fn resolve_methods(constant_pool: &[cp_info], methods: &[method_t]) -> Vec<Option<u16>> {
+    let mut by_signature: HashMap<(&str, &str), u16> = HashMap::with_capacity(methods.len());
+    for (i, method) in methods.iter().enumerate() {
+        if let cp_info_t::CONSTANT_Utf8_info { descriptor } = method.descriptor {
+            // The first method with a signature wins, as in `find_method_index()`
+            by_signature.entry((method.name, descriptor)).or_insert(i as u16);
+        }
+    }
+    // Constant pool indices are 1-indexed, and the last entry marks the end of the pool
+    let mut resolved_methods: Vec<Option<u16>> = vec![None; constant_pool.len() + 1];
+    for index in 1..constant_pool.len() {
+        if constant_pool[index - 1].tag == cp_info_tag::CONSTANT_Methodref {
+            let signature = get_methodref_signature(constant_pool, index as u16);
+            resolved_methods[index] = by_signature.get(&signature).copied();
+        }
+    }
+    resolved_methods
 }
 
-pub fn get_class_header(class_file: ClassFile) -> class_header_t {
+pub fn get_class_header(reader: &mut class_reader_t) -> class_header_t {
     let mut header: class_header_t = class_header_t {
         magic: 0,
         minor_version: 0,
         major_version: 0,
     };
-    header.magic = read_u32(class_file.clone());
+    header.magic = read_u32(reader);
     assert!(header.magic == CLASS_MAGIC);
-    header.major_version = read_u16(class_file.clone());
-    header.minor_version = read_u16(class_file);
+    header.major_version = read_u16(reader);
+    header.minor_version = read_u16(reader);
     header
 }
 
-pub fn get_constant_pool(class_file: ClassFile) -> Vec<cp_info> {
+pub fn get_constant_pool<'a>(reader: &mut class_reader_t<'a>) -> Vec<cp_info<'a>> {
     // Constant pool count includes unused constant at index 0
-    let mut constant_pool_count: u16 = read_u16(class_file.clone()) - 1;
+    let mut constant_pool_count: u16 = read_u16(reader) - 1;
     let mut constant_pool: Vec<cp_info> = Vec::with_capacity(constant_pool_count as usize + 1);
     let original_count = constant_pool_count;
     while constant_pool_count > 0 {
@@ -356,41 +432,43 @@ pub fn get_constant_pool(class_file: ClassFile) -> Vec<cp_info> {
             tag: cp_info_tag::CONSTANT_Integer,
             info: None,
         };
-        constant.tag = cp_info_tag::try_from(read_u8(class_file.clone())).unwrap();
+        constant.tag = cp_info_tag::try_from(read_u8(reader)).unwrap();
         match constant.tag {
             cp_info_tag::CONSTANT_Utf8 => {
-                let length: u16 = read_u16(class_file.clone());
-                let info =
-                    String::from_utf8(read_bytes(class_file.clone(), length as usize)).unwrap();
-                // info.push('\u{0}');
-                // eprintln!("{info:#?}");
-                let info_struct = Box::new(cp_info_t::CONSTANT_Utf8_info { descriptor: info });
-                constant.info = Some(info_struct)
+                let length: u16 = read_u16(reader);
+                let info = match std::str::from_utf8(read_bytes(reader, length as usize)) {
+                    Ok(info) => info,
+                    Err(_) => {
+                        eprintln!("Invalid UTF8 constant");
+                        std::process::exit(1);
+                    }
+                };
+                constant.info = Some(cp_info_t::CONSTANT_Utf8_info { descriptor: info })
             }
             cp_info_tag::CONSTANT_Integer => {
-                let value: Box<cp_info_t> = Box::new(cp_info_t::CONSTANT_Integer_info {
-                    bytes: read_u32(class_file.clone()) as i32,
-                });
+                let value: cp_info_t = cp_info_t::CONSTANT_Integer_info {
+                    bytes: read_u32(reader) as i32,
+                };
                 constant.info = Some(value);
             }
             cp_info_tag::CONSTANT_Class => {
-                let value_0: Box<cp_info_t> = Box::new(cp_info_t::CONSTANT_Class_info {
-                    string_index: read_u16(class_file.clone()),
-                });
+                let value_0: cp_info_t = cp_info_t::CONSTANT_Class_info {
+                    string_index: read_u16(reader),
+                };
                 constant.info = Some(value_0);
             }
             cp_info_tag::CONSTANT_Fieldref | cp_info_tag::CONSTANT_Methodref => {
-                let value_1: Box<cp_info_t> = Box::new(cp_info_t::CONSTANT_FieldOrMethodref_info {
-                    class_index: read_u16(class_file.clone()),
-                    name_and_type_index: read_u16(class_file.clone()),
-                });
+                let value_1: cp_info_t = cp_info_t::CONSTANT_FieldOrMethodref_info {
+                    class_index: read_u16(reader),
+                    name_and_type_index: read_u16(reader),
+                };
                 constant.info = Some(value_1);
             }
             cp_info_tag::CONSTANT_NameAndType => {
-                let value_2: Box<cp_info_t> = Box::new(cp_info_t::CONSTANT_NameAndType_info {
-                    name_index: read_u16(class_file.clone()),
-                    descriptor_index: read_u16(class_file.clone()),
-                });
+                let value_2: cp_info_t = cp_info_t::CONSTANT_NameAndType_info {
+                    name_index: read_u16(reader),
+                    descriptor_index: read_u16(reader),
+                };
                 constant.info = Some(value_2);
             }
             _ => {
@@ -398,7 +476,7 @@ pub fn get_constant_pool(class_file: ClassFile) -> Vec<cp_info> {
                 std::process::exit(1);
             }
         }
-        constant_pool.push(constant.clone());
+        constant_pool.push(constant);
 
         constant_pool_count = constant_pool_count.wrapping_sub(1);
     }
@@ -418,22 +496,22 @@ pub fn get_constant_pool(class_file: ClassFile) -> Vec<cp_info> {
     constant_pool
 }
 
-pub fn get_class_info(class_file: ClassFile) -> class_info_t {
+pub fn get_class_info(reader: &mut class_reader_t) -> class_info_t {
     let mut info: class_info_t = class_info_t {
         access_flags: 0,
         this_class: 0,
         super_class: 0,
     };
-    info.access_flags = read_u16(class_file.clone());
-    info.this_class = read_u16(class_file.clone());
-    info.super_class = read_u16(class_file.clone());
-    let interfaces_count: u16 = read_u16(class_file.clone());
+    info.access_flags = read_u16(reader);
+    info.this_class = read_u16(reader);
+    info.super_class = read_u16(reader);
+    let interfaces_count: u16 = read_u16(reader);
     if interfaces_count != 0 {
         eprintln!("This VM does not support interfaces.");
         std::process::exit(1);
     }
 
-    let fields_count: u16 = read_u16(class_file);
+    let fields_count: u16 = read_u16(reader);
     if fields_count != 0 {
         eprintln!("This VM does not support fields.");
         std::process::exit(1);
@@ -441,11 +519,11 @@ pub fn get_class_info(class_file: ClassFile) -> class_info_t {
     info
 }
 
-pub fn read_method_attributes(
-    class_file: ClassFile,
+pub fn read_method_attributes<'a>(
+    reader: &mut class_reader_t<'a>,
     info: &method_info,
-    code: &mut code_t,
-    constant_pool: &Vec<cp_info>,
+    code: &mut code_t<'a>,
+    constant_pool: &[cp_info<'a>],
 ) {
     let mut found_code: bool = false;
     let mut attributes: u16 = info.attributes_count;
@@ -454,40 +532,37 @@ pub fn read_method_attributes(
             attribute_name_index: 0,
             attribute_length: 0,
         };
-        ainfo.attribute_name_index = read_u16(class_file.clone());
-        ainfo.attribute_length = read_u32(class_file.clone());
-        let attribute_end =
-            class_file.borrow_mut().stream_position().unwrap() + ainfo.attribute_length as u64;
-        let type_constant: cp_info = get_constant(constant_pool, ainfo.attribute_name_index);
+        ainfo.attribute_name_index = read_u16(reader);
+        ainfo.attribute_length = read_u32(reader);
+        let attribute_end = reader.position + ainfo.attribute_length as usize;
+        let type_constant: &cp_info = get_constant(constant_pool, ainfo.attribute_name_index);
         if type_constant.tag != cp_info_tag::CONSTANT_Utf8 {
             eprintln!("Expected a UTF8");
             std::process::exit(1);
         }
-        let type_constant_info = match type_constant.info.as_deref() {
+        let type_constant_info = match type_constant.info {
             Some(cp_info_t::CONSTANT_Utf8_info { descriptor }) => descriptor,
             _ => "",
         };
-        // println!("{}", type_constant_info);
-        if *type_constant_info == *"Code" {
+        if type_constant_info == "Code" {
             if found_code {
                 eprintln!("Duplicate method code");
                 std::process::exit(1);
             }
 
             found_code = true;
-            code.max_stack = read_u16(class_file.clone());
-            code.max_locals = read_u16(class_file.clone());
-            code.code_length = read_u32(class_file.clone());
-            // code.code = Vec::with_capacity(code.code_length as usize);
-
-            code.code = read_bytes(class_file.clone(), code.code_length as usize);
+            code.max_stack = read_u16(reader);
+            code.max_locals = read_u16(reader);
+            code.code_length = read_u32(reader);
+            code.code = read_bytes(reader, code.code_length as usize);
         }
 
         // Skip the rest of the attribute
-        class_file
-            .borrow_mut()
-            .seek(SeekFrom::Start(attribute_end as u64))
-            .unwrap();
+        if attribute_end > reader.data.len() {
+            eprintln!("Unexpected end of class file");
+            std::process::exit(1);
+        }
+        reader.position = attribute_end;
         attributes = attributes.wrapping_sub(1)
     }
     if !found_code {
@@ -496,22 +571,25 @@ pub fn read_method_attributes(
     }
 }
 
-pub fn get_methods(class_file: ClassFile, constant_pool: &Vec<cp_info>) -> Vec<method_t> {
-    let mut method_count: u16 = read_u16(class_file.clone());
+pub fn get_methods<'a>(
+    reader: &mut class_reader_t<'a>,
+    constant_pool: &[cp_info<'a>],
+) -> Vec<method_t<'a>> {
+    let mut method_count: u16 = read_u16(reader);
     let mut methods: Vec<method_t> = Vec::with_capacity((method_count + 1).into());
     // let mut i: usize = 0;
     // let mut method: &mut method_t = &mut methods[i];
     while method_count > 0 {
         let mut method = method_t {
-            name: String::new(),
-            descriptor: cp_info_t::CONSTANT_Utf8_info {
-                descriptor: String::new(),
-            },
+            name: "",
+            descriptor: cp_info_t::CONSTANT_Utf8_info { descriptor: "" },
+            parameter_count: 0,
+            prepared: OnceLock::new(),
             code: code_t {
                 max_stack: 0,
                 max_locals: 0,
                 code_length: 0,
-                code: Vec::new(),
+                code: &[],
             },
         };
         let mut info: method_info = method_info {
@@ -520,28 +598,29 @@ pub fn get_methods(class_file: ClassFile, constant_pool: &Vec<cp_info>) -> Vec<m
             descriptor_index: 0,
             attributes_count: 0,
         };
-        info.access_flags = read_u16(class_file.clone());
-        info.name_index = read_u16(class_file.clone());
-        info.descriptor_index = read_u16(class_file.clone());
-        info.attributes_count = read_u16(class_file.clone());
-        let name: cp_info = get_constant(constant_pool, info.name_index);
+        info.access_flags = read_u16(reader);
+        info.name_index = read_u16(reader);
+        info.descriptor_index = read_u16(reader);
+        info.attributes_count = read_u16(reader);
+        let name: &cp_info = get_constant(constant_pool, info.name_index);
         if name.tag != cp_info_tag::CONSTANT_Utf8 {
             eprintln!("Expected a UTF8");
             std::process::exit(1);
         }
-        method.name = match name.info.unwrap().deref() {
-            cp_info_t::CONSTANT_Utf8_info { descriptor } => descriptor.to_string(),
+        method.name = match name.info.unwrap() {
+            cp_info_t::CONSTANT_Utf8_info { descriptor } => descriptor,
             _ => {
                 eprintln!("Expected a UTF8");
                 std::process::exit(1);
             }
         };
-        let descriptor: cp_info = get_constant(constant_pool, info.descriptor_index);
+        let descriptor: &cp_info = get_constant(constant_pool, info.descriptor_index);
         if descriptor.tag as u32 != cp_info_tag::CONSTANT_Utf8 as i32 as u32 {
             eprintln!("Expected a UTF8");
             std::process::exit(1);
         }
-        method.descriptor = *descriptor.info.unwrap();
+        method.descriptor = descriptor.info.unwrap();
+        method.parameter_count = parse_number_of_parameters(&method);
         /* Our JVM can only execute static methods, so ensure all methods are static.
          * However, javac creates a constructor method <init> we need to ignore. */
         if method.name != "<init>" {
@@ -550,48 +629,49 @@ pub fn get_methods(class_file: ClassFile, constant_pool: &Vec<cp_info>) -> Vec<m
                 std::process::exit(1);
             }
         }
-        read_method_attributes(class_file.clone(), &info, &mut method.code, constant_pool);
-        methods.push(method.clone());
+        read_method_attributes(reader, &info, &mut method.code, constant_pool);
+        methods.push(method);
         method_count = method_count.wrapping_sub(1)
     }
     // Mark end of array with NULL name
     // method.name = "".to_string();
     methods.push(method_t {
-        name: String::new(),
-        descriptor: cp_info_t::CONSTANT_Utf8_info {
-            descriptor: String::new(),
-        },
+        name: "",
+        descriptor: cp_info_t::CONSTANT_Utf8_info { descriptor: "" },
+        parameter_count: 0,
+        prepared: OnceLock::new(),
         code: code_t {
             max_stack: 0,
             max_locals: 0,
             code_length: 0,
-            code: Vec::new(),
+            code: &[],
         },
     });
     methods
 }
 
-// eprintln!(
-//     "Stream Position after reading class info: {}",
-//     class_file.clone().borrow_mut().stream_position().unwrap()
-// );
-
-pub fn get_class(class_file: ClassFile) -> Rc<RefCell<class_file_t>> {
-    let class: Rc<RefCell<class_file_t>> = Rc::new(RefCell::new(class_file_t {
-        constant_pool: Vec::new(),
-        methods: Vec::new(),
-    }));
+/**
+ * Parses a class file that has already been read into memory.
+ *
+ * @param data the contents of the class file, which the parsed class borrows from
+ * @return the parsed class file
+ */
+pub fn get_class(data: &[u8]) -> class_file_t<'_> {
+    let reader = &mut class_reader_t { data, position: 0 };
     /* Read the leading header of the class file.
      * We don't need the result, but we need to skip past the header. */
-    get_class_header(class_file.clone());
+    get_class_header(reader);
     // Read the constant pool
-    class.borrow_mut().constant_pool = get_constant_pool(class_file.clone());
+    let constant_pool: Vec<cp_info> = get_constant_pool(reader);
     /* Read information about the class that was compiled.
      * We don't need the result, but we need to skip past it. */
-    get_class_info(class_file.clone());
+    get_class_info(reader);
     // Read the list of static methods
-    let meth_vec: Vec<method_t> =
-        get_methods(class_file, class.deref().borrow().constant_pool.as_ref());
-    class.borrow_mut().methods = meth_vec;
-    class
+    let methods: Vec<method_t> = get_methods(reader, &constant_pool);
+    let resolved_methods = resolve_methods(&constant_pool, &methods);
+    class_file_t {
+        constant_pool,
+        methods,
+        resolved_methods,
+    }
 }
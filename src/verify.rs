@@ -0,0 +1,288 @@
+/* *
+ * Verifies, when a method is first called (see `prepare_method()`), that it can run
+ * with the unchecked frame accessors (see frame.rs). Verifying lazily keeps loading a
+ * large class cheap when only a few of its methods run.
+ *
+ * Starting from the first instruction, every instruction that can be reached is
+ * checked for:
+ * - being an instruction the interpreter implements, with operands that fit in the
+ *   code
+ * - only accessing locals below `max_locals`
+ * - never popping from an empty operand stack or pushing past `max_stack`
+ * - having the same stack depth on every path that reaches it
+ * - branching, or falling through, only to somewhere inside the code
+ * - returning a value only if the method's descriptor says it does
+ * Methods that fail just run with every access checked, so nothing is reported.
+ *
+ * The bytecode is what gets verified. Its decoded instructions (see decode.rs) take
+ * the same paths, or trap, so the checks hold for them too.
+ */
+use crate::decode::{instruction_length, operand_u16};
+use crate::opcode::jvm_instruction_t;
+use crate::read_class::{count_parameters, cp_info, cp_info_t, cp_info_tag, method_t};
+use std::convert::TryFrom;
+
+/* * Marks an instruction whose stack depth isn't known yet */
+const UNREACHED: i32 = -1;
+
+/* * Gets the local an instruction accesses, if any. */
+fn local_index(opcode: jvm_instruction_t, code: &[u8], program_counter: usize) -> Option<usize> {
+    let opcode_byte = opcode as usize;
+    match opcode {
+        jvm_instruction_t::i_iload
+        | jvm_instruction_t::i_aload
+        | jvm_instruction_t::i_istore
+        | jvm_instruction_t::i_astore
+        | jvm_instruction_t::i_iinc => Some(code[program_counter + 1] as usize),
+        jvm_instruction_t::i_iload_0
+        | jvm_instruction_t::i_iload_1
+        | jvm_instruction_t::i_iload_2
+        | jvm_instruction_t::i_iload_3 => Some(opcode_byte - jvm_instruction_t::i_iload_0 as usize),
+        jvm_instruction_t::i_aload_0
+        | jvm_instruction_t::i_aload_1
+        | jvm_instruction_t::i_aload_2
+        | jvm_instruction_t::i_aload_3 => Some(opcode_byte - jvm_instruction_t::i_aload_0 as usize),
+        jvm_instruction_t::i_istore_0
+        | jvm_instruction_t::i_istore_1
+        | jvm_instruction_t::i_istore_2
+        | jvm_instruction_t::i_istore_3 => {
+            Some(opcode_byte - jvm_instruction_t::i_istore_0 as usize)
+        }
+        jvm_instruction_t::i_astore_0
+        | jvm_instruction_t::i_astore_1
+        | jvm_instruction_t::i_astore_2
+        | jvm_instruction_t::i_astore_3 => {
+            Some(opcode_byte - jvm_instruction_t::i_astore_0 as usize)
+        }
+        _ => None,
+    }
+}
+
+/* *
+ * Gets the descriptor of the method a Methodref constant refers to, or None if the
+ * constant isn't a well-formed Methodref. Unlike `get_method_name_and_type()`, this
+ * doesn't exit, since the instruction that uses the constant may never run.
+ */
+fn methodref_descriptor<'a>(constant_pool: &[cp_info<'a>], index: u16) -> Option<&'a str> {
+    // Constant pool indices are 1-indexed
+    let constant = |index: u16| constant_pool.get((index as usize).wrapping_sub(1));
+    let method = constant(index)?;
+    let name_and_type_index = match (method.tag, method.info?) {
+        (
+            cp_info_tag::CONSTANT_Methodref,
+            cp_info_t::CONSTANT_FieldOrMethodref_info {
+                name_and_type_index,
+                ..
+            },
+        ) => name_and_type_index,
+        _ => return None,
+    };
+    let descriptor_index = match constant(name_and_type_index)?.info? {
+        cp_info_t::CONSTANT_NameAndType_info {
+            descriptor_index, ..
+        } => descriptor_index,
+        _ => return None,
+    };
+    match constant(descriptor_index)?.info? {
+        cp_info_t::CONSTANT_Utf8_info { descriptor } => Some(descriptor),
+        _ => None,
+    }
+}
+
+/* * Whether a method descriptor has a return type other than void */
+fn returns_value(descriptor: &str) -> bool {
+    !descriptor.ends_with(")V")
+}
+
+/* * Whether a method returns a value, according to its descriptor */
+pub fn method_returns_value(method: &method_t) -> bool {
+    match method.descriptor {
+        cp_info_t::CONSTANT_Utf8_info { descriptor } => returns_value(descriptor),
+        _ => false,
+    }
+}
+
+/* *
+ * Gets how many operands an instruction pops and then pushes.
+ *
+ * @return the counts, or None if they can't be determined
+ */
+fn stack_effect(
+    opcode: jvm_instruction_t,
+    code: &[u8],
+    program_counter: usize,
+    constant_pool: &[cp_info],
+) -> Option<(usize, usize)> {
+    Some(match opcode {
+        jvm_instruction_t::i_nop
+        | jvm_instruction_t::i_iinc
+        | jvm_instruction_t::i_goto
+        | jvm_instruction_t::i_return
+        | jvm_instruction_t::i_getstatic => (0, 0),
+        jvm_instruction_t::i_iconst_m1
+        | jvm_instruction_t::i_iconst_0
+        | jvm_instruction_t::i_iconst_1
+        | jvm_instruction_t::i_iconst_2
+        | jvm_instruction_t::i_iconst_3
+        | jvm_instruction_t::i_iconst_4
+        | jvm_instruction_t::i_iconst_5
+        | jvm_instruction_t::i_bipush
+        | jvm_instruction_t::i_sipush
+        | jvm_instruction_t::i_ldc
+        | jvm_instruction_t::i_iload
+        | jvm_instruction_t::i_aload
+        | jvm_instruction_t::i_iload_0
+        | jvm_instruction_t::i_iload_1
+        | jvm_instruction_t::i_iload_2
+        | jvm_instruction_t::i_iload_3
+        | jvm_instruction_t::i_aload_0
+        | jvm_instruction_t::i_aload_1
+        | jvm_instruction_t::i_aload_2
+        | jvm_instruction_t::i_aload_3 => (0, 1),
+        jvm_instruction_t::i_istore
+        | jvm_instruction_t::i_astore
+        | jvm_instruction_t::i_istore_0
+        | jvm_instruction_t::i_istore_1
+        | jvm_instruction_t::i_istore_2
+        | jvm_instruction_t::i_istore_3
+        | jvm_instruction_t::i_astore_0
+        | jvm_instruction_t::i_astore_1
+        | jvm_instruction_t::i_astore_2
+        | jvm_instruction_t::i_astore_3
+        | jvm_instruction_t::i_ifeq
+        | jvm_instruction_t::i_ifne
+        | jvm_instruction_t::i_iflt
+        | jvm_instruction_t::i_ifge
+        | jvm_instruction_t::i_ifgt
+        | jvm_instruction_t::i_ifle
+        | jvm_instruction_t::i_ireturn
+        | jvm_instruction_t::i_areturn
+        | jvm_instruction_t::i_invokevirtual => (1, 0),
+        jvm_instruction_t::i_ineg
+        | jvm_instruction_t::i_newarray
+        | jvm_instruction_t::i_arraylength => (1, 1),
+        jvm_instruction_t::i_dup => (1, 2),
+        jvm_instruction_t::i_if_icmpeq
+        | jvm_instruction_t::i_if_icmpne
+        | jvm_instruction_t::i_if_icmplt
+        | jvm_instruction_t::i_if_icmpge
+        | jvm_instruction_t::i_if_icmpgt
+        | jvm_instruction_t::i_if_icmple => (2, 0),
+        jvm_instruction_t::i_iaload
+        | jvm_instruction_t::i_iadd
+        | jvm_instruction_t::i_isub
+        | jvm_instruction_t::i_imul
+        | jvm_instruction_t::i_idiv
+        | jvm_instruction_t::i_irem
+        | jvm_instruction_t::i_ishl
+        | jvm_instruction_t::i_ishr
+        | jvm_instruction_t::i_iushr
+        | jvm_instruction_t::i_iand
+        | jvm_instruction_t::i_ior
+        | jvm_instruction_t::i_ixor => (2, 1),
+        jvm_instruction_t::i_iastore => (3, 0),
+        jvm_instruction_t::i_invokestatic => {
+            let descriptor =
+                methodref_descriptor(constant_pool, operand_u16(code, program_counter))?;
+            (
+                count_parameters(descriptor) as usize,
+                returns_value(descriptor) as usize,
+            )
+        }
+    })
+}
+
+/* *
+ * Checks that a method's operand stack and locals stay in bounds however it runs.
+ *
+ * @param method the method to check
+ * @param constant_pool the constant pool of the method's class
+ * @return whether the method can run with unchecked frame accesses
+ */
+pub fn verify_method(method: &method_t, constant_pool: &[cp_info]) -> bool {
+    let code: &[u8] = method.code.code;
+    let max_locals = method.code.max_locals as usize;
+    let max_stack = method.code.max_stack as i32;
+    let returns_value = method_returns_value(method);
+    if code.is_empty() {
+        return false;
+    }
+
+    // The stack depth before each reachable instruction
+    let mut depths: Vec<i32> = vec![UNREACHED; code.len()];
+    let mut unchecked: Vec<usize> = vec![0];
+    depths[0] = 0;
+    while let Some(program_counter) = unchecked.pop() {
+        let opcode = match jvm_instruction_t::try_from(code[program_counter]) {
+            Ok(opcode) => opcode,
+            Err(()) => return false,
+        };
+        let next = program_counter + instruction_length(opcode);
+        if next > code.len() {
+            return false;
+        }
+        if let Some(index) = local_index(opcode, code, program_counter) {
+            if index >= max_locals {
+                return false;
+            }
+        }
+        let (pops, pushes) = match stack_effect(opcode, code, program_counter, constant_pool) {
+            Some(effect) => effect,
+            None => return false,
+        };
+        let depth = depths[program_counter];
+        if (depth as usize) < pops || depth - pops as i32 + pushes as i32 > max_stack {
+            return false;
+        }
+        let depth = depth - pops as i32 + pushes as i32;
+
+        let mut successors: [Option<i64>; 2] = [Some(next as i64), None];
+        match opcode {
+            jvm_instruction_t::i_ireturn | jvm_instruction_t::i_areturn => {
+                if !returns_value {
+                    return false;
+                }
+                successors[0] = None;
+            }
+            jvm_instruction_t::i_return => {
+                if returns_value {
+                    return false;
+                }
+                successors[0] = None;
+            }
+            jvm_instruction_t::i_ifeq
+            | jvm_instruction_t::i_ifne
+            | jvm_instruction_t::i_iflt
+            | jvm_instruction_t::i_ifge
+            | jvm_instruction_t::i_ifgt
+            | jvm_instruction_t::i_ifle
+            | jvm_instruction_t::i_if_icmpeq
+            | jvm_instruction_t::i_if_icmpne
+            | jvm_instruction_t::i_if_icmplt
+            | jvm_instruction_t::i_if_icmpge
+            | jvm_instruction_t::i_if_icmpgt
+            | jvm_instruction_t::i_if_icmple
+            | jvm_instruction_t::i_goto => {
+                let offset = operand_u16(code, program_counter) as i16;
+                successors[1] = Some(program_counter as i64 + offset as i64);
+                if opcode == jvm_instruction_t::i_goto {
+                    successors[0] = None;
+                }
+            }
+            _ => {}
+        }
+        for successor in successors.iter().flatten() {
+            if !(0 <= *successor && (*successor as usize) < code.len()) {
+                return false;
+            }
+            let successor = *successor as usize;
+            if depths[successor] == UNREACHED {
+                depths[successor] = depth;
+                unchecked.push(successor);
+            } else if depths[successor] != depth {
+                return false;
+            }
+        }
+    }
+    true
+}
@@ -7,6 +7,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "output.h"
+
 const int32_t NULL_FOUR_BYTES = 0x0000;
 
 // simple stack implementation
@@ -81,6 +83,7 @@ int32_t stack_push(stack_t *stack, int32_t value) {
     }
     else {
         // Oops Stack Overflow
+        output_flush_all();
         fprintf(stderr, "Error: Stack Overflow, value: %d\n", value);
         stack_print(stack);
         return 0;
@@ -98,6 +101,7 @@ int32_t stack_pop(stack_t *stack, int32_t *value) {
     else {
         // return 0 if the stack is empty
         // Stack Underflow;
+        output_flush_all();
         fprintf(stderr, "Error: Stack Underflow\n");
         stack_print(stack);
         return 0;
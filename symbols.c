@@ -0,0 +1,211 @@
+#include "symbols.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** The size of each block of string storage */
+const size_t SYMBOL_CHUNK_SIZE = 64 * 1024;
+/** The initial number of slots in each shard's table (must be a power of two) */
+const size_t SYMBOL_TABLE_INITIAL_CAPACITY = 64;
+/**
+ * The number of independently locked shards (a power of two). Strings are assigned
+ * to shards by the top bits of their hash, so concurrent class loads rarely contend.
+ */
+#define SYMBOL_SHARD_BITS 4
+#define SYMBOL_SHARDS (1 << SYMBOL_SHARD_BITS)
+
+/**
+ * A block of string storage. Interned strings are bump-allocated out of these,
+ * so interning doesn't cost a malloc() per string.
+ */
+typedef struct symbol_chunk {
+    /** The previously allocated chunk */
+    struct symbol_chunk *next;
+    /** How many bytes of `bytes` are in use */
+    size_t used;
+    /** How many bytes `bytes` can hold */
+    size_t capacity;
+    char bytes[];
+} symbol_chunk_t;
+
+/** A slot in the hash table */
+typedef struct {
+    /** The full hash of `string`, checked before comparing contents */
+    size_t hash;
+    /** The length of `string`, excluding the NUL terminator */
+    size_t length;
+    /** The canonical copy of the string, or NULL if the slot is empty */
+    const char *string;
+} symbol_t;
+
+/**
+ * An open-addressing (linear probing) hash table of interned strings, holding the
+ * strings whose hashes select this shard
+ */
+typedef struct {
+    /** Protects every field below, since classes may be loaded on several threads */
+    pthread_mutex_t lock;
+    symbol_t *slots;
+    /** The number of slots (always a power of two) */
+    size_t capacity;
+    /** The number of occupied slots */
+    size_t count;
+    /** The chunk that new strings are allocated from */
+    symbol_chunk_t *chunks;
+} symbol_shard_t;
+
+static symbol_shard_t shards[SYMBOL_SHARDS] = {
+    [0 ... SYMBOL_SHARDS - 1] = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, NULL},
+};
+
+static symbol_shard_t *symbol_shard(size_t hash) {
+    return &shards[hash >> (sizeof(size_t) * 8 - SYMBOL_SHARD_BITS)];
+}
+
+size_t symbol_hash(const char *string, size_t length) {
+    // 64-bit FNV-1a
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) string[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+static char *symbol_allocate(symbol_shard_t *symbols, size_t size) {
+    symbol_chunk_t *chunk = symbols->chunks;
+    if (chunk == NULL || chunk->capacity - chunk->used < size) {
+        size_t capacity = size > SYMBOL_CHUNK_SIZE ? size : SYMBOL_CHUNK_SIZE;
+        chunk = malloc(sizeof(symbol_chunk_t) + capacity);
+        assert(chunk != NULL && "Failed to allocate symbol storage");
+        chunk->next = symbols->chunks;
+        chunk->used = 0;
+        chunk->capacity = capacity;
+        symbols->chunks = chunk;
+    }
+    char *bytes = &chunk->bytes[chunk->used];
+    chunk->used += size;
+    return bytes;
+}
+
+/**
+ * Finds the slot holding a string, or the empty slot where it belongs.
+ */
+static symbol_t *symbol_find(const symbol_shard_t *symbols, const char *string,
+                             size_t length, size_t hash) {
+    size_t mask = symbols->capacity - 1;
+    for (size_t index = hash & mask;; index = (index + 1) & mask) {
+        symbol_t *slot = &symbols->slots[index];
+        if (slot->string == NULL ||
+            (slot->hash == hash && slot->length == length &&
+             memcmp(slot->string, string, length) == 0)) {
+            return slot;
+        }
+    }
+}
+
+static void symbol_grow(symbol_shard_t *symbols) {
+    symbol_t *old_slots = symbols->slots;
+    size_t old_capacity = symbols->capacity;
+
+    symbols->capacity =
+        old_capacity == 0 ? SYMBOL_TABLE_INITIAL_CAPACITY : old_capacity * 2;
+    symbols->slots = calloc(symbols->capacity, sizeof(symbol_t));
+    assert(symbols->slots != NULL && "Failed to allocate symbol table");
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_slots[i].string != NULL) {
+            *symbol_find(symbols, old_slots[i].string, old_slots[i].length,
+                         old_slots[i].hash) = old_slots[i];
+        }
+    }
+    free(old_slots);
+}
+
+/**
+ * Finds or adds a string's slot in its shard. If the string is added, `copy` decides
+ * whether the symbol table stores a copy of it or the string itself.
+ */
+static const char *symbol_insert(const char *string, size_t length, bool copy) {
+    size_t hash = symbol_hash(string, length);
+    symbol_shard_t *symbols = symbol_shard(hash);
+    pthread_mutex_lock(&symbols->lock);
+
+    // Keep the load factor at or below one half
+    if (2 * (symbols->count + 1) > symbols->capacity) {
+        symbol_grow(symbols);
+    }
+
+    symbol_t *slot = symbol_find(symbols, string, length, hash);
+    if (slot->string == NULL) {
+        if (copy) {
+            char *bytes = symbol_allocate(symbols, length + 1);
+            memcpy(bytes, string, length);
+            bytes[length] = '\0';
+            string = bytes;
+        }
+        slot->hash = hash;
+        slot->length = length;
+        slot->string = string;
+        symbols->count++;
+    }
+    const char *symbol = slot->string;
+    pthread_mutex_unlock(&symbols->lock);
+    return symbol;
+}
+
+const char *symbol_intern(const char *string, size_t length) {
+    return symbol_insert(string, length, true);
+}
+
+bool symbol_adopt(const char *string, size_t length) {
+    if (string[length] != '\0') {
+        return false;
+    }
+    return symbol_insert(string, length, false) == string;
+}
+
+void symbol_disown(const char *string, size_t length) {
+    size_t hash = symbol_hash(string, length);
+    symbol_shard_t *symbols = symbol_shard(hash);
+    pthread_mutex_lock(&symbols->lock);
+    if (symbols->count != 0) {
+        symbol_t *slot = symbol_find(symbols, string, length, hash);
+        if (slot->string == string) {
+            char *bytes = symbol_allocate(symbols, length + 1);
+            memcpy(bytes, string, length + 1);
+            slot->string = bytes;
+        }
+    }
+    pthread_mutex_unlock(&symbols->lock);
+}
+
+const char *symbol_lookup(const char *string) {
+    size_t length = strlen(string);
+    size_t hash = symbol_hash(string, length);
+    symbol_shard_t *symbols = symbol_shard(hash);
+    pthread_mutex_lock(&symbols->lock);
+    const char *symbol = symbols->count == 0
+                             ? NULL
+                             : symbol_find(symbols, string, length, hash)->string;
+    pthread_mutex_unlock(&symbols->lock);
+    return symbol;
+}
+
+void symbols_free(void) {
+    for (size_t i = 0; i < SYMBOL_SHARDS; i++) {
+        symbol_shard_t *symbols = &shards[i];
+        while (symbols->chunks != NULL) {
+            symbol_chunk_t *next = symbols->chunks->next;
+            free(symbols->chunks);
+            symbols->chunks = next;
+        }
+        free(symbols->slots);
+        symbols->slots = NULL;
+        symbols->capacity = 0;
+        symbols->count = 0;
+    }
+}
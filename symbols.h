@@ -0,0 +1,64 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * The symbol table holds one canonical, NUL-terminated copy of every string that
+ * has been interned. Every UTF8 constant of every loaded class is interned, so
+ * names and descriptors can be compared by pointer rather than by content.
+ *
+ * The symbol table is safe to use from several threads at once.
+ */
+
+/**
+ * Interns a string, copying it into the symbol table if it hasn't been seen before.
+ *
+ * @param string the bytes of the string (need not be NUL-terminated)
+ * @param length the number of bytes in `string`
+ * @return the canonical copy of the string
+ */
+const char *symbol_intern(const char *string, size_t length);
+
+/**
+ * Interns a string without copying it: if it hasn't been seen before, the string
+ * itself becomes the canonical copy. This lets strings in a mapped image (see
+ * image.h) be used as symbols in place.
+ *
+ * @param string a NUL-terminated string that outlives the symbol table
+ * @param length the number of bytes in `string`, excluding the NUL terminator
+ * @return whether `string` is now the canonical copy; false if it isn't
+ *         NUL-terminated or an equal string was already interned
+ */
+bool symbol_adopt(const char *string, size_t length);
+
+/**
+ * Undoes `symbol_adopt()`: if `string` itself is the canonical copy, the symbol table
+ * switches to a copy of its own, so `string` no longer needs to outlive it.
+ *
+ * @param string a string passed to `symbol_adopt()`
+ * @param length the number of bytes in `string`, excluding the NUL terminator
+ */
+void symbol_disown(const char *string, size_t length);
+
+/**
+ * Finds the canonical copy of a string without interning it.
+ *
+ * @param string a NUL-terminated string
+ * @return the canonical copy of the string, or NULL if it was never interned
+ */
+const char *symbol_lookup(const char *string);
+
+/**
+ * Hashes a string the same way the symbol table does.
+ */
+size_t symbol_hash(const char *string, size_t length);
+
+/**
+ * Frees every interned string. Any pointers returned by `symbol_intern()` become
+ * invalid, so this should only be called once all classes have been freed.
+ */
+void symbols_free(void);
+
+#endif /* SYMBOLS_H */
@@ -0,0 +1,14 @@
+public class InfiniteLoop {
+    public static void main(String[] args) {
+        System.out.println(1);
+        // Never finishes, so it can only end by being cut off or killed
+        int i = 0;
+        while (true) {
+            i = step(i);
+        }
+    }
+
+    public static int step(int i) {
+        return i + 1;
+    }
+}
@@ -0,0 +1,87 @@
+public class Switch {
+    public static void main(String[] args) {
+        // Dense cases compile to tableswitch
+        for (int i = -3; i <= 8; i++) {
+            System.out.println(dense(i));
+        }
+        // Sparse cases compile to lookupswitch
+        for (int i = 1; i <= 1000000; i = i * 3 + 7) {
+            System.out.println(sparse(i));
+        }
+        System.out.println(sparse(-2147483648));
+        System.out.println(sparse(2147483647));
+        System.out.println(sparse(65536));
+        System.out.println(sparse(-5));
+
+        // A switch-driven state machine: count the runs of equal bits in each number
+        for (int i = 0; i < 20; i++) {
+            System.out.println(runs(i * -1640531535));
+        }
+
+        System.out.println(defaultOnly(42));
+    }
+
+    public static int dense(int n) {
+        switch (n) {
+            case -1: return 100;
+            case 0: return 101;
+            case 1: return 102;
+            case 2:
+            case 3: return 103;
+            case 5: return 105;
+            case 6: return 106;
+            default: return -1;
+        }
+    }
+
+    public static int sparse(int n) {
+        switch (n) {
+            case -2147483648: return 1;
+            case -5: return 2;
+            case 0: return 3;
+            case 17: return 4;
+            case 65536: return 5;
+            case 1000000: return 6;
+            case 2147483647: return 7;
+            default: return n % 10;
+        }
+    }
+
+    // A switch with only a default compiles to a lookupswitch with no pairs, which
+    // ends fewer than 12 bytes before the end of the code
+    public static int defaultOnly(int n) {
+        switch (n) {
+            default: return n;
+        }
+    }
+
+    public static int runs(int bits) {
+        int state = 0, count = 0;
+        for (int i = 0; i < 32; i++) {
+            int bit = (bits >>> i) & 1;
+            switch (state * 2 + bit) {
+                case 0: // start, reading 0
+                    state = 1;
+                    count++;
+                    break;
+                case 1: // start, reading 1
+                    state = 2;
+                    count++;
+                    break;
+                case 2: // in a run of zeroes, reading 0
+                    break;
+                case 3: // in a run of zeroes, reading 1
+                    state = 2;
+                    count++;
+                    break;
+                case 4: // in a run of ones, reading 0
+                    state = 1;
+                    count++;
+                    break;
+                default: // in a run of ones, reading 1
+                    break;
+            }
+        }
+        return count;
+    }
+}
@@ -0,0 +1,67 @@
+/**
+ * Embeds the VM through libjvm, the way a host program would: loads javac-compiled
+ * test classes, then invokes their static methods in a context and checks what they
+ * return and print. javac gives every class a constructor, which loading must cope
+ * with even though the VM never runs it.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../libjvm.h"
+
+static int32_t invoke_int(jvm_context_t *context, const class_file_t *class,
+                          const char *name, const char *descriptor,
+                          const int32_t *arguments, size_t argument_count) {
+    optional_value_t result;
+    bool invoked =
+        jvm_invoke(context, class, name, descriptor, arguments, argument_count, &result);
+    assert(invoked && "Failed to invoke method");
+    assert(result.has_value && "Method didn't return an int");
+    return result.value;
+}
+
+int main(void) {
+    jvm_runtime_t *runtime = jvm_runtime_init("tests");
+    const class_file_t *recursion = jvm_load_class(runtime, "Recursion");
+    assert(recursion != NULL && "Failed to load class by name");
+    const class_file_t *function_call =
+        jvm_load_class(runtime, "tests/FunctionCall.class");
+    assert(function_call != NULL && "Failed to load class by path");
+    const class_file_t *reloaded = jvm_load_class(runtime, "Recursion");
+    assert(reloaded == recursion && "Loading a class twice gave different handles");
+
+    jvm_context_t *context = jvm_context_init(NULL);
+    int32_t ten = 10;
+    int32_t factorial = invoke_int(context, recursion, "factorial", "(I)I", &ten, 1);
+    assert(factorial == 3628800 && "Wrong factorial");
+    int32_t fib = invoke_int(context, recursion, "fib", "(I)I", &ten, 1);
+    assert(fib == 55 && "Wrong fib");
+    int32_t addends[] = {2, 200};
+    int32_t sum = invoke_int(context, function_call, "add", "(II)I", addends, 2);
+    assert(sum == 202 && "Wrong sum");
+
+    // Output collects in the context until it is reset
+    bool invoked =
+        jvm_invoke(context, recursion, "printFactorial", "(I)V", &ten, 1, NULL);
+    assert(invoked && "Failed to invoke method");
+    size_t length;
+    const char *output = jvm_context_output(context, &length);
+    assert(length == strlen("3628800\n") && memcmp(output, "3628800\n", length) == 0 &&
+           "Wrong output");
+    jvm_context_reset(context);
+    jvm_context_output(context, &length);
+    assert(length == 0 && "Output survived a reset");
+
+    // Constructors, missing methods and wrong arguments are refused
+    bool refused = !jvm_invoke(context, recursion, "<init>", "()V", NULL, 0, NULL) &&
+                   !jvm_invoke(context, recursion, "missing", "()V", NULL, 0, NULL) &&
+                   !jvm_invoke(context, recursion, "fib", "(I)I", NULL, 0, NULL);
+    assert(refused && "Invoked a method that can't be invoked");
+
+    jvm_context_free(context);
+    jvm_runtime_free(runtime);
+    puts("PASSED test libjvm.");
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include "thread_pool.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** A submitted task, queued in a singly linked list */
+typedef struct task {
+    void (*function)(void *);
+    void *argument;
+    struct task *next;
+} task_t;
+
+typedef struct thread_pool {
+    pthread_t *threads;
+    size_t thread_count;
+    /** Protects every field below */
+    pthread_mutex_t lock;
+    /** Signalled when a task is queued or the pool is stopping */
+    pthread_cond_t work_available;
+    /** Signalled when the last outstanding task finishes */
+    pthread_cond_t work_done;
+    /** The queued tasks, oldest first */
+    task_t *head;
+    task_t *tail;
+    /** The number of tasks that are queued or running */
+    size_t outstanding;
+    bool stopping;
+} thread_pool_t;
+
+static void *worker(void *argument) {
+    thread_pool_t *pool = argument;
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (pool->head == NULL && !pool->stopping) {
+            pthread_cond_wait(&pool->work_available, &pool->lock);
+        }
+        if (pool->head == NULL) {
+            break;
+        }
+
+        task_t *task = pool->head;
+        pool->head = task->next;
+        if (pool->head == NULL) {
+            pool->tail = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        task->function(task->argument);
+        free(task);
+        pthread_mutex_lock(&pool->lock);
+
+        if (--pool->outstanding == 0) {
+            pthread_cond_broadcast(&pool->work_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+thread_pool_t *thread_pool_init(size_t threads) {
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (size_t) cpus : 1;
+    }
+
+    thread_pool_t *pool = calloc(1, sizeof(*pool));
+    assert(pool != NULL && "Failed to allocate thread pool");
+    pool->threads = malloc(sizeof(pthread_t[threads]));
+    assert(pool->threads != NULL && "Failed to allocate thread pool");
+    pool->thread_count = threads;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_available, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+    for (size_t i = 0; i < threads; i++) {
+        int error = pthread_create(&pool->threads[i], NULL, worker, pool);
+        assert(error == 0 && "Failed to start worker thread");
+    }
+    return pool;
+}
+
+size_t thread_pool_threads(const thread_pool_t *pool) {
+    return pool->thread_count;
+}
+
+void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument) {
+    task_t *task = malloc(sizeof(*task));
+    assert(task != NULL && "Failed to allocate task");
+    task->function = function;
+    task->argument = argument;
+    task->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail == NULL) {
+        pool->head = task;
+    }
+    else {
+        pool->tail->next = task;
+    }
+    pool->tail = task;
+    pool->outstanding++;
+    pthread_cond_signal(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_wait(thread_pool_t *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->outstanding > 0) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_free(thread_pool_t *pool) {
+    thread_pool_wait(pool);
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+    for (size_t i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_available);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
@@ -0,0 +1,44 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+
+/**
+ * A fixed set of worker threads that run submitted tasks in parallel.
+ * Tasks may be submitted from any thread, including from within other tasks.
+ */
+typedef struct thread_pool thread_pool_t;
+
+/**
+ * Starts a thread pool.
+ *
+ * @param threads the number of worker threads, or 0 for one per online CPU
+ * @return the thread pool
+ */
+thread_pool_t *thread_pool_init(size_t threads);
+
+/**
+ * Gets the number of worker threads in a thread pool.
+ */
+size_t thread_pool_threads(const thread_pool_t *pool);
+
+/**
+ * Queues a task to run on one of the pool's threads.
+ *
+ * @param pool the thread pool
+ * @param function the function to run
+ * @param argument the argument to pass to `function`
+ */
+void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument);
+
+/**
+ * Waits until every submitted task has finished running.
+ */
+void thread_pool_wait(thread_pool_t *pool);
+
+/**
+ * Waits for the submitted tasks to finish, then stops the pool's threads and frees it.
+ */
+void thread_pool_free(thread_pool_t *pool);
+
+#endif /* THREAD_POOL_H */
@@ -0,0 +1,173 @@
+#include "trace.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** How long the background thread sleeps between drains, unless woken up */
+#define TRACE_FLUSH_INTERVAL_NS (10 * 1000 * 1000)
+
+bool trace_enabled = false;
+_Thread_local trace_ring_t *trace_thread_ring = NULL;
+
+/** The trace file */
+static FILE *trace_file;
+/** Protects everything below, and writes to `trace_file` */
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+/** Signalled when a ring is filling up or the trace is stopping */
+static pthread_cond_t trace_wanted = PTHREAD_COND_INITIALIZER;
+/** Every thread's ring, newest first */
+static trace_ring_t *rings;
+static u4 thread_count;
+static u4 method_count;
+static bool stopping;
+static pthread_t flusher;
+
+static void write_block(trace_block_type_t type, u4 thread, u4 count,
+                        const void *payload, size_t length) {
+    trace_block_t block = {.type = type, .thread = thread, .count = count};
+    fwrite(&block, sizeof(block), 1, trace_file);
+    if (length > 0) {
+        fwrite(payload, 1, length, trace_file);
+    }
+}
+
+/**
+ * Writes out a ring's records that haven't been written yet, then makes room for
+ * new ones. Called with `trace_lock` held.
+ */
+static void drain_ring(trace_ring_t *ring) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    while (tail != head) {
+        // The records may wrap around the end of the ring
+        size_t start = tail & (TRACE_RING_SIZE - 1);
+        size_t count = head - tail;
+        if (count > TRACE_RING_SIZE - start) {
+            count = TRACE_RING_SIZE - start;
+        }
+        write_block(TRACE_BLOCK_RECORDS, ring->thread, (u4) count, &ring->records[start],
+                    sizeof(trace_record_t[count]));
+        tail += count;
+    }
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+    size_t lost = atomic_exchange_explicit(&ring->lost, 0, memory_order_relaxed);
+    if (lost > 0) {
+        write_block(TRACE_BLOCK_LOST, ring->thread, (u4) lost, NULL, 0);
+    }
+}
+
+/** Drains every thread's ring until the trace stops */
+static void *flush_loop(void *unused) {
+    (void) unused;
+    pthread_mutex_lock(&trace_lock);
+    while (!stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += TRACE_FLUSH_INTERVAL_NS;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        int error = pthread_cond_timedwait(&trace_wanted, &trace_lock, &deadline);
+        assert((error == 0 || error == ETIMEDOUT) && "Failed to wait for trace");
+        for (trace_ring_t *ring = rings; ring != NULL; ring = ring->next) {
+            drain_ring(ring);
+        }
+        // Nothing can safely write out the trace if the process aborts
+        fflush(trace_file);
+    }
+    pthread_mutex_unlock(&trace_lock);
+    return NULL;
+}
+
+bool trace_start(const char *path) {
+    assert(!trace_enabled && "Trace already started");
+    trace_file = fopen(path, "wb");
+    if (trace_file == NULL) {
+        return false;
+    }
+    trace_header_t header = {.version = TRACE_VERSION,
+                             .record_size = sizeof(trace_record_t)};
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    fwrite(&header, sizeof(header), 1, trace_file);
+    fflush(trace_file);
+
+    int error = pthread_create(&flusher, NULL, flush_loop, NULL);
+    assert(error == 0 && "Failed to start trace thread");
+    trace_enabled = true;
+    return true;
+}
+
+void trace_stop(void) {
+    if (!trace_enabled) {
+        return;
+    }
+    trace_enabled = false;
+    pthread_mutex_lock(&trace_lock);
+    stopping = true;
+    pthread_cond_signal(&trace_wanted);
+    pthread_mutex_unlock(&trace_lock);
+    pthread_join(flusher, NULL);
+
+    // Whatever was recorded since the last drain
+    while (rings != NULL) {
+        trace_ring_t *ring = rings;
+        drain_ring(ring);
+        rings = ring->next;
+        free(ring->records);
+        free(ring);
+    }
+    fclose(trace_file);
+    trace_file = NULL;
+}
+
+trace_ring_t *trace_ring_register(void) {
+    trace_ring_t *ring = aligned_alloc(alignof(trace_ring_t), sizeof(*ring));
+    assert(ring != NULL && "Failed to allocate trace ring");
+    ring->records = malloc(sizeof(trace_record_t[TRACE_RING_SIZE]));
+    assert(ring->records != NULL && "Failed to allocate trace ring");
+    atomic_init(&ring->head, 0);
+    ring->cached_tail = 0;
+    atomic_init(&ring->lost, 0);
+    atomic_init(&ring->tail, 0);
+
+    pthread_mutex_lock(&trace_lock);
+    ring->thread = ++thread_count;
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&trace_lock);
+    trace_thread_ring = ring;
+    return ring;
+}
+
+u4 trace_define_method(method_t *method) {
+    pthread_mutex_lock(&trace_lock);
+    // Another thread may have defined it first
+    u4 id = atomic_load_explicit(&method->trace_id, memory_order_relaxed);
+    if (id == 0) {
+        id = ++method_count;
+        const char *strings[] = {method->class->name, method->name, method->descriptor};
+        u4 length = sizeof(id);
+        for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+            length += strlen(strings[i]) + 1;
+        }
+        write_block(TRACE_BLOCK_METHOD, 0, length, &id, sizeof(id));
+        for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+            fwrite(strings[i], 1, strlen(strings[i]) + 1, trace_file);
+        }
+        atomic_store_explicit(&method->trace_id, id, memory_order_release);
+    }
+    pthread_mutex_unlock(&trace_lock);
+    return id;
+}
+
+void trace_wake(void) {
+    // Without taking the lock, a wakeup can be missed, which only delays the drain
+    pthread_cond_signal(&trace_wanted);
+}
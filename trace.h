@@ -0,0 +1,233 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <inttypes.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "class_file.h"
+
+/**
+ * An execution trace recorder, for finding out after the fact what the interpreter
+ * did, e.g. when a job misbehaves (see `--trace` in main.c). jvm-trace prints or
+ * summarizes the traces it writes.
+ *
+ * Every thread that runs bytecode records into a ring buffer of its own, so recording
+ * takes no locks and no atomic read-modify-writes: an instruction costs a few stores
+ * and a release store of the ring's head. A background thread drains the rings into
+ * the trace file. If a thread fills its ring faster than it is drained, its newest
+ * records are dropped rather than making it wait, and the trace says how many. The
+ * file is flushed after every drain, so that a trace of a process that aborts
+ * still holds all but its last few milliseconds.
+ *
+ * A trace file is a `trace_header_t` followed by blocks, each a `trace_block_t`
+ * followed by its payload, in the byte order of the machine that wrote it. Blocks of
+ * different threads are interleaved, but each thread's records are in order, and a
+ * method is always defined before any record refers to it.
+ */
+
+/** The magic number at the start of a trace file: "JVMTRACE" */
+#define TRACE_MAGIC "JVMTRACE"
+#define TRACE_VERSION 1
+
+typedef struct {
+    char magic[8];
+    u4 version;
+    /** sizeof(trace_record_t) */
+    u4 record_size;
+} trace_header_t;
+
+typedef enum {
+    /** `count` trace_record_t's of one thread */
+    TRACE_BLOCK_RECORDS = 1,
+    /**
+     * A method's trace id (a u4), then its class name, name and descriptor, each
+     * NUL-terminated. `count` is the payload's length in bytes.
+     */
+    TRACE_BLOCK_METHOD = 2,
+    /** No payload: `count` of the thread's records were dropped at this point */
+    TRACE_BLOCK_LOST = 3
+} trace_block_type_t;
+
+typedef struct {
+    u4 type;
+    /** The thread the block belongs to, numbered from 1 (0 for method blocks) */
+    u4 thread;
+    u4 count;
+} trace_block_t;
+
+typedef enum {
+    /** An instruction is about to run */
+    TRACE_INSTRUCTION = 0,
+    /** A method was called */
+    TRACE_CALL = 1,
+    /** A method returned */
+    TRACE_RETURN = 2
+} trace_event_t;
+
+/** One event, packed into 16 bytes */
+typedef struct {
+    /** The trace id of the method the event happened in (see `trace_method_id()`) */
+    u4 method;
+    /** The bytecode offset of the instruction, or 0 for calls and returns */
+    u4 program_counter;
+    /**
+     * The value on top of the operand stack before the instruction, the first
+     * argument of a call, or the value a method returned. Only meaningful if
+     * `count` isn't 0.
+     */
+    int32_t value;
+    /**
+     * The operand stack's depth before the instruction, the number of arguments of a
+     * call, or whether a method returned a value
+     */
+    u2 count;
+    /** The instruction's opcode, or 0 for calls and returns */
+    u1 opcode;
+    /** A trace_event_t */
+    u1 event;
+} trace_record_t;
+
+/** The number of records in each thread's ring. Must be a power of two. */
+#define TRACE_RING_SIZE ((size_t) 1 << 18)
+/** How often, in records, a thread wakes up the background thread to drain it */
+#define TRACE_WAKE_INTERVAL (TRACE_RING_SIZE / 4)
+
+/**
+ * A thread's records that haven't been written out yet: those from `tail` up to
+ * `head`. Only the thread writes `head`, and only the background thread writes
+ * `tail`, so they are kept on separate cache lines.
+ */
+typedef struct trace_ring {
+    trace_record_t *records;
+    alignas(64) _Atomic size_t head;
+    /** The last `tail` the thread read, so it rarely needs to read the real one */
+    size_t cached_tail;
+    /** The number of records dropped because the ring was full */
+    atomic_size_t lost;
+    alignas(64) _Atomic size_t tail;
+    u4 thread;
+    /** The next ring (see `trace_ring_register()`) */
+    struct trace_ring *next;
+} trace_ring_t;
+
+/** Whether a trace is being recorded. Only changes while no bytecode is running. */
+extern bool trace_enabled;
+/** The calling thread's ring, or NULL if it hasn't recorded anything yet */
+extern _Thread_local trace_ring_t *trace_thread_ring;
+
+/**
+ * Starts recording a trace. This must be done before any bytecode runs, and at most
+ * once per process.
+ *
+ * @param path the trace file to write
+ * @return whether the trace file could be created
+ */
+bool trace_start(const char *path);
+
+/**
+ * Stops recording, writing out every record and closing the trace file. Call this
+ * once no bytecode is running. If the process aborts instead, the trace file ends
+ * with the records drained before then, and any still in the rings are lost.
+ */
+void trace_stop(void);
+
+/**
+ * Creates the calling thread's ring, the first time the thread records something.
+ */
+trace_ring_t *trace_ring_register(void);
+
+/**
+ * Defines a method in the trace, the first time a record refers to it.
+ */
+u4 trace_define_method(method_t *method);
+
+/** Wakes up the background thread, to drain a filling ring */
+void trace_wake(void);
+
+/**
+ * Gets the id that a method's records refer to it by. The method is defined in the
+ * trace the first time this is called for it.
+ */
+static inline u4 trace_method_id(method_t *method) {
+    u4 id = atomic_load_explicit(&method->trace_id, memory_order_acquire);
+    return id != 0 ? id : trace_define_method(method);
+}
+
+/**
+ * Appends a record to the calling thread's ring, or drops it if the ring is full.
+ * Always inlined, so the record is built straight in its slot.
+ */
+__attribute__((always_inline)) static inline void trace_record(trace_record_t record) {
+    trace_ring_t *ring = trace_thread_ring;
+    if (ring == NULL) {
+        ring = trace_ring_register();
+    }
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - ring->cached_tail >= TRACE_RING_SIZE) {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - ring->cached_tail >= TRACE_RING_SIZE) {
+            atomic_fetch_add_explicit(&ring->lost, 1, memory_order_relaxed);
+            return;
+        }
+    }
+    ring->records[head & (TRACE_RING_SIZE - 1)] = record;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    if ((head & (TRACE_WAKE_INTERVAL - 1)) == 0) {
+        trace_wake();
+    }
+}
+
+/**
+ * Records that an instruction is about to run.
+ *
+ * @param method the trace id of the method the instruction is in
+ * @param program_counter the instruction's bytecode offset
+ * @param opcode the instruction's opcode
+ * @param stack the operand stack's contents
+ * @param depth the number of values on the operand stack
+ */
+static inline void trace_instruction(u4 method, size_t program_counter, u1 opcode,
+                                     const int32_t *stack, size_t depth) {
+    trace_record((trace_record_t){.method = method,
+                                  .program_counter = (u4) program_counter,
+                                  .value = depth > 0 ? stack[depth - 1] : 0,
+                                  .count = (u2) depth,
+                                  .opcode = opcode,
+                                  .event = TRACE_INSTRUCTION});
+}
+
+/**
+ * Records a call of a method.
+ *
+ * @param method the method called
+ * @param arguments the method's arguments
+ * @return the method's trace id
+ */
+static inline u4 trace_call(method_t *method, const int32_t *arguments) {
+    u4 id = trace_method_id(method);
+    u2 count = method->parameter_count;
+    trace_record((trace_record_t){.method = id,
+                                  .value = count > 0 ? arguments[0] : 0,
+                                  .count = count,
+                                  .event = TRACE_CALL});
+    return id;
+}
+
+/**
+ * Records a method returning.
+ *
+ * @param method the method's trace id
+ * @param has_value whether the method returned a value
+ * @param value the value returned
+ */
+static inline void trace_return(u4 method, bool has_value, int32_t value) {
+    trace_record((trace_record_t){.method = method,
+                                  .value = has_value ? value : 0,
+                                  .count = has_value,
+                                  .event = TRACE_RETURN});
+}
+
+#endif /* TRACE_H */
@@ -0,0 +1,274 @@
+#include "verify.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "jvm.h"
+
+/**
+ * The length in bytes (opcode and operands) of each instruction the interpreter
+ * implements. Instructions it doesn't implement have length 0.
+ */
+static const u1 INSTRUCTION_LENGTHS[UINT8_MAX + 1] = {
+    [i_nop] = 1,        [i_iconst_m1] = 1,  [i_iconst_0] = 1,   [i_iconst_1] = 1,
+    [i_iconst_2] = 1,   [i_iconst_3] = 1,   [i_iconst_4] = 1,   [i_iconst_5] = 1,
+    [i_bipush] = 2,     [i_sipush] = 3,     [i_ldc] = 2,        [i_iload] = 2,
+    [i_aload] = 2,      [i_iload_0] = 1,    [i_iload_1] = 1,    [i_iload_2] = 1,
+    [i_iload_3] = 1,    [i_aload_0] = 1,    [i_aload_1] = 1,    [i_aload_2] = 1,
+    [i_aload_3] = 1,    [i_iaload] = 1,     [i_istore] = 2,     [i_astore] = 2,
+    [i_istore_0] = 1,   [i_istore_1] = 1,   [i_istore_2] = 1,   [i_istore_3] = 1,
+    [i_astore_0] = 1,   [i_astore_1] = 1,   [i_astore_2] = 1,   [i_astore_3] = 1,
+    [i_iastore] = 1,    [i_dup] = 1,        [i_iadd] = 1,       [i_isub] = 1,
+    [i_imul] = 1,       [i_idiv] = 1,       [i_irem] = 1,       [i_ineg] = 1,
+    [i_ishl] = 1,       [i_ishr] = 1,       [i_iushr] = 1,      [i_iand] = 1,
+    [i_ior] = 1,        [i_ixor] = 1,       [i_iinc] = 3,       [i_ifeq] = 3,
+    [i_ifne] = 3,       [i_iflt] = 3,       [i_ifge] = 3,       [i_ifgt] = 3,
+    [i_ifle] = 3,       [i_if_icmpeq] = 3,  [i_if_icmpne] = 3,  [i_if_icmplt] = 3,
+    [i_if_icmpge] = 3,  [i_if_icmpgt] = 3,  [i_if_icmple] = 3,  [i_goto] = 3,
+    [i_ireturn] = 1,    [i_areturn] = 1,    [i_return] = 1,     [i_getstatic] = 3,
+    [i_invokevirtual] = 3, [i_invokestatic] = 3, [i_newarray] = 2,
+    [i_arraylength] = 1,
+};
+
+static bool verify_error(const method_t *method, u4 program_counter,
+                         const char *message) {
+    output_flush_all();
+    fprintf(stderr, "Verification failed in %s.%s%s at %" PRIu32 ": %s\n",
+            method->class != NULL ? method->class->name : "?", method->name,
+            method->descriptor, program_counter, message);
+    return false;
+}
+
+static inline u2 read_operand_u2(const u1 *code) {
+    return (u2) code[0] << 8 | code[1];
+}
+static inline int32_t read_operand_s4(const u1 *code) {
+    return (int32_t)((u4) code[0] << 24 | (u4) code[1] << 16 | (u4) code[2] << 8 |
+                     code[3]);
+}
+
+/**
+ * Gets the offset of a tableswitch or lookupswitch's operands, which are padded to
+ * start at a multiple of four bytes from the start of the code.
+ */
+static u4 switch_operands(u4 program_counter) {
+    return (program_counter + 4) & ~(u4) 3;
+}
+
+/**
+ * Gets the length of the instruction at the given offset. Unlike other instructions,
+ * tableswitch and lookupswitch have operands that determine their length.
+ *
+ * @return the instruction's length, 0 if the interpreter doesn't implement it, or
+ *   UINT64_MAX if the operands that determine its length overrun the code
+ */
+static uint64_t instruction_length(const code_t *code, u4 program_counter) {
+    u1 opcode = code->code[program_counter];
+    if (opcode != i_tableswitch && opcode != i_lookupswitch) {
+        return INSTRUCTION_LENGTHS[opcode];
+    }
+
+    // tableswitch has a default offset, low and high; lookupswitch has a default
+    // offset and the number of pairs
+    u4 operands = switch_operands(program_counter);
+    u4 header_operands_length = opcode == i_tableswitch ? 12 : 8;
+    if ((uint64_t) operands + header_operands_length > code->code_length) {
+        return UINT64_MAX;
+    }
+    const u1 *operand = &code->code[operands];
+    uint64_t header_length = operands - program_counter + header_operands_length;
+    if (opcode == i_tableswitch) {
+        // Then a jump offset for each key in [low, high]
+        int64_t entries =
+            (int64_t) read_operand_s4(operand + 8) - read_operand_s4(operand + 4) + 1;
+        return header_length + 4 * (entries > 0 ? entries : 0);
+    }
+    // Then each key and its jump offset
+    int32_t pairs = read_operand_s4(operand + 4);
+    return header_length + 8 * (uint64_t)(pairs > 0 ? pairs : 0);
+}
+
+/**
+ * Checks a switch's operands beyond their length: tableswitch's range must be
+ * non-empty, and lookupswitch's keys must be sorted so they can be binary searched.
+ */
+static bool switch_valid(const code_t *code, u4 program_counter) {
+    const u1 *operand = &code->code[switch_operands(program_counter)];
+    if (code->code[program_counter] == i_tableswitch) {
+        return read_operand_s4(operand + 4) <= read_operand_s4(operand + 8);
+    }
+    int32_t pairs = read_operand_s4(operand + 4);
+    if (pairs < 0) {
+        return false;
+    }
+    for (int32_t i = 1; i < pairs; i++) {
+        int32_t previous_key = read_operand_s4(operand + 8 + 8 * (i - 1));
+        if (read_operand_s4(operand + 8 + 8 * i) <= previous_key) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Gets the local variable an instruction accesses.
+ *
+ * @return the local's index, or -1 if the instruction doesn't access a local
+ */
+static int32_t local_index(const u1 *instruction) {
+    switch (instruction[0]) {
+        case i_iload:
+        case i_aload:
+        case i_istore:
+        case i_astore:
+        case i_iinc:
+            return instruction[1];
+        case i_iload_0:
+        case i_iload_1:
+        case i_iload_2:
+        case i_iload_3:
+            return instruction[0] - i_iload_0;
+        case i_aload_0:
+        case i_aload_1:
+        case i_aload_2:
+        case i_aload_3:
+            return instruction[0] - i_aload_0;
+        case i_istore_0:
+        case i_istore_1:
+        case i_istore_2:
+        case i_istore_3:
+            return instruction[0] - i_istore_0;
+        case i_astore_0:
+        case i_astore_1:
+        case i_astore_2:
+        case i_astore_3:
+            return instruction[0] - i_astore_0;
+        default:
+            return -1;
+    }
+}
+
+/**
+ * Gets the kind of constant an instruction's constant pool operand must refer to.
+ *
+ * @return the expected tag, or CONSTANT_Unusable if the instruction has no such operand
+ */
+static cp_tag_t constant_operand(const u1 *instruction, u2 *index) {
+    switch (instruction[0]) {
+        case i_ldc:
+            *index = instruction[1];
+            return CONSTANT_Integer;
+        case i_getstatic:
+            *index = read_operand_u2(&instruction[1]);
+            return CONSTANT_Fieldref;
+        case i_invokevirtual:
+        case i_invokestatic:
+            *index = read_operand_u2(&instruction[1]);
+            return CONSTANT_Methodref;
+        default:
+            return CONSTANT_Unusable;
+    }
+}
+
+static bool is_branch(u1 opcode) {
+    return (i_ifeq <= opcode && opcode <= i_if_icmple) || opcode == i_goto;
+}
+
+static bool branch_valid(const code_t *code, const bool *instruction_starts,
+                         u4 program_counter, int32_t offset) {
+    int64_t target = (int64_t) program_counter + offset;
+    return target >= 0 && target < code->code_length && instruction_starts[target];
+}
+
+/**
+ * Checks that every jump offset of a tableswitch or lookupswitch is valid.
+ */
+static bool switch_targets_valid(const code_t *code, const bool *instruction_starts,
+                                 u4 program_counter) {
+    const u1 *operand = &code->code[switch_operands(program_counter)];
+    if (!branch_valid(code, instruction_starts, program_counter,
+                      read_operand_s4(operand))) {
+        return false;
+    }
+
+    // Table offsets are 4 bytes apart; lookup offsets are 8, each after its key
+    const u1 *offsets = operand + 12;
+    int64_t entries;
+    size_t stride;
+    if (code->code[program_counter] == i_tableswitch) {
+        int32_t low = read_operand_s4(operand + 4);
+        entries = (int64_t) read_operand_s4(operand + 8) - low + 1;
+        stride = 4;
+    }
+    else {
+        entries = read_operand_s4(operand + 4);
+        stride = 8;
+    }
+    for (int64_t i = 0; i < entries; i++) {
+        if (!branch_valid(code, instruction_starts, program_counter,
+                          read_operand_s4(offsets + stride * i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool verify_method(const method_t *method, const constant_pool_t *constant_pool) {
+    const code_t *code = &method->code;
+    if (code->code_length == 0) {
+        return verify_error(method, 0, "Empty method");
+    }
+    if (method->parameter_count > code->max_locals) {
+        return verify_error(method, 0, "Parameters don't fit in the locals");
+    }
+
+    // Find where each instruction starts, checking everything but branch targets
+    bool *instruction_starts = calloc(code->code_length, sizeof(bool));
+    if (instruction_starts == NULL) {
+        return verify_error(method, 0, "Out of memory");
+    }
+    bool valid = true;
+    for (u4 pc = 0; valid && pc < code->code_length; pc += instruction_length(code, pc)) {
+        const u1 *instruction = &code->code[pc];
+        uint64_t length = instruction_length(code, pc);
+        instruction_starts[pc] = true;
+        if (length == 0) {
+            valid = verify_error(method, pc, "Unsupported instruction");
+        }
+        else if (length > code->code_length - pc) {
+            valid = verify_error(method, pc, "Instruction overruns the code");
+        }
+        else if ((instruction[0] == i_tableswitch || instruction[0] == i_lookupswitch) &&
+                 !switch_valid(code, pc)) {
+            valid = verify_error(method, pc, "Malformed switch");
+        }
+        else if (local_index(instruction) >= code->max_locals) {
+            valid = verify_error(method, pc, "Local variable out of range");
+        }
+        else {
+            u2 index;
+            cp_tag_t expected_tag = constant_operand(instruction, &index);
+            if (expected_tag != CONSTANT_Unusable &&
+                (index == 0 || index >= constant_pool->count ||
+                 cp_tag(constant_pool, index) != expected_tag)) {
+                valid = verify_error(method, pc, "Wrong kind of constant");
+            }
+        }
+    }
+
+    for (u4 pc = 0; valid && pc < code->code_length; pc += instruction_length(code, pc)) {
+        u1 opcode = code->code[pc];
+        if (is_branch(opcode)) {
+            int16_t offset = (int16_t) read_operand_u2(&code->code[pc + 1]);
+            valid = branch_valid(code, instruction_starts, pc, offset);
+        }
+        else if (opcode == i_tableswitch || opcode == i_lookupswitch) {
+            valid = switch_targets_valid(code, instruction_starts, pc);
+        }
+        if (!valid) {
+            verify_error(method, pc, "Invalid branch target");
+        }
+    }
+    free(instruction_starts);
+    return valid;
+}
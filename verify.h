@@ -0,0 +1,24 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdbool.h>
+
+#include "class_file.h"
+
+/**
+ * Checks that a method's bytecode is well-formed, so that the interpreter can
+ * execute it without running off the end of the code or the locals. In particular:
+ * - every instruction is one the interpreter implements, and its operands fit in
+ *   the code
+ * - every branch lands on the start of an instruction
+ * - every local variable index is less than `max_locals`
+ * - every constant pool operand refers to the right kind of constant
+ * Problems are reported on stderr.
+ *
+ * @param method the method to check
+ * @param constant_pool the constant pool of the method's class
+ * @return whether the method is well-formed
+ */
+bool verify_method(const method_t *method, const constant_pool_t *constant_pool);
+
+#endif /* VERIFY_H */
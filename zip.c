@@ -0,0 +1,461 @@
+#include "zip.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * The zip file format is documented at
+ * https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT
+ * and the deflate format at https://www.rfc-editor.org/rfc/rfc1951.
+ * Unlike class files, all zip fields are little-endian.
+ */
+const u4 ZIP_END_OF_CENTRAL_DIRECTORY = 0x06054b50;
+const u4 ZIP_CENTRAL_DIRECTORY_HEADER = 0x02014b50;
+const u4 ZIP_LOCAL_FILE_HEADER = 0x04034b50;
+const size_t ZIP_END_OF_CENTRAL_DIRECTORY_SIZE = 22;
+const size_t ZIP_CENTRAL_DIRECTORY_HEADER_SIZE = 46;
+const size_t ZIP_LOCAL_FILE_HEADER_SIZE = 30;
+const size_t ZIP_MAX_COMMENT_LENGTH = 0xffff;
+const u2 ZIP_STORED = 0;
+const u2 ZIP_DEFLATED = 8;
+
+/** An entry in the archive's central directory */
+typedef struct {
+    /** The entry's name, which points into the archive and isn't NUL-terminated */
+    const char *name;
+    u2 name_length;
+    /** How the entry is compressed (ZIP_STORED or ZIP_DEFLATED) */
+    u2 method;
+    u4 compressed_size;
+    u4 uncompressed_size;
+    /** The offset of the entry's local file header */
+    u4 local_header_offset;
+} zip_entry_t;
+
+typedef struct zip {
+    /** The mmap()ed archive */
+    u1 *data;
+    size_t length;
+    /** The archive's entries, sorted by name */
+    zip_entry_t *entries;
+    size_t entry_count;
+} zip_t;
+
+static inline u2 read_le_u2(const u1 *bytes) {
+    return (u2) bytes[0] | (u2) bytes[1] << 8;
+}
+static inline u4 read_le_u4(const u1 *bytes) {
+    return (u4) read_le_u2(bytes) | (u4) read_le_u2(bytes + 2) << 16;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const zip_entry_t *first = a, *second = b;
+    u2 length = first->name_length < second->name_length ? first->name_length
+                                                         : second->name_length;
+    int comparison = memcmp(first->name, second->name, length);
+    return comparison != 0 ? comparison
+                           : (int) first->name_length - (int) second->name_length;
+}
+
+zip_t *zip_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 ||
+        (size_t) status.st_size < ZIP_END_OF_CENTRAL_DIRECTORY_SIZE) {
+        close(fd);
+        return NULL;
+    }
+    u1 *data = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    size_t length = status.st_size;
+
+    // The end of central directory record is followed only by a variable-length comment
+    const u1 *end = NULL;
+    size_t latest = length - ZIP_END_OF_CENTRAL_DIRECTORY_SIZE;
+    size_t earliest =
+        latest > ZIP_MAX_COMMENT_LENGTH ? latest - ZIP_MAX_COMMENT_LENGTH : 0;
+    for (size_t offset = latest + 1; offset-- > earliest;) {
+        if (read_le_u4(data + offset) == ZIP_END_OF_CENTRAL_DIRECTORY) {
+            end = data + offset;
+            break;
+        }
+    }
+    if (end == NULL) {
+        munmap(data, length);
+        return NULL;
+    }
+
+    zip_t *zip = malloc(sizeof(*zip));
+    assert(zip != NULL && "Failed to allocate zip archive");
+    zip->data = data;
+    zip->length = length;
+    zip->entry_count = read_le_u2(end + 10);
+    zip->entries = calloc(zip->entry_count, sizeof(zip_entry_t));
+    assert((zip->entries != NULL || zip->entry_count == 0) &&
+           "Failed to allocate zip entries");
+
+    size_t offset = read_le_u4(end + 16);
+    for (size_t i = 0; i < zip->entry_count; i++) {
+        const u1 *header = data + offset;
+        assert(offset + ZIP_CENTRAL_DIRECTORY_HEADER_SIZE <= length &&
+               read_le_u4(header) == ZIP_CENTRAL_DIRECTORY_HEADER &&
+               "Corrupt zip central directory");
+        zip_entry_t *entry = &zip->entries[i];
+        entry->method = read_le_u2(header + 10);
+        entry->compressed_size = read_le_u4(header + 20);
+        entry->uncompressed_size = read_le_u4(header + 24);
+        entry->name_length = read_le_u2(header + 28);
+        entry->local_header_offset = read_le_u4(header + 42);
+        entry->name = (const char *) header + ZIP_CENTRAL_DIRECTORY_HEADER_SIZE;
+        offset += ZIP_CENTRAL_DIRECTORY_HEADER_SIZE + entry->name_length +
+                  read_le_u2(header + 30) + read_le_u2(header + 32);
+    }
+    qsort(zip->entries, zip->entry_count, sizeof(zip_entry_t), compare_entries);
+    return zip;
+}
+
+size_t zip_entry_count(const zip_t *zip) {
+    return zip->entry_count;
+}
+
+const char *zip_entry_name(const zip_t *zip, size_t index, size_t *length) {
+    *length = zip->entries[index].name_length;
+    return zip->entries[index].name;
+}
+
+/*
+ * A small inflater for raw deflate streams, modelled on zlib's "puff" reference
+ * decoder. It decodes Huffman codes one bit at a time, which is plenty fast for
+ * class files, and writes into an output buffer whose size is known in advance.
+ */
+
+/** The maximum number of bits in a Huffman code */
+#define MAX_CODE_BITS 15
+/** The number of literal/length and distance symbols */
+#define MAX_LITERAL_CODES 288
+#define MAX_DISTANCE_CODES 30
+
+typedef struct {
+    const u1 *in;
+    const u1 *in_end;
+    /** Bits that have been read from `in` but not consumed yet */
+    u4 bit_buffer;
+    int bit_count;
+    u1 *out;
+    size_t out_length;
+    size_t out_capacity;
+    /** Set when the stream is malformed or overruns either buffer */
+    bool error;
+} inflate_state_t;
+
+/** A canonical Huffman code: how many codes have each length, and their symbols */
+typedef struct {
+    u2 counts[MAX_CODE_BITS + 1];
+    u2 symbols[MAX_LITERAL_CODES];
+} huffman_t;
+
+static u4 inflate_bits(inflate_state_t *state, int count) {
+    u4 bits = state->bit_buffer;
+    while (state->bit_count < count) {
+        if (state->in == state->in_end) {
+            state->error = true;
+            return 0;
+        }
+        bits |= (u4) *state->in++ << state->bit_count;
+        state->bit_count += 8;
+    }
+    state->bit_buffer = bits >> count;
+    state->bit_count -= count;
+    return bits & ((1u << count) - 1);
+}
+
+static void huffman_build(huffman_t *huffman, const u1 *lengths, size_t count) {
+    memset(huffman->counts, 0, sizeof(huffman->counts));
+    for (size_t symbol = 0; symbol < count; symbol++) {
+        huffman->counts[lengths[symbol]]++;
+    }
+    huffman->counts[0] = 0;
+
+    // Symbols are ordered by code length, then by value
+    u2 offsets[MAX_CODE_BITS + 1];
+    offsets[1] = 0;
+    for (int length = 1; length < MAX_CODE_BITS; length++) {
+        offsets[length + 1] = offsets[length] + huffman->counts[length];
+    }
+    for (size_t symbol = 0; symbol < count; symbol++) {
+        if (lengths[symbol] != 0) {
+            huffman->symbols[offsets[lengths[symbol]]++] = symbol;
+        }
+    }
+}
+
+static int huffman_decode(inflate_state_t *state, const huffman_t *huffman) {
+    // Codes are packed starting from their most significant bit
+    int code = 0, first = 0, index = 0;
+    for (int length = 1; length <= MAX_CODE_BITS; length++) {
+        code |= inflate_bits(state, 1);
+        int count = huffman->counts[length];
+        if (code - count < first) {
+            return huffman->symbols[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    state->error = true;
+    return -1;
+}
+
+static const u2 LENGTH_BASES[29] = {3,  4,  5,  6,  7,  8,  9,   10,  11,  13,
+                                    15, 17, 19, 23, 27, 31, 35,  43,  51,  59,
+                                    67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const u1 LENGTH_EXTRA_BITS[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                         2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const u2 DISTANCE_BASES[30] = {1,    2,    3,    4,    5,    7,     9,     13,
+                                      17,   25,   33,   49,   65,   97,    129,   193,
+                                      257,  385,  513,  769,  1025, 1537,  2049,  3073,
+                                      4097, 6145, 8193, 12289, 16385, 24577};
+static const u1 DISTANCE_EXTRA_BITS[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                           4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                           9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+/**
+ * Decodes the literals and back-references of a compressed block.
+ */
+static void inflate_codes(inflate_state_t *state, const huffman_t *literals,
+                          const huffman_t *distances) {
+    while (!state->error) {
+        int symbol = huffman_decode(state, literals);
+        if (symbol < 256) {
+            if (symbol < 0 || state->out_length == state->out_capacity) {
+                state->error = true;
+                return;
+            }
+            state->out[state->out_length++] = symbol;
+        }
+        else if (symbol == 256) {
+            // End of block
+            return;
+        }
+        else {
+            symbol -= 257;
+            if (symbol >= 29) {
+                state->error = true;
+                return;
+            }
+            size_t length =
+                LENGTH_BASES[symbol] + inflate_bits(state, LENGTH_EXTRA_BITS[symbol]);
+            int distance_symbol = huffman_decode(state, distances);
+            if (distance_symbol < 0 || distance_symbol >= MAX_DISTANCE_CODES) {
+                state->error = true;
+                return;
+            }
+            size_t distance = DISTANCE_BASES[distance_symbol] +
+                              inflate_bits(state, DISTANCE_EXTRA_BITS[distance_symbol]);
+            if (distance > state->out_length ||
+                length > state->out_capacity - state->out_length) {
+                state->error = true;
+                return;
+            }
+            // The source and destination may overlap, so copy byte by byte
+            u1 *destination = state->out + state->out_length;
+            const u1 *source = destination - distance;
+            for (size_t i = 0; i < length; i++) {
+                destination[i] = source[i];
+            }
+            state->out_length += length;
+        }
+    }
+}
+
+static void inflate_stored(inflate_state_t *state) {
+    // Stored blocks start on a byte boundary
+    state->bit_buffer = 0;
+    state->bit_count = 0;
+    if (state->in_end - state->in < 4) {
+        state->error = true;
+        return;
+    }
+    size_t length = read_le_u2(state->in);
+    u2 complement = read_le_u2(state->in + 2);
+    state->in += 4;
+    if ((u2) ~length != complement || (size_t)(state->in_end - state->in) < length ||
+        length > state->out_capacity - state->out_length) {
+        state->error = true;
+        return;
+    }
+    memcpy(state->out + state->out_length, state->in, length);
+    state->in += length;
+    state->out_length += length;
+}
+
+static void inflate_fixed(inflate_state_t *state) {
+    u1 lengths[MAX_LITERAL_CODES];
+    huffman_t literals, distances;
+    size_t symbol = 0;
+    for (; symbol < 144; symbol++) {
+        lengths[symbol] = 8;
+    }
+    for (; symbol < 256; symbol++) {
+        lengths[symbol] = 9;
+    }
+    for (; symbol < 280; symbol++) {
+        lengths[symbol] = 7;
+    }
+    for (; symbol < MAX_LITERAL_CODES; symbol++) {
+        lengths[symbol] = 8;
+    }
+    huffman_build(&literals, lengths, MAX_LITERAL_CODES);
+    for (symbol = 0; symbol < MAX_DISTANCE_CODES; symbol++) {
+        lengths[symbol] = 5;
+    }
+    huffman_build(&distances, lengths, MAX_DISTANCE_CODES);
+    inflate_codes(state, &literals, &distances);
+}
+
+static void inflate_dynamic(inflate_state_t *state) {
+    // The order in which the code length code lengths are transmitted
+    static const u1 ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5,
+                                 11, 4,  12, 3, 13, 2, 14, 1, 15};
+    size_t literal_count = inflate_bits(state, 5) + 257;
+    size_t distance_count = inflate_bits(state, 5) + 1;
+    size_t code_length_count = inflate_bits(state, 4) + 4;
+    if (literal_count > MAX_LITERAL_CODES || distance_count > MAX_DISTANCE_CODES) {
+        state->error = true;
+        return;
+    }
+
+    u1 lengths[MAX_LITERAL_CODES + MAX_DISTANCE_CODES] = {0};
+    for (size_t i = 0; i < code_length_count; i++) {
+        lengths[ORDER[i]] = inflate_bits(state, 3);
+    }
+    huffman_t code_lengths;
+    huffman_build(&code_lengths, lengths, 19);
+
+    size_t index = 0;
+    memset(lengths, 0, sizeof(lengths));
+    while (index < literal_count + distance_count && !state->error) {
+        int symbol = huffman_decode(state, &code_lengths);
+        if (symbol < 16) {
+            lengths[index++] = symbol;
+            continue;
+        }
+        u1 repeated = 0;
+        size_t repeat;
+        if (symbol == 16) {
+            // Repeat the previous length 3-6 times
+            if (index == 0) {
+                state->error = true;
+                return;
+            }
+            repeated = lengths[index - 1];
+            repeat = 3 + inflate_bits(state, 2);
+        }
+        else if (symbol == 17) {
+            repeat = 3 + inflate_bits(state, 3);
+        }
+        else {
+            repeat = 11 + inflate_bits(state, 7);
+        }
+        if (index + repeat > literal_count + distance_count) {
+            state->error = true;
+            return;
+        }
+        while (repeat-- > 0) {
+            lengths[index++] = repeated;
+        }
+    }
+    if (state->error || lengths[256] == 0) {
+        state->error = true;
+        return;
+    }
+
+    huffman_t literals, distances;
+    huffman_build(&literals, lengths, literal_count);
+    huffman_build(&distances, lengths + literal_count, distance_count);
+    inflate_codes(state, &literals, &distances);
+}
+
+/**
+ * Decompresses a raw deflate stream into a buffer of exactly the expected size.
+ *
+ * @return whether the stream decoded to exactly `out_capacity` bytes
+ */
+static bool inflate(const u1 *in, size_t in_length, u1 *out, size_t out_capacity) {
+    inflate_state_t state = {
+        .in = in,
+        .in_end = in + in_length,
+        .out = out,
+        .out_capacity = out_capacity,
+    };
+    bool last_block = false;
+    while (!last_block && !state.error) {
+        last_block = inflate_bits(&state, 1);
+        switch (inflate_bits(&state, 2)) {
+            case 0:
+                inflate_stored(&state);
+                break;
+            case 1:
+                inflate_fixed(&state);
+                break;
+            case 2:
+                inflate_dynamic(&state);
+                break;
+            default:
+                state.error = true;
+        }
+    }
+    return !state.error && state.out_length == out_capacity;
+}
+
+u1 *zip_read(const zip_t *zip, const char *name, size_t *length) {
+    zip_entry_t key = {.name = name, .name_length = strlen(name)};
+    zip_entry_t *entry = bsearch(&key, zip->entries, zip->entry_count,
+                                 sizeof(zip_entry_t), compare_entries);
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    const u1 *header = zip->data + entry->local_header_offset;
+    assert(entry->local_header_offset + ZIP_LOCAL_FILE_HEADER_SIZE <= zip->length &&
+           read_le_u4(header) == ZIP_LOCAL_FILE_HEADER && "Corrupt zip entry");
+    // The local header's name and extra field lengths can differ from the central one's
+    size_t data_offset = entry->local_header_offset + ZIP_LOCAL_FILE_HEADER_SIZE +
+                         read_le_u2(header + 26) + read_le_u2(header + 28);
+    assert(data_offset + entry->compressed_size <= zip->length && "Corrupt zip entry");
+    const u1 *compressed = zip->data + data_offset;
+
+    // Allocate at least one byte so that empty entries aren't mistaken for missing ones
+    u1 *contents = malloc(entry->uncompressed_size > 0 ? entry->uncompressed_size : 1);
+    assert(contents != NULL && "Failed to allocate zip entry");
+    if (entry->method == ZIP_STORED) {
+        assert(entry->compressed_size == entry->uncompressed_size && "Corrupt zip entry");
+        memcpy(contents, compressed, entry->uncompressed_size);
+    }
+    else {
+        assert(entry->method == ZIP_DEFLATED && "Unsupported zip compression method");
+        bool inflated = inflate(compressed, entry->compressed_size, contents,
+                                entry->uncompressed_size);
+        assert(inflated && "Corrupt deflated zip entry");
+    }
+    *length = entry->uncompressed_size;
+    return contents;
+}
+
+void zip_close(zip_t *zip) {
+    munmap(zip->data, zip->length);
+    free(zip->entries);
+    free(zip);
+}
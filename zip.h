@@ -0,0 +1,54 @@
+#ifndef ZIP_H
+#define ZIP_H
+
+#include <stddef.h>
+
+#include "class_file.h"
+
+/**
+ * A read-only view of a zip (or JAR) archive. Only the central directory is
+ * parsed when the archive is opened; entries are decompressed on demand.
+ * Stored and deflated entries are supported.
+ */
+typedef struct zip zip_t;
+
+/**
+ * Opens a zip archive.
+ *
+ * @param path the path of the archive
+ * @return the archive, or NULL if it can't be opened or isn't a valid zip file
+ */
+zip_t *zip_open(const char *path);
+
+/**
+ * Reads an entry out of a zip archive.
+ *
+ * @param zip the archive
+ * @param name the entry's full name within the archive, e.g. "pkg/Main.class"
+ * @param length set to the number of bytes in the entry
+ * @return a heap-allocated copy of the entry's (decompressed) contents,
+ *   or NULL if the archive has no such entry
+ */
+u1 *zip_read(const zip_t *zip, const char *name, size_t *length);
+
+/**
+ * Gets the number of entries in a zip archive.
+ */
+size_t zip_entry_count(const zip_t *zip);
+
+/**
+ * Gets the name of an entry in a zip archive. Entries are sorted by name.
+ *
+ * @param zip the archive
+ * @param index the index of the entry, less than `zip_entry_count(zip)`
+ * @param length set to the number of bytes in the name (it isn't NUL-terminated)
+ * @return the entry's name
+ */
+const char *zip_entry_name(const zip_t *zip, size_t index, size_t *length);
+
+/**
+ * Closes a zip archive.
+ */
+void zip_close(zip_t *zip);
+
+#endif /* ZIP_H */